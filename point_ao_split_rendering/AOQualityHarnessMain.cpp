@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless replay of an update stream through AOQualityHarness. A recording written by the server
+// (--record_update_stream) is replayed with queries on its initial points and reports the cost of
+// the reconstruction. Without a recording, CPUPointUpdatePipeline moves a plane of points through a
+// fixed AO pattern, and the AO reconstructed on the client has to match the pattern.
+//
+// Example usage:
+// $ ./AOQualityHarness --recording updates.bin --csv ao_replay.csv
+// $ ./AOQualityHarness --frames 30 --save updates.bin --max_mean_abs_error 0.03
+//
+// Exit codes: 0 if the error stays below the thresholds, 1 if it doesn't or a recording doesn't
+// round trip, 2 for invalid arguments or recordings that can't be read.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "CPUAOReconstruction.h"
+#include "CPUPointUpdatePipeline.h"
+#include "ClientPointCodec.h"
+#include "HashFunctionShared.slang"
+#include "PointDataSoA.h"
+#include "argparse.hpp"
+
+using split_rendering::AOQualityHarness;
+using split_rendering::CPUAOReconstruction;
+using split_rendering::CPUPointUpdatePipeline;
+using split_rendering::PointDataSoA;
+using split_rendering::UpdateStreamRecording;
+
+namespace {
+
+const int kExitFailed = 1;
+const int kExitInvalid = 2;
+
+// Grid cells of the generated scene have a size of 1 (DISK_RADIUS_FACTOR * kDiskRadius)
+const float kDiskRadius = 1.0f / DISK_RADIUS_FACTOR;
+const uint32_t kGridDim = 128;
+const float kPlaneOffset = 4.0f;
+const float kPatternPeriod = 16.0f;
+
+// AO of the generated scene, fixed in world space while the points move through it
+float getPatternAO(const Falcor::float3& position) {
+  const float w = 2.0f * 3.14159265f / kPatternPeriod;
+  return 0.5f + 0.4f * std::sin(w * position.x) * std::cos(w * position.y);
+}
+
+Falcor::float3 getPlanePosition(uint32_t pointId, uint32_t planeSize, float offset) {
+  return Falcor::float3(
+      kPlaneOffset + 0.5f + (float)(pointId % planeSize) + offset,
+      kPlaneOffset + 0.5f + (float)(pointId / planeSize),
+      kPlaneOffset + 0.5f);
+}
+
+// Inverse of Falcor::getRawCellId for cells inside the grid
+Falcor::uint3 getCellCoords(uint32_t rawCellId, const Falcor::uint3& gridDim, int hashType) {
+  if (hashType == HASH_TYPE_MORTON) {
+    Falcor::uint3 coords(0);
+    for (uint32_t bit = 0; bit < 10; bit++) {
+      coords.x |= ((rawCellId >> (3 * bit)) & 1) << bit;
+      coords.y |= ((rawCellId >> (3 * bit + 1)) & 1) << bit;
+      coords.z |= ((rawCellId >> (3 * bit + 2)) & 1) << bit;
+    }
+    return coords;
+  } else if (hashType == HASH_TYPE_XORSHIFT) {
+    return Falcor::uint3(
+        rawCellId % gridDim.x,
+        (rawCellId / gridDim.x) % gridDim.y,
+        rawCellId / (gridDim.x * gridDim.y));
+  }
+
+  const uint32_t sliceSize = gridDim.x * gridDim.y * 31;
+  const uint32_t rowSize = gridDim.x * 17;
+  return Falcor::uint3(
+      (rawCellId % sliceSize) % rowSize, (rawCellId % sliceSize) / rowSize, rawCellId / sliceSize);
+}
+
+// Queries on up to numQueries of the decoded points of a client state, spread over all instances
+std::vector<CPUAOReconstruction::Query> getPointQueries(
+    const split_rendering::ClientPointState& state,
+    uint32_t numQueries) {
+  std::vector<CPUAOReconstruction::Query> queries;
+
+  for (uint32_t instanceId = 0; instanceId < (uint32_t)state.instanceHashInfos.size();
+       instanceId++) {
+    const auto& ihi = state.instanceHashInfos[instanceId];
+    const auto& ipi = state.instancePointInfos[instanceId];
+    const float diskRadius = DISK_RADIUS_FACTOR * state.diskRadiusPerInstance[instanceId];
+
+    for (uint32_t i = 0; i < ihi.hashToBucketSize * FIXED_HASH_BUCKET_SIZE; i++) {
+      const auto& entry = state.hashEntries[ihi.hashToBucketOffset + i];
+      if (entry.rawCellId == INVALID_CELL || entry.rawCellId == DELETED_CELL)
+        continue;
+
+      const Falcor::uint3 coords = getCellCoords(entry.rawCellId, ipi.gridDim, ihi.hashType);
+      const uint32_t cellIndex = entry.encodedIndex & COMPACT_HASH_INDEX_MASK;
+
+      for (uint32_t pointOffset = 0; pointOffset < ipi.cellCapacity; pointOffset++) {
+        const auto& ccpd = state.compressedPoints[ipi.pointCellOffset + cellIndex + pointOffset];
+        if ((ccpd.posNormVal & INVALID_CELL) != 0)
+          continue;
+
+        const Falcor::ClientPointData cpd =
+            Falcor::decompressClientData(ccpd, coords, diskRadius, ipi.aabbMin);
+        queries.push_back({cpd.position, cpd.normal, cpd.normal, instanceId});
+      }
+    }
+  }
+
+  if (queries.size() > numQueries) {
+    std::vector<CPUAOReconstruction::Query> subset(numQueries);
+    for (uint32_t i = 0; i < numQueries; i++)
+      subset[i] = queries[(size_t)i * queries.size() / numQueries];
+    queries.swap(subset);
+  }
+
+  return queries;
+}
+
+// Plane of planeSize x planeSize points, one per grid cell, that moves by velocity cells per frame
+// along x through the AO pattern. Every frame gets numQueries queries on the plane, away from its
+// border, with the pattern as reference.
+bool createRecording(
+    uint32_t planeSize,
+    uint32_t numFrames,
+    float velocity,
+    uint32_t numQueries,
+    UpdateStreamRecording& recording,
+    std::vector<std::vector<CPUAOReconstruction::Query>>& queries,
+    std::vector<std::vector<float>>& references) {
+  const uint32_t numPoints = planeSize * planeSize;
+  const uint32_t cellCapacity = MIN_POINTS_PER_CELL;
+  const float diskRadius = DISK_RADIUS_FACTOR * kDiskRadius;
+
+  // Same layout as PointServerHashGenerator::generate, with room for the cells that points move
+  // into before their old cells are freed
+  uint32_t hashTableSize = 1;
+  while (hashTableSize < 8 * numPoints)
+    hashTableSize *= 2;
+
+  Falcor::InstancePointInfo ipi = {};
+  ipi.cellCapacity = cellCapacity;
+  ipi.maxNumPoints = 2 * (numPoints + 64) * cellCapacity;
+  ipi.aabbMin = Falcor::float3(0.0f);
+  ipi.aabbMax = Falcor::float3((float)kGridDim * diskRadius);
+  ipi.gridDim = Falcor::uint3(kGridDim);
+
+  Falcor::InstanceHashInfo ihi = {};
+  ihi.hashToBucketSize = hashTableSize;
+  ihi.aabbMin = ipi.aabbMin;
+  ihi.aabbMax = ipi.aabbMax;
+  ihi.gridDim = ipi.gridDim;
+  ihi.hashType = HASH_TYPE_XORSHIFT;
+
+  std::vector<Falcor::CompactHashToCellInfo> hashEntries(hashTableSize * FIXED_HASH_BUCKET_SIZE);
+  PointDataSoA pointCells;
+  pointCells.allocate(ipi.maxNumPoints);
+  pointCells.fill(Falcor::PointData());
+
+  for (uint32_t pointId = 0; pointId < numPoints; pointId++) {
+    Falcor::PointData point;
+    point.position = getPlanePosition(pointId, planeSize, 0.0f);
+    point.normal = Falcor::float3(0.0f, 0.0f, 1.0f);
+    point.tangent = Falcor::float3(1.0f, 0.0f, 0.0f);
+    point.barycentrics = Falcor::float2(0.25f);
+    point.instanceTriangleId = pointId;
+    point.instanceId = 0;
+    point.value = getPatternAO(point.position);
+
+    const Falcor::HashData hd = Falcor::getPointHashData(point.position, ipi, ihi, diskRadius);
+
+    uint32_t hashEntry = hd.hashBase;
+    while (hashEntry < hd.hashBase + FIXED_HASH_BUCKET_SIZE &&
+           hashEntries[hashEntry].rawCellId != INVALID_CELL)
+      hashEntry++;
+    if (hashEntry >= hd.hashBase + FIXED_HASH_BUCKET_SIZE) {
+      std::cout << "initial hash bucket overflow" << std::endl;
+      return false;
+    }
+
+    hashEntries[hashEntry].rawCellId = hd.rawCellId;
+    hashEntries[hashEntry].encodedIndex = ipi.numAllocatedCells * cellCapacity;
+    pointCells.set(ipi.numAllocatedCells * cellCapacity, point);
+    ipi.numAllocatedCells++;
+  }
+
+  const auto& streams = pointCells.getStreams();
+  std::vector<Falcor::CompressedClientPointData> compressedPoints(ipi.maxNumPoints);
+  split_rendering::ClientPointCodec::compressSlots(
+      streams.positions,
+      streams.normals,
+      streams.values,
+      ipi.maxNumPoints,
+      diskRadius,
+      ipi.aabbMin,
+      compressedPoints.data());
+
+  const std::vector<float> diskRadiusPerInstance = {kDiskRadius};
+  recording.initialState.init(
+      {ihi}, {ipi}, hashEntries, compressedPoints, diskRadiusPerInstance);
+
+  CPUPointUpdatePipeline pipeline;
+  pipeline.init(
+      {ihi},
+      {ipi},
+      pointCells,
+      compressedPoints,
+      hashEntries,
+      ipi.maxNumPoints / cellCapacity,
+      diskRadiusPerInstance);
+
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> planeCoord(1.0f, (float)planeSize - 1.0f);
+
+  for (uint32_t frame = 1; frame <= numFrames; frame++) {
+    const auto output = pipeline.execute([&](const Falcor::PointData& point,
+                                             Falcor::float3& position,
+                                             Falcor::float3& normal,
+                                             float& value) {
+      position = getPlanePosition(point.instanceTriangleId, planeSize, velocity * frame);
+      normal = point.normal;
+      value = getPatternAO(position);
+      return true;
+    });
+    recording.addFrame(output);
+
+    std::vector<CPUAOReconstruction::Query> frameQueries(numQueries);
+    std::vector<float> frameReferences(numQueries);
+
+    for (uint32_t i = 0; i < numQueries; i++) {
+      const Falcor::float3 position =
+          Falcor::float3(kPlaneOffset + velocity * frame, kPlaneOffset, kPlaneOffset + 0.5f) +
+          Falcor::float3(planeCoord(rng), planeCoord(rng), 0.0f);
+      const Falcor::float3 normal(0.0f, 0.0f, 1.0f);
+      frameQueries[i] = {position, normal, normal, 0};
+      frameReferences[i] = getPatternAO(position);
+    }
+
+    queries.push_back(frameQueries);
+    references.push_back(frameReferences);
+  }
+
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("AOQualityHarness");
+
+  args.add_argument("--recording")
+      .help("update stream recording of the server to replay, a moving plane of points is "
+            "generated if not set")
+      .default_value(std::string(""));
+  args.add_argument("--save")
+      .help("writes the replayed recording to this file and checks that it reads back the same")
+      .default_value(std::string(""));
+  args.add_argument("--csv").help("writes the per-frame reports").default_value(std::string(""));
+  args.add_argument("--frames")
+      .help("frames of the generated recording")
+      .default_value(30)
+      .scan<'d', int>();
+  args.add_argument("--plane_size")
+      .help("points per axis of the generated plane, one point per grid cell")
+      .default_value(64)
+      .scan<'d', int>();
+  args.add_argument("--velocity")
+      .help("cells per frame the generated plane moves along x")
+      .default_value(0.4f)
+      .scan<'f', float>();
+  args.add_argument("--num_queries")
+      .help("queries per frame")
+      .default_value(20000)
+      .scan<'d', int>();
+  args.add_argument("--max_mean_abs_error")
+      .help("maximum mean absolute AO error over all frames with references")
+      .default_value(0.03f)
+      .scan<'f', float>();
+  args.add_argument("--max_abs_error")
+      .help("maximum absolute AO error of a query in frames with references")
+      .default_value(0.25f)
+      .scan<'f', float>();
+  args.add_argument("--sequential")
+      .help("whether or not to reconstruct the queries on one thread")
+      .default_value(false)
+      .implicit_value(true);
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const int numFrames = args.get<int>("--frames");
+  const int planeSize = args.get<int>("--plane_size");
+  const float velocity = args.get<float>("--velocity");
+  const int numQueries = args.get<int>("--num_queries");
+
+  if (numFrames < 1 || planeSize < 3 || numQueries < 1 || velocity < 0.0f ||
+      kPlaneOffset + planeSize + velocity * numFrames >= kGridDim - 1) {
+    std::cerr << "invalid arguments, the plane has to stay inside of the " << kGridDim
+              << " cells of the grid" << std::endl;
+    return kExitInvalid;
+  }
+
+  UpdateStreamRecording recording;
+  std::vector<std::vector<CPUAOReconstruction::Query>> queries;
+  std::vector<std::vector<float>> references;
+  const std::string recordingPath = args.get<std::string>("--recording");
+
+  if (!recordingPath.empty()) {
+    if (!recording.load(recordingPath))
+      return kExitInvalid;
+
+    // The recording has no reference AO, only the cost is reported
+    queries.push_back(getPointQueries(recording.initialState, (uint32_t)numQueries));
+  } else if (!createRecording(
+                 (uint32_t)planeSize,
+                 (uint32_t)numFrames,
+                 velocity,
+                 (uint32_t)numQueries,
+                 recording,
+                 queries,
+                 references)) {
+    return kExitFailed;
+  }
+
+  if (recording.frames.empty() || queries[0].empty()) {
+    std::cerr << "recording has no frames or points" << std::endl;
+    return kExitInvalid;
+  }
+
+  bool passed = true;
+
+  const std::string savePath = args.get<std::string>("--save");
+  if (!savePath.empty()) {
+    UpdateStreamRecording loaded;
+    if (!recording.save(savePath) || !loaded.load(savePath))
+      return kExitInvalid;
+
+    bool same = loaded.frames.size() == recording.frames.size() &&
+        loaded.initialState.compressedPoints.size() ==
+            recording.initialState.compressedPoints.size();
+    for (size_t frame = 0; same && frame < recording.frames.size(); frame++) {
+      same = loaded.frames[frame].packedCellUpdates == recording.frames[frame].packedCellUpdates &&
+          loaded.frames[frame].hashUpdates.size() == recording.frames[frame].hashUpdates.size();
+    }
+
+    if (!same) {
+      std::cout << "FAIL " << savePath << " doesn't read back the saved recording" << std::endl;
+      passed = false;
+    }
+  }
+
+  AOQualityHarness harness;
+  harness.reconstruction_.settings_.parallel = !args.get<bool>("--sequential");
+  const auto reports = harness.replay(recording, queries, references);
+
+  AOQualityHarness::printSummary(reports, std::cout);
+
+  if (!args.get<std::string>("--csv").empty())
+    AOQualityHarness::writeCSV(reports, args.get<std::string>("--csv"));
+
+  uint64_t numReferenceValues = 0;
+  double absErrorSum = 0.0;
+  double maxAbsError = 0.0;
+  for (const auto& report : reports) {
+    numReferenceValues += report.numReferenceValues;
+    absErrorSum += report.meanAbsError * report.numReferenceValues;
+    maxAbsError = std::max(maxAbsError, report.maxAbsError);
+  }
+
+  const float maxMeanAbsError = args.get<float>("--max_mean_abs_error");
+  if (numReferenceValues > 0 && absErrorSum / numReferenceValues > maxMeanAbsError) {
+    std::cout << "FAIL mean abs error " << absErrorSum / numReferenceValues << " > "
+              << maxMeanAbsError << std::endl;
+    passed = false;
+  }
+
+  // Stale or missing points show up as a few large errors rather than in the mean
+  if (maxAbsError > args.get<float>("--max_abs_error")) {
+    std::cout << "FAIL max abs error " << maxAbsError << " > "
+              << args.get<float>("--max_abs_error") << std::endl;
+    passed = false;
+  }
+
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed ? 0 : kExitFailed;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "BakePackage.h"
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include "Tracing.h"
+
+namespace split_rendering {
+
+namespace {
+
+const char* kTemporarySuffix = ".part";
+
+} // namespace
+
+bool BakePackageWriter::open(const std::string& filename) {
+  filename_ = filename;
+  sections_.clear();
+
+  file_.open(filename + kTemporarySuffix, std::ios::binary);
+  if (!file_.is_open()) {
+    std::cout << "could not write bake package " << filename << std::endl;
+    return false;
+  }
+
+  // Placeholder until finish()
+  BakePackageHeader header;
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  offset_ = sizeof(header);
+  return true;
+}
+
+uint64_t BakePackageWriter::writePayload(const void* data, uint64_t size) {
+  // Align every payload, so it can be used in place
+  const char padding[BakePackageHeader::kAlignment] = {};
+  uint64_t paddingSize = (BakePackageHeader::kAlignment - offset_ % BakePackageHeader::kAlignment) %
+      BakePackageHeader::kAlignment;
+  file_.write(padding, paddingSize);
+  offset_ += paddingSize;
+
+  uint64_t payloadOffset = offset_;
+  if (size > 0)
+    file_.write(static_cast<const char*>(data), size);
+  offset_ += size;
+  return payloadOffset;
+}
+
+void BakePackageWriter::addSection(
+    uint32_t id,
+    const void* data,
+    uint32_t elementSize,
+    uint64_t numElements) {
+  TRACE_SCOPE("BakePackageWriter::addSection");
+  BakePackageSection section = {};
+  section.id = id;
+  section.elementSize = elementSize;
+  section.numElements = numElements;
+  section.size = (uint64_t)elementSize * numElements;
+
+  section.offset = writePayload(data, section.size);
+  sections_.push_back(section);
+}
+
+void BakePackageWriter::addCompressedSection(
+    uint32_t id,
+    const void* data,
+    uint32_t elementSize,
+    uint64_t numElements,
+    NetworkCompressionBase& compression) {
+  TRACE_SCOPE("BakePackageWriter::addCompressedSection");
+  std::vector<uint8_t> compressedData;
+  int numCompressedBytes =
+      compression.compressData(data, compressedData, (uint32_t)(elementSize * numElements));
+  if (numCompressedBytes < 0) {
+    std::cout << "could not compress bake package section " << id << std::endl;
+    return;
+  }
+
+  BakePackageSection section = {};
+  section.id = id;
+  section.elementSize = elementSize;
+  section.numElements = numElements;
+  section.size = (uint64_t)numCompressedBytes;
+  section.compression = (uint32_t)compression.getID() + 1;
+
+  section.offset = writePayload(compressedData.data(), section.size);
+  sections_.push_back(section);
+}
+
+bool BakePackageWriter::finish(const std::string& key) {
+  if (!file_.is_open())
+    return false;
+
+  BakePackageHeader header;
+  header.numSections = (uint32_t)sections_.size();
+  header.keySize = (uint32_t)key.size();
+
+  header.sectionOffset =
+      writePayload(sections_.data(), sizeof(BakePackageSection) * sections_.size());
+  header.keyOffset = writePayload(key.data(), key.size());
+
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  bool success = file_.good();
+  file_.close();
+
+  // Only complete packages get the final name
+  std::error_code error;
+  if (success)
+    std::filesystem::rename(filename_ + kTemporarySuffix, filename_, error);
+  if (!success || error) {
+    std::cout << "could not write bake package " << filename_ << std::endl;
+    std::filesystem::remove(filename_ + kTemporarySuffix, error);
+    return false;
+  }
+
+  return true;
+}
+
+bool BakePackage::open(const std::string& filename, const std::string& key) {
+  close();
+
+  if (!file_.open(filename)) {
+    std::cout << "could not open bake package " << filename << std::endl;
+    return false;
+  }
+
+  BakePackageHeader header;
+  if (file_.getSize() >= sizeof(header))
+    std::memcpy(&header, file_.getData(), sizeof(header));
+
+  bool valid = file_.getSize() >= sizeof(header) && header.magic == BakePackageHeader::kMagic &&
+      header.version <= BakePackageHeader::kVersion &&
+      header.sectionOffset % BakePackageHeader::kAlignment == 0 &&
+      header.sectionOffset + sizeof(BakePackageSection) * (uint64_t)header.numSections <=
+          file_.getSize() &&
+      header.keyOffset + header.keySize <= file_.getSize();
+
+  if (valid) {
+    sections_ =
+        reinterpret_cast<const BakePackageSection*>(file_.getData() + header.sectionOffset);
+    for (uint32_t i = 0; i < header.numSections && valid; i++) {
+      valid = sections_[i].offset % BakePackageHeader::kAlignment == 0 &&
+          sections_[i].offset + sections_[i].size <= file_.getSize() &&
+          (sections_[i].compression != 0 ||
+           sections_[i].size == (uint64_t)sections_[i].elementSize * sections_[i].numElements);
+    }
+  }
+
+  if (!valid) {
+    std::cout << "invalid bake package " << filename << " (version " << header.version << ")"
+              << std::endl;
+    close();
+    return false;
+  }
+
+  std::string packageKey(
+      reinterpret_cast<const char*>(file_.getData() + header.keyOffset), header.keySize);
+  if (packageKey != key) {
+    std::cout << "bake package " << filename << " was baked with other settings: " << packageKey
+              << std::endl;
+    close();
+    return false;
+  }
+
+  numSections_ = header.numSections;
+  return true;
+}
+
+void BakePackage::close() {
+  file_.close();
+  sections_ = nullptr;
+  numSections_ = 0;
+}
+
+const BakePackageSection* BakePackage::findSection(uint32_t id) const {
+  for (uint32_t i = 0; i < numSections_; i++) {
+    if (sections_[i].id == id)
+      return &sections_[i];
+  }
+
+  return nullptr;
+}
+
+const uint8_t* BakePackage::getCompressedSection(
+    uint32_t id,
+    NetworkCompressionID& compression,
+    uint64_t& size,
+    uint64_t& decompressedSize) const {
+  const BakePackageSection* section = findSection(id);
+  if (!section || section->compression == 0)
+    return nullptr;
+
+  compression = (NetworkCompressionID)(section->compression - 1);
+  size = section->size;
+  decompressedSize = (uint64_t)section->elementSize * section->numElements;
+  return file_.getData() + section->offset;
+}
+
+} // namespace split_rendering
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "NetworkCompressionBase.h"
+
+namespace split_rendering {
+
+// Sections of a scene bake package, see MeshPointGenerator::writeBake,
+// PointServerHashGenerator::writeBake and PointKDTreeGenerator::writeBake
+enum BakeSectionId : uint32_t {
+  kBakeNumSamplesPerInstance = 1,
+  kBakeSampleOffsetPerInstance,
+  kBakeDiskRadiusPerInstance,
+  kBakePointData,
+  kBakeInstanceHashInfo,
+  kBakeInstancePointInfo,
+  // AoS point cells of version 1 packages, replaced by the point cell streams
+  kBakePointCells,
+  kBakeCompressedClientPointCells,
+  // kBakeCompressedClientPointCells compressed with the network compression, sent as is
+  kBakeClientSnapshot,
+  // 10 held the AoS hash table, the compact table replaces it and the ids after it stay the same
+  kBakeCompactHashToPointCell = 11,
+  kBakeHashNumBuckets,
+  kBakeCellInfos,
+  kBakeInstanceDropStats,
+  kBakeHashSizes,
+  // Point cell streams, see PointDataSoA
+  kBakePositions,
+  kBakeNormals,
+  kBakeTangents,
+  kBakeBarycentrics,
+  kBakeInstanceTriangleIds,
+  kBakeInstanceIds,
+  kBakeValues,
+  // CPU kd-trees, see PointKDTree
+  kBakeKDTreeNodes,
+  kBakeKDTreeIndices,
+  kBakeKDTreeInstanceNodeOffsets,
+  kBakeKDTreeInstanceIndexOffsets,
+  kBakeKDTreeNodeBuildSizes,
+};
+
+// File format of scene bake packages (little endian):
+//
+//   BakePackageHeader
+//   section payloads, each aligned to kAlignment
+//   numSections x BakePackageSection at sectionOffset
+//   key at keyOffset
+//
+// The key describes the scene and the settings the package was baked with, packages with a
+// different key are not loaded. Readers accept every version up to kVersion.
+struct BakePackageHeader {
+  static constexpr uint32_t kMagic = 0x4b424153; // "SABK"
+  static constexpr uint16_t kVersion = 2;
+  static constexpr uint32_t kAlignment = 64;
+
+  uint32_t magic = kMagic;
+  uint16_t version = kVersion;
+  uint16_t flags = 0;
+  uint32_t numSections = 0;
+  uint32_t keySize = 0;
+  uint64_t sectionOffset = 0;
+  uint64_t keyOffset = 0;
+};
+
+struct BakePackageSection {
+  uint32_t id;
+  uint32_t elementSize;
+  uint64_t numElements;
+  uint64_t offset;
+  // Stored bytes, smaller than elementSize * numElements for compressed sections
+  uint64_t size;
+  // NetworkCompressionID + 1 of compressed sections, 0 otherwise
+  uint32_t compression;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(BakePackageHeader) == 32, "header is part of the format");
+static_assert(sizeof(BakePackageSection) == 40, "section is part of the format");
+
+// Writes the sections to a temporary file as they are added, which is renamed in finish()
+class BakePackageWriter {
+ public:
+  // Returns false and prints the error if the file can't be created
+  bool open(const std::string& filename);
+  bool finish(const std::string& key);
+
+  void addSection(uint32_t id, const void* data, uint32_t elementSize, uint64_t numElements);
+
+  template <typename T>
+  void addSection(uint32_t id, const std::vector<T>& data) {
+    addSection(id, data.data(), sizeof(T), data.size());
+  }
+
+  // Stores the data compressed, the section is read with BakePackage::getCompressedSection
+  void addCompressedSection(
+      uint32_t id,
+      const void* data,
+      uint32_t elementSize,
+      uint64_t numElements,
+      NetworkCompressionBase& compression);
+
+ private:
+  // Returns the offset of the payload
+  uint64_t writePayload(const void* data, uint64_t size);
+
+  std::string filename_;
+  std::ofstream file_;
+  uint64_t offset_ = 0;
+  std::vector<BakePackageSection> sections_;
+};
+
+// Read-only view of an array, e.g. a section of a mapped bake package or the data of a vector
+template <typename T>
+class ConstArrayView {
+ public:
+  using value_type = T;
+
+  ConstArrayView() = default;
+  ConstArrayView(const T* data, size_t size) : data_(data), size_(size) {}
+  ConstArrayView(const std::vector<T>& vector) : data_(vector.data()), size_(vector.size()) {}
+
+  const T* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  const T* begin() const {
+    return data_;
+  }
+
+  const T* end() const {
+    return data_ + size_;
+  }
+
+  const T& operator[](size_t i) const {
+    return data_[i];
+  }
+
+ private:
+  const T* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// A memory-mapped bake package, sections are used in place
+class BakePackage {
+ public:
+  // Returns false and prints the reason if the file can't be read or was baked with another key
+  bool open(const std::string& filename, const std::string& key);
+  void close();
+
+  bool isOpen() const {
+    return file_.isOpen();
+  }
+
+  const BakePackageSection* findSection(uint32_t id) const;
+
+  // Uncompressed section with elements of type T, nullptr if it is missing or has another
+  // element size
+  template <typename T>
+  const T* getSection(uint32_t id, size_t& numElements) const {
+    const BakePackageSection* section = findSection(id);
+    if (!section || section->compression != 0 || section->elementSize != sizeof(T))
+      return nullptr;
+
+    numElements = (size_t)section->numElements;
+    return reinterpret_cast<const T*>(file_.getData() + section->offset);
+  }
+
+  // getSection() as a view, with no data if the section is missing
+  template <typename T>
+  ConstArrayView<T> getSectionView(uint32_t id) const {
+    size_t numElements = 0;
+    const T* data = getSection<T>(id, numElements);
+    return data ? ConstArrayView<T>(data, numElements) : ConstArrayView<T>();
+  }
+
+  template <typename T>
+  bool readSection(uint32_t id, std::vector<T>& output) const {
+    size_t numElements = 0;
+    const T* data = getSection<T>(id, numElements);
+    if (!data)
+      return false;
+
+    output.assign(data, data + numElements);
+    return true;
+  }
+
+  // Stored bytes of a compressed section, nullptr if it is missing
+  const uint8_t* getCompressedSection(
+      uint32_t id,
+      NetworkCompressionID& compression,
+      uint64_t& size,
+      uint64_t& decompressedSize) const;
+
+ private:
+  MappedFile file_;
+  const BakePackageSection* sections_ = nullptr;
+  uint32_t numSections_ = 0;
+};
+
+} // namespace split_rendering
@@ -25,6 +25,8 @@ enum class TCPMessageType : uint8_t {
   PAOEndOfInit,
   PAOPointCellUpdate,
   PAOHashUpdate,
+  PAOInstanceRelocation,
+  PAOInstanceCellRemap,
   NumberOfMessageTypes // Keep this last.
 };
 
@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CPUAOReconstruction.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <iostream>
+#include <numeric>
+#include "CPUKNNQueryEngine.h"
+#include "HashFunctionShared.slang"
+
+namespace split_rendering {
+
+namespace {
+
+bool isPointValid(uint32_t posNormVal) {
+  return (posNormVal & INVALID_CELL) == 0;
+}
+
+template <typename T>
+void writeVector(std::fstream& file, const std::vector<T>& data) {
+  const uint32_t size = (uint32_t)data.size();
+  file.write((const char*)&size, sizeof(uint32_t));
+  file.write((const char*)data.data(), size * sizeof(T));
+}
+
+template <typename T>
+void readVector(std::fstream& file, std::vector<T>& data) {
+  uint32_t size = 0;
+  file.read((char*)&size, sizeof(uint32_t));
+
+  if (!file)
+    size = 0;
+
+  data.resize(size);
+  file.read((char*)data.data(), size * sizeof(T));
+}
+
+} // namespace
+
+void ClientPointState::init(
+    const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+    const std::vector<Falcor::CompactHashToCellInfo>& hashEntries,
+    const std::vector<Falcor::CompressedClientPointData>& compressedPoints,
+    const std::vector<float>& diskRadiusPerInstance) {
+  this->instanceHashInfos = instanceHashInfos;
+  this->instancePointInfos = instancePointInfos;
+  this->diskRadiusPerInstance = diskRadiusPerInstance;
+  this->hashEntries = hashEntries;
+  this->compressedPoints = compressedPoints;
+}
+
+uint32_t ClientPointState::applyCellUpdates(const std::vector<uint32_t>& packedCellUpdates) {
+  uint32_t numUpdates = 0;
+  size_t offset = 0;
+
+  while (offset < packedCellUpdates.size()) {
+    const uint32_t header = packedCellUpdates[offset];
+    const uint32_t globalCellOffset = Falcor::getCellUpdatePointOffset(header);
+    const uint32_t cellCapacity = Falcor::getCellUpdateCapacity(header);
+
+    // Updates are xor deltas against the previous contents of the cell
+    for (uint32_t pointOffset = 0; pointOffset < cellCapacity; pointOffset++) {
+      const size_t wordOffset = offset + 1 + pointOffset * POINT_ENCODING_WORDS;
+      Falcor::uint2 delta(packedCellUpdates[wordOffset], 0);
+
+      if (POINT_ENCODING_WORDS > 1)
+        delta.y = packedCellUpdates[wordOffset + 1];
+
+      auto& point = compressedPoints[globalCellOffset + pointOffset];
+      point = Falcor::xorCompressedClientData(point, Falcor::makeCompressedClientData(delta));
+    }
+
+    offset += Falcor::getCellUpdateNumWords(header);
+    numUpdates++;
+  }
+
+  return numUpdates;
+}
+
+void ClientPointState::applyHashUpdates(const std::vector<Falcor::HashUpdateInfo>& hashUpdates) {
+  for (const auto& hashUpdate : hashUpdates) {
+    std::copy(
+        hashUpdate.hashData,
+        hashUpdate.hashData + FIXED_HASH_BUCKET_SIZE,
+        hashEntries.begin() + hashUpdate.globalHashOffset);
+  }
+}
+
+void ClientPointState::write(std::fstream& file) const {
+  writeVector(file, instanceHashInfos);
+  writeVector(file, instancePointInfos);
+  writeVector(file, diskRadiusPerInstance);
+  writeVector(file, hashEntries);
+  writeVector(file, compressedPoints);
+}
+
+void ClientPointState::read(std::fstream& file) {
+  readVector(file, instanceHashInfos);
+  readVector(file, instancePointInfos);
+  readVector(file, diskRadiusPerInstance);
+  readVector(file, hashEntries);
+  readVector(file, compressedPoints);
+}
+
+void UpdateStreamRecording::addFrame(const CPUPointUpdatePipeline::FrameOutput& output) {
+  addFrame(output.getNetworkCellUpdateInfo(), output.hashUpdateInfos);
+}
+
+void UpdateStreamRecording::addFrame(
+    const std::vector<uint32_t>& packedCellUpdates,
+    const std::vector<Falcor::HashUpdateInfo>& hashUpdates) {
+  frames.push_back({packedCellUpdates, hashUpdates});
+}
+
+bool UpdateStreamRecording::save(const std::string& filename) const {
+  std::fstream file;
+  file.open(filename, std::ios::out | std::ios::binary);
+
+  if (!file.is_open()) {
+    std::cout << "could not write update stream recording to " << filename << std::endl;
+    return false;
+  }
+
+  initialState.write(file);
+
+  const uint32_t numFrames = (uint32_t)frames.size();
+  file.write((const char*)&numFrames, sizeof(uint32_t));
+
+  for (const auto& frame : frames) {
+    writeVector(file, frame.packedCellUpdates);
+    writeVector(file, frame.hashUpdates);
+  }
+
+  file.close();
+  return true;
+}
+
+bool UpdateStreamRecording::load(const std::string& filename) {
+  std::fstream file;
+  file.open(filename, std::ios::in | std::ios::binary);
+
+  if (!file.is_open()) {
+    std::cout << "could not read update stream recording " << filename << std::endl;
+    return false;
+  }
+
+  initialState.read(file);
+
+  uint32_t numFrames = 0;
+  file.read((char*)&numFrames, sizeof(uint32_t));
+
+  frames.assign(numFrames, {});
+  for (auto& frame : frames) {
+    readVector(file, frame.packedCellUpdates);
+    readVector(file, frame.hashUpdates);
+  }
+
+  if (!file) {
+    std::cout << "update stream recording " << filename << " is truncated" << std::endl;
+    frames.clear();
+    return false;
+  }
+
+  return true;
+}
+
+void CPUAOReconstruction::QueryStats::add(const QueryStats& other) {
+  numQueries += other.numQueries;
+  numHashEntriesRead += other.numHashEntriesRead;
+  numCellsHit += other.numCellsHit;
+  numPointsDecoded += other.numPointsDecoded;
+  numQueriesWithoutCells += other.numQueriesWithoutCells;
+  seconds += other.seconds;
+}
+
+float CPUAOReconstruction::reconstructQuery(
+    const ClientPointState& state,
+    const Query& query,
+    QueryStats& stats) const {
+  const CPUKNNQueryEngine::ShadingPoint sp = CPUKNNQueryEngine::makeShadingPoint(
+      query.position,
+      query.N,
+      query.vertN,
+      query.instanceId,
+      state.diskRadiusPerInstance[query.instanceId],
+      settings_.interpolationRadiusFactor);
+
+  const auto& ihi = state.instanceHashInfos[query.instanceId];
+  const auto& ipi = state.instancePointInfos[query.instanceId];
+
+  const Falcor::float3 floatCoords = (sp.posW - ipi.aabbMin) / sp.diskRadius;
+  const Falcor::int3 intBaseCoords = Falcor::int3(floatCoords - 0.5f);
+
+  CPUKNNQueryEngine::SamplingWeight samplingWeight;
+  uint32_t numHitCells = 0;
+
+  for (int x = 0; x <= 1; x++) {
+    for (int y = 0; y <= 1; y++) {
+      for (int z = 0; z <= 1; z++) {
+        const Falcor::int3 coords = intBaseCoords + Falcor::int3(x, y, z);
+        const Falcor::HashData hd =
+            Falcor::getHash(coords, ipi.gridDim, ihi.hashToBucketSize, ihi.hashType);
+
+        // Same as getPointCellIndexUpdate
+        const uint32_t baseHashOffset =
+            hd.hashBase * FIXED_HASH_BUCKET_SIZE + ihi.hashToBucketOffset;
+        int pointCellIndex = -1;
+
+        for (uint32_t hashBucketOffset = 0; hashBucketOffset < FIXED_HASH_BUCKET_SIZE;
+             hashBucketOffset++) {
+          const auto& htci = state.hashEntries[baseHashOffset + hashBucketOffset];
+          stats.numHashEntriesRead++;
+
+          if (htci.rawCellId == hd.rawCellId) {
+            pointCellIndex = (int)(htci.encodedIndex & COMPACT_HASH_INDEX_MASK);
+            break;
+          } else if (htci.rawCellId == INVALID_CELL) {
+            break;
+          }
+        }
+
+        if (pointCellIndex < 0)
+          continue;
+
+        numHitCells++;
+
+        for (uint32_t pointOffset = 0; pointOffset < ipi.cellCapacity; pointOffset++) {
+          const Falcor::CompressedClientPointData& ccpd =
+              state.compressedPoints[pointCellIndex + ipi.pointCellOffset + pointOffset];
+
+          if (!isPointValid(ccpd.posNormVal))
+            continue;
+
+          const Falcor::ClientPointData cpd = Falcor::decompressClientData(
+              ccpd, Falcor::uint3(coords), sp.diskRadius, ipi.aabbMin);
+          stats.numPointsDecoded++;
+
+          samplingWeight.add(
+              sp,
+              cpd.position,
+              cpd.normal,
+              cpd.value,
+              settings_.cosDeltaThreshold,
+              settings_.cosNormalThreshold);
+        }
+      }
+    }
+  }
+
+  stats.numCellsHit += numHitCells;
+
+  if (numHitCells == 0) {
+    stats.numQueriesWithoutCells++;
+    return 1.0f;
+  }
+
+  return samplingWeight.getAO();
+}
+
+std::vector<float> CPUAOReconstruction::reconstruct(
+    const ClientPointState& state,
+    const std::vector<Query>& queries,
+    QueryStats* stats) const {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  const uint32_t numQueries = (uint32_t)queries.size();
+  const uint32_t batchSize = std::max(settings_.batchSize, 1u);
+  const uint32_t numBatches = (numQueries + batchSize - 1) / batchSize;
+
+  std::vector<float> ao(numQueries);
+  std::vector<QueryStats> batchStats(numBatches);
+
+  auto reconstructBatch = [&](uint32_t batch) {
+    QueryStats& localStats = batchStats[batch];
+    const uint32_t end = std::min((batch + 1) * batchSize, numQueries);
+
+    for (uint32_t i = batch * batchSize; i < end; i++)
+      ao[i] = reconstructQuery(state, queries[i], localStats);
+
+    localStats.numQueries += end - batch * batchSize;
+  };
+
+  std::vector<uint32_t> batches(numBatches);
+  std::iota(batches.begin(), batches.end(), 0);
+
+  if (settings_.parallel)
+    std::for_each(std::execution::par, batches.begin(), batches.end(), reconstructBatch);
+  else
+    std::for_each(batches.begin(), batches.end(), reconstructBatch);
+
+  if (stats != nullptr) {
+    for (const auto& localStats : batchStats)
+      stats->add(localStats);
+
+    std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+    stats->seconds += seconds.count();
+  }
+
+  return ao;
+}
+
+std::vector<AOQualityHarness::FrameReport> AOQualityHarness::replay(
+    const UpdateStreamRecording& recording,
+    const std::vector<std::vector<CPUAOReconstruction::Query>>& queries,
+    const std::vector<std::vector<float>>& references) {
+  std::vector<FrameReport> reports;
+
+  if (queries.empty())
+    return reports;
+
+  ClientPointState state = recording.initialState;
+
+  for (uint32_t frame = 0; frame < (uint32_t)recording.frames.size(); frame++) {
+    const auto& recordedFrame = recording.frames[frame];
+
+    FrameReport report;
+    report.frame = frame;
+    report.numCellUpdates = state.applyCellUpdates(recordedFrame.packedCellUpdates);
+    report.numHashUpdates = (uint32_t)recordedFrame.hashUpdates.size();
+    state.applyHashUpdates(recordedFrame.hashUpdates);
+
+    const auto& frameQueries = queries[std::min(frame, (uint32_t)queries.size() - 1)];
+
+    CPUAOReconstruction::QueryStats stats;
+    const std::vector<float> ao = reconstruction_.reconstruct(state, frameQueries, &stats);
+
+    report.numQueries = stats.numQueries;
+
+    if (stats.numQueries > 0) {
+      report.nsPerQuery = stats.seconds * 1e9 / stats.numQueries;
+      report.cellsPerQuery = stats.numCellsHit / (double)stats.numQueries;
+      report.pointsPerQuery = stats.numPointsDecoded / (double)stats.numQueries;
+    }
+
+    if (frame < references.size() && references[frame].size() == ao.size() && !ao.empty()) {
+      const auto& reference = references[frame];
+      double absErrorSum = 0.0;
+      double squaredErrorSum = 0.0;
+
+      for (size_t i = 0; i < ao.size(); i++) {
+        const double error = std::abs((double)ao[i] - reference[i]);
+        absErrorSum += error;
+        squaredErrorSum += error * error;
+        report.maxAbsError = std::max(report.maxAbsError, error);
+      }
+
+      report.numReferenceValues = ao.size();
+      report.meanAbsError = absErrorSum / ao.size();
+      report.rmse = std::sqrt(squaredErrorSum / ao.size());
+    }
+
+    reports.push_back(report);
+  }
+
+  return reports;
+}
+
+void AOQualityHarness::printSummary(const std::vector<FrameReport>& reports, std::ostream& out) {
+  uint64_t numQueries = 0;
+  uint64_t numReferenceValues = 0;
+  double absErrorSum = 0.0;
+  double squaredErrorSum = 0.0;
+  double maxAbsError = 0.0;
+  double ns = 0.0;
+  double cells = 0.0;
+  double points = 0.0;
+
+  for (const auto& report : reports) {
+    numQueries += report.numQueries;
+    numReferenceValues += report.numReferenceValues;
+    absErrorSum += report.meanAbsError * report.numReferenceValues;
+    squaredErrorSum += report.rmse * report.rmse * report.numReferenceValues;
+    maxAbsError = std::max(maxAbsError, report.maxAbsError);
+    ns += report.nsPerQuery * report.numQueries;
+    cells += report.cellsPerQuery * report.numQueries;
+    points += report.pointsPerQuery * report.numQueries;
+  }
+
+  out << "AO replay of " << reports.size() << " frames, " << numQueries << " queries" << std::endl;
+
+  if (numReferenceValues > 0) {
+    out << "  error: mean abs " << absErrorSum / numReferenceValues << ", rmse "
+        << std::sqrt(squaredErrorSum / numReferenceValues) << ", max abs " << maxAbsError
+        << std::endl;
+  }
+
+  if (numQueries > 0) {
+    out << "  cost per query: " << ns / numQueries << " ns, " << cells / numQueries
+        << " cells, " << points / numQueries << " points" << std::endl;
+  }
+}
+
+void AOQualityHarness::writeCSV(
+    const std::vector<FrameReport>& reports,
+    const std::string& filename) {
+  std::fstream csv;
+  csv.open(filename, std::ios::out);
+
+  if (!csv.is_open()) {
+    std::cout << "could not write AO replay report to " << filename << std::endl;
+    return;
+  }
+
+  csv << "frame,cell_updates,hash_updates,queries,reference_values,mean_abs_error,rmse,"
+         "max_abs_error,ns_per_query,cells_per_query,points_per_query\n";
+
+  for (const auto& r : reports) {
+    csv << r.frame << "," << r.numCellUpdates << "," << r.numHashUpdates << "," << r.numQueries
+        << "," << r.numReferenceValues << "," << r.meanAbsError << "," << r.rmse << ","
+        << r.maxAbsError << "," << r.nsPerQuery << "," << r.cellsPerQuery << ","
+        << r.pointsPerQuery << "\n";
+  }
+
+  csv.flush();
+  csv.close();
+}
+
+} // namespace split_rendering
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CPUPointUpdatePipeline.h"
+#include "PointData.slang"
+
+namespace split_rendering {
+
+// Point data of a client as received from the server: instance infos, the compact hash tables and
+// the compressed points. Updates are applied like PointCellUpdateStage and PointHashUpdateStage.
+struct ClientPointState {
+  std::vector<Falcor::InstanceHashInfo> instanceHashInfos;
+  std::vector<Falcor::InstancePointInfo> instancePointInfos;
+  std::vector<float> diskRadiusPerInstance;
+  std::vector<Falcor::CompactHashToCellInfo> hashEntries;
+  std::vector<Falcor::CompressedClientPointData> compressedPoints;
+
+  // State that is sent to the client during init, e.g. the CPU copies of
+  // PointServerHashGenerator right after generate()
+  void init(
+      const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+      const std::vector<Falcor::CompactHashToCellInfo>& hashEntries,
+      const std::vector<Falcor::CompressedClientPointData>& compressedPoints,
+      const std::vector<float>& diskRadiusPerInstance);
+
+  // Returns the number of cell updates, see ClientPointCodec::packCellUpdates
+  uint32_t applyCellUpdates(const std::vector<uint32_t>& packedCellUpdates);
+  void applyHashUpdates(const std::vector<Falcor::HashUpdateInfo>& hashUpdates);
+
+  void write(std::fstream& file) const;
+  void read(std::fstream& file);
+};
+
+// Cell and hash updates of a sequence of frames, as sent to the client (before network
+// compression), and the client state they start from. Instance relocations and cell remaps are
+// not recorded, so the recorded server must not grow or compact its point structures.
+struct UpdateStreamRecording {
+  struct Frame {
+    std::vector<uint32_t> packedCellUpdates;
+    std::vector<Falcor::HashUpdateInfo> hashUpdates;
+  };
+
+  ClientPointState initialState;
+  std::vector<Frame> frames;
+
+  void addFrame(const CPUPointUpdatePipeline::FrameOutput& output);
+  // Network buffers of a frame as read back from PointCellCreateNetworkBufferStage and
+  // PointHashCreateNetworkBufferStage
+  void addFrame(
+      const std::vector<uint32_t>& packedCellUpdates,
+      const std::vector<Falcor::HashUpdateInfo>& hashUpdates);
+
+  bool save(const std::string& filename) const;
+  bool load(const std::string& filename);
+};
+
+// CPU version of samplePointAOHashUpdate (ClientCompositePointAO.ps.slang): reconstructs the AO of
+// G-buffer samples from the compressed points of a client state, weighted with
+// interpolationRadiusFactor, cosNormalThreshold and cosDeltaThreshold like on the GPU. Queries are
+// processed in batches that are spread across threads.
+class CPUAOReconstruction {
+ public:
+  struct Settings {
+    // Same meaning and defaults as in ServerPointRenderer
+    float interpolationRadiusFactor = 1.0f;
+    float cosNormalThreshold = 0.13f;
+    float cosDeltaThreshold = 0.7f;
+    uint32_t batchSize = 256;
+    bool parallel = true;
+  };
+
+  // G-buffer sample in the local space of its instance, see getInstanceShadingPointPreviousFrame
+  struct Query {
+    Falcor::float3 position;
+    Falcor::float3 N;
+    Falcor::float3 vertN;
+    uint32_t instanceId;
+  };
+
+  struct QueryStats {
+    uint64_t numQueries = 0;
+    uint64_t numHashEntriesRead = 0;
+    uint64_t numCellsHit = 0;
+    uint64_t numPointsDecoded = 0;
+    uint64_t numQueriesWithoutCells = 0; // AO is 1 for these
+    double seconds = 0.0; // wall clock time of all queries
+
+    void add(const QueryStats& other);
+  };
+
+  std::vector<float> reconstruct(
+      const ClientPointState& state,
+      const std::vector<Query>& queries,
+      QueryStats* stats = nullptr) const;
+
+  Settings settings_;
+
+ private:
+  float reconstructQuery(const ClientPointState& state, const Query& query, QueryStats& stats)
+      const;
+};
+
+// Replays an UpdateStreamRecording without a GPU and compares the AO reconstructed after every
+// frame against reference AO, e.g. per pixel RTAO or the uncompressed server points. This catches
+// quality regressions in the point encoding, the update stream and the reconstruction.
+class AOQualityHarness {
+ public:
+  struct FrameReport {
+    uint32_t frame = 0;
+    uint32_t numCellUpdates = 0;
+    uint32_t numHashUpdates = 0;
+    uint64_t numQueries = 0;
+    uint64_t numReferenceValues = 0; // 0 if the frame has no reference
+    double meanAbsError = 0.0;
+    double rmse = 0.0;
+    double maxAbsError = 0.0;
+    double nsPerQuery = 0.0;
+    double cellsPerQuery = 0.0;
+    double pointsPerQuery = 0.0;
+  };
+
+  // queries[frame] are the samples of a frame and references[frame] their reference AO. Frames past
+  // the end of queries reuse its last entry. Frames without references only report the cost.
+  std::vector<FrameReport> replay(
+      const UpdateStreamRecording& recording,
+      const std::vector<std::vector<CPUAOReconstruction::Query>>& queries,
+      const std::vector<std::vector<float>>& references);
+
+  static void printSummary(const std::vector<FrameReport>& reports, std::ostream& out);
+  static void writeCSV(const std::vector<FrameReport>& reports, const std::string& filename);
+
+  CPUAOReconstruction reconstruction_;
+};
+
+} // namespace split_rendering
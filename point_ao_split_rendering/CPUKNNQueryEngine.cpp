@@ -0,0 +1,597 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CPUKNNQueryEngine.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include "HashFunctionShared.slang"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace split_rendering {
+
+namespace {
+
+// Initial distance of the result set entries on the GPU
+constexpr float kNoDist = 9999999.9f;
+
+bool isPointValid(uint32_t posNormVal) {
+  return (posNormVal & INVALID_CELL) == 0;
+}
+
+// Fixed-size max-heap of the NUM_KNN_NEIGHBORS closest points found so far, the farthest one is at
+// the root. Replaces the sorted insertion of addPointCos, which keeps the same set of points.
+class NeighborHeap {
+ public:
+  explicit NeighborHeap(float searchRadius) : searchRadius_(searchRadius) {}
+
+  // Points have to be closer than this to enter the heap, like the test before addPointCos
+  float getMaxDist() const {
+    return count_ < NUM_KNN_NEIGHBORS ? searchRadius_ : std::min(searchRadius_, dists_[0]);
+  }
+
+  void push(float dist, uint32_t index) {
+    uint32_t i = 0;
+
+    if (count_ < NUM_KNN_NEIGHBORS) {
+      // Sift up from the new leaf
+      i = count_++;
+      while (i > 0 && dists_[(i - 1) / 2] < dist) {
+        dists_[i] = dists_[(i - 1) / 2];
+        indices_[i] = indices_[(i - 1) / 2];
+        i = (i - 1) / 2;
+      }
+    } else {
+      // Replace the root and sift down
+      while (true) {
+        const uint32_t left = 2 * i + 1;
+        const uint32_t right = left + 1;
+        uint32_t largest = i;
+        float largestDist = dist;
+
+        if (left < count_ && dists_[left] > largestDist) {
+          largest = left;
+          largestDist = dists_[left];
+        }
+        if (right < count_ && dists_[right] > largestDist)
+          largest = right;
+
+        if (largest == i)
+          break;
+
+        dists_[i] = dists_[largest];
+        indices_[i] = indices_[largest];
+        i = largest;
+      }
+    }
+
+    dists_[i] = dist;
+    indices_[i] = index;
+  }
+
+  // Sorted by distance, like the result set of the shaders (cosDists equal dists, see
+  // cosineHemisphereDist)
+  Falcor::ResultSet toResultSet() const {
+    std::array<std::pair<float, uint32_t>, NUM_KNN_NEIGHBORS> sorted;
+    for (uint32_t i = 0; i < count_; i++)
+      sorted[i] = {dists_[i], indices_[i]};
+
+    std::sort(sorted.begin(), sorted.begin() + count_);
+
+    Falcor::ResultSet result;
+    result.count = count_;
+
+    for (uint32_t i = 0; i < NUM_KNN_NEIGHBORS; i++) {
+      result.indices[i] = i < count_ ? sorted[i].second : 0;
+      result.dists[i] = i < count_ ? sorted[i].first : kNoDist;
+      result.cosDists[i] = result.dists[i];
+    }
+
+    result.maxDist = result.dists[NUM_KNN_NEIGHBORS - 1];
+
+    return result;
+  }
+
+ private:
+  float searchRadius_;
+  uint32_t count_ = 0;
+  float dists_[NUM_KNN_NEIGHBORS];
+  uint32_t indices_[NUM_KNN_NEIGHBORS];
+};
+
+// Squared distances of the 8 points starting at first to p. Returns a bit mask of the points that
+// are closer than maxDist.
+uint32_t computeDistances8(
+    const float* x,
+    const float* y,
+    const float* z,
+    const Falcor::float3& p,
+    float maxDist,
+    float* dists) {
+#if defined(__AVX2__)
+  const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x), _mm256_set1_ps(p.x));
+  const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y), _mm256_set1_ps(p.y));
+  const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z), _mm256_set1_ps(p.z));
+
+  // No FMA, so the distances are the same as in the scalar version
+  const __m256 d = _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+  _mm256_storeu_ps(dists, d);
+
+  return (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_set1_ps(maxDist), _CMP_LT_OQ));
+#else
+  uint32_t mask = 0;
+
+  for (uint32_t i = 0; i < 8; i++) {
+    const float dx = x[i] - p.x;
+    const float dy = y[i] - p.y;
+    const float dz = z[i] - p.z;
+    dists[i] = dx * dx + dy * dy + dz * dz;
+
+    if (dists[i] < maxDist)
+      mask |= 1u << i;
+  }
+
+  return mask;
+#endif
+}
+
+// Tests the numPoints points starting at first and adds the ones within reach to the heap,
+// getIndex(i) is the index that is stored for point first + i
+template <typename F>
+void addPoints(
+    const std::vector<float>& x,
+    const std::vector<float>& y,
+    const std::vector<float>& z,
+    uint32_t first,
+    uint32_t numPoints,
+    const Falcor::float3& p,
+    NeighborHeap& heap,
+    F getIndex) {
+  float dists[8];
+
+  for (uint32_t i = 0; i < numPoints; i += 8) {
+    uint32_t mask = computeDistances8(
+        &x[first + i], &y[first + i], &z[first + i], p, heap.getMaxDist(), dists);
+
+    // Lanes past the end belong to the next leaf or cell
+    if (numPoints - i < 8)
+      mask &= (1u << (numPoints - i)) - 1;
+
+    for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1) {
+      // The heap may have shrunk since the mask was computed
+      if ((mask & 1) != 0 && dists[lane] < heap.getMaxDist())
+        heap.push(dists[lane], getIndex(i + lane));
+    }
+  }
+}
+
+} // namespace
+
+void CPUKNNQueryEngine::SamplingWeight::add(
+    const ShadingPoint& sp,
+    const Falcor::float3& position,
+    const Falcor::float3& normal,
+    float value,
+    float cosDeltaThreshold,
+    float cosNormalThreshold) {
+  const Falcor::float3 distVec = position - sp.posW;
+  const float dist = std::max(0.000001f, glm::dot(distVec, distVec));
+  const float weight = std::max(0.0f, (sp.searchRadius - dist) / sp.searchRadius);
+
+  const float nDotDelta = glm::dot(glm::normalize(sp.vertN), glm::normalize(distVec));
+  const float cosDist = nDotDelta * nDotDelta;
+  const float cosN = glm::dot(sp.N, normal);
+
+  const float fallbackWeight = std::max((1.0f - cosDist) + cosN, 0.0001f);
+  fallbackWeightSum += fallbackWeight;
+  fallbackValueSum += value * fallbackWeight;
+
+  if (cosDist > cosDeltaThreshold || cosN < cosNormalThreshold)
+    return;
+
+  weightSum += weight;
+  valueSum += value * weight;
+}
+
+float CPUKNNQueryEngine::SamplingWeight::getAO() const {
+  // The shaders divide by zero here, unoccluded is the closest to what ends up on screen
+  if (fallbackWeightSum == 0.0f)
+    return 1.0f;
+
+  if (weightSum == 0.0f)
+    return std::clamp(fallbackValueSum / fallbackWeightSum, 0.0f, 1.0f);
+
+  return std::clamp(valueSum / weightSum, 0.0f, 1.0f);
+}
+
+void CPUKNNQueryEngine::QueryStats::add(const QueryStats& other) {
+  numQueries += other.numQueries;
+  numNodesVisited += other.numNodesVisited;
+  numHashEntriesRead += other.numHashEntriesRead;
+  numCellsVisited += other.numCellsVisited;
+  numPointsTested += other.numPointsTested;
+  numNeighbors += other.numNeighbors;
+}
+
+void CPUKNNQueryEngine::PointSoA::resize(uint32_t numPoints) {
+  // Padding points never pass the distance test
+  const float unreachable = std::numeric_limits<float>::infinity();
+  x.assign(numPoints + kSimdWidth, unreachable);
+  y.assign(numPoints + kSimdWidth, unreachable);
+  z.assign(numPoints + kSimdWidth, unreachable);
+}
+
+void CPUKNNQueryEngine::PointSoA::set(uint32_t i, const Falcor::float3& position) {
+  x[i] = position.x;
+  y[i] = position.y;
+  z[i] = position.z;
+}
+
+CPUKNNQueryEngine::ShadingPoint CPUKNNQueryEngine::makeShadingPoint(
+    const Falcor::float3& position,
+    const Falcor::float3& N,
+    const Falcor::float3& vertN,
+    uint32_t instanceId,
+    float instanceDiskRadius,
+    float interpolationRadiusFactor) {
+  ShadingPoint sp;
+  sp.posW = position;
+  sp.N = N;
+  sp.vertN = vertN;
+  sp.diskRadius = DISK_RADIUS_FACTOR * instanceDiskRadius;
+  sp.searchRadius = interpolationRadiusFactor * 0.5f * sp.diskRadius * sp.diskRadius;
+  sp.instanceId = instanceId;
+
+  return sp;
+}
+
+bool CPUKNNQueryEngine::setKDTrees(const PointKDTree& kdTree, const PointDataSoA& points) {
+  if (kdTree.getNodes().empty()) {
+    std::cout << "CPUKNNQueryEngine: kd-trees have to be built first" << std::endl;
+    return false;
+  }
+
+  kdTreeNodes_ = kdTree.getNodes();
+  kdTreeIndex_ = kdTree.getIndices();
+  instanceKdTreeOffsets_ = kdTree.getInstanceNodeOffsets();
+  instanceKdTreeIndexOffsets_ = kdTree.getInstanceIndexOffsets();
+  kdTreePoints_.resize(points.getNumPoints());
+  for (size_t i = 0; i < kdTreePoints_.size(); i++)
+    kdTreePoints_[i] = points.get(i);
+
+  const uint32_t numInstances = (uint32_t)instanceKdTreeIndexOffsets_.size();
+  instanceNumKdTreePoints_.resize(numInstances);
+
+  for (uint32_t instanceId = 0; instanceId < numInstances; instanceId++) {
+    const uint32_t end = instanceId + 1 < numInstances ? instanceKdTreeIndexOffsets_[instanceId + 1]
+                                                       : (uint32_t)kdTreeIndex_.size();
+    instanceNumKdTreePoints_[instanceId] = end - instanceKdTreeIndexOffsets_[instanceId];
+  }
+
+  // Leaves refer to ranges of kdTreeIndex, so the points of a leaf are next to each other
+  kdTreePositions_.resize((uint32_t)kdTreeIndex_.size());
+
+  for (uint32_t i = 0; i < (uint32_t)kdTreeIndex_.size(); i++)
+    kdTreePositions_.set(i, kdTreePoints_[kdTreeIndex_[i]].position);
+
+  return true;
+}
+
+void CPUKNNQueryEngine::setHashTables(
+    const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+    const std::vector<Falcor::CompactHashToCellInfo>& hashEntries,
+    const PointDataSoA& pointSlots,
+    const std::vector<Falcor::CompressedClientPointData>& compressedPointSlots) {
+  instanceHashInfos_ = instanceHashInfos;
+  instancePointInfos_ = instancePointInfos;
+  hashEntries_ = hashEntries;
+  hashPoints_.resize(pointSlots.getNumPoints());
+  hashPositions_.resize((uint32_t)hashPoints_.size());
+
+  for (uint32_t slot = 0; slot < (uint32_t)hashPoints_.size(); slot++) {
+    hashPoints_[slot] = pointSlots.get(slot);
+
+    if (isPointValid(compressedPointSlots[slot].posNormVal))
+      hashPositions_.set(slot, hashPoints_[slot].position);
+  }
+}
+
+void CPUKNNQueryEngine::queryKDTree(
+    const ShadingPoint& sp,
+    Falcor::ResultSet& result,
+    QueryStats& stats) const {
+  // Same traversal as findNeighborsCustomLinearTree, which visits the same nodes
+  NeighborHeap heap(sp.searchRadius);
+
+  const uint32_t kdTreeOffset = instanceKdTreeOffsets_[sp.instanceId];
+  const uint32_t kdTreeIndexOffset = instanceKdTreeIndexOffsets_[sp.instanceId];
+
+  float dists[3] = {0.0f, 0.0f, 0.0f};
+  bool backtrack = false;
+  int lastNode = -1;
+  int current = 0;
+
+  while (current != -1) {
+    const Falcor::KDTreeGPUNode node =
+        Falcor::unpackKDTreeNode(kdTreeNodes_[kdTreeOffset + current]);
+    const bool isLeaf = node.child1 == -1 && node.child2 == -1;
+    stats.numNodesVisited++;
+
+    if (isLeaf) {
+      // Leaves are only reached going down
+      uint32_t left = 0;
+      uint32_t right = 0;
+      std::memcpy(&left, &node.leftOrDivLow, sizeof(left));
+      std::memcpy(&right, &node.rightOrDivHigh, sizeof(right));
+
+      addPoints(
+          kdTreePositions_.x,
+          kdTreePositions_.y,
+          kdTreePositions_.z,
+          kdTreeIndexOffset + left,
+          right - left,
+          sp.posW,
+          heap,
+          [&](uint32_t i) { return kdTreeIndex_[kdTreeIndexOffset + left + i]; });
+      stats.numPointsTested += right - left;
+
+      backtrack = true;
+      lastNode = current;
+      current = node.parentId;
+      continue;
+    }
+
+    const uint32_t idx = node.divfeat;
+    const float val = sp.posW[idx];
+    const float diff1 = val - node.leftOrDivLow;
+    const float diff2 = val - node.rightOrDivHigh;
+    const bool firstIsBest = (diff1 + diff2) < 0;
+    const int bestChild = firstIsBest ? node.child1 : node.child2;
+    const int otherChild = firstIsBest ? node.child2 : node.child1;
+    const float cutVal = firstIsBest ? std::max(val, node.rightOrDivHigh)
+                                     : std::min(val, node.leftOrDivLow);
+    const float cutDist = (val - cutVal) * (val - cutVal);
+
+    if (!backtrack) {
+      lastNode = current;
+      current = bestChild;
+      continue;
+    }
+
+    const float mindistSquared = cutDist - dists[idx];
+    dists[idx] = cutDist;
+
+    // Visit the far child if we came back from the best child and it could contain closer points
+    if (lastNode == bestChild && mindistSquared <= heap.getMaxDist()) {
+      lastNode = current;
+      current = otherChild;
+      backtrack = false;
+    } else {
+      lastNode = current;
+      current = node.parentId;
+    }
+  }
+
+  result = heap.toResultSet();
+}
+
+void CPUKNNQueryEngine::queryHash(
+    const ShadingPoint& sp,
+    Falcor::ResultSet& result,
+    QueryStats& stats) const {
+  // Same lookup as samplePointAOHashNN, on the compact bucket layout of the server
+  NeighborHeap heap(sp.searchRadius);
+
+  const auto& ihi = instanceHashInfos_[sp.instanceId];
+  const auto& ipi = instancePointInfos_[sp.instanceId];
+
+  const Falcor::float3 floatCoords = (sp.posW - ipi.aabbMin) / sp.diskRadius;
+  const Falcor::int3 intBaseCoords = Falcor::int3(floatCoords - 0.5f);
+
+  for (int x = 0; x <= 1; x++) {
+    for (int y = 0; y <= 1; y++) {
+      for (int z = 0; z <= 1; z++) {
+        const Falcor::HashData hd = Falcor::getHash(
+            intBaseCoords + Falcor::int3(x, y, z),
+            ipi.gridDim,
+            ihi.hashToBucketSize,
+            ihi.hashType);
+
+        const uint32_t bucketOffset =
+            ihi.hashToBucketOffset + hd.hashBase * FIXED_HASH_BUCKET_SIZE;
+        int pointCellIndex = -1;
+
+        for (uint32_t entry = 0; entry < FIXED_HASH_BUCKET_SIZE; entry++) {
+          const auto& htci = hashEntries_[bucketOffset + entry];
+          stats.numHashEntriesRead++;
+
+          if (htci.rawCellId == hd.rawCellId) {
+            pointCellIndex = (int)(htci.encodedIndex & COMPACT_HASH_INDEX_MASK);
+            break;
+          } else if (htci.rawCellId == INVALID_CELL) {
+            break;
+          }
+        }
+
+        if (pointCellIndex < 0)
+          continue;
+
+        const uint32_t firstSlot = ipi.pointCellOffset + (uint32_t)pointCellIndex;
+
+        addPoints(
+            hashPositions_.x,
+            hashPositions_.y,
+            hashPositions_.z,
+            firstSlot,
+            ipi.cellCapacity,
+            sp.posW,
+            heap,
+            [&](uint32_t i) { return firstSlot + i; });
+        stats.numCellsVisited++;
+        stats.numPointsTested += ipi.cellCapacity;
+      }
+    }
+  }
+
+  result = heap.toResultSet();
+}
+
+void CPUKNNQueryEngine::queryBruteForce(
+    const ShadingPoint& sp,
+    Falcor::ResultSet& result,
+    QueryStats& stats) const {
+  NeighborHeap heap(sp.searchRadius);
+
+  const uint32_t kdTreeIndexOffset = instanceKdTreeIndexOffsets_[sp.instanceId];
+  const uint32_t numPoints = instanceNumKdTreePoints_[sp.instanceId];
+
+  addPoints(
+      kdTreePositions_.x,
+      kdTreePositions_.y,
+      kdTreePositions_.z,
+      kdTreeIndexOffset,
+      numPoints,
+      sp.posW,
+      heap,
+      [&](uint32_t i) { return kdTreeIndex_[kdTreeIndexOffset + i]; });
+  stats.numPointsTested += numPoints;
+
+  result = heap.toResultSet();
+}
+
+std::vector<Falcor::ResultSet> CPUKNNQueryEngine::query(
+    Structure structure,
+    const std::vector<ShadingPoint>& shadingPoints,
+    QueryStats* stats) const {
+  const uint32_t numQueries = (uint32_t)shadingPoints.size();
+  const uint32_t batchSize = std::max(settings_.batchSize, 1u);
+  const uint32_t numBatches = (numQueries + batchSize - 1) / batchSize;
+
+  std::vector<Falcor::ResultSet> results(numQueries);
+  std::vector<QueryStats> batchStats(numBatches);
+
+  auto queryBatch = [&](uint32_t batch) {
+    QueryStats& localStats = batchStats[batch];
+    const uint32_t end = std::min((batch + 1) * batchSize, numQueries);
+
+    for (uint32_t i = batch * batchSize; i < end; i++) {
+      if (structure == Structure::KDTree)
+        queryKDTree(shadingPoints[i], results[i], localStats);
+      else if (structure == Structure::Hash)
+        queryHash(shadingPoints[i], results[i], localStats);
+      else
+        queryBruteForce(shadingPoints[i], results[i], localStats);
+
+      localStats.numQueries++;
+      localStats.numNeighbors += results[i].count;
+    }
+  };
+
+  std::vector<uint32_t> batches(numBatches);
+  std::iota(batches.begin(), batches.end(), 0);
+
+  if (settings_.parallel)
+    std::for_each(std::execution::par, batches.begin(), batches.end(), queryBatch);
+  else
+    std::for_each(batches.begin(), batches.end(), queryBatch);
+
+  if (stats != nullptr) {
+    for (const auto& localStats : batchStats)
+      stats->add(localStats);
+  }
+
+  return results;
+}
+
+std::vector<float> CPUKNNQueryEngine::reconstructAO(
+    Structure structure,
+    const std::vector<ShadingPoint>& shadingPoints,
+    const std::vector<Falcor::ResultSet>& results,
+    float cosDeltaThreshold,
+    float cosNormalThreshold) const {
+  const auto& points = structure == Structure::Hash ? hashPoints_ : kdTreePoints_;
+  std::vector<float> ao(shadingPoints.size());
+
+  std::vector<uint32_t> ids(shadingPoints.size());
+  std::iota(ids.begin(), ids.end(), 0);
+
+  std::for_each(std::execution::par, ids.begin(), ids.end(), [&](uint32_t i) {
+    const ShadingPoint& sp = shadingPoints[i];
+    const Falcor::ResultSet& result = results[i];
+
+    SamplingWeight samplingWeight;
+
+    for (uint32_t n = 0; n < result.count; n++) {
+      const Falcor::PointData& point = points[result.indices[n]];
+      samplingWeight.add(
+          sp, point.position, point.normal, point.value, cosDeltaThreshold, cosNormalThreshold);
+    }
+
+    ao[i] = samplingWeight.getAO();
+  });
+
+  return ao;
+}
+
+CPUKNNQueryEngine::ComparisonStats CPUKNNQueryEngine::compare(
+    const std::vector<Falcor::ResultSet>& reference,
+    const std::vector<Falcor::ResultSet>& results) {
+  ComparisonStats stats;
+  const size_t numQueries = std::min(reference.size(), results.size());
+
+  for (size_t i = 0; i < numQueries; i++) {
+    const auto& ref = reference[i];
+    const auto& res = results[i];
+
+    uint32_t numFound = 0;
+
+    for (uint32_t r = 0; r < ref.count; r++) {
+      if (std::find(res.indices, res.indices + res.count, ref.indices[r]) !=
+          res.indices + res.count)
+        numFound++;
+    }
+
+    stats.numQueries++;
+    stats.numReferenceNeighbors += ref.count;
+    stats.numFoundNeighbors += numFound;
+
+    if (numFound == ref.count && res.count == ref.count)
+      stats.numExactQueries++;
+
+    if (ref.count > 0 && res.count > 0) {
+      stats.maxDistError = std::max(
+          stats.maxDistError,
+          (double)std::abs(res.dists[res.count - 1] - ref.dists[ref.count - 1]));
+    }
+  }
+
+  return stats;
+}
+
+const char* CPUKNNQueryEngine::getStructureName(Structure structure) {
+  switch (structure) {
+    case Structure::KDTree:
+      return "kd-tree";
+    case Structure::Hash:
+      return "hash";
+    default:
+      return "brute force";
+  }
+}
+
+} // namespace split_rendering
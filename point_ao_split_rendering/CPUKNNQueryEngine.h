@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <vector>
+#include "PointData.slang"
+#include "PointKDTree.h"
+
+namespace split_rendering {
+
+// CPU version of the nearest neighbor queries of the composite shaders: the linearized kd-tree
+// traversal of KDTree.slang (findNeighborsCustomLinearTree) and the hash lookup of the 2x2x2 cell
+// neighborhood (samplePointAOHashNN), on the same buffers that are uploaded to the GPU. Both return
+// the NUM_KNN_NEIGHBORS closest points within the search radius of a shading point as a ResultSet.
+//
+// Queries are processed in batches that are spread across threads, and within a query the
+// candidate points (a kd-tree leaf or a point cell) are tested 8 at a time with AVX2 if available.
+// Point positions are stored as padded SoA arrays in the order they are visited for this.
+//
+// Besides a CPU AO reconstruction path, the engine is meant as an oracle for the GPU: BruteForce
+// returns the exact neighbors, and QueryStats counts the work done per query.
+class CPUKNNQueryEngine {
+ public:
+  enum class Structure { KDTree, Hash, BruteForce };
+
+  // Same as AOShadingPoint, in the local space of the instance
+  struct ShadingPoint {
+    Falcor::float3 posW;
+    Falcor::float3 N;
+    Falcor::float3 vertN;
+    float diskRadius;
+    float searchRadius; // squared distance
+    uint32_t instanceId;
+  };
+
+  // AOSamplingWeight with applySamplingWeight
+  struct SamplingWeight {
+    float weightSum = 0.0f;
+    float valueSum = 0.0f;
+    float fallbackWeightSum = 0.0f;
+    float fallbackValueSum = 0.0f;
+
+    void add(
+        const ShadingPoint& sp,
+        const Falcor::float3& position,
+        const Falcor::float3& normal,
+        float value,
+        float cosDeltaThreshold,
+        float cosNormalThreshold);
+
+    // 1 if no point was added
+    float getAO() const;
+  };
+
+  struct Settings {
+    uint32_t batchSize = 256;
+    bool parallel = true;
+  };
+
+  struct QueryStats {
+    uint64_t numQueries = 0;
+    uint64_t numNodesVisited = 0;
+    uint64_t numHashEntriesRead = 0;
+    uint64_t numCellsVisited = 0;
+    uint64_t numPointsTested = 0;
+    uint64_t numNeighbors = 0;
+
+    void add(const QueryStats& other);
+  };
+
+  // Accuracy of results compared to reference results (e.g. BruteForce)
+  struct ComparisonStats {
+    uint64_t numQueries = 0;
+    uint64_t numExactQueries = 0; // same set of neighbors
+    uint64_t numReferenceNeighbors = 0;
+    uint64_t numFoundNeighbors = 0; // reference neighbors that are also in the results
+    double maxDistError = 0.0; // largest difference of the k-th distance
+
+    double getRecall() const {
+      return numReferenceNeighbors > 0 ? (double)numFoundNeighbors / numReferenceNeighbors : 1.0;
+    }
+  };
+
+  // Shading point as set up by getInstanceShadingPoint
+  static ShadingPoint makeShadingPoint(
+      const Falcor::float3& position,
+      const Falcor::float3& N,
+      const Falcor::float3& vertN,
+      uint32_t instanceId,
+      float instanceDiskRadius,
+      float interpolationRadiusFactor);
+
+  // Copies the trees, e.g. PointKDTreeGenerator::getCPUKDTree. points are the points the trees
+  // were built from (kdTreeIndex refers to them). Used by KDTree and BruteForce.
+  bool setKDTrees(const PointKDTree& kdTree, const PointDataSoA& points);
+
+  // Copies the compact hash tables and point slots, e.g. of PointServerHashGenerator or
+  // CPUPointUpdatePipeline. Slots with an invalid compressed point are empty.
+  void setHashTables(
+      const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+      const std::vector<Falcor::CompactHashToCellInfo>& hashEntries,
+      const PointDataSoA& pointSlots,
+      const std::vector<Falcor::CompressedClientPointData>& compressedPointSlots);
+
+  // Indices of the results are kdTreeIndex values for KDTree and BruteForce, point slots for Hash
+  std::vector<Falcor::ResultSet> query(
+      Structure structure,
+      const std::vector<ShadingPoint>& shadingPoints,
+      QueryStats* stats = nullptr) const;
+
+  // AO of each shading point from its neighbors, weighted like applySamplingWeight
+  std::vector<float> reconstructAO(
+      Structure structure,
+      const std::vector<ShadingPoint>& shadingPoints,
+      const std::vector<Falcor::ResultSet>& results,
+      float cosDeltaThreshold,
+      float cosNormalThreshold) const;
+
+  static ComparisonStats compare(
+      const std::vector<Falcor::ResultSet>& reference,
+      const std::vector<Falcor::ResultSet>& results);
+
+  static const char* getStructureName(Structure structure);
+
+  Settings settings_;
+
+ private:
+  // Positions padded with kSimdWidth unreachable points, so the last points can be tested with a
+  // full SIMD register
+  struct PointSoA {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    void resize(uint32_t numPoints);
+    void set(uint32_t i, const Falcor::float3& position);
+  };
+
+  static constexpr uint32_t kSimdWidth = 8;
+
+  void queryKDTree(const ShadingPoint& sp, Falcor::ResultSet& result, QueryStats& stats) const;
+  void queryHash(const ShadingPoint& sp, Falcor::ResultSet& result, QueryStats& stats) const;
+  void queryBruteForce(const ShadingPoint& sp, Falcor::ResultSet& result, QueryStats& stats)
+      const;
+
+  // KDTree and BruteForce, positions in the order of kdTreeIndex
+  std::vector<Falcor::KDTreeCompactNode> kdTreeNodes_;
+  std::vector<uint32_t> kdTreeIndex_;
+  std::vector<uint32_t> instanceKdTreeOffsets_;
+  std::vector<uint32_t> instanceKdTreeIndexOffsets_;
+  std::vector<uint32_t> instanceNumKdTreePoints_;
+  PointSoA kdTreePositions_;
+  std::vector<Falcor::PointData> kdTreePoints_;
+
+  // Hash, positions of the point slots
+  std::vector<Falcor::InstanceHashInfo> instanceHashInfos_;
+  std::vector<Falcor::InstancePointInfo> instancePointInfos_;
+  std::vector<Falcor::CompactHashToCellInfo> hashEntries_;
+  PointSoA hashPositions_;
+  std::vector<Falcor::PointData> hashPoints_;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless check of CPUKNNQueryEngine. Random point slots of a few instances (one of them flat,
+// with some empty slots) are put into PointKDTree, and the kd-tree and brute force queries of the
+// engine have to return exactly the neighbors of a plain brute force search over the valid slots.
+// With --refit_frames, the points are then deformed every frame and the trees refit
+// (PointKDTree::refit), once with the default rebuild thresholds and once without rebuilds, and
+// the queries have to stay exact. Trees taken over with PointKDTree::assign (as from a bake
+// package) have to refit exactly like the built ones.
+//
+// Example usage:
+// $ ./CPUKNNQueryTest --num_points 50000 --num_queries 5000
+// $ ./CPUKNNQueryTest --refit_frames 20
+//
+// Exit codes: 0 if all checks pass, 1 if a check fails, 2 for invalid arguments.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "CPUKNNQueryEngine.h"
+#include "PointDataSoA.h"
+#include "PointKDTree.h"
+#include "argparse.hpp"
+
+using split_rendering::CPUKNNQueryEngine;
+using split_rendering::PointDataSoA;
+using split_rendering::PointKDTree;
+
+namespace {
+
+const int kExitFailed = 1;
+const int kExitInvalid = 2;
+
+const uint32_t kCellCapacity = 3;
+const float kInstanceSize = 10.0f;
+
+struct TestScene {
+  PointDataSoA pointCells;
+  std::vector<Falcor::InstancePointInfo> instancePointInfos;
+};
+
+// Every instance gets numPointsPerInstance slots, of which emptyFraction are empty. Odd instances
+// are flat (all points at the same z).
+void createTestScene(
+    uint32_t numInstances,
+    uint32_t numPointsPerInstance,
+    float emptyFraction,
+    std::mt19937& rng,
+    TestScene& scene) {
+  std::uniform_real_distribution<float> uniform(0.0f, kInstanceSize);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  const uint32_t numCells = (numPointsPerInstance + kCellCapacity - 1) / kCellCapacity;
+  const uint32_t numSlots = numCells * kCellCapacity;
+
+  scene.pointCells.allocate(numInstances * numSlots);
+  scene.pointCells.fill(Falcor::PointData());
+  scene.instancePointInfos.assign(numInstances, {});
+
+  for (uint32_t instanceId = 0; instanceId < numInstances; instanceId++) {
+    auto& ipi = scene.instancePointInfos[instanceId];
+    ipi.pointCellOffset = instanceId * numSlots;
+    ipi.cellOffset = instanceId * numCells;
+    ipi.numAllocatedCells = numCells;
+    ipi.cellCapacity = kCellCapacity;
+    ipi.maxNumPoints = numSlots;
+
+    for (uint32_t slot = 0; slot < numPointsPerInstance; slot++) {
+      if (unit(rng) < emptyFraction)
+        continue;
+
+      Falcor::PointData point;
+      point.position = Falcor::float3(
+          uniform(rng), uniform(rng), instanceId % 2 == 1 ? 0.5f * kInstanceSize : uniform(rng));
+      point.normal = Falcor::float3(0.0f, 0.0f, 1.0f);
+      point.instanceTriangleId = slot;
+      point.instanceId = instanceId;
+      point.value = unit(rng);
+
+      scene.pointCells.set(ipi.pointCellOffset + slot, point);
+    }
+  }
+}
+
+// NUM_KNN_NEIGHBORS closest valid points of the shading point's instance, in the ResultSet layout
+// of the engine
+Falcor::ResultSet findNeighbors(
+    const TestScene& scene,
+    const CPUKNNQueryEngine::ShadingPoint& sp) {
+  const auto& ipi = scene.instancePointInfos[sp.instanceId];
+  const auto& streams = scene.pointCells.getStreams();
+  std::vector<std::pair<float, uint32_t>> candidates;
+
+  for (uint32_t slot = ipi.pointCellOffset; slot < ipi.pointCellOffset + ipi.maxNumPoints;
+       slot++) {
+    if (streams.values[slot] < 0.0f)
+      continue;
+
+    const Falcor::float3 delta = streams.positions[slot] - sp.posW;
+    const float dist = delta.x * delta.x + delta.y * delta.y + delta.z * delta.z;
+    if (dist < sp.searchRadius)
+      candidates.push_back({dist, slot});
+  }
+
+  const size_t count = std::min<size_t>(candidates.size(), NUM_KNN_NEIGHBORS);
+  std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+
+  Falcor::ResultSet result = {};
+  result.count = (uint32_t)count;
+  for (uint32_t i = 0; i < count; i++) {
+    result.indices[i] = candidates[i].second;
+    result.dists[i] = candidates[i].first;
+  }
+
+  return result;
+}
+
+// Swirls the valid points of every instance around its center, more the further they are from
+// it, plus some jitter. The points stay in their slots, as they do within their cells on the
+// server.
+void deformPoints(TestScene& scene, uint32_t frame, std::mt19937& rng) {
+  std::uniform_real_distribution<float> jitter(-0.01f * kInstanceSize, 0.01f * kInstanceSize);
+  const auto& streams = scene.pointCells.getStreams();
+  const float angle = 0.05f * std::sin(0.3f * frame);
+
+  for (uint32_t instanceId = 0; instanceId < (uint32_t)scene.instancePointInfos.size();
+       instanceId++) {
+    const auto& ipi = scene.instancePointInfos[instanceId];
+    const bool flat = instanceId % 2 == 1;
+
+    for (uint32_t slot = ipi.pointCellOffset; slot < ipi.pointCellOffset + ipi.maxNumPoints;
+         slot++) {
+      if (streams.values[slot] < 0.0f)
+        continue;
+
+      Falcor::float3& position = streams.positions[slot];
+      const float x = position.x - 0.5f * kInstanceSize;
+      const float y = position.y - 0.5f * kInstanceSize;
+      const float a = angle * std::sqrt(x * x + y * y) / kInstanceSize;
+
+      position.x = 0.5f * kInstanceSize + x * std::cos(a) - y * std::sin(a) + jitter(rng);
+      position.y = 0.5f * kInstanceSize + x * std::sin(a) + y * std::cos(a) + jitter(rng);
+      if (!flat)
+        position.z += jitter(rng);
+    }
+  }
+}
+
+// Queries random shading points with the kd-trees and brute force of the engine and compares them
+// to findNeighbors(). kdTreeStats receives the stats of the last kd-tree run.
+bool checkQueries(
+    CPUKNNQueryEngine& engine,
+    const TestScene& scene,
+    int numQueries,
+    std::mt19937& rng,
+    const std::string& label,
+    CPUKNNQueryEngine::QueryStats* kdTreeStats = nullptr) {
+  // Shading points around the instances with search radii from a few to more than
+  // NUM_KNN_NEIGHBORS points
+  std::uniform_real_distribution<float> position(-0.1f * kInstanceSize, 1.1f * kInstanceSize);
+  std::uniform_real_distribution<float> diskRadius(0.02f, 0.6f);
+  std::uniform_int_distribution<int> instance(0, (int)scene.instancePointInfos.size() - 1);
+
+  std::vector<CPUKNNQueryEngine::ShadingPoint> shadingPoints(numQueries);
+  std::vector<Falcor::ResultSet> reference(numQueries);
+
+  for (int i = 0; i < numQueries; i++) {
+    const Falcor::float3 normal(0.0f, 0.0f, 1.0f);
+    shadingPoints[i] = CPUKNNQueryEngine::makeShadingPoint(
+        Falcor::float3(position(rng), position(rng), position(rng)),
+        normal,
+        normal,
+        (uint32_t)instance(rng),
+        diskRadius(rng),
+        1.0f);
+    reference[i] = findNeighbors(scene, shadingPoints[i]);
+  }
+
+  bool passed = true;
+
+  for (bool parallel : {false, true}) {
+    engine.settings_.parallel = parallel;
+
+    for (auto structure :
+         {CPUKNNQueryEngine::Structure::KDTree, CPUKNNQueryEngine::Structure::BruteForce}) {
+      CPUKNNQueryEngine::QueryStats queryStats;
+      const auto results = engine.query(structure, shadingPoints, &queryStats);
+      const auto comparison = CPUKNNQueryEngine::compare(reference, results);
+
+      if (structure == CPUKNNQueryEngine::Structure::KDTree && kdTreeStats != nullptr)
+        *kdTreeStats = queryStats;
+
+      std::cout << label << CPUKNNQueryEngine::getStructureName(structure)
+                << (parallel ? " (parallel)" : " (sequential)") << ": exact "
+                << comparison.numExactQueries << " / " << comparison.numQueries << ", recall "
+                << comparison.getRecall() << ", max distance error " << comparison.maxDistError
+                << ", neighbors per query " << (double)queryStats.numNeighbors / numQueries
+                << ", points tested per query " << (double)queryStats.numPointsTested / numQueries
+                << std::endl;
+
+      if (comparison.numExactQueries != comparison.numQueries || comparison.maxDistError > 1e-5) {
+        std::cout << "FAIL " << label << CPUKNNQueryEngine::getStructureName(structure)
+                  << " results differ from the brute force search" << std::endl;
+        passed = false;
+      }
+    }
+  }
+
+  return passed;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("CPUKNNQueryTest");
+
+  args.add_argument("--num_points")
+      .help("point slots per instance")
+      .default_value(20000)
+      .scan<'d', int>();
+  args.add_argument("--instances").help("number of instances").default_value(3).scan<'d', int>();
+  args.add_argument("--num_queries")
+      .help("shading points per run")
+      .default_value(2000)
+      .scan<'d', int>();
+  args.add_argument("--empty_fraction")
+      .help("fraction of empty point slots")
+      .default_value(0.2f)
+      .scan<'f', float>();
+  args.add_argument("--refit_frames")
+      .help("frames of deforming the points and refitting the kd-trees after the first check")
+      .default_value(0)
+      .scan<'d', int>();
+  args.add_argument("--seed").default_value(1).scan<'d', int>();
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const int numPoints = args.get<int>("--num_points");
+  const int numInstances = args.get<int>("--instances");
+  const int numQueries = args.get<int>("--num_queries");
+  const float emptyFraction = args.get<float>("--empty_fraction");
+
+  if (numPoints < 1 || numInstances < 1 || numQueries < 1 || emptyFraction < 0.0f ||
+      emptyFraction >= 1.0f || args.get<int>("--refit_frames") < 0) {
+    std::cerr << "invalid arguments" << std::endl;
+    return kExitInvalid;
+  }
+
+  std::mt19937 rng(args.get<int>("--seed"));
+  TestScene scene;
+  createTestScene((uint32_t)numInstances, (uint32_t)numPoints, emptyFraction, rng, scene);
+
+  PointKDTree kdTree;
+  kdTree.build(scene.pointCells, scene.instancePointInfos);
+
+  CPUKNNQueryEngine engine;
+  if (!engine.setKDTrees(kdTree, scene.pointCells))
+    return kExitFailed;
+
+  bool passed = checkQueries(engine, scene, numQueries, rng, "");
+
+  const int numRefitFrames = args.get<int>("--refit_frames");
+
+  if (numRefitFrames > 0) {
+    // Same trees, but refit without ever rebuilding a subtree
+    PointKDTree refitOnlyTree;
+    refitOnlyTree.refitSettings_.maxOverlap = std::numeric_limits<float>::max();
+    refitOnlyTree.refitSettings_.maxSizeGrowth = std::numeric_limits<float>::max();
+    refitOnlyTree.build(scene.pointCells, scene.instancePointInfos);
+
+    std::vector<uint32_t> instanceIds(numInstances);
+    std::iota(instanceIds.begin(), instanceIds.end(), 0);
+
+    for (int frame = 1; frame <= numRefitFrames; frame++) {
+      deformPoints(scene, (uint32_t)frame, rng);
+
+      for (PointKDTree* tree : {&kdTree, &refitOnlyTree}) {
+        const bool refitOnly = tree == &refitOnlyTree;
+        const std::string label =
+            "frame " + std::to_string(frame) + (refitOnly ? " refit only " : " refit ");
+
+        const auto stats = tree->refit(scene.pointCells, scene.instancePointInfos, instanceIds);
+        if (stats.numInstances != (uint32_t)numInstances || stats.numChangedInstances != 0) {
+          std::cout << "FAIL " << label << "skipped instances" << std::endl;
+          passed = false;
+        }
+
+        if (!engine.setKDTrees(*tree, scene.pointCells))
+          return kExitFailed;
+
+        CPUKNNQueryEngine::QueryStats kdTreeStats;
+        passed &= checkQueries(engine, scene, numQueries, rng, label, &kdTreeStats);
+
+        std::cout << label << "rebuilt nodes " << stats.numRebuiltNodes << " / " << stats.numNodes
+                  << ", kd-tree nodes visited per query "
+                  << (double)kdTreeStats.numNodesVisited / numQueries << std::endl;
+      }
+    }
+
+    // Trees taken over with assign(), as from a bake package, have to refit like the originals
+    PointKDTree assignedTree;
+    if (!assignedTree.assign(
+            kdTree.getNodes(),
+            kdTree.getIndices(),
+            kdTree.getInstanceNodeOffsets(),
+            kdTree.getInstanceIndexOffsets(),
+            kdTree.getNodeBuildSizes(),
+            scene.instancePointInfos)) {
+      std::cout << "FAIL assign() rejected the trees of build()" << std::endl;
+      passed = false;
+    } else {
+      deformPoints(scene, (uint32_t)numRefitFrames + 1, rng);
+      const auto stats = kdTree.refit(scene.pointCells, scene.instancePointInfos, instanceIds);
+      const auto assignedStats =
+          assignedTree.refit(scene.pointCells, scene.instancePointInfos, instanceIds);
+      const bool sameNodes = std::equal(
+          kdTree.getNodes().begin(),
+          kdTree.getNodes().end(),
+          assignedTree.getNodes().begin(),
+          assignedTree.getNodes().end(),
+          [](const Falcor::KDTreeCompactNode& a, const Falcor::KDTreeCompactNode& b) {
+            return std::memcmp(&a, &b, sizeof(a)) == 0;
+          });
+
+      if (!sameNodes || stats.numRebuiltNodes != assignedStats.numRebuiltNodes ||
+          kdTree.getIndices() != assignedTree.getIndices()) {
+        std::cout << "FAIL refit of assigned trees differs from the built trees" << std::endl;
+        passed = false;
+      }
+    }
+
+    // A leaf index outside of the slots of its instance
+    auto indices = kdTree.getIndices();
+    indices.front() = scene.instancePointInfos[0].pointCellOffset +
+        scene.instancePointInfos[0].maxNumPoints;
+    PointKDTree invalidTree;
+    if (invalidTree.assign(
+            kdTree.getNodes(),
+            indices,
+            kdTree.getInstanceNodeOffsets(),
+            kdTree.getInstanceIndexOffsets(),
+            kdTree.getNodeBuildSizes(),
+            scene.instancePointInfos)) {
+      std::cout << "FAIL assign() accepted a leaf index outside of its instance" << std::endl;
+      passed = false;
+    }
+
+    // Emptying a slot changes the slots of the instance, which refit has to skip
+    const auto& ipi = scene.instancePointInfos[0];
+    const auto& streams = scene.pointCells.getStreams();
+    for (uint32_t slot = ipi.pointCellOffset; slot < ipi.pointCellOffset + ipi.maxNumPoints;
+         slot++) {
+      if (streams.values[slot] >= 0.0f) {
+        streams.values[slot] = -1.0f;
+        break;
+      }
+    }
+
+    const auto stats = kdTree.refit(scene.pointCells, scene.instancePointInfos, instanceIds);
+    if (stats.numChangedInstances != 1 || stats.numInstances != (uint32_t)numInstances - 1) {
+      std::cout << "FAIL refit of an instance with an emptied slot: changed instances "
+                << stats.numChangedInstances << ", refit instances " << stats.numInstances
+                << std::endl;
+      passed = false;
+    }
+  }
+
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed ? 0 : kExitFailed;
+}
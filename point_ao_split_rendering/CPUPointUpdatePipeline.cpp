@@ -0,0 +1,577 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CPUPointUpdatePipeline.h"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include "ClientPointCodec.h"
+#include "HashFunctionShared.slang"
+
+namespace split_rendering {
+
+namespace {
+
+bool isPointValid(uint32_t posNormVal) {
+  return (posNormVal & INVALID_CELL) == 0;
+}
+
+} // namespace
+
+std::vector<uint32_t> CPUPointUpdatePipeline::FrameOutput::getNetworkCellUpdateInfo() const {
+  return ClientPointCodec::packCellUpdates(
+      cellUpdateDeltaInfos.data(), (uint32_t)cellUpdateDeltaInfos.size());
+}
+
+template <typename F>
+void CPUPointUpdatePipeline::forEach(uint32_t count, F f) const {
+  std::vector<uint32_t> ids(count);
+  std::iota(ids.begin(), ids.end(), 0);
+
+  if (settings_.parallel)
+    std::for_each(std::execution::par, ids.begin(), ids.end(), f);
+  else
+    std::for_each(ids.begin(), ids.end(), f);
+}
+
+void CPUPointUpdatePipeline::init(
+    const std::vector<Falcor::InstanceHashInfo>& instanceHashInfo,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfo,
+    const PointDataSoA& pointCells,
+    const std::vector<Falcor::CompressedClientPointData>& compressedPointCells,
+    const std::vector<Falcor::CompactHashToCellInfo>& hashEntries,
+    uint32_t numCells,
+    const std::vector<float>& diskRadiusPerInstance) {
+  instanceHashInfo_ = instanceHashInfo;
+  instancePointInfo_ = instancePointInfo;
+  diskRadiusPerInstance_ = diskRadiusPerInstance;
+
+  const uint32_t numInstances = (uint32_t)instancePointInfo_.size();
+  instanceCounters_ = std::vector<InstanceCounters>(numInstances);
+
+  for (uint32_t instanceId = 0; instanceId < numInstances; instanceId++) {
+    const auto& ipi = instancePointInfo_[instanceId];
+    auto& counters = instanceCounters_[instanceId];
+    counters.numAllocatedCells = ipi.numAllocatedCells;
+    counters.numBucketOverflows = ipi.numBucketOverflows;
+    counters.numPoolOverflows = ipi.numPoolOverflows;
+    counters.numFreeCells = ipi.numFreeCells;
+  }
+
+  // Point slots, split into the same streams as on the GPU
+  const uint32_t numPointSlots = (uint32_t)pointCells.getNumPoints();
+  const auto& streams = pointCells.getStreams();
+
+  positions_.resize(numPointSlots);
+  normals_.resize(numPointSlots);
+  tangents_.resize(numPointSlots);
+  barycentrics_.resize(numPointSlots);
+  instanceTriangleIds_.resize(numPointSlots);
+  instanceIds_.resize(numPointSlots);
+  values_.resize(numPointSlots);
+  compressedClientPoints_ = std::vector<std::atomic<uint32_t>>(numPointSlots);
+  compressedClientPointsHigh_.resize(POINT_ENCODING_WORDS > 1 ? numPointSlots : 0);
+  previousCompressedClientPoints_.resize(numPointSlots);
+
+  forEach(numPointSlots, [&](uint32_t pointSlot) {
+    positions_[pointSlot] = streams.positions[pointSlot];
+    normals_[pointSlot] = streams.normals[pointSlot];
+    tangents_[pointSlot] = streams.tangents[pointSlot];
+    barycentrics_[pointSlot] = streams.barycentrics[pointSlot];
+    instanceTriangleIds_[pointSlot] = streams.instanceTriangleIds[pointSlot];
+    instanceIds_[pointSlot] = streams.instanceIds[pointSlot];
+    values_[pointSlot] = streams.values[pointSlot];
+    setCompressedClientPoint(pointSlot, compressedPointCells[pointSlot]);
+    previousCompressedClientPoints_[pointSlot] = compressedPointCells[pointSlot];
+  });
+
+  // Hash table and the number of used entries per bucket
+  const uint32_t numHashEntries = (uint32_t)hashEntries.size();
+
+  hashRawCellIds_ = std::vector<std::atomic<uint32_t>>(numHashEntries);
+  hashEncodedIndices_ = std::vector<std::atomic<uint32_t>>(numHashEntries);
+  hashNumBuckets_ = std::vector<std::atomic<int>>(numHashEntries / FIXED_HASH_BUCKET_SIZE);
+
+  for (uint32_t entryId = 0; entryId < numHashEntries; entryId++) {
+    hashRawCellIds_[entryId] = hashEntries[entryId].rawCellId;
+    hashEncodedIndices_[entryId] = hashEntries[entryId].encodedIndex;
+
+    if (hashEntries[entryId].encodedIndex != INVALID_CELL)
+      hashNumBuckets_[entryId / FIXED_HASH_BUCKET_SIZE]++;
+  }
+
+  // Cell infos, generate() doesn't keep them on the CPU so they are rebuilt from the hash table
+  cellInfos_.assign(numCells, Falcor::CellInfo{INVALID_CELL, INVALID_CELL});
+
+  for (uint32_t instanceId = 0; instanceId < numInstances; instanceId++) {
+    const auto& ihi = instanceHashInfo_[instanceId];
+    const auto& ipi = instancePointInfo_[instanceId];
+    const uint32_t numPoolCells = ipi.maxNumPoints / ipi.cellCapacity;
+
+    for (uint32_t cell = 0; cell < numPoolCells; cell++)
+      cellInfos_[ipi.cellOffset + cell].instanceId = instanceId;
+
+    const uint32_t numInstanceEntries = ihi.hashToBucketSize * FIXED_HASH_BUCKET_SIZE;
+
+    for (uint32_t entryId = ihi.hashToBucketOffset;
+         entryId < ihi.hashToBucketOffset + numInstanceEntries;
+         entryId++) {
+      const uint32_t encodedIndex = hashEntries[entryId].encodedIndex;
+
+      if (encodedIndex != INVALID_CELL) {
+        cellInfos_[ipi.cellOffset + (encodedIndex & COMPACT_HASH_INDEX_MASK) / ipi.cellCapacity]
+            .hashEntry = entryId;
+      }
+    }
+  }
+
+  cellFreeList_.assign(numCells, 0);
+  cellDirtyFlags_ = std::vector<std::atomic<uint32_t>>(numCells);
+
+  // Every point moves at most once per frame, every cell is allocated and freed at most once
+  pointUpdateData_.resize(numPointSlots);
+  pointUpdateColdData_.resize(numPointSlots);
+  cellDirtyInfos_.resize(numCells);
+  hashDirtyInfos_.resize(2 * numCells);
+}
+
+CPUPointUpdatePipeline::FrameOutput CPUPointUpdatePipeline::execute(
+    const PointEvaluator& evaluator) {
+  FrameOutput output;
+
+  numPointUpdates_ = 0;
+  numCellUpdates_ = 0;
+  numHashUpdates_ = 0;
+  numChangedPoints_ = 0;
+  numDroppedPoints_ = 0;
+
+  // Each pass only starts after the previous one finished, same as the GPU dispatches
+  forEach(getNumPointSlots(), [&](uint32_t pointSlot) { movePoint(pointSlot, evaluator); });
+
+  forEach(numPointUpdates_, [&](uint32_t updateId) { allocatePoint(updateId); });
+
+  output.cellUpdateInfos.resize(numCellUpdates_);
+  output.cellUpdateDeltaInfos.resize(numCellUpdates_);
+  forEach(numCellUpdates_, [&](uint32_t updateId) { createCellUpdate(updateId, output); });
+
+  output.hashUpdateInfos.resize(numHashUpdates_);
+  forEach(numHashUpdates_, [&](uint32_t updateId) { createHashUpdate(updateId, output); });
+
+  output.updateInfo.numChangedPoints = numChangedPoints_;
+  output.updateInfo.numAllocatedCells = numAllocatedCells_;
+  output.updateInfo.numDroppedPoints = numDroppedPoints_;
+
+  return output;
+}
+
+// Point movement and dirty marking of PointRTAO rayGen
+void CPUPointUpdatePipeline::movePoint(uint32_t pointSlot, const PointEvaluator& evaluator) {
+  if (values_[pointSlot] < 0)
+    return;
+
+  const Falcor::PointData point = getPoint(pointSlot);
+
+  Falcor::float3 newPosition;
+  Falcor::float3 newNormal;
+  float newValue = 0.0f;
+
+  if (!evaluator(point, newPosition, newNormal, newValue))
+    return;
+
+  const uint32_t instanceId = point.instanceId;
+  const float diskRadius = DISK_RADIUS_FACTOR * diskRadiusPerInstance_[instanceId];
+
+  const auto& ipi = instancePointInfo_[instanceId];
+  const auto& ihf = instanceHashInfo_[instanceId];
+  auto& counters = instanceCounters_[instanceId];
+
+  const Falcor::float3 oldPosition = point.position;
+  const Falcor::float3 oldNormal = point.normal;
+  const float oldValue = point.value;
+
+  const float posDist = glm::length(newPosition - oldPosition);
+  const float valDist = std::abs(newValue - oldValue);
+  const float cosN = glm::dot(newNormal, oldNormal);
+
+  const float cosThreshold = settings_.updateDeltaCosThreshold;
+  const float posThreshold = settings_.updateDeltaPosFactor * diskRadius * ONE_OVER_POINT_POS_MAX;
+  const float valThreshold = settings_.updateDeltaValFactor * ONE_OVER_POINT_VAL_MAX;
+
+  const Falcor::HashData oldHashData = Falcor::getPointHashData(oldPosition, ipi, ihf, diskRadius);
+  const Falcor::HashData newHashData = Falcor::getPointHashData(newPosition, ipi, ihf, diskRadius);
+
+  if (newHashData.rawCellId == oldHashData.rawCellId && cosN > cosThreshold &&
+      posDist < posThreshold && valDist < valThreshold)
+    return;
+
+  values_[pointSlot] = newValue;
+  positions_[pointSlot] = newPosition;
+  normals_[pointSlot] = newNormal;
+
+  numChangedPoints_++;
+
+  uint32_t cellDirtyRange = 1;
+  uint32_t dirtyCellOffsets[2] = {INVALID_CELL, INVALID_CELL};
+
+  const uint32_t baseHashOffset = newHashData.hashBase + ihf.hashToBucketOffset;
+  const uint32_t oldBaseHashOffset = oldHashData.hashBase + ihf.hashToBucketOffset;
+
+  if (newHashData.rawCellId != oldHashData.rawCellId) {
+    cellDirtyRange = 2;
+
+    bool found = false;
+    bool bucketFull = true;
+
+    for (uint32_t hashBucketOffset = 0; hashBucketOffset < FIXED_HASH_BUCKET_SIZE;
+         hashBucketOffset++) {
+      const uint32_t hashEntry = baseHashOffset + hashBucketOffset;
+
+      uint32_t oldHashEntry = INVALID_CELL;
+      hashRawCellIds_[hashEntry].compare_exchange_strong(oldHashEntry, newHashData.rawCellId);
+
+      if (oldHashEntry == INVALID_CELL) {
+        bucketFull = false;
+
+        // Cells freed in previous frames are reused first, only then the pool grows
+        uint32_t cellIndex = 0;
+        const int numFreeCells = counters.numFreeCells.fetch_sub(1);
+
+        if (numFreeCells > 0) {
+          cellIndex = cellFreeList_[ipi.cellOffset + numFreeCells - 1];
+        } else {
+          counters.numFreeCells++;
+          cellIndex = counters.numAllocatedCells.fetch_add(1);
+
+          if (cellIndex >= ipi.maxNumPoints / ipi.cellCapacity) {
+            // Rolls back the counter and releases the entry, the cell is retried in a later frame
+            counters.numAllocatedCells--;
+            uint32_t claimedRawCellId = newHashData.rawCellId;
+            hashRawCellIds_[hashEntry].compare_exchange_strong(claimedRawCellId, INVALID_CELL);
+            counters.numPoolOverflows++;
+            break;
+          }
+
+          numAllocatedCells_ = counters.numAllocatedCells.load();
+        }
+
+        const uint32_t cellAllocOffset = cellIndex * ipi.cellCapacity;
+
+        hashEncodedIndices_[hashEntry] = cellAllocOffset;
+        cellInfos_[ipi.cellOffset + cellIndex].hashEntry = hashEntry;
+        hashNumBuckets_[baseHashOffset / FIXED_HASH_BUCKET_SIZE]++;
+
+        found = true;
+        dirtyCellOffsets[1] = cellAllocOffset;
+
+        hashDirtyInfos_[numHashUpdates_++] = baseHashOffset;
+        break;
+      } else if (oldHashEntry == newHashData.rawCellId) {
+        // Allocated by another point or during generation, the index is still INVALID_CELL if
+        // the allocating point ran out of point cells (or did not write it yet)
+        bucketFull = false;
+        const uint32_t encodedIndex = hashEncodedIndices_[hashEntry];
+
+        if (encodedIndex != INVALID_CELL) {
+          dirtyCellOffsets[1] = encodedIndex;
+          found = true;
+        }
+        break;
+      }
+    }
+
+    if (!found) {
+      // The point stays in its old cell with its previous data and retries in the next frame
+      if (bucketFull)
+        counters.numBucketOverflows++;
+
+      numDroppedPoints_++;
+
+      positions_[pointSlot] = oldPosition;
+      normals_[pointSlot] = oldNormal;
+      values_[pointSlot] = oldValue;
+      return;
+    }
+
+    const uint32_t updateId = numPointUpdates_++;
+    auto& pointUpdate = pointUpdateData_[updateId];
+    pointUpdate.position = newPosition;
+    pointUpdate.normal = newNormal;
+    pointUpdate.value = newValue;
+    pointUpdate.instanceId = instanceId;
+
+    auto& coldData = pointUpdateColdData_[updateId];
+    coldData.tangent = tangents_[pointSlot];
+    coldData.barycentrics = barycentrics_[pointSlot];
+    coldData.instanceTriangleId = instanceTriangleIds_[pointSlot];
+
+    // Disable the old point, its slot is reused by the allocation pass
+    values_[pointSlot] = -1.0f;
+    setCompressedClientPoint(pointSlot, Falcor::getInvalidCompressedClientData());
+  } else {
+    setCompressedClientPoint(
+        pointSlot,
+        Falcor::compressClientData(
+            positions_[pointSlot],
+            normals_[pointSlot],
+            values_[pointSlot],
+            diskRadius,
+            ipi.aabbMin));
+  }
+
+  for (uint32_t hashBucketOffset = 0; hashBucketOffset < FIXED_HASH_BUCKET_SIZE;
+       hashBucketOffset++) {
+    if (hashRawCellIds_[oldBaseHashOffset + hashBucketOffset] == oldHashData.rawCellId) {
+      dirtyCellOffsets[0] = hashEncodedIndices_[oldBaseHashOffset + hashBucketOffset];
+      break;
+    }
+  }
+
+  for (uint32_t i = 0; i < cellDirtyRange; i++) {
+    if (dirtyCellOffsets[i] == INVALID_CELL)
+      continue;
+
+    const uint32_t globalCellIndex = ipi.cellOffset + dirtyCellOffsets[i] / ipi.cellCapacity;
+
+    uint32_t oldCellStatus = CELL_NOT_DIRTY;
+    cellDirtyFlags_[globalCellIndex].compare_exchange_strong(oldCellStatus, CELL_DIRTY);
+
+    if (oldCellStatus == CELL_NOT_DIRTY)
+      cellDirtyInfos_[numCellUpdates_++] = globalCellIndex;
+  }
+}
+
+// PointCellAllocationStage
+void CPUPointUpdatePipeline::allocatePoint(uint32_t updateId) {
+  const Falcor::PointUpdateData& newPointData = pointUpdateData_[updateId];
+  const auto& ihi = instanceHashInfo_[newPointData.instanceId];
+  const auto& ipi = instancePointInfo_[newPointData.instanceId];
+  const float diskRadius = DISK_RADIUS_FACTOR * diskRadiusPerInstance_[newPointData.instanceId];
+  const Falcor::HashData newHashData =
+      Falcor::getPointHashData(newPointData.position, ipi, ihi, diskRadius);
+
+  const uint32_t baseHashOffset = newHashData.hashBase + ihi.hashToBucketOffset;
+
+  int hashIndex = -1;
+  for (uint32_t hashBucketOffset = 0; hashBucketOffset < FIXED_HASH_BUCKET_SIZE;
+       hashBucketOffset++) {
+    if (hashRawCellIds_[baseHashOffset + hashBucketOffset] == newHashData.rawCellId)
+      hashIndex = hashBucketOffset;
+  }
+
+  if (hashIndex == -1)
+    return;
+
+  const uint32_t encodedIndex = hashEncodedIndices_[baseHashOffset + hashIndex];
+
+  if (encodedIndex == INVALID_CELL)
+    return;
+
+  const uint32_t pci = encodedIndex & COMPACT_HASH_INDEX_MASK;
+
+  for (uint32_t pointCellOffset = 0; pointCellOffset < ipi.cellCapacity; pointCellOffset++) {
+    const uint32_t idx = pci + pointCellOffset + ipi.pointCellOffset;
+
+    // Clearing the invalid flag claims the first free slot, the slot is unique for this update
+    const uint32_t oldPosition = compressedClientPoints_[idx].fetch_and(~INVALID_CELL);
+
+    if (!isPointValid(oldPosition)) {
+      setCompressedClientPoint(
+          idx,
+          Falcor::compressClientData(
+              newPointData.position,
+              newPointData.normal,
+              newPointData.value,
+              diskRadius,
+              ipi.aabbMin));
+
+      positions_[idx] = newPointData.position;
+      normals_[idx] = newPointData.normal;
+      instanceIds_[idx] = newPointData.instanceId;
+      values_[idx] = newPointData.value;
+
+      const Falcor::PointUpdateColdData& coldData = pointUpdateColdData_[updateId];
+      tangents_[idx] = coldData.tangent;
+      barycentrics_[idx] = coldData.barycentrics;
+      instanceTriangleIds_[idx] = coldData.instanceTriangleId;
+      break;
+    }
+  }
+}
+
+// PointCellCreateNetworkBufferStage
+void CPUPointUpdatePipeline::createCellUpdate(uint32_t updateId, FrameOutput& output) {
+  const uint32_t globalCellIndex = cellDirtyInfos_[updateId];
+
+  const Falcor::CellInfo cellInfo = cellInfos_[globalCellIndex];
+  const auto& ipi = instancePointInfo_[cellInfo.instanceId];
+  const uint32_t cellCapacity = ipi.cellCapacity;
+  const uint32_t globalCellOffset =
+      ipi.pointCellOffset + (globalCellIndex - ipi.cellOffset) * cellCapacity;
+  FALCOR_ASSERT(globalCellOffset < MAX_POINT_SLOTS);
+
+  auto& cellUpdate = output.cellUpdateInfos[updateId];
+  auto& cellUpdateDelta = output.cellUpdateDeltaInfos[updateId];
+
+  cellUpdate.header = Falcor::encodeCellUpdateHeader(globalCellOffset, cellCapacity);
+  cellUpdateDelta.header = cellUpdate.header;
+
+  uint32_t validPointCount = 0;
+  uint32_t validCellIds[MAX_POINTS_PER_CELL];
+
+  for (uint32_t pointOffset = 0; pointOffset < cellCapacity; pointOffset++) {
+    if (values_[globalCellOffset + pointOffset] >= 0)
+      validCellIds[validPointCount++] = globalCellOffset + pointOffset;
+  }
+
+  // Reorder points so that the valid points are in front
+  for (uint32_t pointOffset = 0; pointOffset < validPointCount; pointOffset++) {
+    const uint32_t idx = pointOffset + globalCellOffset;
+    const uint32_t idx2 = validCellIds[pointOffset];
+
+    cellUpdate.cellData[pointOffset] = getCompressedClientPoint(idx2);
+    setCompressedClientPoint(idx, cellUpdate.cellData[pointOffset]);
+    positions_[idx] = positions_[idx2];
+    normals_[idx] = normals_[idx2];
+    tangents_[idx] = tangents_[idx2];
+    barycentrics_[idx] = barycentrics_[idx2];
+    instanceTriangleIds_[idx] = instanceTriangleIds_[idx2];
+    instanceIds_[idx] = instanceIds_[idx2];
+    values_[idx] = values_[idx2];
+  }
+
+  // Invalidate all the other slots
+  for (uint32_t pointOffset = validPointCount; pointOffset < cellCapacity; pointOffset++) {
+    cellUpdate.cellData[pointOffset] = Falcor::getInvalidCompressedClientData();
+    setCompressedClientPoint(globalCellOffset + pointOffset, cellUpdate.cellData[pointOffset]);
+    values_[globalCellOffset + pointOffset] = -1.0f;
+  }
+
+  // Compute delta infos and store previous' values
+  for (uint32_t pointOffset = 0; pointOffset < cellCapacity; pointOffset++) {
+    const uint32_t idx = pointOffset + globalCellOffset;
+    const Falcor::CompressedClientPointData ccpd = getCompressedClientPoint(idx);
+
+    cellUpdateDelta.cellData[pointOffset] =
+        Falcor::xorCompressedClientData(ccpd, previousCompressedClientPoints_[idx]);
+    previousCompressedClientPoints_[idx] = ccpd;
+  }
+
+  cellDirtyFlags_[globalCellIndex] = CELL_NOT_DIRTY;
+
+  // Free cells whose last point left, see PointCellCreateNetworkBufferStage.cs.slang
+  if (validPointCount == 0 && cellInfo.hashEntry != INVALID_CELL) {
+    const uint32_t bucketOffset =
+        cellInfo.hashEntry - (cellInfo.hashEntry % FIXED_HASH_BUCKET_SIZE);
+
+    hashRawCellIds_[cellInfo.hashEntry] = DELETED_CELL;
+    hashEncodedIndices_[cellInfo.hashEntry] = INVALID_CELL;
+    hashNumBuckets_[bucketOffset / FIXED_HASH_BUCKET_SIZE]--;
+    cellInfos_[globalCellIndex].hashEntry = INVALID_CELL;
+
+    const int freeListId = instanceCounters_[cellInfo.instanceId].numFreeCells.fetch_add(1);
+    cellFreeList_[ipi.cellOffset + freeListId] = globalCellIndex - ipi.cellOffset;
+
+    hashDirtyInfos_[numHashUpdates_++] = bucketOffset;
+  }
+}
+
+// PointHashCreateNetworkBufferStage
+void CPUPointUpdatePipeline::createHashUpdate(uint32_t updateId, FrameOutput& output) {
+  const uint32_t globalHashOffset = hashDirtyInfos_[updateId];
+
+  auto& hashUpdate = output.hashUpdateInfos[updateId];
+  hashUpdate.globalHashOffset = globalHashOffset;
+
+  // Valid entries first, this drops the tombstones of deleted cells
+  uint32_t validHashCount = 0;
+
+  for (uint32_t hashOffset = 0; hashOffset < FIXED_HASH_BUCKET_SIZE; hashOffset++) {
+    const uint32_t hashEntry = globalHashOffset + hashOffset;
+
+    if (hashEncodedIndices_[hashEntry] != INVALID_CELL) {
+      hashUpdate.hashData[validHashCount].rawCellId = hashRawCellIds_[hashEntry];
+      hashUpdate.hashData[validHashCount].encodedIndex = hashEncodedIndices_[hashEntry];
+      validHashCount++;
+    }
+  }
+
+  for (uint32_t hashOffset = validHashCount; hashOffset < FIXED_HASH_BUCKET_SIZE; hashOffset++) {
+    hashUpdate.hashData[hashOffset].rawCellId = INVALID_CELL;
+    hashUpdate.hashData[hashOffset].encodedIndex = INVALID_CELL;
+  }
+}
+
+std::vector<Falcor::InstancePointInfo> CPUPointUpdatePipeline::getInstancePointInfo() const {
+  std::vector<Falcor::InstancePointInfo> instancePointInfo = instancePointInfo_;
+
+  for (uint32_t instanceId = 0; instanceId < (uint32_t)instancePointInfo.size(); instanceId++) {
+    auto& ipi = instancePointInfo[instanceId];
+    const auto& counters = instanceCounters_[instanceId];
+    ipi.numAllocatedCells = counters.numAllocatedCells;
+    ipi.numBucketOverflows = counters.numBucketOverflows;
+    ipi.numPoolOverflows = counters.numPoolOverflows;
+    ipi.numFreeCells = counters.numFreeCells;
+  }
+
+  return instancePointInfo;
+}
+
+std::vector<Falcor::CompactHashToCellInfo> CPUPointUpdatePipeline::getHashToPointCell() const {
+  std::vector<Falcor::CompactHashToCellInfo> hashEntries(hashRawCellIds_.size());
+
+  for (uint32_t entryId = 0; entryId < (uint32_t)hashEntries.size(); entryId++) {
+    hashEntries[entryId].rawCellId = hashRawCellIds_[entryId];
+    hashEntries[entryId].encodedIndex = hashEncodedIndices_[entryId];
+  }
+
+  return hashEntries;
+}
+
+std::vector<Falcor::CompressedClientPointData>
+CPUPointUpdatePipeline::getCompressedClientPointCells() const {
+  std::vector<Falcor::CompressedClientPointData> points(compressedClientPoints_.size());
+
+  for (uint32_t pointSlot = 0; pointSlot < (uint32_t)points.size(); pointSlot++)
+    points[pointSlot] = getCompressedClientPoint(pointSlot);
+
+  return points;
+}
+
+Falcor::CompressedClientPointData CPUPointUpdatePipeline::getCompressedClientPoint(
+    uint32_t pointSlot) const {
+  Falcor::uint2 words(compressedClientPoints_[pointSlot], 0);
+
+  if (!compressedClientPointsHigh_.empty())
+    words.y = compressedClientPointsHigh_[pointSlot];
+
+  return Falcor::makeCompressedClientData(words);
+}
+
+void CPUPointUpdatePipeline::setCompressedClientPoint(
+    uint32_t pointSlot,
+    const Falcor::CompressedClientPointData& ccpd) {
+  const Falcor::uint2 words = Falcor::getCompressedClientWords(ccpd);
+  compressedClientPoints_[pointSlot] = words.x;
+
+  if (!compressedClientPointsHigh_.empty())
+    compressedClientPointsHigh_[pointSlot] = words.y;
+}
+
+Falcor::PointData CPUPointUpdatePipeline::getPoint(uint32_t pointSlot) const {
+  Falcor::PointData point;
+  point.position = positions_[pointSlot];
+  point.normal = normals_[pointSlot];
+  point.tangent = tangents_[pointSlot];
+  point.barycentrics = barycentrics_[pointSlot];
+  point.instanceTriangleId = instanceTriangleIds_[pointSlot];
+  point.instanceId = instanceIds_[pointSlot];
+  point.value = values_[pointSlot];
+  return point;
+}
+
+} // namespace split_rendering
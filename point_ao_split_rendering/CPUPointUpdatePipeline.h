@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "PointData.slang"
+#include "PointDataSoA.h"
+
+namespace split_rendering {
+
+// CPU implementation of the per frame point update pipeline of the server: the point movement and
+// dirty marking of PointRTAO rayGen, PointCellAllocationStage, PointCellCreateNetworkBufferStage
+// and PointHashCreateNetworkBufferStage. It keeps the same buffers as the GPU (point slots, compact
+// hash table, cell infos, free lists, dirty flags) and every Interlocked* operation of the shaders
+// is a std::atomic operation, so each pass runs multi-threaded with the same races as on the GPU.
+//
+// The new position, normal and value of the points come from a PointEvaluator instead of the
+// animated scene and raytracing. This allows running the server pipeline without a DXR GPU, and
+// serves as a golden model for the GPU passes: the frame outputs are the same buffers that the
+// network stages read back. With parallel = false all passes run in order, which makes the outputs
+// deterministic.
+class CPUPointUpdatePipeline {
+ public:
+  // Computes the new state of a point from its current data, e.g. from the animated triangle given
+  // by instanceTriangleId and barycentrics. Returning false skips the point for this frame, like
+  // points outside of the extended view in rayGen.
+  using PointEvaluator = std::function<bool(
+      const Falcor::PointData& point,
+      Falcor::float3& position,
+      Falcor::float3& normal,
+      float& value)>;
+
+  struct Settings {
+    // Same meaning and defaults as in ServerPointRenderer
+    float updateDeltaCosThreshold = 0.6f;
+    float updateDeltaPosFactor = 3.0f;
+    float updateDeltaValFactor = 8.0f;
+    bool parallel = true;
+  };
+
+  // Contents of the GPU buffers after all passes of a frame
+  struct FrameOutput {
+    Falcor::PerFrameUpdateInfo updateInfo = {};
+    std::vector<Falcor::CellUpdateInfo> cellUpdateInfos;
+    std::vector<Falcor::CellUpdateInfo> cellUpdateDeltaInfos;
+    std::vector<Falcor::HashUpdateInfo> hashUpdateInfos;
+
+    // Cell updates as sent to the client, see ClientPointCodec::packCellUpdates
+    std::vector<uint32_t> getNetworkCellUpdateInfo() const;
+  };
+
+  // Copies the point structures before any frame, e.g. the CPU copies of PointServerHashGenerator
+  // right after generate(). Cell infos are rebuilt from the hash table.
+  void init(
+      const std::vector<Falcor::InstanceHashInfo>& instanceHashInfo,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfo,
+      const PointDataSoA& pointCells,
+      const std::vector<Falcor::CompressedClientPointData>& compressedPointCells,
+      const std::vector<Falcor::CompactHashToCellInfo>& hashEntries,
+      uint32_t numCells,
+      const std::vector<float>& diskRadiusPerInstance);
+
+  // Runs all passes for one frame
+  FrameOutput execute(const PointEvaluator& evaluator);
+
+  Settings settings_;
+
+  // Current state, the atomic counters are included in the instance infos
+  std::vector<Falcor::InstancePointInfo> getInstancePointInfo() const;
+  std::vector<Falcor::CompactHashToCellInfo> getHashToPointCell() const;
+  std::vector<Falcor::CompressedClientPointData> getCompressedClientPointCells() const;
+  Falcor::PointData getPoint(uint32_t pointSlot) const;
+
+  uint32_t getNumPointSlots() const {
+    return (uint32_t)values_.size();
+  }
+
+ private:
+  // Per instance counters that the shaders modify with atomics
+  struct InstanceCounters {
+    std::atomic<uint32_t> numAllocatedCells = 0;
+    std::atomic<uint32_t> numBucketOverflows = 0;
+    std::atomic<uint32_t> numPoolOverflows = 0;
+    std::atomic<int> numFreeCells = 0;
+  };
+
+  // Runs f(0) ... f(count - 1), in parallel if enabled
+  template <typename F>
+  void forEach(uint32_t count, F f) const;
+
+  void movePoint(uint32_t pointSlot, const PointEvaluator& evaluator);
+  void allocatePoint(uint32_t updateId);
+  void createCellUpdate(uint32_t updateId, FrameOutput& output);
+  void createHashUpdate(uint32_t updateId, FrameOutput& output);
+
+  Falcor::CompressedClientPointData getCompressedClientPoint(uint32_t pointSlot) const;
+  void setCompressedClientPoint(uint32_t pointSlot, const Falcor::CompressedClientPointData& ccpd);
+
+  std::vector<Falcor::InstanceHashInfo> instanceHashInfo_;
+  std::vector<Falcor::InstancePointInfo> instancePointInfo_;
+  std::vector<InstanceCounters> instanceCounters_;
+  std::vector<float> diskRadiusPerInstance_;
+
+  // Point slots (serverAO* streams and the compressed client points)
+  std::vector<Falcor::float3> positions_;
+  std::vector<Falcor::float3> normals_;
+  std::vector<Falcor::float3> tangents_;
+  std::vector<Falcor::float2> barycentrics_;
+  std::vector<uint32_t> instanceTriangleIds_;
+  std::vector<uint32_t> instanceIds_;
+  std::vector<float> values_;
+  // First word of the compressed client points (holds the valid bit that allocatePoint claims
+  // atomically) and the second word of the wider point encodings (empty for the compact one)
+  std::vector<std::atomic<uint32_t>> compressedClientPoints_;
+  std::vector<uint32_t> compressedClientPointsHigh_;
+  std::vector<Falcor::CompressedClientPointData> previousCompressedClientPoints_;
+
+  // Hash table
+  std::vector<std::atomic<uint32_t>> hashRawCellIds_;
+  std::vector<std::atomic<uint32_t>> hashEncodedIndices_;
+  std::vector<std::atomic<int>> hashNumBuckets_;
+
+  // Per cell
+  std::vector<Falcor::CellInfo> cellInfos_;
+  std::vector<uint32_t> cellFreeList_;
+  std::vector<std::atomic<uint32_t>> cellDirtyFlags_;
+
+  // Work lists between the passes, with their indirect dispatch counts
+  std::vector<Falcor::PointUpdateData> pointUpdateData_;
+  std::vector<Falcor::PointUpdateColdData> pointUpdateColdData_;
+  std::vector<uint32_t> cellDirtyInfos_;
+  std::vector<uint32_t> hashDirtyInfos_;
+  std::atomic<uint32_t> numPointUpdates_ = 0;
+  std::atomic<uint32_t> numCellUpdates_ = 0;
+  std::atomic<uint32_t> numHashUpdates_ = 0;
+
+  std::atomic<uint32_t> numChangedPoints_ = 0;
+  std::atomic<uint32_t> numAllocatedCells_ = 0;
+  std::atomic<uint32_t> numDroppedPoints_ = 0;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless check of CPUPointUpdatePipeline. A lattice with one point per grid cell is laid out like
+// PointServerHashGenerator::generate does and moved through the grid for a number of frames. After
+// every frame the point structures have to be consistent (every point exactly once, in the cell of
+// its position, with a matching compressed client point), and a client that only applies the
+// packed cell updates and the hash updates has to end up with the same points and hash table as
+// the server. The sequential and the parallel pipeline have to place the same points. The batch
+// kernels of ClientPointCodec, which compress the initial points, have to be bit exact with the
+// scalar functions (ClientPointCodec::verify). With a small --pool_headroom, points that find no
+// free cell are deferred, and their claimed hash entries have to be released again since nothing
+// grows the pool here.
+//
+// Example usage:
+// $ ./CPUPointUpdateTest --frames 20 --cell_capacity 7 --hash_type 0
+//
+// Exit codes: 0 if all checks pass, 1 if a check fails, 2 for invalid arguments.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "CPUPointUpdatePipeline.h"
+#include "ClientPointCodec.h"
+#include "HashFunctionShared.slang"
+#include "PointDataSoA.h"
+#include "argparse.hpp"
+
+using split_rendering::CPUPointUpdatePipeline;
+using split_rendering::PointDataSoA;
+
+namespace {
+
+const int kExitFailed = 1;
+const int kExitInvalid = 2;
+
+// Grid cells have a size of 1 (DISK_RADIUS_FACTOR * kDiskRadius)
+const float kDiskRadius = 1.0f / DISK_RADIUS_FACTOR;
+const uint32_t kGridDim = 64;
+const float kLatticeOffset = 4.0f;
+
+// Point structures of one instance before the first frame, in the layout of
+// PointServerHashGenerator::generate
+struct TestScene {
+  std::vector<Falcor::InstanceHashInfo> instanceHashInfo;
+  std::vector<Falcor::InstancePointInfo> instancePointInfo;
+  PointDataSoA pointCells;
+  std::vector<Falcor::CompressedClientPointData> compressedPointCells;
+  std::vector<Falcor::CompactHashToCellInfo> hashEntries;
+  uint32_t numCells = 0;
+  std::vector<float> diskRadiusPerInstance;
+  uint32_t numPoints = 0;
+};
+
+// Position of a lattice point in a frame, points are identified by their instanceTriangleId
+Falcor::float3 getLatticePosition(uint32_t pointId, uint32_t latticeSize, float offset) {
+  const uint32_t x = pointId % latticeSize;
+  const uint32_t y = (pointId / latticeSize) % latticeSize;
+  const uint32_t z = pointId / (latticeSize * latticeSize);
+  return Falcor::float3(kLatticeOffset + 0.5f) + Falcor::float3(x, y, z) +
+      Falcor::float3(offset, 0.0f, 0.0f);
+}
+
+Falcor::int3 getCellCoords(const Falcor::float3& position, const Falcor::float3& aabbMin) {
+  return Falcor::int3((position - aabbMin) / (DISK_RADIUS_FACTOR * kDiskRadius));
+}
+
+void createTestScene(
+    uint32_t latticeSize,
+    uint32_t cellCapacity,
+    int hashType,
+    uint32_t poolHeadroom,
+    TestScene& scene) {
+  const uint32_t numPoints = latticeSize * latticeSize * latticeSize;
+  const float diskRadius = DISK_RADIUS_FACTOR * kDiskRadius;
+
+  // Points move into new cells before their old cells are freed, so the pool needs about twice the
+  // cells to never overflow. The hash table is large enough that the tombstones of the freed cells
+  // never fill a bucket.
+  uint32_t hashTableSize = 1;
+  while (hashTableSize < 8 * numPoints)
+    hashTableSize *= 2;
+
+  Falcor::InstancePointInfo ipi = {};
+  ipi.pointCellOffset = 0;
+  ipi.cellOffset = 0;
+  ipi.cellCapacity = cellCapacity;
+  ipi.maxNumPoints = (numPoints + poolHeadroom) * cellCapacity;
+  ipi.aabbMin = Falcor::float3(0.0f);
+  ipi.aabbMax = Falcor::float3((float)kGridDim * diskRadius);
+  ipi.gridDim = Falcor::uint3(kGridDim);
+
+  Falcor::InstanceHashInfo ihi = {};
+  ihi.hashToBucketOffset = 0;
+  ihi.hashToBucketSize = hashTableSize;
+  ihi.aabbMin = ipi.aabbMin;
+  ihi.aabbMax = ipi.aabbMax;
+  ihi.gridDim = ipi.gridDim;
+  ihi.hashType = hashType;
+
+  scene.numCells = ipi.maxNumPoints / cellCapacity;
+  scene.numPoints = numPoints;
+  scene.diskRadiusPerInstance = {kDiskRadius};
+  scene.hashEntries.assign(hashTableSize * FIXED_HASH_BUCKET_SIZE, {});
+  scene.pointCells.allocate(ipi.maxNumPoints);
+  scene.pointCells.fill(Falcor::PointData());
+
+  for (uint32_t pointId = 0; pointId < numPoints; pointId++) {
+    Falcor::PointData point;
+    point.position = getLatticePosition(pointId, latticeSize, 0.0f);
+    point.normal = Falcor::float3(0.0f, 0.0f, 1.0f);
+    point.tangent = Falcor::float3(1.0f, 0.0f, 0.0f);
+    point.barycentrics = Falcor::float2(0.25f);
+    point.instanceTriangleId = pointId;
+    point.instanceId = 0;
+    point.value = 0.5f;
+
+    const Falcor::HashData hd = Falcor::getPointHashData(point.position, ipi, ihi, diskRadius);
+
+    // Every point has its own cell, so it always takes the first free entry of its bucket
+    uint32_t hashEntry = hd.hashBase;
+    while (hashEntry < hd.hashBase + FIXED_HASH_BUCKET_SIZE &&
+           scene.hashEntries[hashEntry].rawCellId != INVALID_CELL)
+      hashEntry++;
+    if (hashEntry >= hd.hashBase + FIXED_HASH_BUCKET_SIZE) {
+      std::cout << "initial hash bucket overflow" << std::endl;
+      continue;
+    }
+
+    scene.hashEntries[hashEntry].rawCellId = hd.rawCellId;
+    scene.hashEntries[hashEntry].encodedIndex = ipi.numAllocatedCells * cellCapacity;
+    scene.pointCells.set(ipi.numAllocatedCells * cellCapacity, point);
+    ipi.numAllocatedCells++;
+  }
+
+  const auto& streams = scene.pointCells.getStreams();
+  scene.compressedPointCells.assign(ipi.maxNumPoints, {});
+  split_rendering::ClientPointCodec::compressSlots(
+      streams.positions,
+      streams.normals,
+      streams.values,
+      ipi.maxNumPoints,
+      diskRadius,
+      ipi.aabbMin,
+      scene.compressedPointCells.data());
+
+  scene.instanceHashInfo = {ihi};
+  scene.instancePointInfo = {ipi};
+}
+
+// Client copies of the point slots and the hash table, only updated from the network messages
+struct ClientMirror {
+  std::vector<Falcor::CompressedClientPointData> points;
+  std::vector<Falcor::CompactHashToCellInfo> hashEntries;
+
+  void apply(const CPUPointUpdatePipeline::FrameOutput& output) {
+    const std::vector<uint32_t> cellUpdates = output.getNetworkCellUpdateInfo();
+
+    for (size_t word = 0; word < cellUpdates.size();) {
+      const uint32_t header = cellUpdates[word++];
+      const uint32_t pointOffset = Falcor::getCellUpdatePointOffset(header);
+
+      for (uint32_t i = 0; i < Falcor::getCellUpdateCapacity(header); i++) {
+        Falcor::uint2 delta(cellUpdates[word], 0);
+        if (POINT_ENCODING_WORDS > 1)
+          delta.y = cellUpdates[word + 1];
+        word += POINT_ENCODING_WORDS;
+
+        auto& point = points[pointOffset + i];
+        point = Falcor::xorCompressedClientData(point, Falcor::makeCompressedClientData(delta));
+      }
+    }
+
+    for (const auto& hashUpdate : output.hashUpdateInfos) {
+      std::copy(
+          hashUpdate.hashData,
+          hashUpdate.hashData + FIXED_HASH_BUCKET_SIZE,
+          hashEntries.begin() + hashUpdate.globalHashOffset);
+    }
+  }
+};
+
+bool isLive(const Falcor::CompactHashToCellInfo& entry) {
+  return entry.rawCellId != INVALID_CELL && entry.rawCellId != DELETED_CELL &&
+      entry.encodedIndex != INVALID_CELL;
+}
+
+// Live entries of a bucket, sorted, so that tables with and without tombstones can be compared
+std::vector<std::pair<uint32_t, uint32_t>> getLiveEntries(
+    const std::vector<Falcor::CompactHashToCellInfo>& hashEntries,
+    uint32_t bucket) {
+  std::vector<std::pair<uint32_t, uint32_t>> entries;
+  for (uint32_t i = 0; i < FIXED_HASH_BUCKET_SIZE; i++) {
+    const auto& entry = hashEntries[bucket * FIXED_HASH_BUCKET_SIZE + i];
+    if (isLive(entry))
+      entries.push_back({entry.rawCellId, entry.encodedIndex});
+  }
+  std::sort(entries.begin(), entries.end());
+  return entries;
+}
+
+// Checks the state of the pipeline after a frame, prints the first failures. Returns the position
+// of every point by its id.
+bool checkFrame(
+    const CPUPointUpdatePipeline& pipeline,
+    const Falcor::InstanceHashInfo& instanceHashInfo,
+    const ClientMirror& client,
+    uint32_t frame,
+    uint32_t numPoints,
+    const std::vector<Falcor::float3>& expectedPositions,
+    bool checkPositions,
+    std::vector<Falcor::float3>& positions) {
+  const float diskRadius = DISK_RADIUS_FACTOR * kDiskRadius;
+  const auto ipi = pipeline.getInstancePointInfo()[0];
+  const auto hashEntries = pipeline.getHashToPointCell();
+  const auto compressedPoints = pipeline.getCompressedClientPointCells();
+  const float posThreshold =
+      CPUPointUpdatePipeline::Settings().updateDeltaPosFactor * diskRadius * ONE_OVER_POINT_POS_MAX;
+
+  uint32_t numFailures = 0;
+  const auto fail = [&](const std::string& message) {
+    if (numFailures++ < 10)
+      std::cout << "FAIL frame " << frame << ": " << message << std::endl;
+  };
+
+  positions.assign(numPoints, Falcor::float3(-1.0f));
+  std::vector<uint32_t> numSlotsPerPoint(numPoints, 0);
+
+  for (uint32_t slot = 0; slot < pipeline.getNumPointSlots(); slot++) {
+    const Falcor::PointData point = pipeline.getPoint(slot);
+    const bool valid = point.value >= 0.0f;
+
+    if (valid != ((compressedPoints[slot].posNormVal & INVALID_CELL) == 0))
+      fail("slot " + std::to_string(slot) + " has a mismatching compressed client point");
+
+    if (!valid)
+      continue;
+
+    if (point.instanceTriangleId >= numPoints) {
+      fail("slot " + std::to_string(slot) + " holds an unknown point");
+      continue;
+    }
+
+    numSlotsPerPoint[point.instanceTriangleId]++;
+    positions[point.instanceTriangleId] = point.position;
+
+    // The slot has to belong to the cell that the hash table maps the position to
+    const Falcor::HashData hd =
+        Falcor::getPointHashData(point.position, ipi, instanceHashInfo, diskRadius);
+    bool inHashCell = false;
+    for (uint32_t i = 0; i < FIXED_HASH_BUCKET_SIZE; i++) {
+      const auto& entry = hashEntries[hd.hashBase + i];
+      if (isLive(entry) && entry.rawCellId == hd.rawCellId)
+        inHashCell = entry.encodedIndex / ipi.cellCapacity == slot / ipi.cellCapacity;
+    }
+    if (!inHashCell)
+      fail("slot " + std::to_string(slot) + " is not in the hash cell of its position");
+
+    const Falcor::float3 decoded = Falcor::decompressClientData(
+                                       compressedPoints[slot],
+                                       Falcor::uint3(getCellCoords(point.position, ipi.aabbMin)),
+                                       diskRadius,
+                                       ipi.aabbMin)
+                                       .position;
+    if (glm::length(decoded - point.position) > 2.0f * diskRadius * ONE_OVER_POINT_POS_MAX)
+      fail("point " + std::to_string(point.instanceTriangleId) + " decodes to another position");
+
+    if (checkPositions &&
+        glm::length(point.position - expectedPositions[point.instanceTriangleId]) > posThreshold)
+      fail("point " + std::to_string(point.instanceTriangleId) + " was not updated");
+  }
+
+  for (uint32_t pointId = 0; pointId < numPoints; pointId++) {
+    if (numSlotsPerPoint[pointId] != 1) {
+      fail(
+          "point " + std::to_string(pointId) + " is in " +
+          std::to_string(numSlotsPerPoint[pointId]) + " slots");
+    }
+  }
+
+  if (client.points.size() != compressedPoints.size()) {
+    fail("client has a different number of point slots");
+  } else {
+    for (uint32_t slot = 0; slot < compressedPoints.size(); slot++) {
+      const Falcor::uint2 serverWords = Falcor::getCompressedClientWords(compressedPoints[slot]);
+      const Falcor::uint2 clientWords = Falcor::getCompressedClientWords(client.points[slot]);
+      if (serverWords != clientWords)
+        fail("client point slot " + std::to_string(slot) + " differs from the server");
+    }
+  }
+
+  for (uint32_t bucket = 0; bucket < hashEntries.size() / FIXED_HASH_BUCKET_SIZE; bucket++) {
+    if (getLiveEntries(hashEntries, bucket) != getLiveEntries(client.hashEntries, bucket))
+      fail("client hash bucket " + std::to_string(bucket) + " differs from the server");
+  }
+
+  // Failed allocations have to release their entries, or the cells stay blocked without a pool grow
+  for (uint32_t entry = 0; entry < hashEntries.size(); entry++) {
+    const auto& hashEntry = hashEntries[entry];
+    if (hashEntry.rawCellId != INVALID_CELL && hashEntry.rawCellId != DELETED_CELL &&
+        hashEntry.encodedIndex == INVALID_CELL)
+      fail("hash entry " + std::to_string(entry) + " has no point cell");
+  }
+
+  if (ipi.numAllocatedCells > ipi.maxNumPoints / ipi.cellCapacity)
+    fail(std::to_string(ipi.numAllocatedCells) + " allocated cells exceed the pool");
+
+  return numFailures == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("CPUPointUpdateTest");
+
+  args.add_argument("--frames").help("frames to run").default_value(12).scan<'d', int>();
+  args.add_argument("--lattice_size")
+      .help("points per axis of the lattice, one point per grid cell")
+      .default_value(16)
+      .scan<'d', int>();
+  args.add_argument("--velocity")
+      .help("cells per frame the lattice moves along x")
+      .default_value(0.3f)
+      .scan<'f', float>();
+  args.add_argument("--cell_capacity")
+      .help("points per cell (3, 7, 15)")
+      .default_value(MIN_POINTS_PER_CELL)
+      .scan<'d', int>();
+  args.add_argument("--hash_type")
+      .help("hash function, 0: linear, 1: morton, 2: xorshift")
+      .default_value(HASH_TYPE_XORSHIFT)
+      .scan<'d', int>();
+  args.add_argument("--pool_headroom")
+      .help("cells in the pool on top of one per point, -1 makes the pool large enough")
+      .default_value(-1)
+      .scan<'d', int>();
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const int numFrames = args.get<int>("--frames");
+  const int latticeSize = args.get<int>("--lattice_size");
+  const float velocity = args.get<float>("--velocity");
+  const int cellCapacity = args.get<int>("--cell_capacity");
+  const int hashType = args.get<int>("--hash_type");
+  const int poolHeadroom = args.get<int>("--pool_headroom");
+
+  if (numFrames < 1 || latticeSize < 1 || cellCapacity < 1 || cellCapacity > MAX_POINTS_PER_CELL ||
+      hashType < 0 || hashType >= NUM_HASH_TYPES || poolHeadroom < -1 ||
+      kLatticeOffset + latticeSize + velocity * numFrames >= kGridDim - 1) {
+    std::cerr << "invalid arguments, the lattice has to stay inside of the " << kGridDim
+              << " cells of the grid" << std::endl;
+    return kExitInvalid;
+  }
+
+  bool passed = split_rendering::ClientPointCodec::verify(1 << 16, 1, std::cout) == 0;
+  std::vector<std::vector<Falcor::float3>> finalPositions;
+
+  for (bool parallel : {false, true}) {
+    TestScene scene;
+    const uint32_t numPoints = (uint32_t)(latticeSize * latticeSize * latticeSize);
+    createTestScene(
+        (uint32_t)latticeSize,
+        (uint32_t)cellCapacity,
+        hashType,
+        poolHeadroom < 0 ? numPoints + 128 : (uint32_t)poolHeadroom,
+        scene);
+
+    CPUPointUpdatePipeline pipeline;
+    pipeline.settings_.parallel = parallel;
+    pipeline.init(
+        scene.instanceHashInfo,
+        scene.instancePointInfo,
+        scene.pointCells,
+        scene.compressedPointCells,
+        scene.hashEntries,
+        scene.numCells,
+        scene.diskRadiusPerInstance);
+
+    ClientMirror client{scene.compressedPointCells, scene.hashEntries};
+    std::vector<Falcor::float3> expectedPositions(scene.numPoints);
+    std::vector<Falcor::float3> positions;
+    uint32_t numDroppedPoints = 0;
+    uint32_t numChangedPoints = 0;
+
+    for (int frame = 1; frame <= numFrames; frame++) {
+      for (uint32_t pointId = 0; pointId < scene.numPoints; pointId++) {
+        expectedPositions[pointId] =
+            getLatticePosition(pointId, (uint32_t)latticeSize, velocity * frame);
+      }
+
+      const auto output = pipeline.execute([&](const Falcor::PointData& point,
+                                               Falcor::float3& position,
+                                               Falcor::float3& normal,
+                                               float& value) {
+        position = expectedPositions[point.instanceTriangleId];
+        normal = point.normal;
+        value = point.value;
+        return true;
+      });
+
+      client.apply(output);
+      numDroppedPoints += output.updateInfo.numDroppedPoints;
+      numChangedPoints += output.updateInfo.numChangedPoints;
+
+      // Dropped points keep their old position until a later frame
+      passed &= checkFrame(
+          pipeline,
+          scene.instanceHashInfo[0],
+          client,
+          frame,
+          scene.numPoints,
+          expectedPositions,
+          numDroppedPoints == 0,
+          positions);
+    }
+
+    std::cout << (parallel ? "parallel" : "sequential") << ": " << numFrames << " frames, "
+              << scene.numPoints << " points, changed " << numChangedPoints << ", dropped "
+              << numDroppedPoints << ", pool overflows "
+              << pipeline.getInstancePointInfo()[0].numPoolOverflows << std::endl;
+
+    finalPositions.push_back(positions);
+  }
+
+  if (finalPositions[0] != finalPositions[1]) {
+    std::cout << "FAIL the sequential and the parallel pipeline placed different points"
+              << std::endl;
+    passed = false;
+  }
+
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed ? 0 : kExitFailed;
+}
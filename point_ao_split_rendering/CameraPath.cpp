@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CameraPath.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace split_rendering {
+
+namespace {
+
+using Float3 = std::array<float, 3>;
+using Quaternion = std::array<float, 4>;
+
+const float kSqrt2 = 1.41421356f;
+const uint32_t kComponentBits = 10;
+const uint32_t kComponentMax = (1u << kComponentBits) - 1;
+
+Float3 cross(const Float3& a, const Float3& b) {
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+Float3 normalize(const Float3& v) {
+  float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  if (length == 0.0f)
+    return v;
+  return {v[0] / length, v[1] / length, v[2] / length};
+}
+
+Quaternion normalize(const Quaternion& q) {
+  float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  if (length == 0.0f)
+    return {0.0f, 0.0f, 0.0f, 1.0f};
+  return {q[0] / length, q[1] / length, q[2] / length, q[3] / length};
+}
+
+Float3 rotate(const Quaternion& q, const Float3& v) {
+  // v + 2w (q x v) + 2 q x (q x v)
+  Float3 axis = {q[0], q[1], q[2]};
+  Float3 t = cross(axis, v);
+  t = {2.0f * t[0], 2.0f * t[1], 2.0f * t[2]};
+  Float3 u = cross(axis, t);
+  return {v[0] + q[3] * t[0] + u[0], v[1] + q[3] * t[1] + u[1], v[2] + q[3] * t[2] + u[2]};
+}
+
+Quaternion slerp(const Quaternion& a, Quaternion b, float alpha) {
+  float cosAngle = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+
+  // Take the shorter arc
+  if (cosAngle < 0.0f) {
+    cosAngle = -cosAngle;
+    b = {-b[0], -b[1], -b[2], -b[3]};
+  }
+
+  float weightA = 1.0f - alpha;
+  float weightB = alpha;
+
+  // Linear interpolation is accurate enough for small angles and avoids the division by ~0
+  if (cosAngle < 0.9995f) {
+    float angle = std::acos(cosAngle);
+    float sinAngle = std::sin(angle);
+    weightA = std::sin((1.0f - alpha) * angle) / sinAngle;
+    weightB = std::sin(alpha * angle) / sinAngle;
+  }
+
+  return normalize(Quaternion{
+      weightA * a[0] + weightB * b[0],
+      weightA * a[1] + weightB * b[1],
+      weightA * a[2] + weightB * b[2],
+      weightA * a[3] + weightB * b[3]});
+}
+
+// Smallest three: the largest component is dropped (and made positive, q and -q are the same
+// rotation), the others are within +-1/sqrt(2)
+uint32_t encodeQuaternion(Quaternion q) {
+  q = normalize(q);
+
+  uint32_t largest = 0;
+  for (uint32_t i = 1; i < 4; i++) {
+    if (std::abs(q[i]) > std::abs(q[largest]))
+      largest = i;
+  }
+
+  float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+  uint32_t packed = largest << (3 * kComponentBits);
+  uint32_t shift = 2 * kComponentBits;
+
+  for (uint32_t i = 0; i < 4; i++) {
+    if (i == largest)
+      continue;
+
+    float normalized = std::clamp(sign * q[i] * kSqrt2 * 0.5f + 0.5f, 0.0f, 1.0f);
+    packed |= (uint32_t)std::lround(normalized * kComponentMax) << shift;
+    shift -= kComponentBits;
+  }
+
+  return packed;
+}
+
+Quaternion decodeQuaternion(uint32_t packed) {
+  uint32_t largest = packed >> (3 * kComponentBits);
+  uint32_t shift = 2 * kComponentBits;
+
+  Quaternion q;
+  float sumOfSquares = 0.0f;
+
+  for (uint32_t i = 0; i < 4; i++) {
+    if (i == largest)
+      continue;
+
+    float normalized = (float)((packed >> shift) & kComponentMax) / kComponentMax;
+    q[i] = (normalized - 0.5f) * 2.0f / kSqrt2;
+    sumOfSquares += q[i] * q[i];
+    shift -= kComponentBits;
+  }
+
+  q[largest] = std::sqrt(std::max(1.0f - sumOfSquares, 0.0f));
+  return normalize(q);
+}
+
+CameraPathPose toPose(const float position[3], uint32_t orientation) {
+  CameraPathPose pose;
+  pose.position = {position[0], position[1], position[2]};
+  pose.orientation = decodeQuaternion(orientation);
+  return pose;
+}
+
+CameraPathPose interpolate(const CameraPathPose& a, const CameraPathPose& b, float alpha) {
+  CameraPathPose pose;
+  for (int i = 0; i < 3; i++)
+    pose.position[i] = a.position[i] + (b.position[i] - a.position[i]) * alpha;
+  pose.orientation = slerp(a.orientation, b.orientation, alpha);
+  return pose;
+}
+
+void storePose(const CameraPathPose& pose, float position[3], uint32_t& orientation) {
+  std::memcpy(position, pose.position.data(), sizeof(float) * 3);
+  orientation = encodeQuaternion(pose.orientation);
+}
+
+} // namespace
+
+Float3 CameraPathPose::getForward() const {
+  return rotate(orientation, {0.0f, 0.0f, -1.0f});
+}
+
+Float3 CameraPathPose::getUp() const {
+  return rotate(orientation, {0.0f, 1.0f, 0.0f});
+}
+
+Float3 CameraPathPose::getTarget() const {
+  Float3 forward = getForward();
+  return {position[0] + forward[0], position[1] + forward[1], position[2] + forward[2]};
+}
+
+CameraPathPose CameraPathPose::fromLookAt(
+    const Float3& position,
+    const Float3& target,
+    const Float3& up) {
+  Float3 forward =
+      normalize(Float3{target[0] - position[0], target[1] - position[1], target[2] - position[2]});
+  Float3 right = normalize(cross(forward, up));
+  Float3 trueUp = cross(right, forward);
+
+  // Columns of the rotation matrix are right, up and -forward
+  float m[3][3] = {
+      {right[0], trueUp[0], -forward[0]},
+      {right[1], trueUp[1], -forward[1]},
+      {right[2], trueUp[2], -forward[2]}};
+
+  Quaternion q;
+  float trace = m[0][0] + m[1][1] + m[2][2];
+  if (trace > 0.0f) {
+    float s = std::sqrt(trace + 1.0f) * 2.0f;
+    q = {(m[2][1] - m[1][2]) / s, (m[0][2] - m[2][0]) / s, (m[1][0] - m[0][1]) / s, 0.25f * s};
+  } else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+    float s = std::sqrt(1.0f + m[0][0] - m[1][1] - m[2][2]) * 2.0f;
+    q = {0.25f * s, (m[0][1] + m[1][0]) / s, (m[0][2] + m[2][0]) / s, (m[2][1] - m[1][2]) / s};
+  } else if (m[1][1] > m[2][2]) {
+    float s = std::sqrt(1.0f + m[1][1] - m[0][0] - m[2][2]) * 2.0f;
+    q = {(m[0][1] + m[1][0]) / s, 0.25f * s, (m[1][2] + m[2][1]) / s, (m[0][2] - m[2][0]) / s};
+  } else {
+    float s = std::sqrt(1.0f + m[2][2] - m[0][0] - m[1][1]) * 2.0f;
+    q = {(m[0][2] + m[2][0]) / s, (m[1][2] + m[2][1]) / s, 0.25f * s, (m[1][0] - m[0][1]) / s};
+  }
+
+  CameraPathPose pose;
+  pose.position = position;
+  pose.orientation = normalize(q);
+  return pose;
+}
+
+CameraPath::~CameraPath() {
+  close();
+}
+
+bool CameraPath::open(const std::string& filename, float legacyFrameTime) {
+  close();
+
+  if (!file_.open(filename)) {
+    std::cout << "could not open camera path " << filename << std::endl;
+    return false;
+  }
+
+  const uint8_t* mappedData = file_.getData();
+  size_t mappedSize = file_.getSize();
+
+  CameraPathFileHeader header;
+  if (mappedSize >= sizeof(header))
+    std::memcpy(&header, mappedData, sizeof(header));
+
+  if (mappedSize < sizeof(header) || header.magic != CameraPathFileHeader::kMagic) {
+    // Legacy: int count, count x row-major rmcv::mat4 whose transpose is the view matrix
+    int32_t count = 0;
+    if (mappedSize >= sizeof(count))
+      std::memcpy(&count, mappedData, sizeof(count));
+
+    if (count <= 0 || mappedSize < sizeof(count) + sizeof(float) * 16 * count) {
+      std::cout << "invalid camera path " << filename << std::endl;
+      close();
+      return false;
+    }
+
+    legacyKeys_.resize(count);
+    for (int32_t i = 0; i < count; i++) {
+      float m[4][4];
+      std::memcpy(m, mappedData + sizeof(count) + sizeof(m) * i, sizeof(m));
+
+      // The inverse of the (rigid) view matrix is the camera to world transform
+      Float3 position;
+      for (int r = 0; r < 3; r++)
+        position[r] = -(m[r][0] * m[3][0] + m[r][1] * m[3][1] + m[r][2] * m[3][2]);
+      Float3 forward = {-m[0][2], -m[1][2], -m[2][2]};
+      Float3 up = {m[0][1], m[1][1], m[2][1]};
+
+      CameraPathPose pose = CameraPathPose::fromLookAt(
+          position,
+          {position[0] + forward[0], position[1] + forward[1], position[2] + forward[2]},
+          up);
+
+      legacyKeys_[i].time = legacyFrameTime * i;
+      storePose(pose, legacyKeys_[i].position, legacyKeys_[i].orientation);
+    }
+
+    // The keys are in memory now
+    file_.close();
+
+    numKeys_ = (uint32_t)count;
+    keys_ = reinterpret_cast<const uint8_t*>(legacyKeys_.data());
+    keyStride_ = sizeof(CameraPathKey);
+    duration_ = legacyKeys_.back().time;
+    return true;
+  }
+
+  bool valid = header.version <= CameraPathFileHeader::kVersion && header.numKeys > 0 &&
+      header.keySize >= sizeof(CameraPathKey) &&
+      header.keyOffset + (uint64_t)header.keySize * header.numKeys <= mappedSize;
+
+  bool stereo = header.flags & CameraPathFileHeader::kFlagStereo;
+  if (stereo) {
+    valid &= header.eyeKeySize >= sizeof(CameraPathEyeKeys) &&
+        header.eyeKeyOffset + (uint64_t)header.eyeKeySize * header.numKeys <= mappedSize;
+  }
+
+  if (!valid) {
+    std::cout << "invalid camera path " << filename << " (version " << header.version << ")"
+              << std::endl;
+    close();
+    return false;
+  }
+
+  numKeys_ = header.numKeys;
+  keys_ = mappedData + header.keyOffset;
+  keyStride_ = header.keySize;
+  eyeKeys_ = stereo ? mappedData + header.eyeKeyOffset : nullptr;
+  eyeKeyStride_ = header.eyeKeySize;
+  duration_ = header.duration;
+  return true;
+}
+
+void CameraPath::close() {
+  file_.close();
+  legacyKeys_.clear();
+  numKeys_ = 0;
+  duration_ = 0.0;
+  keys_ = nullptr;
+  eyeKeys_ = nullptr;
+}
+
+CameraPathPose CameraPath::getKeyPose(uint32_t index) const {
+  CameraPathKey key = getKey(index);
+  return toPose(key.position, key.orientation);
+}
+
+CameraPathKey CameraPath::getKey(uint32_t index) const {
+  CameraPathKey key;
+  std::memcpy(&key, keys_ + keyStride_ * index, sizeof(key));
+  return key;
+}
+
+CameraPathEyeKeys CameraPath::getEyeKeys(uint32_t index) const {
+  CameraPathEyeKeys eyeKeys;
+  std::memcpy(&eyeKeys, eyeKeys_ + eyeKeyStride_ * index, sizeof(eyeKeys));
+  return eyeKeys;
+}
+
+CameraPathSample CameraPath::sample(double time, bool loop) const {
+  CameraPathSample result;
+  result.time = time;
+
+  if (numKeys_ == 0)
+    return result;
+
+  const auto keyTime = [&](uint32_t index) {
+    float t;
+    std::memcpy(&t, keys_ + keyStride_ * index, sizeof(t));
+    return (double)t;
+  };
+
+  double firstTime = keyTime(0);
+  double period = duration_ - firstTime;
+
+  if (loop && period > 0.0) {
+    time = std::fmod(time - firstTime, period);
+    if (time < 0.0)
+      time += period;
+    time += firstTime;
+  }
+
+  // Binary search for the first key after time
+  uint32_t low = 0;
+  uint32_t high = numKeys_;
+  while (low < high) {
+    uint32_t middle = (low + high) / 2;
+    if (keyTime(middle) <= time)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  uint32_t next = std::min(low, numKeys_ - 1);
+  uint32_t previous = low > 0 ? low - 1 : 0;
+
+  double previousTime = keyTime(previous);
+  double nextTime = keyTime(next);
+  float alpha = nextTime > previousTime
+      ? (float)std::clamp((time - previousTime) / (nextTime - previousTime), 0.0, 1.0)
+      : 0.0f;
+
+  result.head = interpolate(getKeyPose(previous), getKeyPose(next), alpha);
+
+  if (eyeKeys_) {
+    CameraPathEyeKeys previousEyes = getEyeKeys(previous);
+    CameraPathEyeKeys nextEyes = getEyeKeys(next);
+
+    result.hasEyes = true;
+    for (int eye = 0; eye < 2; eye++) {
+      result.eyes[eye] = interpolate(
+          toPose(previousEyes.position[eye], previousEyes.orientation[eye]),
+          toPose(nextEyes.position[eye], nextEyes.orientation[eye]),
+          alpha);
+    }
+  }
+
+  return result;
+}
+
+void CameraPathWriter::addKey(double time, const CameraPathPose& head) {
+  CameraPathKey key;
+  key.time = (float)time;
+  storePose(head, key.position, key.orientation);
+  keys_.push_back(key);
+}
+
+void CameraPathWriter::addKey(
+    double time,
+    const CameraPathPose& head,
+    const std::array<CameraPathPose, 2>& eyes) {
+  addKey(time, head);
+
+  CameraPathEyeKeys eyeKeys;
+  for (int eye = 0; eye < 2; eye++)
+    storePose(eyes[eye], eyeKeys.position[eye], eyeKeys.orientation[eye]);
+  eyeKeys_.push_back(eyeKeys);
+}
+
+void CameraPathWriter::addKeys(const CameraPath& path) {
+  for (uint32_t index = 0; index < path.getNumKeys(); index++) {
+    keys_.push_back(path.getKey(index));
+    if (path.hasEyes())
+      eyeKeys_.push_back(path.getEyeKeys(index));
+  }
+}
+
+bool CameraPathWriter::write(const std::string& filename) const {
+  bool stereo = !eyeKeys_.empty();
+  if (keys_.empty() || (stereo && eyeKeys_.size() != keys_.size())) {
+    std::cout << "can't write camera path " << filename
+              << ", it needs keys and eye poses for all or none of them" << std::endl;
+    return false;
+  }
+
+  CameraPathFileHeader header;
+  header.flags = stereo ? CameraPathFileHeader::kFlagStereo : 0;
+  header.numKeys = (uint32_t)keys_.size();
+  header.keyOffset = sizeof(CameraPathFileHeader);
+  header.keySize = sizeof(CameraPathKey);
+  header.eyeKeyOffset = stereo ? header.keyOffset + header.keySize * header.numKeys : 0;
+  header.eyeKeySize = stereo ? sizeof(CameraPathEyeKeys) : 0;
+  header.duration = keys_.back().time;
+
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cout << "could not write camera path " << filename << std::endl;
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(keys_.data()), sizeof(CameraPathKey) * keys_.size());
+  if (stereo) {
+    file.write(
+        reinterpret_cast<const char*>(eyeKeys_.data()),
+        sizeof(CameraPathEyeKeys) * eyeKeys_.size());
+  }
+
+  return file.good();
+}
+
+} // namespace split_rendering
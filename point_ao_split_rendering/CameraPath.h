@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+namespace split_rendering {
+
+// Camera to world pose, orientation is a unit quaternion (x, y, z, w). The camera looks along -z
+// and y is up, as for Falcor cameras.
+struct CameraPathPose {
+  std::array<float, 3> position = {0.0f, 0.0f, 0.0f};
+  std::array<float, 4> orientation = {0.0f, 0.0f, 0.0f, 1.0f};
+
+  std::array<float, 3> getForward() const;
+  std::array<float, 3> getUp() const;
+  std::array<float, 3> getTarget() const;
+
+  static CameraPathPose fromLookAt(
+      const std::array<float, 3>& position,
+      const std::array<float, 3>& target,
+      const std::array<float, 3>& up);
+};
+
+struct CameraPathSample {
+  double time = 0.0;
+  CameraPathPose head;
+  // Left and right eye poses, only if the path has HMD stereo poses
+  bool hasEyes = false;
+  std::array<CameraPathPose, 2> eyes;
+};
+
+// File format of camera paths (little endian):
+//
+//   CameraPathFileHeader
+//   numKeys x CameraPathKey at keyOffset, sorted by time
+//   numKeys x CameraPathEyeKeys at eyeKeyOffset if kFlagStereo is set
+//
+// Orientations are stored as the three smallest quaternion components with 10 bits each and the
+// index of the largest one in the top 2 bits, which is accurate to about 0.1 degrees. Readers
+// accept every version up to kVersion and use the offsets, so later versions can append fields.
+struct CameraPathFileHeader {
+  static constexpr uint32_t kMagic = 0x50434153; // "SACP"
+  static constexpr uint16_t kVersion = 1;
+  static constexpr uint16_t kFlagStereo = 1;
+
+  uint32_t magic = kMagic;
+  uint16_t version = kVersion;
+  uint16_t flags = 0;
+  uint32_t numKeys = 0;
+  uint32_t keyOffset = 0;
+  uint32_t keySize = 0;
+  uint32_t eyeKeyOffset = 0;
+  uint32_t eyeKeySize = 0;
+  float duration = 0.0f;
+};
+
+struct CameraPathKey {
+  float time;
+  float position[3];
+  uint32_t orientation;
+};
+
+struct CameraPathEyeKeys {
+  float position[2][3];
+  uint32_t orientation[2];
+};
+
+static_assert(sizeof(CameraPathFileHeader) == 32, "CameraPathFileHeader is part of the format");
+static_assert(sizeof(CameraPathKey) == 20, "CameraPathKey is part of the format");
+static_assert(sizeof(CameraPathEyeKeys) == 32, "CameraPathEyeKeys is part of the format");
+
+// A memory-mapped camera path, sampled at arbitrary times with linear interpolation of the
+// positions and slerp of the orientations, so playback doesn't depend on the frame rate.
+//
+// Files without the header are read as legacy paths (int count followed by count transposed
+// view matrices) with one key every legacyFrameTime seconds.
+class CameraPath {
+ public:
+  CameraPath() = default;
+  ~CameraPath();
+
+  CameraPath(const CameraPath&) = delete;
+  CameraPath& operator=(const CameraPath&) = delete;
+
+  // Returns false and prints the error if the file can't be read
+  bool open(const std::string& filename, float legacyFrameTime = 1.0f / 60.0f);
+  void close();
+
+  bool isOpen() const {
+    return numKeys_ > 0;
+  }
+
+  bool isLegacy() const {
+    return !legacyKeys_.empty();
+  }
+
+  uint32_t getNumKeys() const {
+    return numKeys_;
+  }
+
+  bool hasEyes() const {
+    return eyeKeys_ != nullptr;
+  }
+
+  // Time of the last key
+  double getDuration() const {
+    return duration_;
+  }
+
+  // With loop, times after the duration wrap around, otherwise they are clamped to the last key
+  CameraPathSample sample(double time, bool loop = false) const;
+
+  CameraPathPose getKeyPose(uint32_t index) const;
+
+  // Stored keys, e.g. to write a legacy path in the current format without encoding them again
+  CameraPathKey getKey(uint32_t index) const;
+  // Only if hasEyes()
+  CameraPathEyeKeys getEyeKeys(uint32_t index) const;
+
+ private:
+  uint32_t numKeys_ = 0;
+  double duration_ = 0.0;
+  const uint8_t* keys_ = nullptr;
+  size_t keyStride_ = sizeof(CameraPathKey);
+  const uint8_t* eyeKeys_ = nullptr;
+  size_t eyeKeyStride_ = sizeof(CameraPathEyeKeys);
+
+  // Legacy paths are converted into memory
+  std::vector<CameraPathKey> legacyKeys_;
+
+  MappedFile file_;
+};
+
+// Collects keys and writes them in the current CameraPathFileHeader::kVersion
+class CameraPathWriter {
+ public:
+  // Keys have to be added in increasing time order. Either all or no keys have eye poses.
+  void addKey(double time, const CameraPathPose& head);
+  void addKey(double time, const CameraPathPose& head, const std::array<CameraPathPose, 2>& eyes);
+
+  // Appends all keys of path, with its eye poses if it has them
+  void addKeys(const CameraPath& path);
+
+  // Time of the last key
+  double getDuration() const {
+    return keys_.empty() ? 0.0 : keys_.back().time;
+  }
+
+  size_t getNumKeys() const {
+    return keys_.size();
+  }
+
+  bool write(const std::string& filename) const;
+
+ private:
+  std::vector<CameraPathKey> keys_;
+  std::vector<CameraPathEyeKeys> eyeKeys_;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "CameraPathReplay.h"
+#include <chrono>
+#include <cmath>
+#include "Tracing.h"
+
+namespace split_rendering {
+
+CameraPathReplay::CameraPathReplay(
+    const CameraPath& path,
+    const Options& options,
+    PoseCallback onPose)
+    : path_(path), options_(options), onPose_(std::move(onPose)) {}
+
+CameraPathReplay::~CameraPathReplay() {
+  stop();
+}
+
+void CameraPathReplay::start() {
+  stop();
+
+  stopRequested_ = false;
+  numPoses_ = 0;
+  numLatePoses_ = 0;
+  running_ = true;
+  thread_ = std::thread([this]() { run(); });
+}
+
+void CameraPathReplay::stop() {
+  stopRequested_ = true;
+  wait();
+}
+
+void CameraPathReplay::wait() {
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void CameraPathReplay::run() {
+  Tracing::setThreadName("camera_path_replay");
+
+  double duration = options_.duration > 0.0 ? options_.duration : path_.getDuration();
+  bool loop = duration > path_.getDuration();
+  double period = 1.0 / options_.rateHz;
+  uint64_t numPoses = (uint64_t)std::floor(duration * options_.rateHz) + 1;
+
+  auto start = std::chrono::steady_clock::now();
+
+  for (uint64_t i = 0; i < numPoses && !stopRequested_; i++) {
+    double time = i * period;
+
+    if (options_.realtime) {
+      auto deadline = start + std::chrono::duration<double>(time);
+      auto now = std::chrono::steady_clock::now();
+
+      if (now < deadline)
+        std::this_thread::sleep_until(deadline);
+      else if (now - deadline > std::chrono::duration<double>(period))
+        numLatePoses_++;
+    }
+
+    TRACE_SCOPE("CameraPathReplay::pose");
+    onPose_(i, path_.sample(time, loop));
+    numPoses_++;
+  }
+
+  running_ = false;
+}
+
+} // namespace split_rendering
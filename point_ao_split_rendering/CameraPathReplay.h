@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include "CameraPath.h"
+
+namespace split_rendering {
+
+// Replays a camera path on its own thread without rendering, e.g. to feed the poses into the
+// network client for reproducible load tests.
+//
+// Pose i is always sampled at path time i / rateHz, so every run produces the same sequence of
+// poses. With realtime pacing, pose i is delivered at start + i / rateHz, otherwise as fast as
+// the callback returns. Poses delivered more than one period late are counted.
+class CameraPathReplay {
+ public:
+  struct Options {
+    float rateHz = 60.0f;
+    bool realtime = true;
+    // Replayed time, 0 for the duration of the path. Longer durations loop the path.
+    double duration = 0.0;
+  };
+
+  using PoseCallback = std::function<void(uint64_t index, const CameraPathSample& sample)>;
+
+  // The path has to outlive the replay
+  CameraPathReplay(const CameraPath& path, const Options& options, PoseCallback onPose);
+  // Stops the replay
+  ~CameraPathReplay();
+
+  void start();
+  void stop();
+  // Blocks until all poses are delivered or the replay is stopped
+  void wait();
+
+  bool isRunning() const {
+    return running_;
+  }
+
+  uint64_t getNumPoses() const {
+    return numPoses_;
+  }
+
+  uint64_t getNumLatePoses() const {
+    return numLatePoses_;
+  }
+
+ private:
+  void run();
+
+  const CameraPath& path_;
+  Options options_;
+  PoseCallback onPose_;
+
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> stopRequested_{false};
+  std::atomic<uint64_t> numPoses_{0};
+  std::atomic<uint64_t> numLatePoses_{0};
+};
+
+} // namespace split_rendering
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless round trip of camera paths. A path of a camera turning around the y axis with unevenly
+// spaced keys and stereo eye poses is written with CameraPathWriter, opened with CameraPath and
+// sampled between the keys: positions have to be interpolated linearly and orientations along the
+// arc between the keys, up to the quantization of the orientations. Looping, clamping and paths
+// without eye poses are checked as well, and a legacy path (one view matrix per frame) has to
+// convert into the current format without changing its samples.
+//
+// Example usage:
+// $ ./CameraPathTest --output_dir camera_path_test
+//
+// Exit codes: 0 if all checks pass, 1 if a check fails, 2 for invalid arguments.
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "CameraPath.h"
+#include "argparse.hpp"
+
+using split_rendering::CameraPath;
+using split_rendering::CameraPathPose;
+using split_rendering::CameraPathSample;
+using split_rendering::CameraPathWriter;
+
+namespace {
+
+using Float3 = std::array<float, 3>;
+
+const int kExitFailed = 1;
+const int kExitInvalid = 2;
+
+// 10 bits per quaternion component are accurate to about 0.1 degrees
+const float kMaxAngleErrorDegrees = 0.3f;
+const float kMaxPositionError = 1e-4f;
+const float kEyeOffset = 0.032f;
+const float kEyeToeIn = 0.02f;
+
+uint32_t numFailures = 0;
+
+void fail(const std::string& message) {
+  if (numFailures++ < 20)
+    std::cout << "FAIL " << message << std::endl;
+}
+
+// Uneven key times, so that sample() has to search for the keys
+const std::vector<double> kKeyTimes = {0.0, 0.4, 1.0, 1.5, 2.7, 3.0, 3.05, 4.5, 6.0};
+
+// Camera at key of the path, which turns around the y axis by 0.3 radians per key
+struct ExpectedPose {
+  Float3 position;
+  float yaw;
+};
+
+Float3 getForward(float yaw) {
+  return {std::sin(yaw), 0.0f, -std::cos(yaw)};
+}
+
+// Eyes are offset along the right vector and turned inwards, eye -1 is the head
+ExpectedPose getKeyPose(size_t key, int eye = -1) {
+  const float k = (float)key;
+  ExpectedPose pose = {{k, 0.5f * k * k, -2.0f * k}, 0.3f * k};
+
+  if (eye >= 0) {
+    const float side = eye == 0 ? -1.0f : 1.0f;
+    const Float3 right = {std::cos(pose.yaw), 0.0f, std::sin(pose.yaw)};
+    for (int i = 0; i < 3; i++)
+      pose.position[i] += side * kEyeOffset * right[i];
+    pose.yaw -= side * kEyeToeIn;
+  }
+
+  return pose;
+}
+
+// Positions are interpolated linearly between the keys, the yaw along the arc
+ExpectedPose getExpectedPose(double time, int eye = -1) {
+  size_t next = 0;
+  while (next < kKeyTimes.size() && kKeyTimes[next] <= time)
+    next++;
+  if (next == 0)
+    return getKeyPose(0, eye);
+  if (next == kKeyTimes.size())
+    return getKeyPose(kKeyTimes.size() - 1, eye);
+
+  const ExpectedPose previousPose = getKeyPose(next - 1, eye);
+  const ExpectedPose nextPose = getKeyPose(next, eye);
+  const float alpha =
+      (float)((time - kKeyTimes[next - 1]) / (kKeyTimes[next] - kKeyTimes[next - 1]));
+
+  ExpectedPose pose;
+  for (int i = 0; i < 3; i++) {
+    pose.position[i] =
+        previousPose.position[i] + (nextPose.position[i] - previousPose.position[i]) * alpha;
+  }
+  pose.yaw = previousPose.yaw + (nextPose.yaw - previousPose.yaw) * alpha;
+  return pose;
+}
+
+CameraPathPose toPose(const ExpectedPose& expected) {
+  const Float3 forward = getForward(expected.yaw);
+  return CameraPathPose::fromLookAt(
+      expected.position,
+      {expected.position[0] + forward[0],
+       expected.position[1] + forward[1],
+       expected.position[2] + forward[2]},
+      {0.0f, 1.0f, 0.0f});
+}
+
+float getAngleDegrees(const Float3& a, const Float3& b) {
+  const float cosAngle = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  return std::acos(std::min(std::max(cosAngle, -1.0f), 1.0f)) * 180.0f / 3.14159265f;
+}
+
+float getDistance(const Float3& a, const Float3& b) {
+  return std::sqrt(
+      (a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) +
+      (a[2] - b[2]) * (a[2] - b[2]));
+}
+
+void checkPose(
+    const CameraPathPose& pose,
+    const ExpectedPose& expected,
+    const std::string& name,
+    double time) {
+  const float positionError = getDistance(pose.position, expected.position);
+  const float forwardError = getAngleDegrees(pose.getForward(), getForward(expected.yaw));
+  const float upError = getAngleDegrees(pose.getUp(), {0.0f, 1.0f, 0.0f});
+
+  if (positionError > kMaxPositionError * (1.0f + getDistance(expected.position, {})) ||
+      forwardError > kMaxAngleErrorDegrees || upError > kMaxAngleErrorDegrees) {
+    fail(
+        name + " at " + std::to_string(time) + ": position off by " +
+        std::to_string(positionError) + ", forward by " + std::to_string(forwardError) +
+        " degrees, up by " + std::to_string(upError) + " degrees");
+  }
+}
+
+bool isSamePose(const CameraPathPose& a, const CameraPathPose& b) {
+  return a.position == b.position && a.orientation == b.orientation;
+}
+
+bool isSameSample(const CameraPathSample& a, const CameraPathSample& b) {
+  return isSamePose(a.head, b.head) && a.hasEyes == b.hasEyes &&
+      (!a.hasEyes || (isSamePose(a.eyes[0], b.eyes[0]) && isSamePose(a.eyes[1], b.eyes[1])));
+}
+
+// Times between and on the keys, and outside of the path
+std::vector<double> getSampleTimes(double duration) {
+  std::vector<double> times;
+  for (double time = -0.5; time <= duration + 0.5; time += 0.0173)
+    times.push_back(time);
+  times.insert(times.end(), kKeyTimes.begin(), kKeyTimes.end());
+  return times;
+}
+
+void checkStereoPath(const std::string& filename) {
+  CameraPathWriter writer;
+  for (size_t key = 0; key < kKeyTimes.size(); key++) {
+    writer.addKey(
+        kKeyTimes[key],
+        toPose(getKeyPose(key)),
+        {toPose(getKeyPose(key, 0)), toPose(getKeyPose(key, 1))});
+  }
+
+  if (!writer.write(filename)) {
+    fail("can't write " + filename);
+    return;
+  }
+
+  CameraPath path;
+  if (!path.open(filename)) {
+    fail("can't open " + filename);
+    return;
+  }
+
+  if (path.isLegacy() || !path.hasEyes() || path.getNumKeys() != kKeyTimes.size() ||
+      path.getDuration() != (float)kKeyTimes.back()) {
+    fail(filename + " has the wrong number of keys, duration or eye poses");
+    return;
+  }
+
+  for (double time : getSampleTimes(path.getDuration())) {
+    const CameraPathSample sample = path.sample(time);
+    checkPose(sample.head, getExpectedPose(time), "head", time);
+
+    if (!sample.hasEyes) {
+      fail("sample at " + std::to_string(time) + " has no eye poses");
+      continue;
+    }
+
+    for (int eye = 0; eye < 2; eye++)
+      checkPose(sample.eyes[eye], getExpectedPose(time, eye), "eye " + std::to_string(eye), time);
+
+    // Looping wraps the time around the duration of the path
+    if (time > 0.0 && time < path.getDuration()) {
+      const double loopedTime = time + 2.0 * path.getDuration();
+      if (!isSameSample(path.sample(loopedTime, true), path.sample(time)))
+        fail("looped sample at " + std::to_string(loopedTime) + " differs");
+    }
+  }
+
+  // Without loop, the path stays at its last key
+  if (!isSameSample(path.sample(path.getDuration() + 10.0), path.sample(path.getDuration())))
+    fail("sample after the end differs from the last key");
+}
+
+void checkMonoPath(const std::string& filename) {
+  CameraPathWriter writer;
+  for (size_t key = 0; key < kKeyTimes.size(); key++)
+    writer.addKey(kKeyTimes[key], toPose(getKeyPose(key)));
+
+  CameraPath path;
+  if (!writer.write(filename) || !path.open(filename)) {
+    fail("can't write or open " + filename);
+    return;
+  }
+
+  if (path.hasEyes() || path.sample(1.0).hasEyes)
+    fail(filename + " has eye poses");
+
+  for (double time : getSampleTimes(path.getDuration()))
+    checkPose(path.sample(time).head, getExpectedPose(time), "mono head", time);
+
+  // Keys need eye poses for all or none of them
+  CameraPathWriter mixedWriter;
+  mixedWriter.addKey(0.0, toPose(getKeyPose(0)));
+  mixedWriter.addKey(1.0, toPose(getKeyPose(1)), {toPose(getKeyPose(1)), toPose(getKeyPose(1))});
+  if (mixedWriter.write(filename + ".mixed"))
+    fail("a path with eye poses for some keys was written");
+}
+
+// Legacy paths are an int count and one transposed view matrix per frame
+void writeLegacyPath(const std::string& filename, uint32_t numFrames, float frameTime) {
+  std::ofstream file(filename, std::ios::binary);
+  const int32_t count = (int32_t)numFrames;
+  file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+  for (uint32_t frame = 0; frame < numFrames; frame++) {
+    const ExpectedPose pose = getExpectedPose(frame * frameTime);
+    const Float3 forward = getForward(pose.yaw);
+    const Float3 right = {std::cos(pose.yaw), 0.0f, std::sin(pose.yaw)};
+    const Float3 up = {0.0f, 1.0f, 0.0f};
+    const Float3 rows[3] = {right, up, {-forward[0], -forward[1], -forward[2]}};
+
+    // m[column][row] of the view matrix [R | -R * position]
+    float m[4][4] = {};
+    for (int row = 0; row < 3; row++) {
+      for (int column = 0; column < 3; column++)
+        m[column][row] = rows[row][column];
+      m[3][row] = -(rows[row][0] * pose.position[0] + rows[row][1] * pose.position[1] +
+                    rows[row][2] * pose.position[2]);
+    }
+    m[3][3] = 1.0f;
+
+    file.write(reinterpret_cast<const char*>(m), sizeof(m));
+  }
+}
+
+void checkLegacyConversion(const std::string& legacyFilename, const std::string& filename) {
+  const float frameTime = 1.0f / 30.0f;
+  const uint32_t numFrames = (uint32_t)std::lround(kKeyTimes.back() / frameTime) + 1;
+  writeLegacyPath(legacyFilename, numFrames, frameTime);
+
+  CameraPath legacyPath;
+  if (!legacyPath.open(legacyFilename, frameTime) || !legacyPath.isLegacy() ||
+      legacyPath.getNumKeys() != numFrames) {
+    fail("can't open " + legacyFilename + " as a legacy path");
+    return;
+  }
+
+  CameraPathWriter writer;
+  writer.addKeys(legacyPath);
+
+  CameraPath path;
+  if (!writer.write(filename) || !path.open(filename) || path.isLegacy() ||
+      path.getNumKeys() != numFrames) {
+    fail("can't convert " + legacyFilename);
+    return;
+  }
+
+  for (double time : getSampleTimes(path.getDuration())) {
+    const CameraPathSample sample = path.sample(time);
+    if (!isSameSample(sample, legacyPath.sample(time)))
+      fail("converted path differs from the legacy path at " + std::to_string(time));
+
+    // Frames are samples of the path above, the interpolation between them is close to it
+    if (std::abs(time - std::round(time / frameTime) * frameTime) < 1e-4)
+      checkPose(sample.head, getExpectedPose(time), "legacy head", time);
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("CameraPathTest");
+
+  args.add_argument("--output_dir")
+      .help("directory for the test paths")
+      .default_value((std::filesystem::temp_directory_path() / "CameraPathTest").string());
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const std::filesystem::path outputDir = args.get<std::string>("--output_dir");
+  std::filesystem::create_directories(outputDir);
+
+  checkStereoPath((outputDir / "stereo.campath").string());
+  checkMonoPath((outputDir / "mono.campath").string());
+  checkLegacyConversion(
+      (outputDir / "legacy.bin").string(), (outputDir / "converted.campath").string());
+
+  std::cout << (numFailures == 0 ? "PASSED" : "FAILED") << std::endl;
+  return numFailures == 0 ? 0 : kExitFailed;
+}
@@ -13,7 +13,10 @@
 // clang-format on
 
 #include "NetworkClient.h"
+#include "CameraPath.h"
+#include "CameraPathReplay.h"
 #include "ClientPointRenderer.h"
+#include "Tracing.h"
 #include "samples/Flags.h"
 
 #include <Falcor.h>
@@ -27,16 +30,86 @@
 #include <windows.h>
 #endif
 
+#include <chrono>
+#include <cstring>
 #include <thread>
 
 using rlr_streaming::IceProtocol;
 using rlr_streaming::VideoCodec;
 using rlr_streaming::WebrtcPeerInit;
 using rlr_streaming::WebrtcStreamingApi;
+using split_rendering::CameraPath;
+using split_rendering::CameraPathReplay;
+using split_rendering::CameraPathSample;
 using split_rendering::NetworkClient;
 using split_rendering::ClientPointRenderer;
 using split_rendering::RunningState;
 using split_rendering::StreamedMessage;
+using split_rendering::Tracing;
+
+DEFINE_string(
+    trace_output,
+    "",
+    "chrome://tracing / Perfetto trace that is written on exit, tracing is disabled if empty");
+DEFINE_string(
+    replay_camera_path,
+    "",
+    "camera path whose poses are sent to the server without rendering, e.g. for load tests");
+DEFINE_double(replay_rate, 60.0, "poses per second of -replay_camera_path");
+DEFINE_double(
+    replay_duration,
+    0.0,
+    "replayed seconds, 0 for the whole path, longer durations loop");
+DEFINE_bool(replay_realtime, true, "whether or not the poses are paced to -replay_rate");
+
+namespace {
+
+// Headless client that only sends the camera poses of -replay_camera_path
+int replayCameraPath(NetworkClient& client) {
+  CameraPath path;
+  if (!path.open(FLAGS_replay_camera_path))
+    return 1;
+
+  client.startThreads();
+  while (client.getStatus() != rlr_streaming::TcpStatus::Connected)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  const auto toFloat3 = [](const std::array<float, 3>& v) {
+    return Falcor::float3(v[0], v[1], v[2]);
+  };
+
+  CameraPathReplay::Options options;
+  options.rateHz = (float)FLAGS_replay_rate;
+  options.duration = FLAGS_replay_duration;
+  options.realtime = FLAGS_replay_realtime;
+
+  CameraPathReplay replay(path, options, [&](uint64_t index, const CameraPathSample& sample) {
+    split_rendering::CameraPoseData camData;
+    camData.headPos = toFloat3(sample.head.position);
+    camData.upVec = toFloat3(sample.head.getUp());
+    camData.headTarget = toFloat3(sample.head.getTarget());
+
+    split_rendering::TCPMessage msg;
+    msg.header.type = split_rendering::TCPMessageType::CameraPoseMessage;
+    msg.header.id = (uint32_t)index;
+    msg.header.timestamp = (float)sample.time;
+    msg.data.resize(sizeof(camData));
+    std::memcpy(msg.data.data(), &camData, sizeof(camData));
+    msg.header.size = msg.data.size();
+    client.send(msg);
+  });
+
+  replay.start();
+  replay.wait();
+
+  LOG(INFO) << "Replayed " << replay.getNumPoses() << " poses of " << FLAGS_replay_camera_path
+            << ", " << replay.getNumLatePoses() << " late";
+
+  client.stopThreads();
+  return 0;
+}
+
+} // namespace
 
 
 int main(int argc, char* argv[]) {
@@ -45,10 +118,25 @@ int main(int argc, char* argv[]) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
 
   LOG(INFO) << "Starting ...";
+
+  if (!FLAGS_trace_output.empty()) {
+    Tracing::enable("FalcorClient", 2);
+    Tracing::setThreadName("render");
+  }
+
   ClientEventHandler handler;
 
   NetworkClient client("::1", 4001, handler);
 
+  if (!FLAGS_replay_camera_path.empty()) {
+    int result = replayCameraPath(client);
+
+    if (Tracing::isEnabled())
+      Tracing::writeChromeTrace(FLAGS_trace_output);
+
+    return result;
+  }
+
   // Create Falcor GUI.
   const char* kFalcorGuiTitle = "Falcor Client";
   msgBoxTitle(kFalcorGuiTitle);
@@ -59,6 +147,9 @@ int main(int argc, char* argv[]) {
   falcorSampleConfig.stereo = false;
   Sample::run(falcorSampleConfig, falcorRenderer, 0, nullptr);
 
+  if (Tracing::isEnabled())
+    Tracing::writeChromeTrace(FLAGS_trace_output);
+
   LOG(INFO) << "Existing ...";
 
   return 0;
@@ -0,0 +1,608 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ClientPointCodec.h"
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// The point kernels are written for the compact encoding, the wider ones use the scalar functions
+#if defined(__AVX2__) && POINT_ENCODING == POINT_ENCODING_COMPACT_32
+#define CLIENT_POINT_CODEC_AVX2
+#endif
+
+namespace split_rendering {
+
+namespace {
+
+// octahedral8 codes, independent of the point encoding
+constexpr uint32_t kNumNormalCodes = 256;
+
+// octahedral8Inverse of every code, as SoA for gathers
+struct NormalTable {
+  float x[kNumNormalCodes];
+  float y[kNumNormalCodes];
+  float z[kNumNormalCodes];
+
+  NormalTable() {
+    for (uint32_t code = 0; code < kNumNormalCodes; code++) {
+      const Falcor::float3 normal = Falcor::octahedral8Inverse(code);
+      x[code] = normal.x;
+      y[code] = normal.y;
+      z[code] = normal.z;
+    }
+  }
+};
+
+const NormalTable& getNormalTable() {
+  static const NormalTable table;
+  return table;
+}
+
+bool isBitEqual(float a, float b) {
+  return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+bool isBitEqual(const Falcor::float3& a, const Falcor::float3& b) {
+  return isBitEqual(a.x, b.x) && isBitEqual(a.y, b.y) && isBitEqual(a.z, b.z);
+}
+
+#if defined(__AVX2__)
+
+constexpr size_t kLanes = 8;
+
+// round() of the scalar code, i.e. halfway cases away from zero. _mm256_round_ps rounds them to
+// even, so the fraction is compared against 0.5 instead (x - trunc(x) is exact).
+__m256 roundHalfAwayFromZero(__m256 v) {
+  const __m256 truncated = _mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+  const __m256 fraction = _mm256_sub_ps(v, truncated);
+  const __m256 up = _mm256_and_ps(
+      _mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ), _mm256_set1_ps(1.0f));
+  const __m256 down = _mm256_and_ps(
+      _mm256_cmp_ps(fraction, _mm256_set1_ps(-0.5f), _CMP_LE_OQ), _mm256_set1_ps(1.0f));
+  return _mm256_sub_ps(_mm256_add_ps(truncated, up), down);
+}
+
+__m256 abs8(__m256 v) {
+  return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+}
+
+// msign(): 1 for v >= 0 (including -0), -1 otherwise
+__m256 msign8(__m256 v) {
+  return _mm256_blendv_ps(
+      _mm256_set1_ps(-1.0f),
+      _mm256_set1_ps(1.0f),
+      _mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_GE_OQ));
+}
+
+// uint() of the scalar code for values that fit into an int
+__m256i toUint8(__m256 v) {
+  return _mm256_cvttps_epi32(v);
+}
+
+// octahedral8, without FMA so every step rounds like the scalar version
+__m256i encodeNormals8(__m256 x, __m256 y, __m256 z) {
+  const __m256 sum = _mm256_add_ps(_mm256_add_ps(abs8(x), abs8(y)), abs8(z));
+  x = _mm256_div_ps(x, sum);
+  y = _mm256_div_ps(y, sum);
+  z = _mm256_div_ps(z, sum);
+
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 foldedX = _mm256_mul_ps(_mm256_sub_ps(one, abs8(y)), msign8(x));
+  const __m256 foldedY = _mm256_mul_ps(_mm256_sub_ps(one, abs8(x)), msign8(y));
+  const __m256 upper = _mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_GE_OQ);
+  x = _mm256_blendv_ps(foldedX, x, upper);
+  y = _mm256_blendv_ps(foldedY, y, upper);
+
+  // packSnorm2x4
+  const __m256 scale = _mm256_set1_ps(7.5f);
+  const __m256i dx =
+      toUint8(roundHalfAwayFromZero(_mm256_add_ps(scale, _mm256_mul_ps(x, scale))));
+  const __m256i dy =
+      toUint8(roundHalfAwayFromZero(_mm256_add_ps(scale, _mm256_mul_ps(y, scale))));
+  return _mm256_or_si256(dx, _mm256_slli_epi32(dy, 4));
+}
+
+// Loads member offset of 8 consecutive structs of strideBytes bytes each
+__m256 gather8(const void* base, size_t strideBytes, size_t offsetBytes) {
+  const int stride = (int)(strideBytes / sizeof(float));
+  const __m256i indices =
+      _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+  return _mm256_i32gather_ps(
+      (const float*)((const uint8_t*)base + offsetBytes), indices, sizeof(float));
+}
+
+#endif
+
+#if defined(CLIENT_POINT_CODEC_AVX2)
+
+// compressClientData
+__m256i compress8(
+    __m256 px,
+    __m256 py,
+    __m256 pz,
+    __m256 nx,
+    __m256 ny,
+    __m256 nz,
+    __m256 value,
+    float gridCellSize,
+    const Falcor::float3& aabbMin) {
+  const __m256 cellSize = _mm256_set1_ps(gridCellSize);
+  const __m256 posMax = _mm256_set1_ps((float)POINT_POS_MAX);
+
+  auto quantize = [&](__m256 p, float minValue) {
+    const __m256 local = _mm256_div_ps(_mm256_sub_ps(p, _mm256_set1_ps(minValue)), cellSize);
+    const __m256 remainder =
+        _mm256_sub_ps(local, _mm256_cvtepi32_ps(_mm256_cvttps_epi32(local)));
+    return _mm256_and_si256(
+        toUint8(roundHalfAwayFromZero(_mm256_mul_ps(remainder, posMax))),
+        _mm256_set1_epi32(POINT_POS_MAX));
+  };
+
+  __m256i posNormVal = quantize(px, aabbMin.x);
+  posNormVal =
+      _mm256_or_si256(posNormVal, _mm256_slli_epi32(quantize(py, aabbMin.y), POINT_POS_BITS));
+  posNormVal =
+      _mm256_or_si256(posNormVal, _mm256_slli_epi32(quantize(pz, aabbMin.z), 2 * POINT_POS_BITS));
+
+  const __m256i normal =
+      _mm256_and_si256(encodeNormals8(nx, ny, nz), _mm256_set1_epi32(NORMAL_MAX));
+  posNormVal = _mm256_or_si256(posNormVal, _mm256_slli_epi32(normal, 3 * POINT_POS_BITS));
+
+  const __m256i quantizedValue = _mm256_and_si256(
+      toUint8(_mm256_mul_ps(value, _mm256_set1_ps((float)POINT_VAL_MAX))),
+      _mm256_set1_epi32(POINT_VAL_MAX));
+  return _mm256_or_si256(
+      posNormVal, _mm256_slli_epi32(quantizedValue, NORMAL_BITS + 3 * POINT_POS_BITS));
+}
+
+void storeFloat3x8(__m256 x, __m256 y, __m256 z, Falcor::float3* out) {
+  alignas(32) float xs[kLanes];
+  alignas(32) float ys[kLanes];
+  alignas(32) float zs[kLanes];
+  _mm256_store_ps(xs, x);
+  _mm256_store_ps(ys, y);
+  _mm256_store_ps(zs, z);
+
+  for (size_t lane = 0; lane < kLanes; lane++)
+    out[lane] = Falcor::float3(xs[lane], ys[lane], zs[lane]);
+}
+
+// decompressClientData, gridIndexStride is 0 if all points share one grid index
+void decompress8(
+    const Falcor::CompressedClientPointData* compressed,
+    const Falcor::uint3* gridIndices,
+    size_t gridIndexStride,
+    float gridCellSize,
+    const Falcor::float3& aabbMin,
+    Falcor::float3* positions,
+    Falcor::float3* normals,
+    float* values) {
+  const __m256i posNormVal = _mm256_loadu_si256((const __m256i*)compressed);
+
+  if (positions != nullptr) {
+    const __m256 cellSize = _mm256_set1_ps(gridCellSize);
+    const __m256 oneOverPosMax = _mm256_set1_ps(ONE_OVER_POINT_POS_MAX);
+    const __m256i posMask = _mm256_set1_epi32(POINT_POS_MAX);
+
+    auto decode = [&](int shift, size_t component, float minValue) {
+      __m256i gridIndex;
+
+      if (gridIndexStride == 0) {
+        gridIndex = _mm256_set1_epi32((int)gridIndices[0][(int)component]);
+      } else {
+        gridIndex = _mm256_castps_si256(
+            gather8(gridIndices, sizeof(Falcor::uint3), component * sizeof(uint32_t)));
+      }
+
+      const __m256 offset = _mm256_add_ps(
+          _mm256_set1_ps(minValue), _mm256_mul_ps(cellSize, _mm256_cvtepi32_ps(gridIndex)));
+      const __m256 quantized = _mm256_cvtepi32_ps(
+          _mm256_and_si256(_mm256_srli_epi32(posNormVal, shift), posMask));
+      return _mm256_add_ps(
+          offset, _mm256_mul_ps(_mm256_mul_ps(quantized, oneOverPosMax), cellSize));
+    };
+
+    storeFloat3x8(
+        decode(0, 0, aabbMin.x),
+        decode(POINT_POS_BITS, 1, aabbMin.y),
+        decode(2 * POINT_POS_BITS, 2, aabbMin.z),
+        positions);
+  }
+
+  if (normals != nullptr) {
+    const NormalTable& table = getNormalTable();
+    const __m256i code = _mm256_and_si256(
+        _mm256_srli_epi32(posNormVal, 3 * POINT_POS_BITS), _mm256_set1_epi32(NORMAL_MAX));
+    storeFloat3x8(
+        _mm256_i32gather_ps(table.x, code, sizeof(float)),
+        _mm256_i32gather_ps(table.y, code, sizeof(float)),
+        _mm256_i32gather_ps(table.z, code, sizeof(float)),
+        normals);
+  }
+
+  if (values != nullptr) {
+    const __m256i quantized = _mm256_and_si256(
+        _mm256_srli_epi32(posNormVal, 3 * POINT_POS_BITS + NORMAL_BITS),
+        _mm256_set1_epi32(POINT_VAL_MAX));
+    _mm256_storeu_ps(
+        values,
+        _mm256_mul_ps(_mm256_cvtepi32_ps(quantized), _mm256_set1_ps(ONE_OVER_POINT_VAL_MAX)));
+  }
+}
+
+#endif
+
+void decompressScalar(
+    const Falcor::CompressedClientPointData* compressed,
+    const Falcor::uint3* gridIndices,
+    size_t gridIndexStride,
+    size_t first,
+    size_t numPoints,
+    float gridCellSize,
+    const Falcor::float3& aabbMin,
+    Falcor::float3* positions,
+    Falcor::float3* normals,
+    float* values) {
+  for (size_t i = first; i < numPoints; i++) {
+    const Falcor::ClientPointData cpd = Falcor::decompressClientData(
+        compressed[i], gridIndices[i * gridIndexStride], gridCellSize, aabbMin);
+
+    if (positions != nullptr)
+      positions[i] = cpd.position;
+    if (normals != nullptr)
+      normals[i] = cpd.normal;
+    if (values != nullptr)
+      values[i] = cpd.value;
+  }
+}
+
+void decompressImpl(
+    const Falcor::CompressedClientPointData* compressed,
+    const Falcor::uint3* gridIndices,
+    size_t gridIndexStride,
+    size_t numPoints,
+    float gridCellSize,
+    const Falcor::float3& aabbMin,
+    Falcor::float3* positions,
+    Falcor::float3* normals,
+    float* values) {
+  size_t i = 0;
+
+#if defined(CLIENT_POINT_CODEC_AVX2)
+  for (; i + kLanes <= numPoints; i += kLanes) {
+    decompress8(
+        compressed + i,
+        gridIndices + i * gridIndexStride,
+        gridIndexStride,
+        gridCellSize,
+        aabbMin,
+        positions != nullptr ? positions + i : nullptr,
+        normals != nullptr ? normals + i : nullptr,
+        values != nullptr ? values + i : nullptr);
+  }
+#endif
+
+  decompressScalar(
+      compressed,
+      gridIndices,
+      gridIndexStride,
+      i,
+      numPoints,
+      gridCellSize,
+      aabbMin,
+      positions,
+      normals,
+      values);
+}
+
+} // namespace
+
+void ClientPointCodec::compress(
+    const Falcor::float3* positions,
+    const Falcor::float3* normals,
+    const float* values,
+    size_t numPoints,
+    float gridCellSize,
+    const Falcor::float3& aabbMin,
+    Falcor::CompressedClientPointData* compressed) {
+  size_t i = 0;
+
+#if defined(CLIENT_POINT_CODEC_AVX2)
+  const size_t stride = sizeof(Falcor::float3);
+
+  for (; i + kLanes <= numPoints; i += kLanes) {
+    const __m256i posNormVal = compress8(
+        gather8(positions + i, stride, 0),
+        gather8(positions + i, stride, sizeof(float)),
+        gather8(positions + i, stride, 2 * sizeof(float)),
+        gather8(normals + i, stride, 0),
+        gather8(normals + i, stride, sizeof(float)),
+        gather8(normals + i, stride, 2 * sizeof(float)),
+        _mm256_loadu_ps(values + i),
+        gridCellSize,
+        aabbMin);
+    _mm256_storeu_si256((__m256i*)(compressed + i), posNormVal);
+  }
+#endif
+
+  for (; i < numPoints; i++) {
+    compressed[i] =
+        Falcor::compressClientData(positions[i], normals[i], values[i], gridCellSize, aabbMin);
+  }
+}
+
+void ClientPointCodec::compressSlots(
+    const Falcor::float3* positions,
+    const Falcor::float3* normals,
+    const float* values,
+    size_t numPoints,
+    float gridCellSize,
+    const Falcor::float3& aabbMin,
+    Falcor::CompressedClientPointData* compressed) {
+  compress(positions, normals, values, numPoints, gridCellSize, aabbMin, compressed);
+
+  for (size_t i = 0; i < numPoints; i++) {
+    if (values[i] < 0.0f)
+      compressed[i] = Falcor::getInvalidCompressedClientData();
+  }
+}
+
+void ClientPointCodec::decompress(
+    const Falcor::CompressedClientPointData* compressed,
+    const Falcor::uint3* gridIndices,
+    size_t numPoints,
+    float gridCellSize,
+    const Falcor::float3& aabbMin,
+    Falcor::float3* positions,
+    Falcor::float3* normals,
+    float* values) {
+  decompressImpl(
+      compressed, gridIndices, 1, numPoints, gridCellSize, aabbMin, positions, normals, values);
+}
+
+void ClientPointCodec::decompress(
+    const Falcor::CompressedClientPointData* compressed,
+    const Falcor::uint3& gridIndex,
+    size_t numPoints,
+    float gridCellSize,
+    const Falcor::float3& aabbMin,
+    Falcor::float3* positions,
+    Falcor::float3* normals,
+    float* values) {
+  decompressImpl(
+      compressed, &gridIndex, 0, numPoints, gridCellSize, aabbMin, positions, normals, values);
+}
+
+void ClientPointCodec::encodeNormals(
+    const Falcor::float3* normals,
+    size_t numNormals,
+    uint32_t* encoded) {
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  const size_t stride = sizeof(Falcor::float3);
+
+  for (; i + kLanes <= numNormals; i += kLanes) {
+    const __m256i codes = encodeNormals8(
+        gather8(normals + i, stride, 0),
+        gather8(normals + i, stride, sizeof(float)),
+        gather8(normals + i, stride, 2 * sizeof(float)));
+    _mm256_storeu_si256((__m256i*)(encoded + i), codes);
+  }
+#endif
+
+  for (; i < numNormals; i++)
+    encoded[i] = Falcor::octahedral8(normals[i]);
+}
+
+void ClientPointCodec::decodeNormals(
+    const uint32_t* encoded,
+    size_t numNormals,
+    Falcor::float3* normals) {
+  const NormalTable& table = getNormalTable();
+
+  // octahedral8Inverse only looks at the lower 8 bits
+  for (size_t i = 0; i < numNormals; i++) {
+    const uint32_t code = encoded[i] & (kNumNormalCodes - 1);
+    normals[i] = Falcor::float3(table.x[code], table.y[code], table.z[code]);
+  }
+}
+
+uint64_t ClientPointCodec::verify(size_t numPoints, uint32_t seed, std::ostream& out) {
+  constexpr uint64_t kMaxPrintedMismatches = 10;
+  uint64_t numMismatches = 0;
+
+  auto reportMismatch = [&](const char* what, size_t index) {
+    if (numMismatches < kMaxPrintedMismatches)
+      out << "ClientPointCodec mismatch: " << what << " of point " << index << std::endl;
+    numMismatches++;
+  };
+
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_int_distribution<uint32_t> cellIndex(0, 63);
+  std::uniform_int_distribution<uint32_t> borderIndex(0, 2 * POINT_POS_MAX);
+
+  const float gridCellSize = 0.37f;
+  const Falcor::float3 aabbMin(-3.5f, 0.25f, 10.0f);
+
+  std::vector<Falcor::float3> positions(numPoints);
+  std::vector<Falcor::float3> normals(numPoints);
+  std::vector<float> values(numPoints);
+  std::vector<Falcor::uint3> gridIndices(numPoints);
+  std::vector<float> slotValues(numPoints);
+
+  for (size_t i = 0; i < numPoints; i++) {
+    gridIndices[i] = Falcor::uint3(cellIndex(rng), cellIndex(rng), cellIndex(rng));
+    Falcor::float3 local(unit(rng) * 0.5f + 0.5f, unit(rng) * 0.5f + 0.5f, unit(rng) * 0.5f + 0.5f);
+
+    // Every fourth point lies on a quantization step or halfway between two
+    if (i % 4 == 1)
+      local.x = borderIndex(rng) * (0.5f / POINT_POS_MAX);
+
+    positions[i] = aabbMin + (Falcor::float3(gridIndices[i]) + local) * gridCellSize;
+
+    switch (i % 8) {
+      case 2:
+        normals[i] = Falcor::float3(0.0f, 0.0f, unit(rng) < 0.0f ? -1.0f : 1.0f);
+        break;
+      case 3:
+        normals[i] = Falcor::float3(unit(rng) < 0.0f ? -1.0f : 1.0f, 0.0f, -0.0f);
+        break;
+      default:
+        normals[i] = glm::normalize(Falcor::float3(unit(rng), unit(rng), unit(rng)) + 1e-6f);
+        break;
+    }
+
+    values[i] = i % 16 == 5 ? UNINITIALIZED_VALUE : unit(rng) * 0.5f + 0.5f;
+
+    slotValues[i] = i % 16 == 7 ? -1.0f : values[i];
+  }
+
+  // Normal encoding
+  std::vector<uint32_t> codes(numPoints);
+  encodeNormals(normals.data(), numPoints, codes.data());
+
+  for (size_t i = 0; i < numPoints; i++) {
+    if (codes[i] != Falcor::octahedral8(normals[i]))
+      reportMismatch("octahedral8", i);
+  }
+
+  // Normal decoding of all codes
+  std::vector<uint32_t> allCodes(kNumNormalCodes);
+  std::vector<Falcor::float3> decodedNormals(kNumNormalCodes);
+  for (uint32_t code = 0; code < kNumNormalCodes; code++)
+    allCodes[code] = code;
+  decodeNormals(allCodes.data(), kNumNormalCodes, decodedNormals.data());
+
+  for (uint32_t code = 0; code < kNumNormalCodes; code++) {
+    if (!isBitEqual(decodedNormals[code], Falcor::octahedral8Inverse(code)))
+      reportMismatch("octahedral8Inverse", code);
+  }
+
+  // Compression of streams and of point slots
+  std::vector<Falcor::CompressedClientPointData> compressed(numPoints);
+  std::vector<Falcor::CompressedClientPointData> compressedSlots(numPoints);
+  compress(
+      positions.data(),
+      normals.data(),
+      values.data(),
+      numPoints,
+      gridCellSize,
+      aabbMin,
+      compressed.data());
+  compressSlots(
+      positions.data(),
+      normals.data(),
+      slotValues.data(),
+      numPoints,
+      gridCellSize,
+      aabbMin,
+      compressedSlots.data());
+
+  for (size_t i = 0; i < numPoints; i++) {
+    const Falcor::uint2 reference = Falcor::getCompressedClientWords(
+        Falcor::compressClientData(positions[i], normals[i], values[i], gridCellSize, aabbMin));
+
+    if (Falcor::getCompressedClientWords(compressed[i]) != reference)
+      reportMismatch("compressClientData", i);
+
+    const Falcor::uint2 slotReference = slotValues[i] < 0.0f
+        ? Falcor::getCompressedClientWords(Falcor::getInvalidCompressedClientData())
+        : reference;
+    if (Falcor::getCompressedClientWords(compressedSlots[i]) != slotReference)
+      reportMismatch("compressClientData of point slot", i);
+  }
+
+  // Decompression, with one grid index per point and with one shared grid index
+  std::vector<Falcor::float3> decodedPositions(numPoints);
+  std::vector<Falcor::float3> cellPositions(numPoints);
+  std::vector<float> decodedValues(numPoints);
+  decodedNormals.resize(numPoints);
+  decompress(
+      compressed.data(),
+      gridIndices.data(),
+      numPoints,
+      gridCellSize,
+      aabbMin,
+      decodedPositions.data(),
+      decodedNormals.data(),
+      decodedValues.data());
+
+  const Falcor::uint3 cellGridIndex(5, 17, 3);
+  decompress(
+      compressed.data(),
+      cellGridIndex,
+      numPoints,
+      gridCellSize,
+      aabbMin,
+      cellPositions.data(),
+      nullptr,
+      nullptr);
+
+  for (size_t i = 0; i < numPoints; i++) {
+    const Falcor::CompressedClientPointData& ccpd = compressed[i];
+    const Falcor::ClientPointData reference =
+        Falcor::decompressClientData(ccpd, gridIndices[i], gridCellSize, aabbMin);
+
+    if (!isBitEqual(decodedPositions[i], reference.position))
+      reportMismatch("decompressClientData position", i);
+    if (!isBitEqual(decodedNormals[i], reference.normal))
+      reportMismatch("decompressClientData normal", i);
+    if (!isBitEqual(decodedValues[i], reference.value))
+      reportMismatch("decompressClientData value", i);
+
+    const Falcor::ClientPointData cellReference =
+        Falcor::decompressClientData(ccpd, cellGridIndex, gridCellSize, aabbMin);
+    if (!isBitEqual(cellPositions[i], cellReference.position))
+      reportMismatch("decompressClientData position with shared grid index", i);
+  }
+
+  out << "ClientPointCodec (" << (hasSIMD() ? "AVX2" : "scalar") << "): " << numPoints
+      << " points, " << numMismatches << " mismatches" << std::endl;
+
+  return numMismatches;
+}
+
+bool ClientPointCodec::hasSIMD() {
+#if defined(CLIENT_POINT_CODEC_AVX2)
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::vector<uint32_t> ClientPointCodec::packCellUpdates(
+    const Falcor::CellUpdateInfo* updates,
+    uint32_t numUpdates) {
+  // Only the points within the capacity of each cell are sent
+  std::vector<uint32_t> cellUpdates;
+  cellUpdates.reserve(numUpdates * (1 + MAX_POINTS_PER_CELL * POINT_ENCODING_WORDS));
+
+  for (uint32_t updateId = 0; updateId < numUpdates; updateId++) {
+    const auto& update = updates[updateId];
+    const uint32_t cellCapacity = Falcor::getCellUpdateCapacity(update.header);
+
+    cellUpdates.push_back(update.header);
+    for (uint32_t pointOffset = 0; pointOffset < cellCapacity; pointOffset++) {
+      const Falcor::uint2 words = Falcor::getCompressedClientWords(update.cellData[pointOffset]);
+
+      for (uint32_t wordId = 0; wordId < POINT_ENCODING_WORDS; wordId++)
+        cellUpdates.push_back(words[wordId]);
+    }
+  }
+
+  return cellUpdates;
+}
+
+} // namespace split_rendering
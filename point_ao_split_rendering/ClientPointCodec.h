@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <ostream>
+#include <vector>
+#include "PointData.slang"
+
+namespace split_rendering {
+
+// Batch versions of compressClientData / decompressClientData (PointData.slang) and of the
+// octahedral normal encoding (OctEncoding.slang) for arrays of points on the CPU.
+//
+// With AVX2, 8 points are encoded or decoded at a time: positions are quantized against aabbMin
+// and the grid cell size, normals are oct encoded with packSnorm2x4 and values are quantized, all
+// with the same operations in the same order as the scalar functions, so the results are bit
+// exact as long as the scalar code is compiled without FMA contraction (verify() catches this).
+// Normals are decoded with a table of the 256 codes built from octahedral8Inverse. Without AVX2,
+// and for the wider point encodings (POINT_ENCODING), the scalar functions are called for every
+// point.
+//
+// The kernels are single threaded, callers split large arrays across threads.
+class ClientPointCodec {
+ public:
+  // compressed[i] = compressClientData(positions[i], normals[i], values[i], ...)
+  static void compress(
+      const Falcor::float3* positions,
+      const Falcor::float3* normals,
+      const float* values,
+      size_t numPoints,
+      float gridCellSize,
+      const Falcor::float3& aabbMin,
+      Falcor::CompressedClientPointData* compressed);
+
+  // Same for point slots, empty slots (negative value) are set to INVALID_CELL
+  static void compressSlots(
+      const Falcor::float3* positions,
+      const Falcor::float3* normals,
+      const float* values,
+      size_t numPoints,
+      float gridCellSize,
+      const Falcor::float3& aabbMin,
+      Falcor::CompressedClientPointData* compressed);
+
+  // decompressClientData of points with their own grid index each. Invalid points are decoded as
+  // well, callers check isPointValid. Any output pointer can be nullptr to skip it.
+  static void decompress(
+      const Falcor::CompressedClientPointData* compressed,
+      const Falcor::uint3* gridIndices,
+      size_t numPoints,
+      float gridCellSize,
+      const Falcor::float3& aabbMin,
+      Falcor::float3* positions,
+      Falcor::float3* normals,
+      float* values);
+
+  // Same for points of one cell, e.g. a point cell of the client
+  static void decompress(
+      const Falcor::CompressedClientPointData* compressed,
+      const Falcor::uint3& gridIndex,
+      size_t numPoints,
+      float gridCellSize,
+      const Falcor::float3& aabbMin,
+      Falcor::float3* positions,
+      Falcor::float3* normals,
+      float* values);
+
+  // Packs cell updates for the network with a variable number of points per cell: the header of
+  // each update (see Falcor::encodeCellUpdateHeader) is followed by its first cellCapacity points
+  static std::vector<uint32_t> packCellUpdates(
+      const Falcor::CellUpdateInfo* updates,
+      uint32_t numUpdates);
+
+  // octahedral8 / octahedral8Inverse
+  static void encodeNormals(const Falcor::float3* normals, size_t numNormals, uint32_t* encoded);
+  static void decodeNormals(const uint32_t* encoded, size_t numNormals, Falcor::float3* normals);
+
+  // Compares the batch kernels with the scalar functions on numPoints random points (including
+  // points on cell borders and axis aligned normals) and all normal codes. Prints the first
+  // mismatches and returns the number of mismatching values, 0 if the kernels are bit exact.
+  static uint64_t verify(size_t numPoints, uint32_t seed, std::ostream& out);
+
+  static bool hasSIMD();
+};
+
+} // namespace split_rendering
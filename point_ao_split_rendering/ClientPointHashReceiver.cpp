@@ -9,6 +9,7 @@
 #include "ClientPointHashReceiver.h"
 #include <algorithm>
 #include <execution>
+#include "Tracing.h"
 #include "lz4.h"
 #include "zstd.h"
 
@@ -23,10 +24,20 @@ void ClientPointHashReceiver::init() {
       Falcor::ComputePass::create("Samples/FalcorServer/PointHashUpdateStage.cs.slang");
   hashComputePass_->getProgram()->setGenerateDebugInfoEnabled(true);
 
+  remapComputePass_ =
+      Falcor::ComputePass::create("Samples/FalcorServer/PointCellRemapStage.cs.slang");
+  remapComputePass_->getProgram()->setGenerateDebugInfoEnabled(true);
+
   // TODO: use some sort of config file for this
   constexpr uint32_t kMaxNumCellUpdates = 1000000;
   cellUpdateBuffer_ = Falcor::Buffer::createStructured(
-      sizeof(Falcor::CellUpdateInfo),
+      sizeof(uint32_t),
+      kMaxNumCellUpdates * (1 + MAX_POINTS_PER_CELL * POINT_ENCODING_WORDS),
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      Falcor::Buffer::CpuAccess::None);
+
+  cellUpdateOffsetBuffer_ = Falcor::Buffer::createStructured(
+      sizeof(uint32_t),
       kMaxNumCellUpdates,
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None);
@@ -40,14 +51,18 @@ void ClientPointHashReceiver::init() {
 
 void ClientPointHashReceiver::receive(TCPMessage& message, Falcor::RenderContext* renderContext) {
   FALCOR_PROFILE("receive");
+  TRACE_SCOPE("receive");
+
+  const auto receive_vector_message = [&](TCPMessage& message, auto& gpuBuffer, uint32_t typeSize) {
+    size_t numBytes = 0;
+    const uint8_t* data = getPayload(message, numBytes);
 
-  const auto receive_vector_message = [](TCPMessage& message, auto& gpuBuffer, uint32_t typeSize) {
     gpuBuffer = Falcor::Buffer::createStructured(
         typeSize,
-        message.data.size() / typeSize,
+        (uint32_t)(numBytes / typeSize),
         Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
         Falcor::Buffer::CpuAccess::None,
-        message.data.data());
+        data);
   };
 
   switch (message.header.type) {
@@ -76,46 +91,74 @@ void ClientPointHashReceiver::receive(TCPMessage& message, Falcor::RenderContext
   // This is just to make the profiling in Falcor work more nicely.
   updateCells(message, renderContext);
   updateHash(message, renderContext);
+  relocateInstance(message, renderContext);
+  remapCells(message, renderContext);
+}
+
+const uint8_t* ClientPointHashReceiver::getPayload(const TCPMessage& message, size_t& numBytes) {
+  numBytes = message.data.size();
+
+  // Older servers left decompressedSize at 0 for uncompressed messages
+  if (message.header.decompressedSize == 0 ||
+      message.header.decompressedSize == message.header.size) {
+    return message.data.data();
+  }
+
+  decompressedData_.resize(message.header.decompressedSize);
+
+  // If we don't know the compression type yet, figure it out
+  if (!networkCompression_.get()) {
+    networkCompression_ =
+        NetworkCompressionBase::getDerived((NetworkCompressionID)message.header.width);
+  }
+
+  int numDecompressedBytes = networkCompression_->decompressData(message.data, decompressedData_);
+
+  if (numDecompressedBytes <= 0) {
+    // This should never happen.
+    throw std::runtime_error("Number of decompressed bytes <= 0, error in decompression!");
+  }
+
+  numBytes = numDecompressedBytes;
+  return decompressedData_.data();
 }
 
 void ClientPointHashReceiver::updateCells(
     TCPMessage& message,
     Falcor::RenderContext* renderContext) {
   FALCOR_PROFILE("updateCells");
+  TRACE_SCOPE("updateCells");
 
   if (message.header.type != TCPMessageType::PAOPointCellUpdate)
     return;
 
-  uint32_t numUpdates = message.header.size / sizeof(Falcor::CellUpdateInfo);
+  size_t numUpdateBytes = 0;
+  const uint8_t* updateData = getPayload(message, numUpdateBytes);
 
-  if (message.header.decompressedSize != message.header.size) {
-    decompressedData_.resize(message.header.decompressedSize);
+  // Cells have a different number of points per instance, so we find where each update starts
+  const uint32_t* updateWords = (const uint32_t*)updateData;
+  const uint32_t numUpdateWords = (uint32_t)(numUpdateBytes / sizeof(uint32_t));
 
-    // If we don't know the compression type yet, figure it out
-    if (!networkCompression_.get()) {
-      networkCompression_ =
-          NetworkCompressionBase::getDerived((NetworkCompressionID)message.header.width);
-    }
-
-    int numDecompressedBytes = networkCompression_->decompressData(message.data, decompressedData_);
+  cellUpdateOffsets_.clear();
+  for (uint32_t wordId = 0; wordId < numUpdateWords;
+       wordId += Falcor::getCellUpdateNumWords(updateWords[wordId])) {
+    cellUpdateOffsets_.push_back(wordId);
+  }
 
-    if (numDecompressedBytes <= 0) {
-      // This should never happen.
-      throw std::runtime_error("Number of decompressed bytes <= 0, error in decompression!");
-    }
+  const uint32_t numUpdates = (uint32_t)cellUpdateOffsets_.size();
 
-    cellUpdateBuffer_->setBlob(decompressedData_.data(), 0, numDecompressedBytes);
+  if (numUpdates == 0)
+    return;
 
-    // We need a different number of updates for when we have compression
-    numUpdates = decompressedData_.size() / sizeof(Falcor::CellUpdateInfo);
-  } else {
-    cellUpdateBuffer_->setBlob(message.data.data(), 0, message.data.size());
-  }
+  cellUpdateBuffer_->setBlob(updateData, 0, numUpdateWords * sizeof(uint32_t));
+  cellUpdateOffsetBuffer_->setBlob(
+      cellUpdateOffsets_.data(), 0, cellUpdateOffsets_.size() * sizeof(uint32_t));
 
   auto vars = cellComputePass_->getVars();
 
   vars["compressedClientAOPoints"] = gpuCompressedClientPointCells_;
-  vars["cellUpdateInfos"] = cellUpdateBuffer_;
+  vars["packedCellUpdates"] = cellUpdateBuffer_;
+  vars["packedCellUpdateOffsets"] = cellUpdateOffsetBuffer_;
 
   auto cb = vars["perFrameConstantBuffer"];
   cb["numUpdates"] = numUpdates;
@@ -127,6 +170,7 @@ void ClientPointHashReceiver::updateHash(
     TCPMessage& message,
     Falcor::RenderContext* renderContext) {
   FALCOR_PROFILE("updateHash");
+  TRACE_SCOPE("updateHash");
 
   if (message.header.type != TCPMessageType::PAOHashUpdate)
     return;
@@ -146,4 +190,176 @@ void ClientPointHashReceiver::updateHash(
   hashComputePass_->execute(renderContext, Falcor::uint3(numUpdates, 1, 1));
 }
 
+void ClientPointHashReceiver::relocateInstance(
+    TCPMessage& message,
+    Falcor::RenderContext* renderContext) {
+  FALCOR_PROFILE("relocateInstance");
+  TRACE_SCOPE("relocateInstance");
+
+  if (message.header.type != TCPMessageType::PAOInstanceRelocation)
+    return;
+
+  Falcor::InstanceRelocationInfo info;
+  std::memcpy(&info, message.data.data(), sizeof(Falcor::InstanceRelocationInfo));
+
+  const auto* hashEntries = (const Falcor::CompactHashToCellInfo*)(message.data.data() +
+                                                                    sizeof(info));
+
+  // The server moves relocated regions into regions it released earlier or appends them to the
+  // end of its buffers, so we grow ours the same way and keep the old contents at the start
+  const auto growBuffer = [&](Falcor::Buffer::SharedPtr& buffer, uint32_t newElementCount) {
+    Falcor::Buffer::SharedPtr oldBuffer = buffer;
+
+    if (newElementCount > oldBuffer->getElementCount()) {
+      buffer = Falcor::Buffer::createStructured(
+          oldBuffer->getStructSize(),
+          newElementCount,
+          Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+          Falcor::Buffer::CpuAccess::None);
+      renderContext->copyBufferRegion(buffer.get(), 0, oldBuffer.get(), 0, oldBuffer->getSize());
+    }
+
+    return oldBuffer;
+  };
+
+  const auto invalidatePoints = [&](uint32_t offset, uint32_t numPoints) {
+    if (numPoints == 0)
+      return;
+
+    std::vector<Falcor::CompressedClientPointData> invalidPoints(numPoints);
+    gpuCompressedClientPointCells_->setBlob(
+        invalidPoints.data(),
+        offset * sizeof(Falcor::CompressedClientPointData),
+        numPoints * sizeof(Falcor::CompressedClientPointData));
+  };
+
+  growBuffer(gpuHashToPointCell_, info.totalHashEntries);
+
+  gpuHashToPointCell_->setBlob(
+      hashEntries,
+      info.ihi.hashToBucketOffset * sizeof(Falcor::CompactHashToCellInfo),
+      info.numHashEntries * sizeof(Falcor::CompactHashToCellInfo));
+
+  if (info.ipi.pointCellOffset != info.oldPointCellOffset) {
+    const uint32_t oldNumPoints = gpuCompressedClientPointCells_->getElementCount();
+    auto oldPoints = growBuffer(gpuCompressedClientPointCells_, info.totalPointSlots);
+    const uint64_t poolSize =
+        (uint64_t)info.oldMaxNumPoints * sizeof(Falcor::CompressedClientPointData);
+
+    if (info.totalPointSlots > oldNumPoints)
+      invalidatePoints(oldNumPoints, info.totalPointSlots - oldNumPoints);
+
+    // A pool moved into a released region stays in the same buffer, which can't be the source and
+    // destination of one copy
+    Falcor::Buffer::SharedPtr source = oldPoints;
+
+    if (oldPoints == gpuCompressedClientPointCells_) {
+      source = Falcor::Buffer::create(
+          poolSize, Falcor::ResourceBindFlags::None, Falcor::Buffer::CpuAccess::None);
+      renderContext->copyBufferRegion(
+          source.get(),
+          0,
+          oldPoints.get(),
+          info.oldPointCellOffset * sizeof(Falcor::CompressedClientPointData),
+          poolSize);
+    }
+
+    renderContext->copyBufferRegion(
+        gpuCompressedClientPointCells_.get(),
+        info.ipi.pointCellOffset * sizeof(Falcor::CompressedClientPointData),
+        source.get(),
+        source == oldPoints ? info.oldPointCellOffset * sizeof(Falcor::CompressedClientPointData)
+                            : 0,
+        poolSize);
+
+    // Like on the server, the released region and the new part of the pool are empty
+    invalidatePoints(info.oldPointCellOffset, info.oldMaxNumPoints);
+    invalidatePoints(
+        info.ipi.pointCellOffset + info.oldMaxNumPoints,
+        info.ipi.maxNumPoints - info.oldMaxNumPoints);
+  }
+
+  gpuInstanceHashInfo_->setBlob(
+      &info.ihi,
+      info.instanceId * sizeof(Falcor::InstanceHashInfo),
+      sizeof(Falcor::InstanceHashInfo));
+  gpuInstancePointInfo_->setBlob(
+      &info.ipi,
+      info.instanceId * sizeof(Falcor::InstancePointInfo),
+      sizeof(Falcor::InstancePointInfo));
+}
+
+void ClientPointHashReceiver::remapCells(
+    TCPMessage& message,
+    Falcor::RenderContext* renderContext) {
+  FALCOR_PROFILE("remapCells");
+  TRACE_SCOPE("remapCells");
+
+  if (message.header.type != TCPMessageType::PAOInstanceCellRemap)
+    return;
+
+  Falcor::InstanceCellRemapInfo info;
+  std::memcpy(&info, message.data.data(), sizeof(Falcor::InstanceCellRemapInfo));
+
+  const auto* runs = (const Falcor::CellRemapRun*)(message.data.data() + sizeof(info));
+
+  // Move the cells the same way as the server. Runs only move towards the front but may overlap
+  // their old location, so the allocated part of the pool is staged first.
+  const uint32_t cellSize = info.cellCapacity * sizeof(Falcor::CompressedClientPointData);
+  const uint64_t poolOffset =
+      (uint64_t)info.pointCellOffset * sizeof(Falcor::CompressedClientPointData);
+
+  Falcor::Buffer::SharedPtr scratch = Falcor::Buffer::create(
+      (size_t)info.oldNumAllocatedCells * cellSize,
+      Falcor::ResourceBindFlags::None,
+      Falcor::Buffer::CpuAccess::None);
+  renderContext->copyBufferRegion(
+      scratch.get(),
+      0,
+      gpuCompressedClientPointCells_.get(),
+      poolOffset,
+      (uint64_t)info.oldNumAllocatedCells * cellSize);
+
+  for (uint32_t runId = 0; runId < info.numRuns; runId++) {
+    const auto& run = runs[runId];
+    if (run.oldCell == run.newCell)
+      continue;
+
+    renderContext->copyBufferRegion(
+        gpuCompressedClientPointCells_.get(),
+        poolOffset + (uint64_t)run.newCell * cellSize,
+        scratch.get(),
+        (uint64_t)run.oldCell * cellSize,
+        (uint64_t)run.numCells * cellSize);
+  }
+
+  std::vector<Falcor::CompressedClientPointData> invalidPoints(
+      (info.oldNumAllocatedCells - info.newNumAllocatedCells) * info.cellCapacity);
+  gpuCompressedClientPointCells_->setBlob(
+      invalidPoints.data(),
+      poolOffset + (uint64_t)info.newNumAllocatedCells * cellSize,
+      invalidPoints.size() * sizeof(Falcor::CompressedClientPointData));
+
+  // Rewrite the cell indices of the instance's hash table
+  Falcor::Buffer::SharedPtr runBuffer = Falcor::Buffer::createStructured(
+      sizeof(Falcor::CellRemapRun),
+      std::max(info.numRuns, 1U),
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      Falcor::Buffer::CpuAccess::None,
+      info.numRuns > 0 ? runs : nullptr);
+
+  auto vars = remapComputePass_->getVars();
+
+  vars["serverHashToPointCell"] = gpuHashToPointCell_;
+  vars["cellRemapRuns"] = runBuffer;
+
+  auto cb = vars["perFrameConstantBuffer"];
+  cb["hashToBucketOffset"] = info.hashToBucketOffset;
+  cb["numHashEntries"] = info.numHashEntries;
+  cb["numRuns"] = info.numRuns;
+  cb["cellCapacity"] = info.cellCapacity;
+
+  remapComputePass_->execute(renderContext, Falcor::uint3(info.numHashEntries, 1, 1));
+}
+
 } // namespace split_rendering
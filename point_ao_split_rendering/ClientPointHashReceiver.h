@@ -47,10 +47,17 @@ class ClientPointHashReceiver {
   }
 
  private:
+  // Payload of the message, decompressed into decompressedData_ if the server compressed it
+  const uint8_t* getPayload(const TCPMessage& message, size_t& numBytes);
+
   void updateCells(TCPMessage& message, Falcor::RenderContext* renderContext);
 
   void updateHash(TCPMessage& message, Falcor::RenderContext* renderContext);
 
+  void relocateInstance(TCPMessage& message, Falcor::RenderContext* renderContext);
+
+  void remapCells(TCPMessage& message, Falcor::RenderContext* renderContext);
+
   Falcor::Buffer::SharedPtr gpuHashToPointCell_;
   Falcor::Buffer::SharedPtr gpuInstanceHashInfo_;
   Falcor::Buffer::SharedPtr gpuInstancePointInfo_;
@@ -61,10 +68,13 @@ class ClientPointHashReceiver {
 
   Falcor::ComputePass::SharedPtr cellComputePass_;
   Falcor::ComputePass::SharedPtr hashComputePass_;
+  Falcor::ComputePass::SharedPtr remapComputePass_;
   Falcor::Buffer::SharedPtr cellUpdateBuffer_;
+  Falcor::Buffer::SharedPtr cellUpdateOffsetBuffer_;
   Falcor::Buffer::SharedPtr hashUpdateBuffer_;
 
   std::vector<uint8_t> decompressedData_;
+  std::vector<uint32_t> cellUpdateOffsets_;
   std::unique_ptr<NetworkCompressionBase> networkCompression_;
 };
 
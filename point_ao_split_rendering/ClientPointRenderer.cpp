@@ -11,6 +11,7 @@
 // shared\third-party\Falcor\4.1\Falcor\Source\Samples\HelloDXR\HelloDXR.cpp
 
 #include "ClientPointRenderer.h"
+#include "Tracing.h"
 
 #include <stdio.h>
 
@@ -106,6 +107,7 @@ void ClientPointRenderer::onLoad(RenderContext* renderContext) {
 
 void ClientPointRenderer::receiveMessages(RenderContext* renderContext) {
   FALCOR_PROFILE("receiveMessages");
+  TRACE_SCOPE("receiveMessages");
   TCPMessage msg;
 
   bool msgReceived = false;
@@ -153,6 +155,7 @@ void ClientPointRenderer::receiveMessages(RenderContext* renderContext) {
 
 void ClientPointRenderer::sendMessages() {
   FALCOR_PROFILE("sendMessages");
+  TRACE_SCOPE("sendMessages");
   static int id = -1;
   id++;
 
@@ -198,6 +201,8 @@ void ClientPointRenderer::sendMessages() {
 void ClientPointRenderer::onFrameRender(
     RenderContext* renderContext,
     const Fbo::SharedPtr& targetFbo) {
+  TRACE_SCOPE("onFrameRender");
+
   renderContext->clearFbo(targetFbo.get(), kClearColor, 1.0f, 0, FboAttachmentType::All);
 
   clock_.tick();
@@ -238,6 +243,7 @@ void ClientPointRenderer::onFrameRender(
     // Depth prepass
     {
       FALCOR_PROFILE("Depth Prepass");
+      TRACE_SCOPE("Depth Prepass");
       constantBuffer["depthPrepass"] = true;
       rasterPass_->renderScene(renderContext, targetFbo, [&](EyeType eye) {});
     }
@@ -11,6 +11,7 @@
 // shared\third-party\Falcor\4.1\Falcor\Source\Samples\HelloDXR\HelloDXR.cpp
 
 #include "ClientScreenSpaceRenderer.h"
+#include "Tracing.h"
 
 #include <stdio.h>
 
@@ -128,6 +129,7 @@ void ClientScreenSpaceRenderer::renderDepthNormalsPrepass(
 
 void ClientScreenSpaceRenderer::receiveMessages() {
   FALCOR_PROFILE("receiveMessages");
+  TRACE_SCOPE("receiveMessages");
   TCPMessage msg;
 
   while (client_.tryPopFront(msg)) {
@@ -141,6 +143,7 @@ void ClientScreenSpaceRenderer::receiveMessages() {
 
 void ClientScreenSpaceRenderer::sendMessages() {
   FALCOR_PROFILE("sendMessages");
+  TRACE_SCOPE("sendMessages");
   static int id = -1;
   id++;
 
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ExperimentSweep.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace split_rendering {
+
+namespace {
+
+// Just enough JSON for the sweep configs: no unicode escapes, numbers as double
+struct JsonValue {
+  enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+
+  Type type = Type::kNull;
+  bool boolean = false;
+  double number = 0.0;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+};
+
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string& text) : text_(text) {}
+
+  JsonValue parse() {
+    JsonValue value = parseValue();
+    skipWhitespace();
+    if (position_ != text_.size())
+      fail("trailing characters");
+    return value;
+  }
+
+ private:
+  [[noreturn]] void fail(const std::string& message) {
+    throw std::runtime_error(message + " at offset " + std::to_string(position_));
+  }
+
+  void skipWhitespace() {
+    while (position_ < text_.size() && std::isspace((unsigned char)text_[position_]))
+      position_++;
+  }
+
+  bool consume(char c) {
+    skipWhitespace();
+    if (position_ < text_.size() && text_[position_] == c) {
+      position_++;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c) {
+    if (!consume(c))
+      fail(std::string("expected '") + c + "'");
+  }
+
+  bool consumeWord(const char* word) {
+    size_t length = std::char_traits<char>::length(word);
+    if (text_.compare(position_, length, word) != 0)
+      return false;
+    position_ += length;
+    return true;
+  }
+
+  JsonValue parseValue() {
+    skipWhitespace();
+    if (position_ >= text_.size())
+      fail("unexpected end");
+
+    JsonValue value;
+    char c = text_[position_];
+
+    if (c == '{') {
+      value.type = JsonValue::Type::kObject;
+      position_++;
+      if (consume('}'))
+        return value;
+      do {
+        skipWhitespace();
+        std::string key = parseString();
+        expect(':');
+        value.object.emplace_back(std::move(key), parseValue());
+      } while (consume(','));
+      expect('}');
+    } else if (c == '[') {
+      value.type = JsonValue::Type::kArray;
+      position_++;
+      if (consume(']'))
+        return value;
+      do {
+        value.array.push_back(parseValue());
+      } while (consume(','));
+      expect(']');
+    } else if (c == '"') {
+      value.type = JsonValue::Type::kString;
+      value.string = parseString();
+    } else if (consumeWord("true")) {
+      value.type = JsonValue::Type::kBool;
+      value.boolean = true;
+    } else if (consumeWord("false")) {
+      value.type = JsonValue::Type::kBool;
+    } else if (consumeWord("null")) {
+      value.type = JsonValue::Type::kNull;
+    } else {
+      const char* begin = text_.c_str() + position_;
+      char* end = nullptr;
+      value.type = JsonValue::Type::kNumber;
+      value.number = std::strtod(begin, &end);
+      if (end == begin)
+        fail("invalid value");
+      position_ += end - begin;
+    }
+
+    return value;
+  }
+
+  std::string parseString() {
+    if (position_ >= text_.size() || text_[position_] != '"')
+      fail("expected a string");
+    position_++;
+
+    std::string result;
+    while (position_ < text_.size() && text_[position_] != '"') {
+      char c = text_[position_++];
+      if (c == '\\' && position_ < text_.size()) {
+        char escaped = text_[position_++];
+        switch (escaped) {
+          case 'n':
+            c = '\n';
+            break;
+          case 't':
+            c = '\t';
+            break;
+          default:
+            c = escaped;
+        }
+      }
+      result += c;
+    }
+
+    if (position_ >= text_.size())
+      fail("unterminated string");
+    position_++;
+    return result;
+  }
+
+  const std::string& text_;
+  size_t position_ = 0;
+};
+
+void checkType(const JsonValue& value, JsonValue::Type type, const std::string& key) {
+  if (value.type != type)
+    throw std::runtime_error("unexpected type of \"" + key + "\"");
+}
+
+float toFloat(const JsonValue& value, const std::string& key) {
+  checkType(value, JsonValue::Type::kNumber, key);
+  return (float)value.number;
+}
+
+std::vector<float> toFloats(const JsonValue& value, const std::string& key) {
+  checkType(value, JsonValue::Type::kArray, key);
+  std::vector<float> result;
+  for (const auto& element : value.array)
+    result.push_back(toFloat(element, key));
+  return result;
+}
+
+std::array<float, 3> toFloat3(const JsonValue& value, const std::string& key) {
+  std::vector<float> values = toFloats(value, key);
+  if (values.size() != 3)
+    throw std::runtime_error("\"" + key + "\" needs 3 values");
+  return {values[0], values[1], values[2]};
+}
+
+std::string toString(const JsonValue& value, const std::string& key) {
+  checkType(value, JsonValue::Type::kString, key);
+  return value.string;
+}
+
+bool toBool(const JsonValue& value, const std::string& key) {
+  checkType(value, JsonValue::Type::kBool, key);
+  return value.boolean;
+}
+
+// "40" instead of "40.000000" in paths and ids
+std::string formatNumber(float value) {
+  std::ostringstream ss;
+  ss << value;
+  return ss.str();
+}
+
+} // namespace
+
+bool SweepConfig::load(const std::string& filename, SweepConfig& config) {
+  std::ifstream file(filename);
+  if (!file.is_open()) {
+    std::cout << "could not open sweep config " << filename << std::endl;
+    return false;
+  }
+
+  std::stringstream text;
+  text << file.rdbuf();
+
+  SweepConfig result;
+
+  try {
+    JsonValue root = JsonParser(text.str()).parse();
+    checkType(root, JsonValue::Type::kObject, "root");
+
+    for (const auto& [key, value] : root.object) {
+      if (key == "output_dir") {
+        result.outputDirectory = toString(value, key);
+      } else if (key == "cameras") {
+        checkType(value, JsonValue::Type::kArray, key);
+        result.cameras.clear();
+        for (const auto& cameraValue : value.array) {
+          checkType(cameraValue, JsonValue::Type::kObject, key);
+          Camera camera;
+          for (const auto& [cameraKey, parameter] : cameraValue.object) {
+            if (cameraKey == "position") {
+              camera.position = toFloat3(parameter, cameraKey);
+              camera.hasPosition = true;
+            } else if (cameraKey == "target") {
+              camera.target = toFloat3(parameter, cameraKey);
+            } else if (cameraKey == "up") {
+              camera.up = toFloat3(parameter, cameraKey);
+            } else {
+              std::cout << "sweep config: ignoring unknown camera key " << cameraKey << std::endl;
+            }
+          }
+          result.cameras.push_back(camera);
+        }
+      } else if (key == "time_stamps") {
+        result.timeStamps = toFloats(value, key);
+      } else if (key == "latencies_ms") {
+        result.latenciesMs = toFloats(value, key);
+      } else if (key == "ao_types") {
+        checkType(value, JsonValue::Type::kArray, key);
+        result.aoTypes.clear();
+        for (const auto& element : value.array)
+          result.aoTypes.push_back(toString(element, key));
+      } else if (key == "ao_configs") {
+        checkType(value, JsonValue::Type::kArray, key);
+        result.aoConfigs.clear();
+        for (const auto& configValue : value.array) {
+          checkType(configValue, JsonValue::Type::kObject, key);
+          AOConfig aoConfig;
+          for (const auto& [configKey, parameter] : configValue.object) {
+            if (configKey == "name")
+              aoConfig.name = toString(parameter, configKey);
+            else if (configKey == "ao_only")
+              aoConfig.aoOnly = toBool(parameter, configKey);
+            else if (configKey == "point_viz")
+              aoConfig.pointViz = toBool(parameter, configKey);
+            else
+              std::cout << "sweep config: ignoring unknown AO config key " << configKey
+                        << std::endl;
+          }
+          if (aoConfig.name.empty())
+            aoConfig.name = "config" + std::to_string(result.aoConfigs.size());
+          result.aoConfigs.push_back(aoConfig);
+        }
+      } else if (key == "reference") {
+        checkType(value, JsonValue::Type::kObject, key);
+        for (const auto& [referenceKey, parameter] : value.object) {
+          if (referenceKey == "ao_type")
+            result.referenceAOType = toString(parameter, referenceKey);
+          else if (referenceKey == "latency_ms")
+            result.referenceLatencyMs = toFloat(parameter, referenceKey);
+        }
+      } else if (key == "ao_samples") {
+        checkType(value, JsonValue::Type::kObject, key);
+        result.aoSamples.clear();
+        for (const auto& [aoType, samples] : value.object) {
+          if (aoType == "default")
+            result.defaultAOSamples = (uint32_t)toFloat(samples, aoType);
+          else
+            result.aoSamples[aoType] = (uint32_t)toFloat(samples, aoType);
+        }
+      } else if (key == "color_only_pass") {
+        result.colorOnlyPass = toBool(value, key);
+      } else if (key == "warmup_frames") {
+        result.warmupFrames = (uint32_t)toFloat(value, key);
+      } else {
+        std::cout << "sweep config: ignoring unknown key " << key << std::endl;
+      }
+    }
+  } catch (const std::runtime_error& err) {
+    std::cout << "invalid sweep config " << filename << ": " << err.what() << std::endl;
+    return false;
+  }
+
+  config = std::move(result);
+  return true;
+}
+
+ExperimentSweep::ExperimentSweep(const SweepConfig& config) : config_(config) {
+  std::filesystem::create_directories(config_.outputDirectory);
+  loadFinishedRuns();
+  expand();
+}
+
+std::string ExperimentSweep::getManifestFilename() const {
+  return config_.outputDirectory + "/sweep_runs.csv";
+}
+
+void ExperimentSweep::loadFinishedRuns() {
+  std::ifstream manifest(getManifestFilename());
+  std::string line;
+
+  // Skip the header
+  std::getline(manifest, line);
+
+  // The id is the first, quoted column
+  while (std::getline(manifest, line)) {
+    size_t end = line.find('"', 1);
+    if (line.size() > 1 && line[0] == '"' && end != std::string::npos)
+      finishedRunIds_.insert(line.substr(1, end - 1));
+  }
+}
+
+void ExperimentSweep::expand() {
+  // The reference AO type and latency go first
+  bool rendersReference =
+      std::find(config_.aoTypes.begin(), config_.aoTypes.end(), config_.referenceAOType) !=
+      config_.aoTypes.end();
+
+  std::vector<std::string> aoTypes;
+  if (rendersReference)
+    aoTypes.push_back(config_.referenceAOType);
+  for (const auto& aoType : config_.aoTypes) {
+    if (aoType != config_.referenceAOType)
+      aoTypes.push_back(aoType);
+  }
+
+  std::vector<float> referenceLatencies = {config_.referenceLatencyMs};
+  for (float latencyMs : config_.latenciesMs) {
+    if (latencyMs != config_.referenceLatencyMs)
+      referenceLatencies.push_back(latencyMs);
+  }
+
+  // Warm-up frames are needed for the first pending run after a camera or time stamp change
+  bool needsWarmup = true;
+
+  const auto addRun = [&](SweepRun run) {
+    numRuns_++;
+
+    if (finishedRunIds_.count(run.id) && std::filesystem::exists(run.imageFilename))
+      return;
+
+    run.warmupFrames = needsWarmup ? config_.warmupFrames : 0;
+    needsWarmup = false;
+    pendingRuns_.push_back(std::move(run));
+  };
+
+  for (uint32_t cameraIndex = 0; cameraIndex < config_.cameras.size(); cameraIndex++) {
+    for (float timeStamp : config_.timeStamps) {
+      needsWarmup = true;
+
+      std::string timeDirectory = config_.outputDirectory + "/t" + formatNumber(timeStamp);
+
+      if (config_.colorOnlyPass) {
+        SweepRun run;
+        run.cameraIndex = cameraIndex;
+        run.timeStamp = timeStamp;
+        run.colorOnly = true;
+        run.id = "t" + formatNumber(timeStamp) + "/color_only/" + std::to_string(cameraIndex);
+        run.imageFilename =
+            timeDirectory + "/color_only/images/" + std::to_string(cameraIndex) + ".png";
+        addRun(std::move(run));
+      }
+
+      for (const auto& aoConfig : config_.aoConfigs) {
+        std::string configDirectory = timeDirectory + "/" + aoConfig.name;
+
+        for (const auto& aoType : aoTypes) {
+          bool isReferenceType = aoType == config_.referenceAOType;
+
+          for (float latencyMs : isReferenceType ? referenceLatencies : config_.latenciesMs) {
+            SweepRun run;
+            run.cameraIndex = cameraIndex;
+            run.timeStamp = timeStamp;
+            run.aoConfig = aoConfig;
+            run.aoType = aoType;
+            run.latencyMs = latencyMs;
+
+            auto samples = config_.aoSamples.find(aoType);
+            run.aoSamples =
+                samples != config_.aoSamples.end() ? samples->second : config_.defaultAOSamples;
+
+            std::string name =
+                std::to_string(cameraIndex) + "_" + aoType + "_" + formatNumber(latencyMs);
+            run.id = "t" + formatNumber(timeStamp) + "/" + aoConfig.name + "/" + name;
+            run.imageFilename = configDirectory + "/images/" + name + ".png";
+
+            bool isReference = isReferenceType && latencyMs == config_.referenceLatencyMs;
+            if (!aoConfig.pointViz && !isReference) {
+              run.referenceFilename = configDirectory + "/images/" +
+                  std::to_string(cameraIndex) + "_" + config_.referenceAOType + "_" +
+                  formatNumber(config_.referenceLatencyMs) + ".png";
+              run.flipDirectory = configDirectory + "/flip";
+            }
+
+            addRun(std::move(run));
+          }
+        }
+      }
+    }
+  }
+}
+
+void ExperimentSweep::markFinished(const SweepRun& run, const FlipComparisonResult* flipResult) {
+  std::lock_guard<std::mutex> lock(manifestMutex_);
+
+  std::ofstream manifest(getManifestFilename(), std::ios::app);
+  if (!manifest.is_open()) {
+    std::cout << "could not write " << getManifestFilename() << std::endl;
+    return;
+  }
+
+  manifest.seekp(0, std::ios_base::end);
+  if (manifest.tellp() <= 0)
+    manifest << "id,camera,time_stamp,ao_config,ao_type,latency_ms,ao_samples,image,flip_mean,"
+                "flip_weighted_median,flip_weighted_third_quartile,flip_max\n";
+
+  manifest << "\"" << run.id << "\"," << run.cameraIndex << "," << run.timeStamp << ",\""
+           << (run.colorOnly ? "color_only" : run.aoConfig.name) << "\",\"" << run.aoType
+           << "\"," << run.latencyMs << "," << run.aoSamples << ",\"" << run.imageFilename
+           << "\",";
+
+  if (flipResult && flipResult->valid) {
+    manifest << flipResult->mean << "," << flipResult->weightedMedian << ","
+             << flipResult->weightedThirdQuartile << "," << flipResult->maxValue << "\n";
+  } else {
+    manifest << ",,,\n";
+  }
+
+  numFinished_++;
+}
+
+size_t ExperimentSweep::getNumFinished() {
+  std::lock_guard<std::mutex> lock(manifestMutex_);
+  return numFinished_;
+}
+
+} // namespace split_rendering
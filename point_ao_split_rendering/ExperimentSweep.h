@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "FLIPComparisonResult.h"
+
+namespace split_rendering {
+
+// Parameters of an automated screenshot sweep, loaded from a JSON file (--sweep_config). All keys
+// are optional, missing keys keep the defaults below:
+//
+// {
+//   "output_dir": "automated_screenshots",
+//   "cameras": [{"position": [-1.68, 1.61, 3.21], "target": [-1.10, 1.21, 2.51],
+//                "up": [0.0, 1.0, 0.0]}],
+//   "time_stamps": [1, 5],
+//   "latencies_ms": [0, 40, 80, 120],
+//   "ao_types": ["Per-pixel RTAO", "Point RTAO (Hash, Update)", "SSAO"],
+//   "ao_configs": [{"name": "color"}, {"name": "point_viz", "point_viz": true},
+//                  {"name": "ao", "ao_only": true}],
+//   "reference": {"ao_type": "Per-pixel RTAO", "latency_ms": 0},
+//   "ao_samples": {"default": 4096, "Per-pixel RTAO": 512},
+//   "color_only_pass": true,
+//   "warmup_frames": 0
+// }
+//
+// Cameras without a position and target keep the current ones and only set the up vector.
+struct SweepConfig {
+  struct Camera {
+    bool hasPosition = false;
+    std::array<float, 3> position = {0.0f, 0.0f, 0.0f};
+    std::array<float, 3> target = {0.0f, 0.0f, -1.0f};
+    std::array<float, 3> up = {0.0f, 1.0f, 0.0f};
+  };
+
+  struct AOConfig {
+    std::string name;
+    bool aoOnly = false;
+    bool pointViz = false;
+  };
+
+  // Empty: chosen by the renderer
+  std::string outputDirectory;
+  std::vector<Camera> cameras = {
+      {false, {}, {}, {0.001629f, 0.999997f, -0.001951f}},
+      {false, {}, {}, {0.000000f, 1.000000f, 0.000000f}},
+      {false, {}, {}, {0.000224f, 0.999996f, 0.002757f}},
+      {false, {}, {}, {-0.000676f, 0.999999f, 0.001559f}},
+      {false, {}, {}, {-0.001659f, 0.999998f, 0.000813f}}};
+  std::vector<float> timeStamps = {1.0f, 5.0f};
+  std::vector<float> latenciesMs = {0.0f, 40.0f, 80.0f, 120.0f};
+  std::vector<std::string> aoTypes = {"Per-pixel RTAO", "Point RTAO (Hash, Update)", "SSAO"};
+  std::vector<AOConfig> aoConfigs = {
+      {"color", false, false},
+      {"point_viz", false, true},
+      {"ao", true, false}};
+  std::string referenceAOType = "Per-pixel RTAO";
+  float referenceLatencyMs = 0.0f;
+  std::map<std::string, uint32_t> aoSamples = {{"Per-pixel RTAO", 512}};
+  uint32_t defaultAOSamples = 4096;
+  bool colorOnlyPass = true;
+  // Frames rendered before the screenshot whenever the camera or time stamp changes
+  uint32_t warmupFrames = 0;
+
+  // Returns false and prints the error if the file can't be read or parsed
+  static bool load(const std::string& filename, SweepConfig& config);
+};
+
+// One screenshot of a sweep
+struct SweepRun {
+  // Unique within the sweep, identifies finished runs when a sweep is resumed
+  std::string id;
+
+  uint32_t cameraIndex = 0;
+  float timeStamp = 0.0f;
+  bool colorOnly = false;
+  // Not set for colorOnly runs
+  SweepConfig::AOConfig aoConfig;
+  std::string aoType;
+  float latencyMs = 0.0f;
+  uint32_t aoSamples = 0;
+
+  // Frames to render before the screenshot, 0 if the run continues with the state (camera, time
+  // stamp and points) of the previous run
+  uint32_t warmupFrames = 0;
+
+  std::string imageFilename;
+  // Empty if no FLIP comparison is run (color only, point visualization)
+  std::string referenceFilename;
+  std::string flipDirectory;
+};
+
+// Expands a SweepConfig into the cartesian product of its parameters and tracks the finished
+// runs in <output_dir>/sweep_runs.csv, so an interrupted sweep continues where it stopped.
+//
+// Runs are ordered camera, time stamp, AO config, AO type, latency (innermost). Changing the
+// camera or time stamp resets the animation and the point set, all other parameters only change
+// the rendering, so the runs of one camera and time stamp share the warm state. The reference of
+// every AO config is scheduled first, so its image exists when the other runs are compared to it.
+//
+// Output tree: <output_dir>/t<time stamp>/<AO config>/images/<camera>_<AO type>_<latency>.png and
+// the FLIP maps and CSVs in <output_dir>/t<time stamp>/<AO config>/flip/, color only screenshots
+// in <output_dir>/t<time stamp>/color_only/images/<camera>.png.
+class ExperimentSweep {
+ public:
+  explicit ExperimentSweep(const SweepConfig& config);
+
+  const SweepConfig& getConfig() const {
+    return config_;
+  }
+
+  // The runs that aren't finished yet, in schedule order
+  const std::vector<SweepRun>& getPendingRuns() const {
+    return pendingRuns_;
+  }
+
+  size_t getNumRuns() const {
+    return numRuns_;
+  }
+
+  size_t getNumResumed() const {
+    return numRuns_ - pendingRuns_.size();
+  }
+
+  // Appends the run to sweep_runs.csv, thread-safe (FLIP results arrive on worker threads)
+  void markFinished(const SweepRun& run, const FlipComparisonResult* flipResult = nullptr);
+
+  size_t getNumFinished();
+
+  std::string getManifestFilename() const;
+
+ private:
+  void loadFinishedRuns();
+  void expand();
+
+  SweepConfig config_;
+  std::set<std::string> finishedRunIds_;
+  std::vector<SweepRun> pendingRuns_;
+  size_t numRuns_ = 0;
+
+  std::mutex manifestMutex_;
+  size_t numFinished_ = 0;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FLIPComparisonPool.h"
+#include <algorithm>
+#include <iostream>
+#include "FLIPScreenshotComparison.h"
+#include "Tracing.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace split_rendering {
+
+FlipComparisonPool::FlipComparisonPool(uint32_t numWorkers) : numWorkers_(numWorkers) {}
+
+FlipComparisonPool::~FlipComparisonPool() {
+  waitForAll();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  jobAvailable_.notify_all();
+
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+void FlipComparisonPool::enqueue(
+    const std::string& referenceFilename,
+    const std::string& currentFilename,
+    const std::string& destinationDirectory,
+    ResultCallback onResult,
+    bool writeOutputs) {
+  Job job = {
+      referenceFilename, currentFilename, destinationDirectory, std::move(onResult), writeOutputs};
+
+  if (numWorkers_ == 0) {
+    run(job);
+    return;
+  }
+
+  // Workers are only started once the first comparison is queued
+  if (workers_.empty())
+    startWorkers();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+  }
+  jobAvailable_.notify_one();
+}
+
+void FlipComparisonPool::waitForAll() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  jobsDone_.wait(lock, [&]() { return jobs_.empty() && numRunning_ == 0; });
+}
+
+size_t FlipComparisonPool::getNumPending() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size() + numRunning_;
+}
+
+void FlipComparisonPool::startWorkers() {
+  for (uint32_t i = 0; i < numWorkers_; i++)
+    workers_.emplace_back([this]() { workerLoop(); });
+}
+
+void FlipComparisonPool::workerLoop() {
+  Tracing::setThreadName("flip_worker");
+
+#ifdef _OPENMP
+  // The OpenMP thread count is per thread, so the workers split the cores instead of every
+  // comparison using all of them
+  uint32_t numCores = std::max(std::thread::hardware_concurrency(), 1u);
+  omp_set_num_threads((int)std::max(numCores / numWorkers_, 1u));
+#endif
+
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      jobAvailable_.wait(lock, [&]() { return stop_ || !jobs_.empty(); });
+
+      if (jobs_.empty())
+        return;
+
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+      numRunning_++;
+    }
+
+    run(job);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      numRunning_--;
+    }
+    jobsDone_.notify_all();
+  }
+}
+
+void FlipComparisonPool::run(const Job& job) {
+  TRACE_SCOPE("FlipComparisonPool::run");
+
+  auto result = FlipScreenshotComparison::evaluate(
+      job.referenceFilename, job.currentFilename, job.destinationDirectory, job.writeOutputs);
+
+  if (job.writeOutputs && result.valid) {
+    std::lock_guard<std::mutex> lock(csvMutex_);
+    FlipScreenshotComparison::appendCSV(result);
+  }
+
+  if (job.onResult)
+    job.onResult(result);
+}
+
+} // namespace split_rendering
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FLIPComparisonResult.h"
+
+namespace split_rendering {
+
+// Runs FlipScreenshotComparison off the render thread. Comparisons are queued and evaluated by a
+// few worker threads, each of which runs the row-parallel FLIP filters on its share of the cores
+// (OpenMP), and the pooled statistics are appended to the comparison's CSV by the worker.
+//
+// FLIPComparisonPool.cpp is the only translation unit of a target that may include FLIP.h, as
+// FLIP.h also defines the stb/tinyexr implementations.
+class FlipComparisonPool {
+ public:
+  // numWorkers = 0 evaluates the comparisons synchronously in enqueue()
+  explicit FlipComparisonPool(uint32_t numWorkers = 2);
+  // Waits for all queued comparisons
+  ~FlipComparisonPool();
+
+  using ResultCallback = std::function<void(const FlipComparisonResult&)>;
+
+  // The files have to be written completely before the comparison is queued. Without
+  // writeOutputs, only onResult receives the result (on a worker thread), otherwise the error
+  // map, histogram and CSV row are written to destinationDirectory as well.
+  void enqueue(
+      const std::string& referenceFilename,
+      const std::string& currentFilename,
+      const std::string& destinationDirectory,
+      ResultCallback onResult = nullptr,
+      bool writeOutputs = true);
+
+  void waitForAll();
+
+  size_t getNumPending();
+
+ private:
+  struct Job {
+    std::string referenceFilename;
+    std::string currentFilename;
+    std::string destinationDirectory;
+    ResultCallback onResult;
+    bool writeOutputs = true;
+  };
+
+  void startWorkers();
+  void workerLoop();
+  void run(const Job& job);
+
+  uint32_t numWorkers_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable jobAvailable_;
+  std::condition_variable jobsDone_;
+  std::deque<Job> jobs_;
+  size_t numRunning_ = 0;
+  bool stop_ = false;
+
+  // Comparisons of the same image pair append to the same CSV
+  std::mutex csvMutex_;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+#include <string>
+
+namespace split_rendering {
+
+// Pooled FLIP error of one comparison, one row of its CSV. Kept apart from
+// FLIPScreenshotComparison.h, which can only be included by one translation unit.
+struct FlipComparisonResult {
+  std::string referenceFilename;
+  std::string testFilename;
+  std::string csvFilename;
+  // False if an image couldn't be compared, e.g. because the sizes differ
+  bool valid = true;
+  float mean = 0.0f;
+  float weightedMedian = 0.0f;
+  float weightedFirstQuartile = 0.0f;
+  float weightedThirdQuartile = 0.0f;
+  float minValue = 0.0f;
+  float maxValue = 0.0f;
+  float evaluationSeconds = 0.0f;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless image regression with FLIP, e.g. for nightly quality and performance gates. Pairs the
+// images of a test directory with the images of a reference directory, evaluates FLIP for all
+// pairs in parallel and aggregates the pooled errors per configuration.
+//
+// Example usage (point AO and SSAO screenshots against RTAO screenshots of the same sweep):
+// clang-format off
+// $ ./FLIPRegression ref_dir test_dir --map "_(Point RTAO \(Hash, Update\)|SSAO)_([0-9]+)_[0-9.]+\.png$" "_Per-pixel RTAO_\$2_0.000000.png" --max_mean 0.08 --output_dir flip_out
+// clang-format on
+//
+// Exit codes: 0 if all thresholds are met, 1 if a threshold is exceeded or a reference is
+// missing, 2 for invalid arguments or images that can't be compared.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <string>
+#include <vector>
+#include "FLIPComparisonPool.h"
+#include "argparse.hpp"
+
+using split_rendering::FlipComparisonPool;
+using split_rendering::FlipComparisonResult;
+
+namespace {
+
+const int kExitThresholdExceeded = 1;
+const int kExitInvalid = 2;
+
+struct ImagePair {
+  std::string referencePath;
+  std::string testPath;
+  std::string configuration;
+};
+
+struct ConfigurationReport {
+  uint32_t numPairs = 0;
+  // Means over the pairs of the pooled per-pair values
+  double mean = 0.0;
+  double weightedMedian = 0.0;
+  double weightedFirstQuartile = 0.0;
+  double weightedThirdQuartile = 0.0;
+  double evaluationSeconds = 0.0;
+  double maxPairMean = 0.0;
+  double maxValue = 0.0;
+};
+
+bool isImageFile(const std::filesystem::path& path) {
+  std::string extension = path.extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+  return extension == ".png" || extension == ".jpg" || extension == ".bmp" ||
+      extension == ".tga";
+}
+
+// Checks value <= threshold for an optional threshold, prints the violation
+bool checkThreshold(
+    const std::string& configuration,
+    const char* name,
+    double value,
+    const std::optional<float>& threshold) {
+  if (!threshold || value <= *threshold)
+    return true;
+
+  std::cout << "FAIL " << configuration << ": " << name << " " << value << " > " << *threshold
+            << std::endl;
+  return false;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("FLIPRegression");
+
+  args.add_argument("reference_dir").help("directory with the reference images");
+  args.add_argument("test_dir").help("directory with the test images, every image is evaluated");
+  args.add_argument("--map")
+      .help(
+          "regex and replacement (ECMAScript, std::regex_replace) that turn a test filename into "
+          "its reference filename, by default the filenames are the same")
+      .nargs(2);
+  args.add_argument("--group")
+      .help(
+          "regex whose first capture group of the test filename is the configuration, the "
+          "whole filename if it doesn't match")
+      .default_value(std::string("^[0-9]+_(.*)\\.[A-Za-z]+$"));
+  args.add_argument("--workers")
+      .help("comparisons evaluated at the same time, each uses its share of the cores")
+      .default_value(4)
+      .scan<'d', int>();
+  args.add_argument("--output_dir")
+      .help("writes flip_pairs.csv and flip_configurations.csv if set")
+      .default_value(std::string(""));
+  args.add_argument("--write_maps")
+      .help("whether or not to write the error maps and histograms to the output dir")
+      .default_value(false)
+      .implicit_value(true);
+  args.add_argument("--allow_missing")
+      .help("whether or not test images without a reference image are skipped instead of failing")
+      .default_value(false)
+      .implicit_value(true);
+  args.add_argument("--max_mean")
+      .help("maximum mean FLIP error of a configuration")
+      .scan<'f', float>();
+  args.add_argument("--max_median")
+      .help("maximum mean of the weighted medians of a configuration")
+      .scan<'f', float>();
+  args.add_argument("--max_third_quartile")
+      .help("maximum mean of the 3rd weighted quartiles of a configuration")
+      .scan<'f', float>();
+  args.add_argument("--max_pair_mean")
+      .help("maximum mean FLIP error of any single pair")
+      .scan<'f', float>();
+  args.add_argument("--max_seconds")
+      .help("maximum mean evaluation time per pair of a configuration")
+      .scan<'f', float>();
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  std::filesystem::path referenceDirectory = args.get<std::string>("reference_dir");
+  std::filesystem::path testDirectory = args.get<std::string>("test_dir");
+  std::string outputDirectory = args.get<std::string>("--output_dir");
+  bool writeMaps = args.get<bool>("--write_maps");
+
+  if (!std::filesystem::is_directory(referenceDirectory) ||
+      !std::filesystem::is_directory(testDirectory)) {
+    std::cerr << "reference_dir and test_dir have to be directories" << std::endl;
+    return kExitInvalid;
+  }
+
+  if (writeMaps && outputDirectory.empty()) {
+    std::cerr << "--write_maps requires --output_dir" << std::endl;
+    return kExitInvalid;
+  }
+
+  if (!outputDirectory.empty())
+    std::filesystem::create_directories(outputDirectory);
+
+  std::optional<std::pair<std::regex, std::string>> mapping;
+  std::regex groupRegex;
+  try {
+    if (auto map = args.present<std::vector<std::string>>("--map"))
+      mapping = std::make_pair(std::regex((*map)[0]), (*map)[1]);
+    groupRegex = std::regex(args.get<std::string>("--group"));
+  } catch (const std::regex_error& err) {
+    std::cerr << "invalid regex: " << err.what() << std::endl;
+    return kExitInvalid;
+  }
+
+  // Pair the test images with their reference images, sorted so the output is deterministic
+  std::vector<std::filesystem::path> testFiles;
+  for (const auto& entry : std::filesystem::directory_iterator(testDirectory)) {
+    if (entry.is_regular_file() && isImageFile(entry.path()))
+      testFiles.push_back(entry.path());
+  }
+  std::sort(testFiles.begin(), testFiles.end());
+
+  std::vector<ImagePair> pairs;
+  uint32_t numMissing = 0;
+
+  for (const auto& testFile : testFiles) {
+    std::string testName = testFile.filename().string();
+    std::string referenceName =
+        mapping ? std::regex_replace(testName, mapping->first, mapping->second) : testName;
+    std::filesystem::path referenceFile = referenceDirectory / referenceName;
+
+    if (!std::filesystem::exists(referenceFile)) {
+      std::cout << (args.get<bool>("--allow_missing") ? "skipping " : "FAIL ") << testName
+                << ": no reference " << referenceFile.string() << std::endl;
+      numMissing++;
+      continue;
+    }
+
+    std::smatch match;
+    std::string configuration = std::regex_match(testName, match, groupRegex) && match.size() > 1
+        ? match[1].str()
+        : testName;
+
+    pairs.push_back({referenceFile.string(), testFile.string(), configuration});
+  }
+
+  if (pairs.empty()) {
+    std::cerr << "no image pairs found" << std::endl;
+    return kExitInvalid;
+  }
+
+  std::cout << "evaluating " << pairs.size() << " image pairs" << std::endl;
+
+  std::vector<FlipComparisonResult> results(pairs.size());
+  auto start = std::chrono::steady_clock::now();
+
+  {
+    FlipComparisonPool pool((uint32_t)std::max(args.get<int>("--workers"), 1));
+
+    for (size_t i = 0; i < pairs.size(); i++) {
+      pool.enqueue(
+          pairs[i].referencePath,
+          pairs[i].testPath,
+          outputDirectory,
+          [&results, i](const FlipComparisonResult& result) { results[i] = result; },
+          writeMaps);
+    }
+
+    pool.waitForAll();
+  }
+
+  std::chrono::duration<double> wallSeconds = std::chrono::steady_clock::now() - start;
+
+  bool passed = numMissing == 0 || args.get<bool>("--allow_missing");
+  bool allValid = true;
+
+  std::map<std::string, ConfigurationReport> reports;
+
+  for (size_t i = 0; i < pairs.size(); i++) {
+    const FlipComparisonResult& result = results[i];
+
+    if (!result.valid) {
+      allValid = false;
+      continue;
+    }
+
+    ConfigurationReport& report = reports[pairs[i].configuration];
+    report.numPairs++;
+    report.mean += result.mean;
+    report.weightedMedian += result.weightedMedian;
+    report.weightedFirstQuartile += result.weightedFirstQuartile;
+    report.weightedThirdQuartile += result.weightedThirdQuartile;
+    report.evaluationSeconds += result.evaluationSeconds;
+    report.maxPairMean = std::max(report.maxPairMean, (double)result.mean);
+    report.maxValue = std::max(report.maxValue, (double)result.maxValue);
+  }
+
+  for (auto& [configuration, report] : reports) {
+    report.mean /= report.numPairs;
+    report.weightedMedian /= report.numPairs;
+    report.weightedFirstQuartile /= report.numPairs;
+    report.weightedThirdQuartile /= report.numPairs;
+    report.evaluationSeconds /= report.numPairs;
+
+    std::cout << configuration << ": pairs " << report.numPairs << ", mean " << report.mean
+              << ", median " << report.weightedMedian << ", quartiles "
+              << report.weightedFirstQuartile << " - " << report.weightedThirdQuartile
+              << ", max pair mean " << report.maxPairMean << ", max " << report.maxValue
+              << ", seconds per pair " << report.evaluationSeconds << std::endl;
+
+    passed &= checkThreshold(configuration, "mean", report.mean, args.present<float>("--max_mean"));
+    passed &= checkThreshold(
+        configuration, "median", report.weightedMedian, args.present<float>("--max_median"));
+    passed &= checkThreshold(
+        configuration,
+        "third quartile",
+        report.weightedThirdQuartile,
+        args.present<float>("--max_third_quartile"));
+    passed &= checkThreshold(
+        configuration, "pair mean", report.maxPairMean, args.present<float>("--max_pair_mean"));
+    passed &= checkThreshold(
+        configuration,
+        "seconds per pair",
+        report.evaluationSeconds,
+        args.present<float>("--max_seconds"));
+  }
+
+  std::cout << "evaluated " << pairs.size() << " pairs in " << wallSeconds.count() << " s"
+            << std::endl;
+
+  if (!outputDirectory.empty()) {
+    std::ofstream pairsCSV(outputDirectory + "/flip_pairs.csv");
+    pairsCSV << "configuration,reference,test,valid,mean,weighted_median,weighted_first_quartile,"
+                "weighted_third_quartile,min,max,evaluation_seconds\n";
+    for (size_t i = 0; i < pairs.size(); i++) {
+      const FlipComparisonResult& result = results[i];
+      pairsCSV << "\"" << pairs[i].configuration << "\",\"" << pairs[i].referencePath << "\",\""
+               << pairs[i].testPath << "\"," << result.valid << "," << result.mean << ","
+               << result.weightedMedian << "," << result.weightedFirstQuartile << ","
+               << result.weightedThirdQuartile << "," << result.minValue << ","
+               << result.maxValue << "," << result.evaluationSeconds << "\n";
+    }
+
+    std::ofstream configurationsCSV(outputDirectory + "/flip_configurations.csv");
+    configurationsCSV << "configuration,num_pairs,mean,weighted_median,weighted_first_quartile,"
+                         "weighted_third_quartile,max_pair_mean,max,evaluation_seconds\n";
+    for (const auto& [configuration, report] : reports) {
+      configurationsCSV << "\"" << configuration << "\"," << report.numPairs << ","
+                        << report.mean << "," << report.weightedMedian << ","
+                        << report.weightedFirstQuartile << "," << report.weightedThirdQuartile
+                        << "," << report.maxPairMean << "," << report.maxValue << ","
+                        << report.evaluationSeconds << "\n";
+    }
+  }
+
+  if (!allValid)
+    return kExitInvalid;
+
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed ? 0 : kExitThresholdExceeded;
+}
@@ -8,17 +8,37 @@
 
 #pragma once
 #include <chrono>
+#include <cmath>
+#include <fstream>
 #include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
 #include "FLIP.h"
+#include "FLIPComparisonResult.h"
 
 namespace split_rendering {
 
 class FlipScreenshotComparison {
  public:
+  using Result = FlipComparisonResult;
+
   static void compare(
       std::string& referenceFilename,
       std::string& currentFilename,
       std::string& destinationDirectory) {
+    Result result = evaluate(referenceFilename, currentFilename, destinationDirectory);
+    if (result.valid)
+      appendCSV(result);
+  }
+
+  // Writes the FLIP error map and the histogram to destinationDirectory if writeOutputs is set.
+  // The row-parallel filters of FLIP use OpenMP if it is enabled.
+  static Result evaluate(
+      const std::string& referenceFilename,
+      const std::string& currentFilename,
+      const std::string& destinationDirectory,
+      bool writeOutputs = true) {
     // Most of the code below was copied from the FLIP main executable.
     struct {
       float ppd = 0; // If ppd==0.0, then it will be computed from the parameters below.
@@ -68,6 +88,19 @@ class FlipScreenshotComparison {
 
     FLIP::image<FLIP::color3> testImage(testFileName.toString());
 
+    Result result;
+    result.referenceFilename = referenceFileName.toString();
+    result.testFilename = testFileName.toString();
+    result.csvFilename = destinationDirectory + "/" + csvFileName.toString();
+
+    if (testImage.getWidth() != referenceImage.getWidth() ||
+        testImage.getHeight() != referenceImage.getHeight()) {
+      std::cout << "\nError: " << result.testFilename << " and " << result.referenceFilename
+                << " differ in size\n";
+      result.valid = false;
+      return result;
+    }
+
     FLIP::image<FLIP::color3> viridisMap(FLIP::MapViridis, 256);
     FLIP::image<float> errorMapFLIP(referenceImage.getWidth(), referenceImage.getHeight());
 
@@ -75,10 +108,13 @@ class FlipScreenshotComparison {
     auto t = t0;
     errorMapFLIP.FLIP(referenceImage, testImage, gFLIPOptions.ppd);
     t = std::chrono::high_resolution_clock::now();
-    FLIP::image<FLIP::color3> pngResult(referenceImage.getWidth(), referenceImage.getHeight());
-    pngResult.copyFloat2Color3(errorMapFLIP);
-    pngResult.colorMap(errorMapFLIP, magmaMap);
-    pngResult.pngSave(destinationDirectory + "/" + flipFileName.toString());
+
+    if (writeOutputs) {
+      FLIP::image<FLIP::color3> pngResult(referenceImage.getWidth(), referenceImage.getHeight());
+      pngResult.copyFloat2Color3(errorMapFLIP);
+      pngResult.colorMap(errorMapFLIP, magmaMap);
+      pngResult.pngSave(destinationDirectory + "/" + flipFileName.toString());
+    }
 
     pooling<float> pooledValues;
     for (int y = 0; y < errorMapFLIP.getHeight(); y++) {
@@ -91,18 +127,33 @@ class FlipScreenshotComparison {
     bool optionExcludeValues = false;
     float yMax = 1.0f;
 
-    pooledValues.save(
-        destinationDirectory + "/" + histogramFileName.toString(),
-        errorMapFLIP.getWidth(),
-        errorMapFLIP.getHeight(),
-        optionLog,
-        referenceFileName.toString(),
-        testFileName.toString(),
-        !optionExcludeValues,
-        yMax);
+    if (writeOutputs) {
+      pooledValues.save(
+          destinationDirectory + "/" + histogramFileName.toString(),
+          errorMapFLIP.getWidth(),
+          errorMapFLIP.getHeight(),
+          optionLog,
+          referenceFileName.toString(),
+          testFileName.toString(),
+          !optionExcludeValues,
+          yMax);
+    }
+
+    result.mean = pooledValues.getMean();
+    result.weightedMedian = pooledValues.getPercentile(0.5f, true);
+    result.weightedFirstQuartile = pooledValues.getPercentile(0.25f, true);
+    result.weightedThirdQuartile = pooledValues.getPercentile(0.75f, true);
+    result.minValue = pooledValues.getMinValue();
+    result.maxValue = pooledValues.getMaxValue();
+    result.evaluationSeconds =
+        std::chrono::duration_cast<std::chrono::microseconds>(t - t0).count() / 1000000.0f;
+    return result;
+  }
 
+  // Appends the result to its CSV, writes the header if the file is new
+  static void appendCSV(const Result& result) {
     std::fstream csv;
-    csv.open(destinationDirectory + "/" + csvFileName.toString(), std::ios::app);
+    csv.open(result.csvFilename, std::ios::app);
     if (csv.is_open()) {
       csv.seekp(0, std::ios_base::end);
 
@@ -111,23 +162,19 @@ class FlipScreenshotComparison {
 
 #define FIXED_DECIMAL_DIGITS(x, d) std::fixed << std::setprecision(d) << (x)
 
-      csv << "\"" << referenceFileName.toString() << "\",";
-      csv << "\"" << testFileName.toString() << "\",";
-      csv << "\"" << FIXED_DECIMAL_DIGITS(pooledValues.getMean(), 6) << "\",";
-      csv << "\"" << FIXED_DECIMAL_DIGITS(pooledValues.getPercentile(0.5f, true), 6) << "\",";
-      csv << "\"" << FIXED_DECIMAL_DIGITS(pooledValues.getPercentile(0.25f, true), 6) << "\",";
-      csv << "\"" << FIXED_DECIMAL_DIGITS(pooledValues.getPercentile(0.75f, true), 6) << "\",";
-      csv << "\"" << FIXED_DECIMAL_DIGITS(pooledValues.getMinValue(), 6) << "\",";
-      csv << "\"" << FIXED_DECIMAL_DIGITS(pooledValues.getMaxValue(), 6) << "\",";
-      csv << "\""
-          << FIXED_DECIMAL_DIGITS(
-                 std::chrono::duration_cast<std::chrono::microseconds>(t - t0).count() / 1000000.0f,
-                 4)
-          << "\"\n";
+      csv << "\"" << result.referenceFilename << "\",";
+      csv << "\"" << result.testFilename << "\",";
+      csv << "\"" << FIXED_DECIMAL_DIGITS(result.mean, 6) << "\",";
+      csv << "\"" << FIXED_DECIMAL_DIGITS(result.weightedMedian, 6) << "\",";
+      csv << "\"" << FIXED_DECIMAL_DIGITS(result.weightedFirstQuartile, 6) << "\",";
+      csv << "\"" << FIXED_DECIMAL_DIGITS(result.weightedThirdQuartile, 6) << "\",";
+      csv << "\"" << FIXED_DECIMAL_DIGITS(result.minValue, 6) << "\",";
+      csv << "\"" << FIXED_DECIMAL_DIGITS(result.maxValue, 6) << "\",";
+      csv << "\"" << FIXED_DECIMAL_DIGITS(result.evaluationSeconds, 4) << "\"\n";
 
       csv.close();
     } else {
-      std::cout << "\nError: Could not write csv file " << csvFileName.toString() << "\n";
+      std::cout << "\nError: Could not write csv file " << result.csvFilename << "\n";
     }
   }
 };
@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "HashTableAnalysis.h"
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <unordered_set>
+#include "HashFunctionShared.slang"
+#include "PointServerHashGenerator.h"
+#include "RobinHoodHashTable.h"
+
+namespace split_rendering {
+
+namespace {
+
+// Runs find(rawCellId, numProbes) for all keys, once for the probe statistics and numRepeats
+// times for the timing. Returns the fastest repeat in ns per lookup.
+template <typename Find>
+double timeLookups(
+    const std::vector<uint32_t>& rawCellIds,
+    int numRepeats,
+    Find find,
+    HashTableAnalysis::LayoutReport& report) {
+  uint64_t probeLengthSum = 0;
+
+  for (uint32_t rawCellId : rawCellIds) {
+    uint32_t numProbes = 0;
+    find(rawCellId, numProbes);
+    probeLengthSum += numProbes;
+    report.maxProbeLength = std::max(report.maxProbeLength, numProbes);
+  }
+
+  report.numLookups = rawCellIds.size();
+  report.meanProbeLength =
+      rawCellIds.empty() ? 0.0 : probeLengthSum / (double)rawCellIds.size();
+
+  double bestSeconds = std::numeric_limits<double>::max();
+  int64_t checksum = 0;
+
+  for (int repeat = 0; repeat < numRepeats; repeat++) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t rawCellId : rawCellIds) {
+      uint32_t numProbes = 0;
+      checksum += find(rawCellId, numProbes);
+    }
+
+    std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+    bestSeconds = std::min(bestSeconds, seconds.count());
+  }
+
+  // Keeps the lookups from being optimized away
+  volatile int64_t lookupChecksum = checksum;
+  (void)lookupChecksum;
+
+  return rawCellIds.empty() ? 0.0 : bestSeconds * 1e9 / rawCellIds.size();
+}
+
+} // namespace
+
+const char* HashTableAnalysis::getHashTypeName(int hashType) {
+  switch (hashType) {
+    case HASH_TYPE_LINEAR:
+      return "linear";
+    case HASH_TYPE_MORTON:
+      return "morton";
+    case HASH_TYPE_XORSHIFT:
+      return "xorshift";
+    default:
+      return "unknown";
+  }
+}
+
+const char* HashTableAnalysis::getHashLayoutName(int hashLayout) {
+  switch (hashLayout) {
+    case HASH_LAYOUT_BUCKET:
+      return "bucket";
+    case HASH_LAYOUT_ROBIN_HOOD:
+      return "robin_hood";
+    default:
+      return "unknown";
+  }
+}
+
+HashTableAnalysis::InstanceReport HashTableAnalysis::analyzeInstance(
+    const Falcor::PointData* points,
+    uint32_t numPoints,
+    float diskRadius,
+    const Falcor::InstanceHashInfo& ihi,
+    uint32_t cellCapacity,
+    int hashType,
+    int log2SizeFactor) {
+  InstanceReport report;
+  report.hashType = hashType;
+  report.effectiveHashType = PointServerHashGenerator::getInstanceHashType(hashType, ihi.gridDim);
+  report.log2SizeFactor = log2SizeFactor;
+  report.hashTableSize = PointServerHashGenerator::getHashTableSize(numPoints, log2SizeFactor);
+  report.numPoints = numPoints;
+
+  // Mirrors the bucket layout of PointServerHashGenerator, but only tracks the number of points
+  // per cell instead of allocating point cells
+  struct Entry {
+    uint32_t rawCellId = INVALID_CELL;
+    uint32_t numPoints = 0;
+  };
+
+  std::vector<Entry> entries(report.hashTableSize * FIXED_HASH_BUCKET_SIZE);
+  std::vector<uint32_t> pointProbeLengths(numPoints, 0);
+
+  for (uint32_t pointId = 0; pointId < numPoints; pointId++) {
+    glm::ivec3 coords = ((points[pointId].position - ihi.aabbMin)) / diskRadius;
+
+    Falcor::HashData hd =
+        Falcor::getHash(coords, ihi.gridDim, report.hashTableSize, report.effectiveHashType);
+    hd.hashBase *= FIXED_HASH_BUCKET_SIZE;
+
+    // Same as the client lookup: walk the bucket until the cell or the first empty entry is found
+    uint32_t hashInfoIndex = 0;
+    for (; hashInfoIndex < FIXED_HASH_BUCKET_SIZE; hashInfoIndex++) {
+      auto& entry = entries[hd.hashBase + hashInfoIndex];
+
+      if (entry.rawCellId == INVALID_CELL) {
+        entry.rawCellId = hd.rawCellId;
+        report.numCells++;
+      }
+
+      if (entry.rawCellId == hd.rawCellId) {
+        if (entry.numPoints < cellCapacity)
+          entry.numPoints++;
+        else
+          report.droppedCellFull++;
+
+        break;
+      }
+    }
+
+    if (hashInfoIndex == FIXED_HASH_BUCKET_SIZE)
+      report.droppedBucketFull++;
+
+    pointProbeLengths[pointId] = std::min(hashInfoIndex + 1, (uint32_t)FIXED_HASH_BUCKET_SIZE);
+  }
+
+  for (uint32_t bucket = 0; bucket < report.hashTableSize; bucket++) {
+    uint32_t numUsedEntries = 0;
+    for (uint32_t i = 0; i < FIXED_HASH_BUCKET_SIZE; i++) {
+      if (entries[bucket * FIXED_HASH_BUCKET_SIZE + i].rawCellId != INVALID_CELL)
+        numUsedEntries++;
+    }
+    report.bucketOccupancy[numUsedEntries]++;
+  }
+
+  uint64_t probeLengthSum = 0;
+  for (uint32_t probeLength : pointProbeLengths) {
+    probeLengthSum += probeLength;
+    report.maxProbeLength = std::max(report.maxProbeLength, probeLength);
+  }
+  report.meanProbeLength = numPoints > 0 ? probeLengthSum / (double)numPoints : 0.0;
+
+  return report;
+}
+
+void HashTableAnalysis::analyze(
+    const MeshPointGenerator& pointGen,
+    const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+    int minLog2SizeFactor,
+    int maxLog2SizeFactor) {
+  const auto& numSamplesPerInstance = pointGen.getNumSamplesPerInstance();
+  const auto& sampleOffsetPerInstance = pointGen.getSampleOffsetPerInstance();
+  const auto& diskRadiusPerInstance = pointGen.getDiskRadiusPerInstance();
+  const auto& cpuPointsData = pointGen.getCPUPointData();
+
+  const uint32_t numInstances = (uint32_t)instanceHashInfos.size();
+  const int numSizeFactors = maxLog2SizeFactor - minLog2SizeFactor + 1;
+
+  reports_.clear();
+  reports_.resize(numInstances * NUM_HASH_TYPES * numSizeFactors);
+
+  std::vector<uint32_t> taskIds(reports_.size());
+  std::iota(taskIds.begin(), taskIds.end(), 0);
+
+  std::for_each(std::execution::par, taskIds.begin(), taskIds.end(), [&](uint32_t taskId) {
+    const uint32_t instanceId = taskId / (NUM_HASH_TYPES * numSizeFactors);
+    const int hashType = (taskId / numSizeFactors) % NUM_HASH_TYPES;
+    const int log2SizeFactor = minLog2SizeFactor + (int)(taskId % numSizeFactors);
+
+    reports_[taskId] = analyzeInstance(
+        &cpuPointsData[sampleOffsetPerInstance[instanceId]],
+        numSamplesPerInstance[instanceId],
+        DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId],
+        instanceHashInfos[instanceId],
+        instancePointInfos[instanceId].cellCapacity,
+        hashType,
+        log2SizeFactor);
+    reports_[taskId].instanceId = instanceId;
+  });
+}
+
+HashTableAnalysis::LayoutReport HashTableAnalysis::benchmarkInstance(
+    const Falcor::PointData* points,
+    uint32_t numPoints,
+    float diskRadius,
+    const Falcor::InstanceHashInfo& ihi,
+    int hashType,
+    int hashLayout,
+    int numRepeats) {
+  LayoutReport report;
+  report.hashLayout = hashLayout;
+  report.effectiveHashType = PointServerHashGenerator::getInstanceHashType(hashType, ihi.gridDim);
+
+  // Occupied cells in the order of their first point, and the cells looked up around each point
+  std::vector<uint32_t> cellRawCellIds;
+  std::unordered_set<uint32_t> insertedRawCellIds;
+  std::vector<uint32_t> lookupRawCellIds;
+  lookupRawCellIds.reserve((size_t)numPoints * 8);
+
+  for (uint32_t pointId = 0; pointId < numPoints; pointId++) {
+    glm::vec3 floatCoords = ((points[pointId].position - ihi.aabbMin)) / diskRadius;
+
+    const uint32_t rawCellId =
+        Falcor::getRawCellId(glm::ivec3(floatCoords), ihi.gridDim, report.effectiveHashType);
+
+    if (insertedRawCellIds.insert(rawCellId).second)
+      cellRawCellIds.push_back(rawCellId);
+
+    glm::ivec3 baseCoords = floatCoords - 0.5f;
+
+    for (int x = 0; x <= 1; x++) {
+      for (int y = 0; y <= 1; y++) {
+        for (int z = 0; z <= 1; z++) {
+          lookupRawCellIds.push_back(Falcor::getRawCellId(
+              baseCoords + glm::ivec3(x, y, z), ihi.gridDim, report.effectiveHashType));
+        }
+      }
+    }
+  }
+
+  if (hashLayout == HASH_LAYOUT_ROBIN_HOOD) {
+    RobinHoodHashTable table;
+    table.init(
+        RobinHoodHashTable::getHashTableSize((uint32_t)cellRawCellIds.size()),
+        report.effectiveHashType);
+
+    for (uint32_t cellId = 0; cellId < (uint32_t)cellRawCellIds.size(); cellId++) {
+      if (!table.insert(cellRawCellIds[cellId], cellId))
+        report.numDroppedCells++;
+    }
+
+    report.numCells = table.getNumCells();
+    report.tableBytes = (uint64_t)table.getHashTableSize() * sizeof(Falcor::CompactHashToCellInfo);
+    report.loadFactor = table.getNumCells() / (double)table.getHashTableSize();
+    report.nsPerLookup = timeLookups(
+        lookupRawCellIds,
+        numRepeats,
+        [&](uint32_t rawCellId, uint32_t& numProbes) { return table.find(rawCellId, numProbes); },
+        report);
+  } else {
+    // Same size and insertion as PointServerHashGenerator::generate
+    const uint32_t hashTableSize = PointServerHashGenerator::getHashTableSize(numPoints);
+    std::vector<Falcor::CompactHashToCellInfo> entries(hashTableSize * FIXED_HASH_BUCKET_SIZE);
+
+    for (uint32_t cellId = 0; cellId < (uint32_t)cellRawCellIds.size(); cellId++) {
+      const uint32_t hashBase =
+          Falcor::getHashBase(cellRawCellIds[cellId], hashTableSize, report.effectiveHashType) *
+          FIXED_HASH_BUCKET_SIZE;
+
+      uint32_t hashInfoIndex = 0;
+      for (; hashInfoIndex < FIXED_HASH_BUCKET_SIZE; hashInfoIndex++) {
+        auto& entry = entries[hashBase + hashInfoIndex];
+
+        if (entry.rawCellId == INVALID_CELL) {
+          entry.rawCellId = cellRawCellIds[cellId];
+          entry.encodedIndex = cellId;
+          report.numCells++;
+          break;
+        }
+      }
+
+      if (hashInfoIndex == FIXED_HASH_BUCKET_SIZE)
+        report.numDroppedCells++;
+    }
+
+    report.tableBytes = (uint64_t)entries.size() * sizeof(Falcor::CompactHashToCellInfo);
+    report.loadFactor = report.numCells / (double)entries.size();
+
+    // Same as the client lookup: walk the bucket until the cell or the first empty entry is found
+    report.nsPerLookup = timeLookups(
+        lookupRawCellIds,
+        numRepeats,
+        [&](uint32_t rawCellId, uint32_t& numProbes) {
+          const uint32_t hashBase =
+              Falcor::getHashBase(rawCellId, hashTableSize, report.effectiveHashType) *
+              FIXED_HASH_BUCKET_SIZE;
+
+          for (numProbes = 1; numProbes <= FIXED_HASH_BUCKET_SIZE; numProbes++) {
+            const auto& entry = entries[hashBase + numProbes - 1];
+
+            if (entry.rawCellId == rawCellId)
+              return (int)(hashBase + numProbes - 1);
+
+            if (entry.rawCellId == INVALID_CELL)
+              break;
+          }
+
+          numProbes = std::min(numProbes, (uint32_t)FIXED_HASH_BUCKET_SIZE);
+          return -1;
+        },
+        report);
+  }
+
+  return report;
+}
+
+void HashTableAnalysis::benchmarkLayouts(
+    const MeshPointGenerator& pointGen,
+    const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+    int hashType,
+    int numRepeats) {
+  const auto& numSamplesPerInstance = pointGen.getNumSamplesPerInstance();
+  const auto& sampleOffsetPerInstance = pointGen.getSampleOffsetPerInstance();
+  const auto& diskRadiusPerInstance = pointGen.getDiskRadiusPerInstance();
+  const auto& cpuPointsData = pointGen.getCPUPointData();
+
+  layoutReports_.clear();
+
+  for (uint32_t instanceId = 0; instanceId < (uint32_t)instanceHashInfos.size(); instanceId++) {
+    for (int hashLayout = 0; hashLayout < NUM_HASH_LAYOUTS; hashLayout++) {
+      layoutReports_.push_back(benchmarkInstance(
+          &cpuPointsData[sampleOffsetPerInstance[instanceId]],
+          numSamplesPerInstance[instanceId],
+          DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId],
+          instanceHashInfos[instanceId],
+          hashType,
+          hashLayout,
+          numRepeats));
+      layoutReports_.back().instanceId = instanceId;
+    }
+  }
+}
+
+void HashTableAnalysis::printSummary(std::ostream& out) const {
+  struct Totals {
+    uint64_t tableBytes = 0;
+    uint64_t numPoints = 0;
+    uint64_t droppedBucketFull = 0;
+    uint64_t droppedCellFull = 0;
+    double probeLengthSum = 0.0;
+    uint32_t maxProbeLength = 0;
+  };
+
+  // Keyed by (hash type, size factor)
+  std::map<std::pair<int, int>, Totals> totals;
+
+  for (const auto& report : reports_) {
+    auto& t = totals[{report.hashType, report.log2SizeFactor}];
+    t.tableBytes += (uint64_t)report.hashTableSize * FIXED_HASH_BUCKET_SIZE *
+        sizeof(Falcor::CompactHashToCellInfo);
+    t.numPoints += report.numPoints;
+    t.droppedBucketFull += report.droppedBucketFull;
+    t.droppedCellFull += report.droppedCellFull;
+    t.probeLengthSum += report.meanProbeLength * report.numPoints;
+    t.maxProbeLength = std::max(t.maxProbeLength, report.maxProbeLength);
+  }
+
+  out << "Hash table analysis (hash, log2 size factor: table bytes, dropped bucket full, dropped "
+         "cell full, mean probe length, max probe length)"
+      << std::endl;
+
+  for (const auto& [key, t] : totals) {
+    out << "  " << getHashTypeName(key.first) << ", " << key.second << ": " << t.tableBytes << ", "
+        << t.droppedBucketFull << ", " << t.droppedCellFull << ", "
+        << (t.numPoints > 0 ? t.probeLengthSum / t.numPoints : 0.0) << ", " << t.maxProbeLength
+        << std::endl;
+  }
+}
+
+void HashTableAnalysis::writeCSV(const std::string& filename) const {
+  std::fstream csv;
+  csv.open(filename, std::ios::out);
+
+  if (!csv.is_open()) {
+    std::cout << "could not write hash analysis to " << filename << std::endl;
+    return;
+  }
+
+  csv << "instance,hash,effective_hash,log2_size_factor,hash_table_size,num_points,num_cells,"
+         "dropped_bucket_full,dropped_cell_full,mean_probe_length,max_probe_length";
+  for (uint32_t i = 0; i <= FIXED_HASH_BUCKET_SIZE; i++)
+    csv << ",buckets_with_" << i << "_cells";
+  csv << "\n";
+
+  for (const auto& report : reports_) {
+    csv << report.instanceId << "," << getHashTypeName(report.hashType) << ","
+        << getHashTypeName(report.effectiveHashType) << "," << report.log2SizeFactor << ","
+        << report.hashTableSize << "," << report.numPoints << "," << report.numCells << ","
+        << report.droppedBucketFull << "," << report.droppedCellFull << ","
+        << report.meanProbeLength << "," << report.maxProbeLength;
+    for (uint32_t count : report.bucketOccupancy)
+      csv << "," << count;
+    csv << "\n";
+  }
+
+  csv.flush();
+  csv.close();
+}
+
+void HashTableAnalysis::printLayoutSummary(std::ostream& out) const {
+  struct Totals {
+    uint64_t tableBytes = 0;
+    uint64_t numCells = 0;
+    uint64_t numDroppedCells = 0;
+    uint64_t numLookups = 0;
+    double probeLengthSum = 0.0;
+    uint32_t maxProbeLength = 0;
+    double lookupNs = 0.0;
+  };
+
+  std::array<Totals, NUM_HASH_LAYOUTS> totals = {};
+
+  for (const auto& report : layoutReports_) {
+    auto& t = totals[report.hashLayout];
+    t.tableBytes += report.tableBytes;
+    t.numCells += report.numCells;
+    t.numDroppedCells += report.numDroppedCells;
+    t.numLookups += report.numLookups;
+    t.probeLengthSum += report.meanProbeLength * report.numLookups;
+    t.maxProbeLength = std::max(t.maxProbeLength, report.maxProbeLength);
+    t.lookupNs += report.nsPerLookup * report.numLookups;
+  }
+
+  out << "Hash layout benchmark (layout: table bytes, load factor, dropped cells, mean probe "
+         "length, max probe length, ns per lookup)"
+      << std::endl;
+
+  for (int hashLayout = 0; hashLayout < NUM_HASH_LAYOUTS; hashLayout++) {
+    const auto& t = totals[hashLayout];
+    const uint64_t numEntries = t.tableBytes / sizeof(Falcor::CompactHashToCellInfo);
+
+    out << "  " << getHashLayoutName(hashLayout) << ": " << t.tableBytes << ", "
+        << (numEntries > 0 ? t.numCells / (double)numEntries : 0.0) << ", " << t.numDroppedCells
+        << ", " << (t.numLookups > 0 ? t.probeLengthSum / t.numLookups : 0.0) << ", "
+        << t.maxProbeLength << ", " << (t.numLookups > 0 ? t.lookupNs / t.numLookups : 0.0)
+        << std::endl;
+  }
+}
+
+void HashTableAnalysis::writeLayoutCSV(const std::string& filename) const {
+  std::fstream csv;
+  csv.open(filename, std::ios::out);
+
+  if (!csv.is_open()) {
+    std::cout << "could not write hash layout benchmark to " << filename << std::endl;
+    return;
+  }
+
+  csv << "instance,layout,effective_hash,num_cells,dropped_cells,table_bytes,load_factor,"
+         "num_lookups,mean_probe_length,max_probe_length,ns_per_lookup\n";
+
+  for (const auto& report : layoutReports_) {
+    csv << report.instanceId << "," << getHashLayoutName(report.hashLayout) << ","
+        << getHashTypeName(report.effectiveHashType) << "," << report.numCells << ","
+        << report.numDroppedCells << "," << report.tableBytes << "," << report.loadFactor << ","
+        << report.numLookups << "," << report.meanProbeLength << "," << report.maxProbeLength
+        << "," << report.nsPerLookup << "\n";
+  }
+
+  csv.flush();
+  csv.close();
+}
+
+} // namespace split_rendering
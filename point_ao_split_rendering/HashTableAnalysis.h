@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <array>
+#include <ostream>
+#include "MeshPointGenerator.h"
+#include "PointData.slang"
+
+namespace split_rendering {
+
+// CPU analysis of the server hash table (see PointServerHashGenerator). For every instance, it
+// replays the insertion of the generated points with each hash function (HASH_TYPE_*) and a range
+// of table sizes. Point cells are not allocated, so the pool size does not influence the results.
+//
+// This is used to pick the hash function with the fewest dropped points at the smallest table size.
+// benchmarkLayouts() compares the bucket layout with the Robin-Hood layout (RobinHoodHashTable).
+class HashTableAnalysis {
+ public:
+  struct InstanceReport {
+    uint32_t instanceId = 0;
+    int hashType = HASH_TYPE_LINEAR;
+    // Can differ from hashType if the grid is too large for Morton codes
+    int effectiveHashType = HASH_TYPE_LINEAR;
+    int log2SizeFactor = 0;
+    uint32_t hashTableSize = 0;
+    uint32_t numPoints = 0;
+    uint32_t numCells = 0;
+    uint32_t droppedBucketFull = 0;
+    uint32_t droppedCellFull = 0;
+    // bucketOccupancy[i] is the number of buckets holding i cells
+    std::array<uint32_t, FIXED_HASH_BUCKET_SIZE + 1> bucketOccupancy = {};
+    // Bucket entries visited when looking up the cell of each point, as done on the client
+    double meanProbeLength = 0.0;
+    uint32_t maxProbeLength = 0;
+  };
+
+  // Lookup cost and size of one hash table layout (HASH_LAYOUT_*) for one instance
+  struct LayoutReport {
+    uint32_t instanceId = 0;
+    int hashLayout = HASH_LAYOUT_BUCKET;
+    int effectiveHashType = HASH_TYPE_LINEAR;
+    uint32_t numCells = 0;
+    // Cells that could not be inserted, i.e. their bucket was full
+    uint32_t numDroppedCells = 0;
+    uint64_t tableBytes = 0;
+    double loadFactor = 0.0;
+    // Lookups of the 2x2x2 cells around every point, as done by the client composite
+    uint64_t numLookups = 0;
+    double meanProbeLength = 0.0;
+    uint32_t maxProbeLength = 0;
+    // Fastest of all repeats
+    double nsPerLookup = 0.0;
+  };
+
+  // Runs the analysis for all hash functions and log2 size factors in [min, max]. Uses the grids
+  // computed by PointServerHashGenerator and the cell capacity of each instance so that the results
+  // match the server tables.
+  void analyze(
+      const MeshPointGenerator& pointGen,
+      const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+      int minLog2SizeFactor = 0,
+      int maxLog2SizeFactor = HASH_LOG2_SIZE_FACTOR);
+
+  // Builds the tables of all instances with every layout (bucket tables with the server size,
+  // Robin-Hood tables at ROBIN_HOOD_MAX_LOAD_FACTOR) and times the client lookups on the CPU.
+  // Instances are run one after another so that the timings are comparable.
+  void benchmarkLayouts(
+      const MeshPointGenerator& pointGen,
+      const std::vector<Falcor::InstanceHashInfo>& instanceHashInfos,
+      int hashType,
+      int numRepeats = 5);
+
+  // Prints totals over all instances, one line per hash function and table size
+  void printSummary(std::ostream& out) const;
+
+  // Writes one row per instance, hash function and table size
+  void writeCSV(const std::string& filename) const;
+
+  // Same for benchmarkLayouts(), one line / row per layout and per instance and layout
+  void printLayoutSummary(std::ostream& out) const;
+  void writeLayoutCSV(const std::string& filename) const;
+
+  const std::vector<InstanceReport>& getReports() const {
+    return reports_;
+  }
+
+  const std::vector<LayoutReport>& getLayoutReports() const {
+    return layoutReports_;
+  }
+
+  static const char* getHashTypeName(int hashType);
+  static const char* getHashLayoutName(int hashLayout);
+
+ private:
+  static InstanceReport analyzeInstance(
+      const Falcor::PointData* points,
+      uint32_t numPoints,
+      float diskRadius,
+      const Falcor::InstanceHashInfo& ihi,
+      uint32_t cellCapacity,
+      int hashType,
+      int log2SizeFactor);
+
+  static LayoutReport benchmarkInstance(
+      const Falcor::PointData* points,
+      uint32_t numPoints,
+      float diskRadius,
+      const Falcor::InstanceHashInfo& ihi,
+      int hashType,
+      int hashLayout,
+      int numRepeats);
+
+  std::vector<InstanceReport> reports_;
+  std::vector<LayoutReport> layoutReports_;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+// Stand-in for <Falcor.h> in the headless targets (see CMakeLists.txt). They only compile the host
+// code of the sample that doesn't touch the GPU, which needs the Falcor math types and the assert
+// and profiling macros.
+
+#include <cassert>
+#include "Utils/HostDeviceShared.slangh"
+
+#define FALCOR_ASSERT(x) assert(x)
+#define FALCOR_PROFILE(name)
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ImageCapturePipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include "Tracing.h"
+
+// Declarations only, the implementations are part of FLIPComparisonPool.cpp
+#include "stb_image_write.h"
+#include "tinyexr.h"
+
+namespace split_rendering {
+
+namespace {
+
+const char* kTemporarySuffix = ".part";
+
+bool hasExtension(const std::string& filename, const char* extension) {
+  std::string fileExtension = std::filesystem::path(filename).extension().string();
+  std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
+  return fileExtension == extension;
+}
+
+bool isFloatFormat(CapturePixelFormat format) {
+  return format == CapturePixelFormat::kR32Float || format == CapturePixelFormat::kRGBA32Float;
+}
+
+} // namespace
+
+ImageCapturePipeline::ImageCapturePipeline(uint32_t numBuffers, uint32_t numWorkers)
+    : numWorkers_(numWorkers) {
+  buffers_.resize(std::max(numBuffers, 1u));
+
+  // Buffers are popped from the back, so the first submissions use the first buffers
+  for (uint32_t i = (uint32_t)buffers_.size(); i > 0; i--)
+    freeBuffers_.push_back(i - 1);
+}
+
+ImageCapturePipeline::~ImageCapturePipeline() {
+  flush();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  jobAvailable_.notify_all();
+
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+void ImageCapturePipeline::submit(
+    const std::string& filename,
+    uint32_t width,
+    uint32_t height,
+    CapturePixelFormat format,
+    const void* data,
+    size_t rowPitch) {
+  TRACE_SCOPE("ImageCapturePipeline::submit");
+
+  size_t packedRowPitch = (size_t)width * getBytesPerPixel(format);
+  if (rowPitch == 0)
+    rowPitch = packedRowPitch;
+
+  // Workers are only started once the first image is submitted
+  if (numWorkers_ > 0 && workers_.empty())
+    startWorkers();
+
+  Job job;
+  job.filename = filename;
+  job.width = width;
+  job.height = height;
+  job.format = format;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (freeBuffers_.empty()) {
+      TRACE_SCOPE("waitForCaptureBuffer");
+      auto start = std::chrono::steady_clock::now();
+      bufferAvailable_.wait(lock, [&]() { return !freeBuffers_.empty(); });
+      numStalls_++;
+      stallSeconds_ +=
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    job.bufferIndex = freeBuffers_.back();
+    freeBuffers_.pop_back();
+    job.sequence = nextSequence_++;
+  }
+
+  // The buffer is owned by this job until it is released, so the copy doesn't need the lock. The
+  // buffers keep their capacity, so they are only allocated for the first frames.
+  auto& buffer = buffers_[job.bufferIndex];
+  buffer.resize(packedRowPitch * height);
+
+  const uint8_t* source = static_cast<const uint8_t*>(data);
+  if (rowPitch == packedRowPitch) {
+    std::memcpy(buffer.data(), source, buffer.size());
+  } else {
+    for (uint32_t y = 0; y < height; y++)
+      std::memcpy(buffer.data() + y * packedRowPitch, source + y * rowPitch, packedRowPitch);
+  }
+
+  if (numWorkers_ == 0) {
+    run(job);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+  }
+  jobAvailable_.notify_one();
+}
+
+void ImageCapturePipeline::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // Jobs are committed before their buffer is released, so all buffers being free means that all
+  // images are written
+  jobsDone_.wait(
+      lock, [&]() { return jobs_.empty() && freeBuffers_.size() == buffers_.size(); });
+}
+
+uint64_t ImageCapturePipeline::getNumWritten() {
+  std::lock_guard<std::mutex> lock(commitMutex_);
+  return numWritten_;
+}
+
+uint64_t ImageCapturePipeline::getNumFailed() {
+  std::lock_guard<std::mutex> lock(commitMutex_);
+  return numFailed_;
+}
+
+uint64_t ImageCapturePipeline::getNumStalls() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return numStalls_;
+}
+
+double ImageCapturePipeline::getStallSeconds() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stallSeconds_;
+}
+
+void ImageCapturePipeline::startWorkers() {
+  for (uint32_t i = 0; i < numWorkers_; i++)
+    workers_.emplace_back([this]() { workerLoop(); });
+}
+
+void ImageCapturePipeline::workerLoop() {
+  Tracing::setThreadName("capture_worker");
+
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      jobAvailable_.wait(lock, [&]() { return stop_ || !jobs_.empty(); });
+
+      if (jobs_.empty())
+        return;
+
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+
+    run(job);
+  }
+}
+
+void ImageCapturePipeline::run(const Job& job) {
+  TRACE_SCOPE("ImageCapturePipeline::run");
+
+  bool encoded = encodeAs(
+      job.filename,
+      job.filename + kTemporarySuffix,
+      job.width,
+      job.height,
+      job.format,
+      buffers_[job.bufferIndex].data());
+
+  commit(job.sequence, job.filename, encoded);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    freeBuffers_.push_back(job.bufferIndex);
+  }
+  bufferAvailable_.notify_one();
+  jobsDone_.notify_all();
+}
+
+void ImageCapturePipeline::commit(uint64_t sequence, const std::string& filename, bool encoded) {
+  std::lock_guard<std::mutex> lock(commitMutex_);
+  pendingCommits_[sequence] = {filename, encoded};
+
+  for (auto it = pendingCommits_.begin();
+       it != pendingCommits_.end() && it->first == nextCommit_;
+       it = pendingCommits_.erase(it), nextCommit_++) {
+    const auto& [pendingFilename, pendingEncoded] = it->second;
+
+    std::error_code error;
+
+    if (!pendingEncoded) {
+      std::filesystem::remove(pendingFilename + kTemporarySuffix, error);
+      numFailed_++;
+      continue;
+    }
+
+    std::filesystem::rename(pendingFilename + kTemporarySuffix, pendingFilename, error);
+
+    if (error) {
+      std::cout << "could not write " << pendingFilename << ": " << error.message() << std::endl;
+      numFailed_++;
+    } else {
+      numWritten_++;
+    }
+  }
+}
+
+bool ImageCapturePipeline::encode(
+    const std::string& filename,
+    uint32_t width,
+    uint32_t height,
+    CapturePixelFormat format,
+    const void* data) {
+  return encodeAs(filename, filename, width, height, format, data);
+}
+
+bool ImageCapturePipeline::encodeAs(
+    const std::string& imageFilename,
+    const std::string& outputFilename,
+    uint32_t width,
+    uint32_t height,
+    CapturePixelFormat format,
+    const void* data) {
+  TRACE_SCOPE("ImageCapturePipeline::encode");
+
+  size_t numPixels = (size_t)width * height;
+
+  if (hasExtension(imageFilename, ".png")) {
+    if (isFloatFormat(format)) {
+      std::cout << "can't write float pixels to " << imageFilename << ", use .exr" << std::endl;
+      return false;
+    }
+
+    // Drop alpha and swizzle BGRA into RGB
+    bool bgra = format == CapturePixelFormat::kBGRA8;
+    const uint8_t* pixels = static_cast<const uint8_t*>(data);
+    std::vector<uint8_t> rgb(numPixels * 3);
+    for (size_t i = 0; i < numPixels; i++) {
+      rgb[i * 3 + 0] = pixels[i * 4 + (bgra ? 2 : 0)];
+      rgb[i * 3 + 1] = pixels[i * 4 + 1];
+      rgb[i * 3 + 2] = pixels[i * 4 + (bgra ? 0 : 2)];
+    }
+
+    int rowPitch = (int)width * 3;
+    if (!stbi_write_png(outputFilename.c_str(), (int)width, (int)height, 3, rgb.data(), rowPitch)) {
+      std::cout << "could not write " << imageFilename << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  if (hasExtension(imageFilename, ".exr")) {
+    if (!isFloatFormat(format)) {
+      std::cout << "can't write 8-bit pixels to " << imageFilename << ", use .png" << std::endl;
+      return false;
+    }
+
+    int numComponents = format == CapturePixelFormat::kR32Float ? 1 : 4;
+    const char* error = nullptr;
+    if (SaveEXR(
+            static_cast<const float*>(data),
+            (int)width,
+            (int)height,
+            numComponents,
+            0,
+            outputFilename.c_str(),
+            &error) != TINYEXR_SUCCESS) {
+      std::cout << "could not write " << imageFilename << ": " << (error ? error : "") << std::endl;
+      FreeEXRErrorMessage(error);
+      return false;
+    }
+    return true;
+  }
+
+  std::cout << "unsupported image format " << imageFilename << std::endl;
+  return false;
+}
+
+uint32_t ImageCapturePipeline::getBytesPerPixel(CapturePixelFormat format) {
+  switch (format) {
+    case CapturePixelFormat::kRGBA8:
+    case CapturePixelFormat::kBGRA8:
+    case CapturePixelFormat::kR32Float:
+      return 4;
+    case CapturePixelFormat::kRGBA32Float:
+      return 16;
+  }
+  return 4;
+}
+
+} // namespace split_rendering
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace split_rendering {
+
+enum class CapturePixelFormat : uint8_t { kRGBA8, kBGRA8, kR32Float, kRGBA32Float };
+
+// Encodes captured frames (e.g. --export_images) off the render thread.
+//
+// submit() copies the pixels into one of a fixed number of pooled CPU buffers and returns, worker
+// threads encode the buffers as PNG (stb_image_write, 8-bit formats) or EXR (tinyexr, float
+// formats) into temporary files. The files are renamed to their final names in submission order,
+// so an image sequence never has gaps or partial files while it is written. If all buffers are in
+// flight, submit() blocks until the oldest one is written (bounded backpressure), which bounds the
+// memory to numBuffers frames.
+//
+// Doesn't depend on Falcor or a GPU. The stb_image_write and tinyexr implementations are compiled
+// by FLIPComparisonPool.cpp (FLIP.h), which has to be part of the same target.
+class ImageCapturePipeline {
+ public:
+  // numWorkers = 0 encodes synchronously in submit()
+  explicit ImageCapturePipeline(uint32_t numBuffers = 8, uint32_t numWorkers = 2);
+  // Writes all submitted images
+  ~ImageCapturePipeline();
+
+  // rowPitch is in bytes, 0 for tightly packed rows. The extension of filename (.png or .exr)
+  // selects the encoder, PNGs are written without alpha.
+  void submit(
+      const std::string& filename,
+      uint32_t width,
+      uint32_t height,
+      CapturePixelFormat format,
+      const void* data,
+      size_t rowPitch = 0);
+
+  // Waits until all submitted images are written
+  void flush();
+
+  uint64_t getNumWritten();
+  uint64_t getNumFailed();
+  // Number of submit() calls that had to wait for a free buffer, and how long they waited in total
+  uint64_t getNumStalls();
+  double getStallSeconds();
+
+  // Encodes tightly packed pixels and writes them to filename, returns false on errors
+  static bool encode(
+      const std::string& filename,
+      uint32_t width,
+      uint32_t height,
+      CapturePixelFormat format,
+      const void* data);
+
+  static uint32_t getBytesPerPixel(CapturePixelFormat format);
+
+ private:
+  struct Job {
+    uint64_t sequence = 0;
+    std::string filename;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    CapturePixelFormat format = CapturePixelFormat::kRGBA8;
+    uint32_t bufferIndex = 0;
+  };
+
+  // The extension of imageFilename selects the encoder
+  static bool encodeAs(
+      const std::string& imageFilename,
+      const std::string& outputFilename,
+      uint32_t width,
+      uint32_t height,
+      CapturePixelFormat format,
+      const void* data);
+
+  void startWorkers();
+  void workerLoop();
+  void run(const Job& job);
+  // Renames the encoded temporary files whose predecessors are all done
+  void commit(uint64_t sequence, const std::string& filename, bool encoded);
+
+  uint32_t numWorkers_;
+  std::vector<std::thread> workers_;
+  std::vector<std::vector<uint8_t>> buffers_;
+
+  std::mutex mutex_;
+  std::condition_variable jobAvailable_;
+  std::condition_variable bufferAvailable_;
+  std::condition_variable jobsDone_;
+  std::deque<Job> jobs_;
+  std::vector<uint32_t> freeBuffers_;
+  bool stop_ = false;
+
+  uint64_t nextSequence_ = 0;
+
+  // Encoded or failed images waiting for their predecessors, by sequence number
+  std::mutex commitMutex_;
+  std::map<uint64_t, std::pair<std::string, bool>> pendingCommits_;
+  uint64_t nextCommit_ = 0;
+
+  uint64_t numWritten_ = 0;
+  uint64_t numFailed_ = 0;
+  uint64_t numStalls_ = 0;
+  double stallSeconds_ = 0.0;
+};
+
+} // namespace split_rendering
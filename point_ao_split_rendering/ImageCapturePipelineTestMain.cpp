@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless check of ImageCapturePipeline with synthetic frames. RGBA8, BGRA8 and float frames
+// with padded rows have to read back with the submitted pixels. A watcher thread lists the output
+// directory while frames of very different encoding cost are submitted, the final files have to
+// appear in submission order. Failed encodes must not leave temporary files behind, and only
+// submissions after the first numBuffers can stall.
+//
+// Example usage:
+// $ ./ImageCapturePipelineTest --output_dir capture_test --frames 48 --buffers 3 --workers 4
+//
+// Exit codes: 0 if all checks pass, 1 if a check fails, 2 for invalid arguments.
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ImageCapturePipeline.h"
+#include "argparse.hpp"
+
+// Declarations only, the implementations are part of FLIPComparisonPool.cpp
+#include "stb_image.h"
+#include "tinyexr.h"
+
+using split_rendering::CapturePixelFormat;
+using split_rendering::ImageCapturePipeline;
+
+namespace {
+
+const int kExitFailed = 1;
+const int kExitInvalid = 2;
+
+// Padding bytes at the end of every row of the submitted frames, filled with garbage
+const size_t kRowPadding = 12;
+const uint8_t kPaddingByte = 0xCD;
+
+uint32_t numFailures = 0;
+
+void fail(const std::string& message) {
+  if (numFailures++ < 20)
+    std::cout << "FAIL " << message << std::endl;
+}
+
+uint8_t getPixelByte(uint32_t x, uint32_t y, uint32_t channel, uint32_t frame) {
+  return (uint8_t)(x * 7 + y * 13 + channel * 61 + frame * 29);
+}
+
+float getPixelFloat(uint32_t x, uint32_t y, uint32_t channel) {
+  return (float)x * 0.25f - (float)y * 1.5f + (float)channel * 100.0f;
+}
+
+// Frame with rowPitch = width * bytesPerPixel + kRowPadding
+std::vector<uint8_t> createFrame(
+    uint32_t width,
+    uint32_t height,
+    CapturePixelFormat format,
+    uint32_t frame,
+    size_t& rowPitch) {
+  const uint32_t bytesPerPixel = ImageCapturePipeline::getBytesPerPixel(format);
+  rowPitch = (size_t)width * bytesPerPixel + kRowPadding;
+  std::vector<uint8_t> pixels(rowPitch * height, kPaddingByte);
+
+  for (uint32_t y = 0; y < height; y++) {
+    uint8_t* row = pixels.data() + y * rowPitch;
+
+    for (uint32_t x = 0; x < width; x++) {
+      if (format == CapturePixelFormat::kRGBA8 || format == CapturePixelFormat::kBGRA8) {
+        for (uint32_t channel = 0; channel < 4; channel++)
+          row[x * 4 + channel] = getPixelByte(x, y, channel, frame);
+      } else {
+        const uint32_t numChannels = bytesPerPixel / sizeof(float);
+        for (uint32_t channel = 0; channel < numChannels; channel++) {
+          const float value = getPixelFloat(x, y, channel);
+          std::memcpy(row + (x * numChannels + channel) * sizeof(float), &value, sizeof(float));
+        }
+      }
+    }
+  }
+
+  return pixels;
+}
+
+// PNGs drop alpha, BGRA8 frames are swizzled into RGB
+void checkPNG(
+    const std::string& filename,
+    uint32_t width,
+    uint32_t height,
+    CapturePixelFormat format,
+    uint32_t frame) {
+  int loadedWidth = 0;
+  int loadedHeight = 0;
+  int numComponents = 0;
+  stbi_uc* pixels = stbi_load(filename.c_str(), &loadedWidth, &loadedHeight, &numComponents, 3);
+
+  if (!pixels) {
+    fail("can't read " + filename);
+    return;
+  }
+
+  if ((uint32_t)loadedWidth != width || (uint32_t)loadedHeight != height || numComponents != 3) {
+    fail(filename + " has another size or number of channels");
+  } else {
+    const bool bgra = format == CapturePixelFormat::kBGRA8;
+    uint32_t numMismatches = 0;
+
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+        for (uint32_t channel = 0; channel < 3; channel++) {
+          const uint32_t sourceChannel = bgra && channel != 1 ? 2 - channel : channel;
+          if (pixels[(y * width + x) * 3 + channel] != getPixelByte(x, y, sourceChannel, frame))
+            numMismatches++;
+        }
+      }
+    }
+
+    if (numMismatches > 0)
+      fail(filename + " has " + std::to_string(numMismatches) + " wrong channels");
+  }
+
+  stbi_image_free(pixels);
+}
+
+// Single channel EXRs are loaded into all four channels
+void checkEXR(
+    const std::string& filename,
+    uint32_t width,
+    uint32_t height,
+    CapturePixelFormat format) {
+  float* pixels = nullptr;
+  int loadedWidth = 0;
+  int loadedHeight = 0;
+  const char* error = nullptr;
+
+  if (LoadEXR(&pixels, &loadedWidth, &loadedHeight, filename.c_str(), &error) != TINYEXR_SUCCESS) {
+    fail("can't read " + filename + ": " + (error ? error : ""));
+    FreeEXRErrorMessage(error);
+    return;
+  }
+
+  if ((uint32_t)loadedWidth != width || (uint32_t)loadedHeight != height) {
+    fail(filename + " has another size");
+  } else {
+    const bool singleChannel = format == CapturePixelFormat::kR32Float;
+    uint32_t numMismatches = 0;
+
+    for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+        for (uint32_t channel = 0; channel < (singleChannel ? 1u : 4u); channel++) {
+          if (pixels[(y * width + x) * 4 + channel] != getPixelFloat(x, y, channel))
+            numMismatches++;
+        }
+      }
+    }
+
+    if (numMismatches > 0)
+      fail(filename + " has " + std::to_string(numMismatches) + " wrong channels");
+  }
+
+  free(pixels);
+}
+
+// Every format with padded rows, encoded synchronously and by a worker
+void checkFormats(const std::filesystem::path& directory) {
+  struct FormatCase {
+    CapturePixelFormat format;
+    const char* name;
+    const char* extension;
+  };
+  const FormatCase formatCases[] = {
+      {CapturePixelFormat::kRGBA8, "rgba8", ".png"},
+      {CapturePixelFormat::kBGRA8, "bgra8", ".png"},
+      {CapturePixelFormat::kR32Float, "r32f", ".exr"},
+      {CapturePixelFormat::kRGBA32Float, "rgba32f", ".exr"},
+  };
+  const uint32_t width = 37;
+  const uint32_t height = 23;
+
+  for (uint32_t numWorkers : {0u, 2u}) {
+    std::vector<std::string> filenames;
+
+    {
+      ImageCapturePipeline pipeline(2, numWorkers);
+
+      for (const auto& formatCase : formatCases) {
+        size_t rowPitch = 0;
+        const auto pixels = createFrame(width, height, formatCase.format, 0, rowPitch);
+        filenames.push_back(
+            (directory /
+             (std::string(formatCase.name) + "_" + std::to_string(numWorkers) +
+              formatCase.extension))
+                .string());
+        pipeline.submit(
+            filenames.back(), width, height, formatCase.format, pixels.data(), rowPitch);
+      }
+
+      pipeline.flush();
+
+      if (pipeline.getNumWritten() != filenames.size() || pipeline.getNumFailed() != 0)
+        fail("not all formats were written with " + std::to_string(numWorkers) + " workers");
+    }
+
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (formatCases[i].extension == std::string(".png"))
+        checkPNG(filenames[i], width, height, formatCases[i].format, 0);
+      else
+        checkEXR(filenames[i], width, height, formatCases[i].format);
+    }
+  }
+}
+
+std::set<uint32_t> listFrames(const std::filesystem::path& directory) {
+  std::set<uint32_t> frames;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+    const std::string filename = entry.path().filename().string();
+    if (filename.rfind("frame_", 0) == 0 && entry.path().extension() == ".png")
+      frames.insert((uint32_t)std::stoul(filename.substr(6)));
+  }
+  return frames;
+}
+
+uint32_t countTemporaryFiles(const std::filesystem::path& directory) {
+  uint32_t numTemporaryFiles = 0;
+  for (const auto& entry : std::filesystem::directory_iterator(directory))
+    numTemporaryFiles += entry.path().extension() == ".part";
+  return numTemporaryFiles;
+}
+
+// Lists the directory until stop is set. A listing isn't atomic, it can miss files renamed while it
+// runs, but the frames before the last one of a listing were renamed before it and have to be in
+// the next listing.
+void watchFrameOrder(
+    const std::filesystem::path& directory,
+    const std::atomic<bool>& stop,
+    std::atomic<uint32_t>& numOrderViolations) {
+  std::set<uint32_t> previousFrames = listFrames(directory);
+
+  while (!stop) {
+    const std::set<uint32_t> frames = listFrames(directory);
+
+    if (!previousFrames.empty()) {
+      for (uint32_t frame = 0; frame < *previousFrames.rbegin(); frame++) {
+        if (frames.count(frame) == 0) {
+          numOrderViolations++;
+          break;
+        }
+      }
+    }
+
+    previousFrames = frames;
+  }
+}
+
+// Frames alternate between expensive and cheap to encode, so that the workers finish them out of
+// order, but they have to be renamed in submission order
+void checkOrder(
+    const std::filesystem::path& directory,
+    uint32_t numFrames,
+    uint32_t numBuffers,
+    uint32_t numWorkers) {
+  std::atomic<bool> stop = false;
+  std::atomic<uint32_t> numOrderViolations = 0;
+  std::thread watcher(
+      [&]() { watchFrameOrder(directory, stop, numOrderViolations); });
+
+  size_t rowPitch = 0;
+  const auto largeFrame = createFrame(512, 512, CapturePixelFormat::kRGBA8, 0, rowPitch);
+  const size_t largeRowPitch = rowPitch;
+  const auto smallFrame = createFrame(8, 8, CapturePixelFormat::kRGBA8, 1, rowPitch);
+  const size_t smallRowPitch = rowPitch;
+
+  uint64_t numWritten = 0;
+  uint64_t numFailed = 0;
+  {
+    ImageCapturePipeline pipeline(numBuffers, numWorkers);
+
+    for (uint32_t frame = 0; frame < numFrames; frame++) {
+      const std::string filename =
+          (directory / ("frame_" + std::to_string(frame) + ".png")).string();
+      if (frame % 2 == 0) {
+        pipeline.submit(
+            filename, 512, 512, CapturePixelFormat::kRGBA8, largeFrame.data(), largeRowPitch);
+      } else {
+        pipeline.submit(
+            filename, 8, 8, CapturePixelFormat::kRGBA8, smallFrame.data(), smallRowPitch);
+      }
+    }
+
+    pipeline.flush();
+    numWritten = pipeline.getNumWritten();
+    numFailed = pipeline.getNumFailed();
+  }
+
+  stop = true;
+  watcher.join();
+
+  if (numOrderViolations > 0)
+    fail("frames were renamed out of submission order " + std::to_string(numOrderViolations) +
+         " times");
+  if (numWritten != numFrames || numFailed != 0 || listFrames(directory).size() != numFrames)
+    fail("only " + std::to_string(numWritten) + " of " + std::to_string(numFrames) +
+         " frames were written");
+  if (countTemporaryFiles(directory) != 0)
+    fail("temporary files are left after writing all frames");
+
+  checkPNG((directory / "frame_0.png").string(), 512, 512, CapturePixelFormat::kRGBA8, 0);
+  checkPNG((directory / "frame_1.png").string(), 8, 8, CapturePixelFormat::kRGBA8, 1);
+}
+
+// Encodes that fail for different reasons in between frames that are written
+void checkFailures(const std::filesystem::path& directory) {
+  size_t rowPitch = 0;
+  const auto byteFrame = createFrame(16, 16, CapturePixelFormat::kRGBA8, 0, rowPitch);
+  const size_t byteRowPitch = rowPitch;
+  const auto floatFrame = createFrame(16, 16, CapturePixelFormat::kRGBA32Float, 0, rowPitch);
+  const size_t floatRowPitch = rowPitch;
+
+  struct Submission {
+    std::string filename;
+    bool floatFrame;
+    bool written;
+  };
+  const Submission submissions[] = {
+      {"written_0.png", false, true},
+      {"float_to_png.png", true, false},
+      {"written_1.exr", true, true},
+      {"unsupported.bmp", false, false},
+      {"bytes_to_exr.exr", false, false},
+      {"missing_directory/frame.png", false, false},
+      {"written_2.png", false, true},
+  };
+
+  uint64_t numWritten = 0;
+  uint64_t numFailed = 0;
+  {
+    ImageCapturePipeline pipeline(2, 2);
+
+    for (const auto& submission : submissions) {
+      pipeline.submit(
+          (directory / submission.filename).string(),
+          16,
+          16,
+          submission.floatFrame ? CapturePixelFormat::kRGBA32Float : CapturePixelFormat::kRGBA8,
+          submission.floatFrame ? floatFrame.data() : byteFrame.data(),
+          submission.floatFrame ? floatRowPitch : byteRowPitch);
+    }
+
+    pipeline.flush();
+    numWritten = pipeline.getNumWritten();
+    numFailed = pipeline.getNumFailed();
+  }
+
+  uint64_t expectedWritten = 0;
+  for (const auto& submission : submissions) {
+    expectedWritten += submission.written;
+    if (std::filesystem::exists(directory / submission.filename) != submission.written)
+      fail(submission.filename + (submission.written ? " is missing" : " was written"));
+  }
+
+  if (numWritten != expectedWritten || numFailed != std::size(submissions) - expectedWritten)
+    fail("wrong number of written (" + std::to_string(numWritten) + ") or failed (" +
+         std::to_string(numFailed) + ") images");
+  if (countTemporaryFiles(directory) != 0)
+    fail("failed encodes left temporary files");
+}
+
+// Only submissions after the first numBuffers can wait for a buffer. With a single buffer, the
+// second frame is submitted long before the first one is encoded.
+void checkStalls(const std::filesystem::path& directory, uint32_t numFrames) {
+  size_t rowPitch = 0;
+  const auto pixels = createFrame(512, 512, CapturePixelFormat::kRGBA8, 0, rowPitch);
+
+  for (uint32_t numBuffers : {1u, 3u, numFrames}) {
+    ImageCapturePipeline pipeline(numBuffers, 1);
+
+    for (uint32_t frame = 0; frame < numFrames; frame++) {
+      pipeline.submit(
+          (directory / ("stall_" + std::to_string(frame) + ".png")).string(),
+          512,
+          512,
+          CapturePixelFormat::kRGBA8,
+          pixels.data(),
+          rowPitch);
+    }
+
+    pipeline.flush();
+    const uint64_t numStalls = pipeline.getNumStalls();
+
+    if (numStalls > numFrames - numBuffers)
+      fail(std::to_string(numStalls) + " stalls with " + std::to_string(numBuffers) +
+           " buffers for " + std::to_string(numFrames) + " frames");
+    if (numBuffers == 1 && numStalls == 0)
+      fail("submit() never waited for the only buffer");
+
+    std::cout << numBuffers << " buffers: " << numStalls << " stalls, "
+              << pipeline.getStallSeconds() << " s" << std::endl;
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("ImageCapturePipelineTest");
+
+  args.add_argument("--output_dir")
+      .help("directory for the test images, it is cleared first")
+      .default_value(
+          (std::filesystem::temp_directory_path() / "ImageCapturePipelineTest").string());
+  args.add_argument("--frames")
+      .help("frames submitted by the order and stall checks")
+      .default_value(48)
+      .scan<'d', int>();
+  args.add_argument("--buffers")
+      .help("capture buffers of the order check")
+      .default_value(6)
+      .scan<'d', int>();
+  args.add_argument("--workers")
+      .help("encoding threads of the order check")
+      .default_value(4)
+      .scan<'d', int>();
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const std::filesystem::path outputDir = args.get<std::string>("--output_dir");
+  const int numFrames = args.get<int>("--frames");
+  const int numBuffers = args.get<int>("--buffers");
+  const int numWorkers = args.get<int>("--workers");
+
+  if (numFrames < 4 || numBuffers < 1 || numWorkers < 1) {
+    std::cerr << "invalid arguments" << std::endl;
+    return kExitInvalid;
+  }
+
+  for (const char* subdirectory : {"formats", "order", "failures", "stalls"}) {
+    std::filesystem::remove_all(outputDir / subdirectory);
+    std::filesystem::create_directories(outputDir / subdirectory);
+  }
+
+  checkFormats(outputDir / "formats");
+  checkOrder(outputDir / "order", (uint32_t)numFrames, (uint32_t)numBuffers, (uint32_t)numWorkers);
+  checkFailures(outputDir / "failures");
+  checkStalls(outputDir / "stalls", (uint32_t)numFrames);
+
+  std::cout << (numFailures == 0 ? "PASSED" : "FAILED") << std::endl;
+  return numFailures == 0 ? 0 : kExitFailed;
+}
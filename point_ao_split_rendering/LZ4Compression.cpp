@@ -7,11 +7,13 @@
  */
 
 #include "LZ4Compression.h"
+#include "Tracing.h"
 
 int LZ4Compression::compressData(
     const void* uncompressedData,
     std::vector<uint8_t>& compressedData,
     uint32_t numUncompressedBytes) {
+  TRACE_SCOPE("LZ4Compression::compressData");
   uint32_t maxCompressedBytes = LZ4_compressBound(numUncompressedBytes);
   compressedData.resize(maxCompressedBytes);
   return LZ4_compress_default(
@@ -24,6 +26,7 @@ int LZ4Compression::compressData(
 int LZ4Compression::decompressData(
     const std::vector<uint8_t>& compressedData,
     std::vector<uint8_t>& decompressedData) {
+  TRACE_SCOPE("LZ4Compression::decompressData");
   return LZ4_decompress_safe(
       (const char*)compressedData.data(),
       (char*)decompressedData.data(),
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace split_rendering {
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(
+      filename.c_str(),
+      GENERIC_READ,
+      FILE_SHARE_READ,
+      nullptr,
+      OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL,
+      nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(file, &fileSize);
+  HANDLE mapping = fileSize.QuadPart > 0
+      ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)
+      : nullptr;
+  const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+  fileHandle_ = file;
+  mappingHandle_ = mapping;
+  size_ = (size_t)fileSize.QuadPart;
+#else
+  int file = ::open(filename.c_str(), O_RDONLY);
+  if (file < 0)
+    return false;
+
+  struct stat fileStat;
+  fstat(file, &fileStat);
+  size_ = (size_t)fileStat.st_size;
+  void* data = size_ > 0 ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+  ::close(file);
+
+  if (data == MAP_FAILED)
+    data = nullptr;
+#endif
+
+  data_ = static_cast<const uint8_t*>(data);
+  if (!data_) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mappingHandle_)
+    CloseHandle(mappingHandle_);
+  if (fileHandle_)
+    CloseHandle(fileHandle_);
+  mappingHandle_ = nullptr;
+  fileHandle_ = nullptr;
+#else
+  if (data_)
+    munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+} // namespace split_rendering
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace split_rendering {
+
+// Read-only memory mapping of a whole file, used to load binary assets without copying them
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Returns false if the file doesn't exist, is empty or can't be mapped
+  bool open(const std::string& filename);
+  void close();
+
+  bool isOpen() const {
+    return data_ != nullptr;
+  }
+
+  const uint8_t* getData() const {
+    return data_;
+  }
+
+  size_t getSize() const {
+    return size_;
+  }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* fileHandle_ = nullptr;
+  void* mappingHandle_ = nullptr;
+#endif
+};
+
+} // namespace split_rendering
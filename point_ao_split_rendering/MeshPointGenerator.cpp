@@ -12,6 +12,7 @@
 #include <execution>
 #include "../poisson_sampling/cySampleElim.h"
 #include "Core/API/Device.h"
+#include "Tracing.h"
 #include <filesystem>
 #include <fstream>
 
@@ -139,12 +140,7 @@ float MeshPointGenerator::getTotalSurfaceArea(
   // NOTE: This could be easily parallelized
   for (uint32_t idxStart = indexOffset; idxStart < indexOffset + numTriangles * 3; idxStart += 3) {
 
-    //if ((idxStart / 3) < cpuTriangleVisibility_.size() && cpuTriangleVisibility_[idxStart / 3] == 0)
-    //  continue;
-    if (instanceID < cpuTriangleVisibilityOffsets_.size() &&
-        (tri_idx + cpuTriangleVisibilityOffsets_[instanceID]) < cpuTriangleVisibility_.size() &&
-        cpuTriangleVisibility_[tri_idx + cpuTriangleVisibilityOffsets_[instanceID]] == 0)
-    {
+    if (!isTriangleVisible(instanceID, tri_idx)) {
       instanceTriangleIndex++;
       tri_idx++;
       continue;
@@ -208,9 +204,7 @@ std::vector<uint32_t> MeshPointGenerator::getNumSamplesPerTriangle(
     }
 
     
-    if (instanceID < cpuTriangleVisibilityOffsets_.size() &&
-        (tri_idx + cpuTriangleVisibilityOffsets_[instanceID]) < cpuTriangleVisibility_.size() &&
-        cpuTriangleVisibility_[tri_idx + cpuTriangleVisibilityOffsets_[instanceID]] == 0)
+    if (!isTriangleVisible(instanceID, tri_idx))
       continue;
 
 
@@ -233,9 +227,7 @@ std::vector<uint32_t> MeshPointGenerator::getNumSamplesPerTriangle(
 
     // Can't find anything, just add samples to random for this instance
     if (rand_loop_cnt < 10000) {
-      if (instanceID < cpuTriangleVisibilityOffsets_.size() &&
-          (tri_idx + cpuTriangleVisibilityOffsets_[instanceID]) < cpuTriangleVisibility_.size() &&
-          cpuTriangleVisibility_[tri_idx + cpuTriangleVisibilityOffsets_[instanceID]] == 0)
+      if (!isTriangleVisible(instanceID, tri_idx))
         continue;
     } else {
       
@@ -607,6 +599,8 @@ void MeshPointGenerator::generatePointsInScene(
   // NOTE: this could use dispenso::for_each which might have better performance
   std::for_each(
       std::execution::par, instanceIds.begin(), instanceIds.end(), [&](uint32_t& instanceId) {
+        TRACE_SCOPE("poissonSampleInstance");
+
         const auto& instance = scene->getGeometryInstance(instanceId);
 
         //if (instanceId == 90)
@@ -707,13 +701,38 @@ void MeshPointGenerator::generatePointsInScene(
 
       });
 
+  createGPUBuffers();
+}
+
+void MeshPointGenerator::writeBake(BakePackageWriter& writer) const {
+  TRACE_SCOPE("MeshPointGenerator::writeBake");
+  writer.addSection(kBakeNumSamplesPerInstance, numSamplesPerInstance_);
+  writer.addSection(kBakeSampleOffsetPerInstance, sampleOffsetPerInstance_);
+  writer.addSection(kBakeDiskRadiusPerInstance, diskRadiusPerInstance_);
+  writer.addSection(kBakePointData, pointData_);
+}
+
+bool MeshPointGenerator::loadBake(const BakePackage& package) {
+  TRACE_SCOPE("MeshPointGenerator::loadBake");
+  if (!package.readSection(kBakeNumSamplesPerInstance, numSamplesPerInstance_) ||
+      !package.readSection(kBakeSampleOffsetPerInstance, sampleOffsetPerInstance_) ||
+      !package.readSection(kBakeDiskRadiusPerInstance, diskRadiusPerInstance_) ||
+      !package.readSection(kBakePointData, pointData_)) {
+    std::cout << "bake package is missing the scene points" << std::endl;
+    return false;
+  }
+
+  createGPUBuffers();
+  return true;
+}
+
+void MeshPointGenerator::createGPUBuffers() {
   gpuDiskRadiusPerInstance_ = Falcor::Buffer::createStructured(
       sizeof(float),
       diskRadiusPerInstance_.size(),
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None,
       diskRadiusPerInstance_.data());
-
 }
 
 void MeshPointGenerator::setupGPUUniformPointGenerationPipeline(
@@ -11,6 +11,8 @@
 #include <Falcor.h>
 #include "PointData.slang"
 #include <random>
+#include "BakePackage.h"
+#include "TriangleVisibilitySet.h"
 
 namespace split_rendering {
 
@@ -27,6 +29,12 @@ class MeshPointGenerator {
  public:
   void generatePointsInScene(Falcor::Scene::SharedPtr& scene, Falcor::RenderContext* renderContext);
 
+  // Stores the generated points in a bake package
+  void writeBake(BakePackageWriter& writer) const;
+  // Restores the points of a bake package instead of generating them, returns false if sections
+  // are missing
+  bool loadBake(const BakePackage& package);
+
   const std::vector<uint32_t>& getNumSamplesPerInstance() const {
     return numSamplesPerInstance_;
   }
@@ -55,16 +63,21 @@ class MeshPointGenerator {
     return gpuSampleOffsetPerInstance_;
   }
 
-  std::vector<uint32_t> cpuTriangleVisibility_;
-  std::vector<uint32_t> cpuTriangleVisibilityOffsets_;
+  // Triangles that are not visible get no samples. The set has to outlive point generation.
+  void setTriangleVisibility(const TriangleVisibilitySet* triangleVisibility) {
+    triangleVisibility_ = triangleVisibility;
+  }
 
-  
   // Constants for point generation
   uint32_t kNumSamplesPerUnitSquaredEliminated = 2048;
   uint32_t kMinSamplesPerInstance = 4096;
   uint32_t kSamplesEliminatedFactor = 8;
 
  private:
+  bool isTriangleVisible(uint32_t instanceID, uint32_t triangleIndex) const {
+    return !triangleVisibility_ || triangleVisibility_->isVisible(instanceID, triangleIndex);
+  }
+
   uint32_t samplePoissonDiskOnMeshOffsets(
       const Falcor::PointData* uniformPointData,
       uint32_t uniformDataOffset,
@@ -147,6 +160,7 @@ class MeshPointGenerator {
 
   void setupGPUUniformPointGenerationPipeline(Falcor::Scene::SharedPtr& scene);
 
+  void createGPUBuffers();
 
 
   std::vector<uint32_t> numSamplesPerInstance_;
@@ -158,6 +172,7 @@ class MeshPointGenerator {
   Falcor::Buffer::SharedPtr gpuSampleOffsetPerInstance_;
   Falcor::RtProgramVars::SharedPtr pointGenRtVars_;
   Falcor::RtProgram::SharedPtr pointGenRtProgram_;
+  const TriangleVisibilitySet* triangleVisibility_ = nullptr;
 
 };
 
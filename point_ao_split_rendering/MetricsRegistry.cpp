@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MetricsRegistry.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include "Tracing.h"
+
+namespace split_rendering {
+
+namespace {
+
+const float kMissingFloat = std::numeric_limits<float>::quiet_NaN();
+const int64_t kMissingInt = std::numeric_limits<int64_t>::min();
+
+// How often the writer wakes up without being notified
+const auto kWriterInterval = std::chrono::milliseconds(250);
+
+template <typename T>
+void writeBinary(std::ofstream& file, const T& value) {
+  file.write((const char*)&value, sizeof(T));
+}
+
+} // namespace
+
+MetricsRegistry::P2Quantile::P2Quantile(double p) : p_(p) {}
+
+void MetricsRegistry::P2Quantile::add(double x) {
+  // The first five samples become the markers
+  if (count_ < 5) {
+    heights_[count_++] = x;
+
+    if (count_ == 5) {
+      std::sort(heights_, heights_ + 5);
+      for (int i = 0; i < 5; i++)
+        positions_[i] = i + 1;
+
+      desiredPositions_[0] = 1.0;
+      desiredPositions_[1] = 1.0 + 2.0 * p_;
+      desiredPositions_[2] = 1.0 + 4.0 * p_;
+      desiredPositions_[3] = 3.0 + 2.0 * p_;
+      desiredPositions_[4] = 5.0;
+
+      increments_[0] = 0.0;
+      increments_[1] = p_ / 2.0;
+      increments_[2] = p_;
+      increments_[3] = (1.0 + p_) / 2.0;
+      increments_[4] = 1.0;
+    }
+    return;
+  }
+
+  // Cell k of the sample, extending the outer markers if needed
+  int k = 0;
+  if (x < heights_[0]) {
+    heights_[0] = x;
+  } else if (x >= heights_[4]) {
+    heights_[4] = x;
+    k = 3;
+  } else {
+    while (k < 3 && x >= heights_[k + 1])
+      k++;
+  }
+
+  for (int i = k + 1; i < 5; i++)
+    positions_[i] += 1.0;
+  for (int i = 0; i < 5; i++)
+    desiredPositions_[i] += increments_[i];
+  count_++;
+
+  // Moves the middle markers towards their desired positions, piecewise parabolic if that keeps
+  // the heights ordered, otherwise linear
+  for (int i = 1; i < 4; i++) {
+    double d = desiredPositions_[i] - positions_[i];
+
+    if ((d >= 1.0 && positions_[i + 1] - positions_[i] > 1.0) ||
+        (d <= -1.0 && positions_[i - 1] - positions_[i] < -1.0)) {
+      int s = d >= 0.0 ? 1 : -1;
+
+      double parabolic = heights_[i] +
+          s / (positions_[i + 1] - positions_[i - 1]) *
+              ((positions_[i] - positions_[i - 1] + s) * (heights_[i + 1] - heights_[i]) /
+                   (positions_[i + 1] - positions_[i]) +
+               (positions_[i + 1] - positions_[i] - s) * (heights_[i] - heights_[i - 1]) /
+                   (positions_[i] - positions_[i - 1]));
+
+      if (heights_[i - 1] < parabolic && parabolic < heights_[i + 1]) {
+        heights_[i] = parabolic;
+      } else {
+        heights_[i] += s * (heights_[i + s] - heights_[i]) / (positions_[i + s] - positions_[i]);
+      }
+
+      positions_[i] += s;
+    }
+  }
+}
+
+double MetricsRegistry::P2Quantile::get() const {
+  if (count_ == 0)
+    return 0.0;
+
+  // Exact for fewer than five samples
+  if (count_ < 5) {
+    double sorted[5];
+    std::copy(heights_, heights_ + count_, sorted);
+    std::sort(sorted, sorted + count_);
+    return sorted[(size_t)std::round(p_ * (count_ - 1))];
+  }
+
+  return heights_[2];
+}
+
+MetricsRegistry::MetricsRegistry(size_t ringCapacity)
+    : ringCapacity_(std::max<size_t>(ringCapacity, 2)) {}
+
+MetricsRegistry::~MetricsRegistry() {
+  stop();
+}
+
+MetricsRegistry::MetricId MetricsRegistry::registerMetric(
+    const std::string& name,
+    MetricType type) {
+  auto it = metricIds_.find(name);
+  if (it != metricIds_.end()) {
+    if (metrics_[it->second].type != type)
+      std::cout << "metric " << name << " was registered with a different type" << std::endl;
+    return it->second;
+  }
+
+  if (writerRunning_) {
+    std::cout << "can't register metric " << name << " after the metrics writer started"
+              << std::endl;
+    return 0;
+  }
+
+  Metric metric;
+  metric.name = name;
+  metric.type = type;
+
+  if (type == MetricType::kFloat) {
+    metric.column = numFloatColumns_++;
+    floatColumns_.resize((size_t)numFloatColumns_ * ringCapacity_, kMissingFloat);
+  } else {
+    metric.column = numIntColumns_++;
+    intColumns_.resize((size_t)numIntColumns_ * ringCapacity_, kMissingInt);
+  }
+
+  MetricId id = (MetricId)metrics_.size();
+  metrics_.push_back(std::move(metric));
+  metricIds_[name] = id;
+  return id;
+}
+
+bool MetricsRegistry::start(const std::string& filename, OutputFormat format) {
+  stop();
+
+  std::ios::openmode mode = std::ios::out;
+  if (format == OutputFormat::kBinary)
+    mode |= std::ios::binary;
+
+  file_.open(filename, mode);
+  if (!file_.is_open()) {
+    std::cout << "could not write metrics to " << filename << std::endl;
+    return false;
+  }
+
+  format_ = format;
+
+  if (format_ == OutputFormat::kCSV) {
+    for (size_t i = 0; i < metrics_.size(); i++)
+      file_ << (i > 0 ? "," : "") << metrics_[i].name;
+    file_ << "\n";
+  } else {
+    writeBinary(file_, kBinaryMagic);
+    writeBinary(file_, kBinaryVersion);
+    writeBinary(file_, (uint32_t)metrics_.size());
+    for (const auto& metric : metrics_) {
+      writeBinary(file_, (uint8_t)metric.type);
+      writeBinary(file_, (uint16_t)metric.name.size());
+      file_.write(metric.name.data(), metric.name.size());
+    }
+  }
+
+  // Rows that were recorded without a writer are not written
+  numRowsWritten_ = numRowsCommitted_.load();
+  rowOpen_ = false;
+
+  stopWriter_ = false;
+  writerRunning_ = true;
+  writerThread_ = std::thread([this]() { writerLoop(); });
+  return true;
+}
+
+void MetricsRegistry::stop() {
+  endFrame();
+
+  if (!writerRunning_)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(writerMutex_);
+    stopWriter_ = true;
+  }
+  writerCondition_.notify_one();
+  writerThread_.join();
+
+  writerRunning_ = false;
+  file_.flush();
+  file_.close();
+}
+
+void MetricsRegistry::beginFrame() {
+  endFrame();
+
+  numFrames_++;
+
+  if (!writerRunning_)
+    return;
+
+  uint64_t row = numRowsCommitted_.load(std::memory_order_relaxed);
+  if (row - numRowsWritten_.load(std::memory_order_acquire) >= ringCapacity_) {
+    numDroppedRows_++;
+    return;
+  }
+
+  size_t slot = row % ringCapacity_;
+  for (uint32_t column = 0; column < numFloatColumns_; column++)
+    floatColumns_[column * ringCapacity_ + slot] = kMissingFloat;
+  for (uint32_t column = 0; column < numIntColumns_; column++)
+    intColumns_[column * ringCapacity_ + slot] = kMissingInt;
+
+  rowOpen_ = true;
+}
+
+void MetricsRegistry::endFrame() {
+  if (!rowOpen_)
+    return;
+
+  rowOpen_ = false;
+  uint64_t numPending = numRowsCommitted_.fetch_add(1, std::memory_order_release) + 1 -
+      numRowsWritten_.load(std::memory_order_relaxed);
+
+  // Only wake the writer early once a good part of the ring is filled
+  if (numPending >= ringCapacity_ / 4)
+    writerCondition_.notify_one();
+}
+
+void MetricsRegistry::recordFloat(MetricId id, float value) {
+  Metric& metric = metrics_[id];
+  addSample(metric, value);
+
+  if (rowOpen_) {
+    size_t slot = numRowsCommitted_.load(std::memory_order_relaxed) % ringCapacity_;
+    floatColumns_[metric.column * ringCapacity_ + slot] = value;
+  }
+}
+
+void MetricsRegistry::recordInt(MetricId id, int64_t value) {
+  Metric& metric = metrics_[id];
+  addSample(metric, (double)value);
+
+  if (rowOpen_) {
+    size_t slot = numRowsCommitted_.load(std::memory_order_relaxed) % ringCapacity_;
+    intColumns_[metric.column * ringCapacity_ + slot] = value;
+  }
+}
+
+void MetricsRegistry::addSample(Metric& metric, double value) {
+  if (metric.count == 0) {
+    metric.min = value;
+    metric.max = value;
+  } else {
+    metric.min = std::min(metric.min, value);
+    metric.max = std::max(metric.max, value);
+  }
+
+  metric.count++;
+  metric.sum += value;
+  metric.p50.add(value);
+  metric.p95.add(value);
+  metric.p99.add(value);
+}
+
+void MetricsRegistry::writerLoop() {
+  Tracing::setThreadName("metrics_writer");
+
+  while (true) {
+    bool stopping;
+    {
+      std::unique_lock<std::mutex> lock(writerMutex_);
+      writerCondition_.wait_for(lock, kWriterInterval);
+      stopping = stopWriter_;
+    }
+
+    uint64_t begin = numRowsWritten_.load(std::memory_order_relaxed);
+    uint64_t end = numRowsCommitted_.load(std::memory_order_acquire);
+
+    if (begin != end) {
+      writeRows(begin, end);
+      numRowsWritten_.store(end, std::memory_order_release);
+    }
+
+    if (stopping)
+      return;
+  }
+}
+
+void MetricsRegistry::writeRows(uint64_t begin, uint64_t end) {
+  TRACE_SCOPE("MetricsRegistry::writeRows");
+
+  for (uint64_t row = begin; row < end; row++) {
+    size_t slot = row % ringCapacity_;
+
+    for (size_t i = 0; i < metrics_.size(); i++) {
+      const Metric& metric = metrics_[i];
+
+      if (metric.type == MetricType::kFloat) {
+        float value = floatColumns_[metric.column * ringCapacity_ + slot];
+
+        if (format_ == OutputFormat::kBinary)
+          writeBinary(file_, value);
+        else {
+          if (i > 0)
+            file_ << ",";
+          if (!std::isnan(value))
+            file_ << value;
+        }
+      } else {
+        int64_t value = intColumns_[metric.column * ringCapacity_ + slot];
+
+        if (format_ == OutputFormat::kBinary)
+          writeBinary(file_, value);
+        else {
+          if (i > 0)
+            file_ << ",";
+          if (value != kMissingInt)
+            file_ << value;
+        }
+      }
+    }
+
+    if (format_ == OutputFormat::kCSV)
+      file_ << "\n";
+  }
+}
+
+MetricsRegistry::Summary MetricsRegistry::getSummary(MetricId id) const {
+  const Metric& metric = metrics_[id];
+
+  Summary summary;
+  summary.count = metric.count;
+  if (metric.count > 0) {
+    summary.mean = metric.sum / metric.count;
+    summary.min = metric.min;
+    summary.max = metric.max;
+    summary.p50 = metric.p50.get();
+    summary.p95 = metric.p95.get();
+    summary.p99 = metric.p99.get();
+  }
+  return summary;
+}
+
+void MetricsRegistry::printSummary(std::ostream& out) const {
+  out << "metrics of " << numFrames_ << " frames (" << numDroppedRows_ << " rows dropped)"
+      << std::endl;
+
+  for (MetricId id = 0; id < metrics_.size(); id++) {
+    Summary summary = getSummary(id);
+    out << metrics_[id].name << ": count " << summary.count << ", mean " << summary.mean
+        << ", min " << summary.min << ", max " << summary.max << ", p50 " << summary.p50
+        << ", p95 " << summary.p95 << ", p99 " << summary.p99 << std::endl;
+  }
+}
+
+void MetricsRegistry::writeSummaryCSV(const std::string& filename) const {
+  std::fstream csv;
+  csv.open(filename, std::ios::out);
+
+  if (!csv.is_open()) {
+    std::cout << "could not write metrics summary to " << filename << std::endl;
+    return;
+  }
+
+  csv << "metric,count,mean,min,max,p50,p95,p99\n";
+
+  for (MetricId id = 0; id < metrics_.size(); id++) {
+    Summary summary = getSummary(id);
+    csv << metrics_[id].name << "," << summary.count << "," << summary.mean << ","
+        << summary.min << "," << summary.max << "," << summary.p50 << "," << summary.p95 << ","
+        << summary.p99 << "\n";
+  }
+}
+
+} // namespace split_rendering
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace split_rendering {
+
+// Per-frame metrics (stage timings, byte counts, ...) with bounded memory.
+//
+// Metrics are registered once by name and afterwards recorded by their id, so a frame doesn't
+// allocate or touch any strings. Every frame is one row of a preallocated ring buffer that stores
+// one column per metric, a background thread streams the rows to a CSV or binary file. If the
+// writer falls behind by a whole ring, rows are dropped (and counted) instead of stalling the
+// frame. Count, mean, min, max and the p50/p95/p99 of every metric are tracked online with the
+// P2 estimator (Jain and Chlamtac 1985) and cover all frames, including dropped rows.
+//
+// beginFrame/record/endFrame are expected to be called from a single (render) thread.
+class MetricsRegistry {
+ public:
+  using MetricId = uint32_t;
+
+  enum class MetricType : uint8_t { kFloat = 0, kInt = 1 };
+
+  // kBinary: the magic "SAOM", version, the number of metrics and their (type, name length, name)
+  // in registration order, followed by one row per frame holding every metric in registration
+  // order as float (4 bytes) or int64 (8 bytes). Missing values are NaN and INT64_MIN.
+  enum class OutputFormat { kCSV, kBinary };
+
+  struct Summary {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+  };
+
+  static constexpr uint32_t kBinaryMagic = 0x4d4f4153; // "SAOM"
+  static constexpr uint32_t kBinaryVersion = 1;
+
+  explicit MetricsRegistry(size_t ringCapacity = 1024);
+  ~MetricsRegistry();
+
+  // Returns the id of an already registered metric with the same name. Metrics can only be
+  // registered before start().
+  MetricId registerMetric(const std::string& name, MetricType type);
+
+  // Starts the background writer. Without it, only the summaries are kept.
+  bool start(const std::string& filename, OutputFormat format = OutputFormat::kCSV);
+  // Commits the open frame and writes all pending rows
+  void stop();
+
+  // Opens a new row, an open row of the previous frame is committed first. Metrics that are not
+  // recorded in a frame are left empty.
+  void beginFrame();
+  void endFrame();
+
+  void recordFloat(MetricId id, float value);
+  void recordInt(MetricId id, int64_t value);
+
+  Summary getSummary(MetricId id) const;
+  const std::string& getName(MetricId id) const {
+    return metrics_[id].name;
+  }
+  size_t getNumMetrics() const {
+    return metrics_.size();
+  }
+  uint64_t getNumFrames() const {
+    return numFrames_;
+  }
+  uint64_t getNumDroppedRows() const {
+    return numDroppedRows_;
+  }
+
+  // One line per metric with the count, mean, min, max and percentiles
+  void printSummary(std::ostream& out) const;
+  void writeSummaryCSV(const std::string& filename) const;
+
+ private:
+  // Streaming quantile estimate with five markers, see the P2 paper
+  class P2Quantile {
+   public:
+    explicit P2Quantile(double p = 0.5);
+    void add(double x);
+    double get() const;
+
+   private:
+    double p_;
+    uint64_t count_ = 0;
+    double heights_[5] = {};
+    double positions_[5] = {};
+    double desiredPositions_[5] = {};
+    double increments_[5] = {};
+  };
+
+  struct Metric {
+    std::string name;
+    MetricType type = MetricType::kFloat;
+    // Index into floatColumns_ or intColumns_
+    uint32_t column = 0;
+
+    uint64_t count = 0;
+    double sum = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    P2Quantile p50{0.50};
+    P2Quantile p95{0.95};
+    P2Quantile p99{0.99};
+  };
+
+  void addSample(Metric& metric, double value);
+  void writerLoop();
+  void writeRows(uint64_t begin, uint64_t end);
+
+  size_t ringCapacity_;
+  std::vector<Metric> metrics_;
+  std::unordered_map<std::string, MetricId> metricIds_;
+
+  // Column major, ringCapacity_ entries per column
+  std::vector<float> floatColumns_;
+  std::vector<int64_t> intColumns_;
+  uint32_t numFloatColumns_ = 0;
+  uint32_t numIntColumns_ = 0;
+
+  // Rows [numRowsWritten_, numRowsCommitted_) are ready to be written. The row at
+  // numRowsCommitted_ is filled by the render thread while a frame is open.
+  std::atomic<uint64_t> numRowsCommitted_{0};
+  std::atomic<uint64_t> numRowsWritten_{0};
+  bool rowOpen_ = false;
+  uint64_t numFrames_ = 0;
+  uint64_t numDroppedRows_ = 0;
+
+  OutputFormat format_ = OutputFormat::kCSV;
+  std::ofstream file_;
+  std::thread writerThread_;
+  std::mutex writerMutex_;
+  std::condition_variable writerCondition_;
+  bool writerRunning_ = false;
+  bool stopWriter_ = false;
+};
+
+} // namespace split_rendering
@@ -8,6 +8,7 @@
 
 #include "PointCellAllocationStage.h"
 #include "PointData.slang"
+#include "Tracing.h"
 using namespace Falcor;
 
 namespace split_rendering {
@@ -31,6 +32,7 @@ void PointCellAllocationStage::execute(
     PointServerHashGenerator& serverHashGen,
     MeshPointGenerator& pointGen) {
   FALCOR_PROFILE("PointAllocationStage");
+  TRACE_SCOPE("PointAllocationStage");
   auto vars = computePass_->getVars();
 
   //vars["serverAOPoints"] = serverHashGen.getGPUPointCells();
@@ -47,6 +49,7 @@ void PointCellAllocationStage::execute(
   vars["instanceToDiskRadius"] = pointGen.getGPUDiskRadiusPerInstance();
   vars["serverInstanceHashInfo"] = serverHashGen.getGPUInstanceHashInfo();
   vars["pointUpdateData"] = serverHashGen.getGPUPointUpdateData();
+  vars["pointUpdateColdData"] = serverHashGen.getGPUPointUpdateColdData();
   vars["serverHashToPointCell"] = serverHashGen.getGPUHashToPointCell();
   vars["hashNumBuckets"] = serverHashGen.getGPUHashNumBuckets();
 
@@ -7,7 +7,9 @@
  */
 
 #include "PointCellCreateNetworkBufferStage.h"
+#include "ClientPointCodec.h"
 #include "PointData.slang"
+#include "Tracing.h"
 using namespace Falcor;
 
 namespace split_rendering {
@@ -26,21 +28,25 @@ void PointCellCreateNetworkBufferStage::init(PointServerHashGenerator& serverHas
       Falcor::Buffer::CpuAccess::None,
       &args_init);
 
+  resize(serverHashGen);
+}
+
+void PointCellCreateNetworkBufferStage::resize(PointServerHashGenerator& serverHashGen) {
   dirtyCellInfoBuffer_ = Falcor::Buffer::createStructured(
       sizeof(uint32_t),
-      serverHashGen.getCPUPointCells().size() / FIXED_POINTS_PER_CELL,
+      serverHashGen.getNumCells(),
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None);
 
   cellUpdateBuffer_ = Falcor::Buffer::createStructured(
       sizeof(Falcor::CellUpdateInfo),
-      serverHashGen.getCPUPointCells().size() / FIXED_POINTS_PER_CELL,
+      serverHashGen.getNumCells(),
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None);
 
   cellUpdateDeltaBuffer_ = Falcor::Buffer::createStructured(
       sizeof(Falcor::CellUpdateInfo),
-      serverHashGen.getCPUPointCells().size() / FIXED_POINTS_PER_CELL,
+      serverHashGen.getNumCells(),
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None);
 }
@@ -48,8 +54,10 @@ void PointCellCreateNetworkBufferStage::init(PointServerHashGenerator& serverHas
 void PointCellCreateNetworkBufferStage::execute(
     RenderContext* renderContext,
     PointServerHashGenerator& serverHashGen,
-    MeshPointGenerator& pointGen) {
+    MeshPointGenerator& pointGen,
+    PointHashCreateNetworkBufferStage& hashStage) {
   FALCOR_PROFILE("PointCellCreateNetworkBufferStage");
+  TRACE_SCOPE("PointCellCreateNetworkBufferStage");
 
   auto vars = cellUpdateComputePass_->getVars();
 
@@ -71,7 +79,11 @@ void PointCellCreateNetworkBufferStage::execute(
   vars["serverHashToPointCell"] = serverHashGen.getGPUHashToPointCell();
   vars["hashNumBuckets"] = serverHashGen.getGPUHashNumBuckets();
   vars["cellDirtyFlags"] = serverHashGen.getGPUCellDirtyFlags();
+  vars["cellInfos"] = serverHashGen.getGPUCellInfos();
+  vars["cellFreeList"] = serverHashGen.getGPUCellFreeList();
   vars["cellDirtyInfos"] = dirtyCellInfoBuffer_;
+  vars["hashDirtyInfos"] = hashStage.getDirtyHashInfoBuffer();
+  vars["hashNetworkBufferIndirectDispatchArgs"] = hashStage.getHashIndirectBuffer();
   vars["cellUpdateInfos"] = cellUpdateBuffer_;
   vars["cellUpdateDeltaInfos"] = cellUpdateDeltaBuffer_;
 
@@ -86,18 +98,16 @@ void PointCellCreateNetworkBufferStage::execute(
   renderContext->updateBuffer(cellIndirectArgsBuffer_.get(), &args_init, 0, 4);
 }
 
-std::vector<Falcor::CellUpdateInfo> PointCellCreateNetworkBufferStage::getNetworkCellUpdateInfo(
+std::vector<uint32_t> PointCellCreateNetworkBufferStage::getNetworkCellUpdateInfo(
     Falcor::RenderContext* renderContext) {
   if (numCellUpdates_ == 0) {
     return {};
   }
 
-  Falcor::CellUpdateInfo* cudDelta =
-      (Falcor::CellUpdateInfo*)cellUpdateDeltaBuffer_->map(Falcor::Buffer::MapType::Read);
-
-  std::vector<Falcor::CellUpdateInfo> cellUpdates(numCellUpdates_);
+  const Falcor::CellUpdateInfo* cudDelta =
+      (const Falcor::CellUpdateInfo*)cellUpdateDeltaBuffer_->map(Falcor::Buffer::MapType::Read);
 
-  std::memcpy(cellUpdates.data(), cudDelta, numCellUpdates_ * sizeof(Falcor::CellUpdateInfo));
+  std::vector<uint32_t> cellUpdates = ClientPointCodec::packCellUpdates(cudDelta, numCellUpdates_);
 
   cellUpdateDeltaBuffer_->unmap();
   numCellUpdates_ = 0;
@@ -8,19 +8,26 @@
 
 #pragma once
 #include <Falcor.h>
+#include "PointHashCreateNetworkBufferStage.h"
 #include "PointServerHashGenerator.h"
 
 namespace split_rendering {
 class PointCellCreateNetworkBufferStage {
  public:
   void init(PointServerHashGenerator& serverHashGen);
+  // (Re-)creates the buffers that depend on the size of the server hash table and point cells
+  void resize(PointServerHashGenerator& serverHashGen);
+  // Freed cells append their hash bucket to the dirty buckets of hashStage, so it has to run
+  // afterwards
   void execute(
       Falcor::RenderContext* renderContext,
       PointServerHashGenerator& serverHashGen,
-      MeshPointGenerator& pointGen);
+      MeshPointGenerator& pointGen,
+      PointHashCreateNetworkBufferStage& hashStage);
 
-  std::vector<Falcor::CellUpdateInfo> getNetworkCellUpdateInfo(
-      Falcor::RenderContext* renderContext);
+  // Cell updates of the last execute, packed with a variable number of points per cell: the header
+  // of each update (see Falcor::encodeCellUpdateHeader) is followed by cellCapacity points
+  std::vector<uint32_t> getNetworkCellUpdateInfo(Falcor::RenderContext* renderContext);
 
   Falcor::Buffer::SharedPtr& getCellIndirectBuffer() {
     return cellIndirectArgsBuffer_;
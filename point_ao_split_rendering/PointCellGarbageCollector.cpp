@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PointCellGarbageCollector.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "HashFunctionShared.slang"
+
+namespace split_rendering {
+
+namespace {
+bool isLiveEntry(const Falcor::CompactHashToCellInfo& entry) {
+  return entry.rawCellId != INVALID_CELL && entry.rawCellId != DELETED_CELL &&
+      entry.encodedIndex != INVALID_CELL;
+}
+} // namespace
+
+bool PointCellGarbageCollector::needsCompaction(const Falcor::InstancePointInfo& ipi) {
+  return ipi.numFreeCells >= COMPACTION_MIN_FREE_CELLS &&
+      ipi.numFreeCells >= COMPACTION_FREE_FRACTION * ipi.numAllocatedCells;
+}
+
+PointCellGarbageCollector::Compaction PointCellGarbageCollector::compact(
+    const Falcor::CompactHashToCellInfo* hashEntries,
+    uint32_t hashTableSize,
+    int hashType,
+    uint32_t cellCapacity,
+    [[maybe_unused]] uint32_t numAllocatedCells) {
+  const uint32_t numEntries = hashTableSize * FIXED_HASH_BUCKET_SIZE;
+
+  std::vector<uint32_t> liveCells;
+  for (uint32_t entryId = 0; entryId < numEntries; entryId++) {
+    if (isLiveEntry(hashEntries[entryId])) {
+      liveCells.push_back(
+          (hashEntries[entryId].encodedIndex & COMPACT_HASH_INDEX_MASK) / cellCapacity);
+    }
+  }
+
+  std::sort(liveCells.begin(), liveCells.end());
+
+  // Live cells keep their order, so consecutive live cells form one run
+  Compaction compaction;
+  for (uint32_t newCell = 0; newCell < liveCells.size(); newCell++) {
+    const uint32_t oldCell = liveCells[newCell];
+
+    if (!compaction.runs.empty()) {
+      auto& run = compaction.runs.back();
+      if (run.oldCell + run.numCells == oldCell) {
+        run.numCells++;
+        continue;
+      }
+    }
+
+    compaction.runs.push_back({oldCell, newCell, 1});
+  }
+
+  compaction.numAllocatedCells = (uint32_t)liveCells.size();
+  FALCOR_ASSERT(compaction.numAllocatedCells <= numAllocatedCells);
+
+  std::vector<Falcor::CompactHashToCellInfo> remappedEntries(
+      hashEntries, hashEntries + numEntries);
+  for (auto& entry : remappedEntries) {
+    if (!isLiveEntry(entry))
+      continue;
+
+    const uint32_t oldCell = (entry.encodedIndex & COMPACT_HASH_INDEX_MASK) / cellCapacity;
+    entry.encodedIndex = remapCell(compaction.runs, oldCell) * cellCapacity;
+  }
+
+  // Rehashing into the same size removes the tombstones, every bucket only loses entries so this
+  // can't overflow
+  [[maybe_unused]] bool rehashed =
+      rehash(remappedEntries.data(), numEntries, hashTableSize, hashType, compaction.hashEntries);
+  FALCOR_ASSERT(rehashed);
+
+  return compaction;
+}
+
+bool PointCellGarbageCollector::rehash(
+    const Falcor::CompactHashToCellInfo* entries,
+    uint32_t numEntries,
+    uint32_t newHashTableSize,
+    int hashType,
+    std::vector<Falcor::CompactHashToCellInfo>& newEntries) {
+  newEntries.assign(newHashTableSize * FIXED_HASH_BUCKET_SIZE, {});
+
+  for (uint32_t entryId = 0; entryId < numEntries; entryId++) {
+    const auto& entry = entries[entryId];
+
+    // Entries claimed on the GPU without a point cell (pool was full) are dropped
+    if (entry.rawCellId == INVALID_CELL || entry.encodedIndex == INVALID_CELL)
+      continue;
+
+    const uint32_t hashBase =
+        Falcor::getHashBase(entry.rawCellId, newHashTableSize, hashType) * FIXED_HASH_BUCKET_SIZE;
+
+    uint32_t hashInfoIndex = 0;
+    for (; hashInfoIndex < FIXED_HASH_BUCKET_SIZE; hashInfoIndex++) {
+      auto& newEntry = newEntries[hashBase + hashInfoIndex];
+
+      if (newEntry.rawCellId == INVALID_CELL) {
+        newEntry = entry;
+        break;
+      }
+    }
+
+    if (hashInfoIndex == FIXED_HASH_BUCKET_SIZE)
+      return false;
+  }
+
+  return true;
+}
+
+uint32_t PointCellGarbageCollector::remapCell(
+    const std::vector<Falcor::CellRemapRun>& runs,
+    uint32_t cell) {
+  // First run starting after the cell, the cell is part of the run before it
+  auto run = std::upper_bound(
+      runs.begin(), runs.end(), cell, [](uint32_t cell, const Falcor::CellRemapRun& run) {
+        return cell < run.oldCell;
+      });
+
+  FALCOR_ASSERT(run != runs.begin());
+  --run;
+  FALCOR_ASSERT(cell < run->oldCell + run->numCells);
+
+  return run->newCell + (cell - run->oldCell);
+}
+
+uint32_t BufferRegionFreeList::allocate(uint32_t size) {
+  auto region = std::find_if(regions_.begin(), regions_.end(), [size](const Region& region) {
+    return region.size >= size;
+  });
+
+  if (region == regions_.end())
+    return INVALID_CELL;
+
+  const uint32_t offset = region->offset;
+  region->offset += size;
+  region->size -= size;
+
+  if (region->size == 0)
+    regions_.erase(region);
+
+  return offset;
+}
+
+void BufferRegionFreeList::release(uint32_t offset, uint32_t size) {
+  if (size == 0)
+    return;
+
+  auto next = std::upper_bound(
+      regions_.begin(), regions_.end(), offset, [](uint32_t offset, const Region& region) {
+        return offset < region.offset;
+      });
+
+  FALCOR_ASSERT(next == regions_.end() || offset + size <= next->offset);
+
+  // Merge with the previous and/or the next region
+  if (next != regions_.begin()) {
+    auto previous = next - 1;
+    FALCOR_ASSERT(previous->offset + previous->size <= offset);
+
+    if (previous->offset + previous->size == offset) {
+      previous->size += size;
+
+      if (next != regions_.end() && previous->offset + previous->size == next->offset) {
+        previous->size += next->size;
+        regions_.erase(next);
+      }
+
+      return;
+    }
+  }
+
+  if (next != regions_.end() && offset + size == next->offset) {
+    next->offset = offset;
+    next->size += size;
+    return;
+  }
+
+  regions_.insert(next, {offset, size});
+}
+
+void BufferRegionFreeList::clear() {
+  regions_.clear();
+}
+
+uint32_t BufferRegionFreeList::getNumFreeElements() const {
+  uint32_t numFreeElements = 0;
+  for (const auto& region : regions_)
+    numFreeElements += region.size;
+  return numFreeElements;
+}
+
+bool PointMotionRecording::save(const std::string& filename) const {
+  std::fstream file;
+  file.open(filename, std::ios::out | std::ios::binary);
+
+  if (!file.is_open()) {
+    std::cout << "could not write point motion recording to " << filename << std::endl;
+    return false;
+  }
+
+  const uint32_t numFrames = (uint32_t)frames.size();
+  file.write((const char*)&numPoints, sizeof(uint32_t));
+  file.write((const char*)&numFrames, sizeof(uint32_t));
+
+  for (const auto& frame : frames) {
+    FALCOR_ASSERT(frame.size() == numPoints);
+    file.write((const char*)frame.data(), numPoints * sizeof(uint32_t));
+  }
+
+  file.close();
+  return true;
+}
+
+bool PointMotionRecording::load(const std::string& filename) {
+  std::fstream file;
+  file.open(filename, std::ios::in | std::ios::binary);
+
+  if (!file.is_open()) {
+    std::cout << "could not read point motion recording " << filename << std::endl;
+    return false;
+  }
+
+  uint32_t numFrames = 0;
+  file.read((char*)&numPoints, sizeof(uint32_t));
+  file.read((char*)&numFrames, sizeof(uint32_t));
+
+  frames.assign(numFrames, std::vector<uint32_t>(numPoints, INVALID_CELL));
+  for (auto& frame : frames)
+    file.read((char*)frame.data(), numPoints * sizeof(uint32_t));
+
+  if (!file) {
+    std::cout << "point motion recording " << filename << " is truncated" << std::endl;
+    frames.clear();
+    return false;
+  }
+
+  return true;
+}
+
+void PointCellPoolReference::init(
+    uint32_t numCells,
+    uint32_t hashTableSize,
+    int hashType,
+    uint32_t cellCapacity,
+    bool enableGC) {
+  hashType_ = hashType;
+  cellCapacity_ = cellCapacity;
+  enableGC_ = enableGC;
+  hashTableSize_ = hashTableSize;
+  maxNumCells_ = std::max(numCells, 1U);
+  numAllocatedCells_ = 0;
+  numBucketOverflows_ = 0;
+  numPoolOverflows_ = 0;
+  frame_ = 0;
+
+  hashEntries_.assign(hashTableSize_ * FIXED_HASH_BUCKET_SIZE, {});
+  freeList_.clear();
+  cellNumPoints_.assign(maxNumCells_, 0);
+  cellHashEntries_.assign(maxNumCells_, INVALID_CELL);
+  cellDirty_.assign(maxNumCells_, 0);
+  pointCells_.clear();
+  pointRawCellIds_.clear();
+  pointLost_.clear();
+}
+
+uint32_t PointCellPoolReference::findOrAllocateCell(uint32_t rawCellId, FrameStats& stats) {
+  const uint32_t hashBase =
+      Falcor::getHashBase(rawCellId, hashTableSize_, hashType_) * FIXED_HASH_BUCKET_SIZE;
+
+  // Same as rayGen: claim the first empty entry unless the cell is found before, tombstones are
+  // skipped
+  for (uint32_t hashInfoIndex = 0; hashInfoIndex < FIXED_HASH_BUCKET_SIZE; hashInfoIndex++) {
+    auto& entry = hashEntries_[hashBase + hashInfoIndex];
+
+    if (entry.rawCellId == INVALID_CELL) {
+      entry.rawCellId = rawCellId;
+
+      uint32_t cell = INVALID_CELL;
+      if (!freeList_.empty()) {
+        cell = freeList_.back();
+        freeList_.pop_back();
+        stats.numReusedCells++;
+      } else if (numAllocatedCells_ < maxNumCells_) {
+        cell = numAllocatedCells_++;
+      } else {
+        // Releases the entry again, the cell is retried in a later frame
+        entry.rawCellId = INVALID_CELL;
+        numPoolOverflows_++;
+        return INVALID_CELL;
+      }
+
+      entry.encodedIndex = cell * cellCapacity_;
+      cellHashEntries_[cell] = hashBase + hashInfoIndex;
+      return cell;
+    }
+
+    if (entry.rawCellId == rawCellId) {
+      return entry.encodedIndex == INVALID_CELL ? INVALID_CELL
+                                                : entry.encodedIndex / cellCapacity_;
+    }
+  }
+
+  numBucketOverflows_++;
+  return INVALID_CELL;
+}
+
+void PointCellPoolReference::freeCell(uint32_t cell) {
+  auto& entry = hashEntries_[cellHashEntries_[cell]];
+  entry.rawCellId = DELETED_CELL;
+  entry.encodedIndex = INVALID_CELL;
+
+  cellHashEntries_[cell] = INVALID_CELL;
+  freeList_.push_back(cell);
+}
+
+PointCellPoolReference::FrameStats PointCellPoolReference::step(
+    const std::vector<uint32_t>& rawCellIds) {
+  FrameStats stats;
+  stats.frame = frame_++;
+
+  if (pointCells_.size() < rawCellIds.size()) {
+    pointCells_.resize(rawCellIds.size(), INVALID_CELL);
+    pointRawCellIds_.resize(rawCellIds.size(), INVALID_CELL);
+    pointLost_.resize(rawCellIds.size(), 0);
+  }
+
+  const auto removeFromCell = [&](uint32_t pointId) {
+    const uint32_t oldCell = pointCells_[pointId];
+    if (oldCell != INVALID_CELL) {
+      cellNumPoints_[oldCell]--;
+      cellDirty_[oldCell] = 1;
+    }
+
+    pointCells_[pointId] = INVALID_CELL;
+    pointRawCellIds_[pointId] = INVALID_CELL;
+  };
+
+  for (uint32_t pointId = 0; pointId < rawCellIds.size(); pointId++) {
+    const uint32_t rawCellId = rawCellIds[pointId];
+
+    if (pointLost_[pointId] || rawCellId == pointRawCellIds_[pointId])
+      continue;
+
+    if (rawCellId == INVALID_CELL) {
+      removeFromCell(pointId);
+      continue;
+    }
+
+    const uint32_t cell = findOrAllocateCell(rawCellId, stats);
+
+    if (cell == INVALID_CELL) {
+      // The point stays in its old cell and moves in a later frame
+      stats.numDeferred++;
+      continue;
+    }
+
+    removeFromCell(pointId);
+    cellDirty_[cell] = 1;
+
+    if (cellNumPoints_[cell] >= cellCapacity_) {
+      // The allocation stage does not find a free slot and ignores the point
+      pointLost_[pointId] = 1;
+      stats.numDroppedCellFull++;
+      continue;
+    }
+
+    cellNumPoints_[cell]++;
+    pointCells_[pointId] = cell;
+    pointRawCellIds_[pointId] = rawCellId;
+    stats.numMoves++;
+  }
+
+  // Same as the cell network buffer stage: free dirty cells without points
+  for (uint32_t cell = 0; cell < numAllocatedCells_; cell++) {
+    if (!cellDirty_[cell])
+      continue;
+
+    cellDirty_[cell] = 0;
+
+    if (enableGC_ && cellNumPoints_[cell] == 0 && cellHashEntries_[cell] != INVALID_CELL) {
+      freeCell(cell);
+      stats.numFreedCells++;
+    }
+  }
+
+  maintain(stats);
+
+  stats.numAllocatedCells = numAllocatedCells_;
+  stats.numFreeCells = (uint32_t)freeList_.size();
+  stats.numLiveCells = numAllocatedCells_ - stats.numFreeCells;
+  stats.maxNumCells = maxNumCells_;
+  stats.hashTableSize = hashTableSize_;
+
+  return stats;
+}
+
+void PointCellPoolReference::maintain(FrameStats& stats) {
+  Falcor::InstancePointInfo ipi = {};
+  ipi.numAllocatedCells = numAllocatedCells_;
+  ipi.numFreeCells = (int)freeList_.size();
+
+  if (enableGC_ && PointCellGarbageCollector::needsCompaction(ipi)) {
+    auto compaction = PointCellGarbageCollector::compact(
+        hashEntries_.data(), hashTableSize_, hashType_, cellCapacity_, numAllocatedCells_);
+
+    std::vector<uint32_t> cellNumPoints(maxNumCells_, 0);
+    for (uint32_t pointId = 0; pointId < pointCells_.size(); pointId++) {
+      if (pointCells_[pointId] == INVALID_CELL)
+        continue;
+
+      pointCells_[pointId] =
+          PointCellGarbageCollector::remapCell(compaction.runs, pointCells_[pointId]);
+      cellNumPoints[pointCells_[pointId]]++;
+    }
+
+    cellNumPoints_ = std::move(cellNumPoints);
+    hashEntries_ = std::move(compaction.hashEntries);
+    numAllocatedCells_ = compaction.numAllocatedCells;
+    freeList_.clear();
+    stats.numRemapRuns = (uint32_t)compaction.runs.size();
+  }
+
+  // Same thresholds as PointServerHashGenerator::grow
+  const uint32_t numUsedCells = numAllocatedCells_ - (uint32_t)freeList_.size();
+  const bool growPool =
+      numPoolOverflows_ > 0 || numUsedCells >= POOL_GROW_OCCUPANCY * maxNumCells_;
+  const bool growHash =
+      numUsedCells >= HASH_GROW_LOAD_FACTOR * hashTableSize_ * FIXED_HASH_BUCKET_SIZE;
+  // Full buckets at a low load are mostly caused by tombstones, rebuilding the table is enough
+  const bool rebuildHash = numBucketOverflows_ > 0;
+
+  numPoolOverflows_ = 0;
+  numBucketOverflows_ = 0;
+
+  if (growHash || rebuildHash || growPool) {
+    uint32_t newHashTableSize = growHash ? 2 * hashTableSize_ : hashTableSize_;
+
+    std::vector<Falcor::CompactHashToCellInfo> newEntries;
+    while (!PointCellGarbageCollector::rehash(
+        hashEntries_.data(),
+        (uint32_t)hashEntries_.size(),
+        newHashTableSize,
+        hashType_,
+        newEntries)) {
+      newHashTableSize *= 2;
+    }
+
+    hashEntries_ = std::move(newEntries);
+    hashTableSize_ = newHashTableSize;
+
+    if (growPool) {
+      maxNumCells_ *= 2;
+      cellNumPoints_.resize(maxNumCells_, 0);
+      cellDirty_.resize(maxNumCells_, 0);
+    }
+
+    rebuildCellHashEntries();
+  } else if (stats.numRemapRuns > 0) {
+    rebuildCellHashEntries();
+  }
+}
+
+void PointCellPoolReference::rebuildCellHashEntries() {
+  cellHashEntries_.assign(maxNumCells_, INVALID_CELL);
+  for (uint32_t entryId = 0; entryId < hashEntries_.size(); entryId++) {
+    if (isLiveEntry(hashEntries_[entryId]))
+      cellHashEntries_[hashEntries_[entryId].encodedIndex / cellCapacity_] = entryId;
+  }
+}
+
+std::vector<PointCellPoolReference::FrameStats> PointCellPoolReference::replay(
+    const PointMotionRecording& recording) {
+  std::vector<FrameStats> stats;
+  stats.reserve(recording.frames.size());
+
+  for (const auto& frame : recording.frames)
+    stats.push_back(step(frame));
+
+  return stats;
+}
+
+void PointCellPoolReference::writeCSV(
+    const std::vector<FrameStats>& stats,
+    const std::string& filename) {
+  std::fstream csv;
+  csv.open(filename, std::ios::out);
+
+  if (!csv.is_open()) {
+    std::cout << "could not write cell pool stats to " << filename << std::endl;
+    return;
+  }
+
+  csv << "frame,moves,deferred,dropped_cell_full,freed_cells,reused_cells,live_cells,"
+         "allocated_cells,free_cells,max_cells,hash_table_size,remap_runs\n";
+
+  for (const auto& s : stats) {
+    csv << s.frame << "," << s.numMoves << "," << s.numDeferred << "," << s.numDroppedCellFull
+        << "," << s.numFreedCells << "," << s.numReusedCells << "," << s.numLiveCells << ","
+        << s.numAllocatedCells << "," << s.numFreeCells << "," << s.maxNumCells << ","
+        << s.hashTableSize << "," << s.numRemapRuns << "\n";
+  }
+
+  csv.flush();
+  csv.close();
+}
+
+} // namespace split_rendering
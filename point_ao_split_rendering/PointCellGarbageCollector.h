@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "PointData.slang"
+
+namespace split_rendering {
+
+// Reclamation of point cells. Cells whose last point left are freed on the GPU: their hash entry
+// becomes a DELETED_CELL tombstone and the cell is pushed onto the instance's free list, which
+// rayGen pops before growing the pool. Over time the pool fragments, so the host periodically
+// compacts it: all live cells are moved to the front (in order) and the hash table is rebuilt
+// without tombstones. Clients receive the moves as a short list of CellRemapRun.
+class PointCellGarbageCollector {
+ public:
+  struct Compaction {
+    std::vector<Falcor::CellRemapRun> runs;
+    // Rebuilt hash table of the instance, with remapped indices and without tombstones
+    std::vector<Falcor::CompactHashToCellInfo> hashEntries;
+    uint32_t numAllocatedCells = 0;
+  };
+
+  // Instances with at least COMPACTION_FREE_FRACTION (and COMPACTION_MIN_FREE_CELLS) free cells
+  static bool needsCompaction(const Falcor::InstancePointInfo& ipi);
+
+  // Computes the compaction of one instance from its hash table (hashTableSize buckets). Cells
+  // that are not referenced by the table are free.
+  static Compaction compact(
+      const Falcor::CompactHashToCellInfo* hashEntries,
+      uint32_t hashTableSize,
+      int hashType,
+      uint32_t cellCapacity,
+      uint32_t numAllocatedCells);
+
+  // New index of a live cell, cell indices are relative to the instance
+  static uint32_t remapCell(const std::vector<Falcor::CellRemapRun>& runs, uint32_t cell);
+
+  // Inserts all allocated cells of a hash table into a table with newHashTableSize buckets, using
+  // the same bucket layout as PointServerHashGenerator::generate(). Returns false if a bucket
+  // overflows.
+  static bool rehash(
+      const Falcor::CompactHashToCellInfo* entries,
+      uint32_t numEntries,
+      uint32_t newHashTableSize,
+      int hashType,
+      std::vector<Falcor::CompactHashToCellInfo>& newEntries);
+};
+
+// Released regions of a buffer that only grows at its end, e.g. the hash tables and point cell
+// pools that PointServerHashGenerator::grow moved to a larger region. Allocations are first fit,
+// adjacent released regions are merged.
+class BufferRegionFreeList {
+ public:
+  // Offset of a released region of size elements, which is no longer free afterwards.
+  // INVALID_CELL if no released region is large enough.
+  uint32_t allocate(uint32_t size);
+  void release(uint32_t offset, uint32_t size);
+  void clear();
+
+  uint32_t getNumFreeElements() const;
+
+ private:
+  struct Region {
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  // Sorted by offset, never adjacent
+  std::vector<Region> regions_;
+};
+
+// Cell ids of all points of an instance over a sequence of frames, e.g. recorded from an animated
+// scene. Used to replay the point movement on the CPU.
+struct PointMotionRecording {
+  uint32_t numPoints = 0;
+  // frames[frame][point] is the raw cell id, INVALID_CELL if the point does not exist in the frame
+  std::vector<std::vector<uint32_t>> frames;
+
+  bool save(const std::string& filename) const;
+  bool load(const std::string& filename);
+};
+
+// CPU reference of the cell management of one instance, following the same rules as the GPU
+// pipeline (PointRTAO rayGen, the allocation and network buffer stages) and the host maintenance
+// (PointServerHashGenerator::grow / compact) on the same data layouts. Points are processed
+// sequentially, so indices differ from a GPU run, but the number of allocated, free and live cells
+// must stay bounded for a long running recording - otherwise cells are leaking.
+class PointCellPoolReference {
+ public:
+  struct FrameStats {
+    uint32_t frame = 0;
+    uint32_t numMoves = 0;
+    uint32_t numDeferred = 0; // bucket or pool full, retried next frame
+    uint32_t numDroppedCellFull = 0; // lost points, same as on the GPU
+    uint32_t numFreedCells = 0;
+    uint32_t numReusedCells = 0;
+    uint32_t numLiveCells = 0;
+    uint32_t numAllocatedCells = 0;
+    uint32_t numFreeCells = 0;
+    uint32_t maxNumCells = 0;
+    uint32_t hashTableSize = 0;
+    uint32_t numRemapRuns = 0; // > 0 if the pool was compacted after this frame
+  };
+
+  void init(
+      uint32_t numCells,
+      uint32_t hashTableSize,
+      int hashType,
+      uint32_t cellCapacity,
+      bool enableGC = true);
+
+  // Moves all points to their cell of the next frame, then frees empty cells and runs the host
+  // maintenance (compaction and growth)
+  FrameStats step(const std::vector<uint32_t>& rawCellIds);
+
+  std::vector<FrameStats> replay(const PointMotionRecording& recording);
+
+  static void writeCSV(const std::vector<FrameStats>& stats, const std::string& filename);
+
+ private:
+  // Returns the cell for rawCellId, allocating it if necessary. INVALID_CELL if deferred.
+  uint32_t findOrAllocateCell(uint32_t rawCellId, FrameStats& stats);
+  void freeCell(uint32_t cell);
+  void maintain(FrameStats& stats);
+  void rebuildCellHashEntries();
+
+  int hashType_ = HASH_TYPE_LINEAR;
+  uint32_t cellCapacity_ = 0;
+  bool enableGC_ = true;
+  uint32_t hashTableSize_ = 0;
+  uint32_t maxNumCells_ = 0;
+  uint32_t numAllocatedCells_ = 0;
+  uint32_t numBucketOverflows_ = 0;
+  uint32_t numPoolOverflows_ = 0;
+  uint32_t frame_ = 0;
+
+  std::vector<Falcor::CompactHashToCellInfo> hashEntries_;
+  std::vector<uint32_t> freeList_;
+  // Per cell: number of points, hash entry (INVALID_CELL if free) and dirty flag of this frame
+  std::vector<uint32_t> cellNumPoints_;
+  std::vector<uint32_t> cellHashEntries_;
+  std::vector<uint8_t> cellDirty_;
+  // Per point: current cell and raw cell id, INVALID_CELL if not inserted (yet) or lost
+  std::vector<uint32_t> pointCells_;
+  std::vector<uint32_t> pointRawCellIds_;
+  std::vector<uint8_t> pointLost_;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless replay of a point motion recording through the CPU reference of the point cell
+// management (PointCellPoolReference), to check that freed cells are reused and compacted instead
+// of leaking. Without a recording, a blob of points drifting through the grid is generated, which
+// leaves empty cells behind every frame.
+//
+// Example usage:
+// $ ./PointCellPoolReplay --recording motion.bin --csv cell_pool.csv --max_allocated_factor 2
+// $ ./PointCellPoolReplay --frames 300 --save motion.bin
+//
+// Exit codes: 0 if the pool stays bounded, 1 if cells leak or a recording doesn't round trip, 2
+// for invalid arguments or recordings that can't be read.
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "PointCellGarbageCollector.h"
+#include "argparse.hpp"
+
+using split_rendering::PointCellPoolReference;
+using split_rendering::PointMotionRecording;
+
+namespace {
+
+const int kExitLeak = 1;
+const int kExitInvalid = 2;
+
+// Points uniformly distributed in a sphere of blobRadius cells, which moves by velocity cells per
+// frame along the diagonal of the grid and back
+PointMotionRecording createDriftingBlob(
+    uint32_t numPoints,
+    uint32_t numFrames,
+    float blobRadius,
+    float velocity,
+    int hashType) {
+  const Falcor::uint3 gridDim(256);
+  const float travel = (float)gridDim.x - 2.0f * (blobRadius + 1.0f);
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+  std::vector<Falcor::float3> offsets;
+  offsets.reserve(numPoints);
+  while (offsets.size() < numPoints) {
+    Falcor::float3 offset(uniform(rng), uniform(rng), uniform(rng));
+    if (glm::dot(offset, offset) <= 1.0f)
+      offsets.push_back(offset * blobRadius);
+  }
+
+  PointMotionRecording recording;
+  recording.numPoints = numPoints;
+  recording.frames.resize(numFrames);
+
+  for (uint32_t frame = 0; frame < numFrames; frame++) {
+    const float distance = std::fmod(velocity * frame, 2.0f * travel);
+    const Falcor::float3 center(
+        blobRadius + 1.0f + (distance < travel ? distance : 2.0f * travel - distance));
+    auto& rawCellIds = recording.frames[frame];
+    rawCellIds.resize(numPoints);
+
+    for (uint32_t pointId = 0; pointId < numPoints; pointId++) {
+      const Falcor::float3 position = center + offsets[pointId];
+      const Falcor::int3 coords(
+          (int)std::floor(position.x), (int)std::floor(position.y), (int)std::floor(position.z));
+      rawCellIds[pointId] = Falcor::getRawCellId(coords, gridDim, hashType);
+    }
+  }
+
+  return recording;
+}
+
+// Number of distinct cells with points in a frame
+uint32_t getNumOccupiedCells(std::vector<uint32_t> rawCellIds) {
+  rawCellIds.erase(
+      std::remove(rawCellIds.begin(), rawCellIds.end(), INVALID_CELL), rawCellIds.end());
+  std::sort(rawCellIds.begin(), rawCellIds.end());
+  return (uint32_t)(std::unique(rawCellIds.begin(), rawCellIds.end()) - rawCellIds.begin());
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("PointCellPoolReplay");
+
+  args.add_argument("--recording")
+      .help("point motion recording to replay, a drifting blob of points is generated if not set")
+      .default_value(std::string(""));
+  args.add_argument("--save")
+      .help("writes the replayed recording to this file and checks that it reads back the same")
+      .default_value(std::string(""));
+  args.add_argument("--csv").help("writes the per-frame pool stats").default_value(std::string(""));
+  args.add_argument("--num_points")
+      .help("points of the generated recording")
+      .default_value(8000)
+      .scan<'d', int>();
+  args.add_argument("--frames")
+      .help("frames of the generated recording")
+      .default_value(300)
+      .scan<'d', int>();
+  args.add_argument("--velocity")
+      .help("cells per frame the generated blob of points moves")
+      .default_value(1.0f)
+      .scan<'f', float>();
+  args.add_argument("--hash_type")
+      .help("hash function, 0: linear, 1: morton, 2: xorshift")
+      .default_value(HASH_TYPE_LINEAR)
+      .scan<'d', int>();
+  args.add_argument("--cell_capacity")
+      .help("points per cell")
+      .default_value(MAX_POINTS_PER_CELL)
+      .scan<'d', int>();
+  args.add_argument("--disable_gc")
+      .help("whether or not to keep empty cells allocated, e.g. to see the leak the GC prevents")
+      .default_value(false)
+      .implicit_value(true);
+  args.add_argument("--max_allocated_factor")
+      .help("maximum allocated cells in the last frame, relative to the most occupied cells of a "
+            "frame")
+      .default_value(2.0f)
+      .scan<'f', float>();
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const int hashType = args.get<int>("--hash_type");
+  const int cellCapacity = args.get<int>("--cell_capacity");
+  if (hashType < 0 || hashType >= NUM_HASH_TYPES || cellCapacity < 1) {
+    std::cerr << "invalid --hash_type or --cell_capacity" << std::endl;
+    return kExitInvalid;
+  }
+
+  PointMotionRecording recording;
+  const std::string recordingPath = args.get<std::string>("--recording");
+
+  if (!recordingPath.empty()) {
+    if (!recording.load(recordingPath))
+      return kExitInvalid;
+  } else {
+    recording = createDriftingBlob(
+        (uint32_t)std::max(args.get<int>("--num_points"), 1),
+        (uint32_t)std::max(args.get<int>("--frames"), 1),
+        8.0f,
+        args.get<float>("--velocity"),
+        hashType);
+  }
+
+  if (recording.frames.empty()) {
+    std::cerr << "recording has no frames" << std::endl;
+    return kExitInvalid;
+  }
+
+  bool passed = true;
+
+  const std::string savePath = args.get<std::string>("--save");
+  if (!savePath.empty()) {
+    PointMotionRecording loaded;
+    if (!recording.save(savePath) || !loaded.load(savePath))
+      return kExitInvalid;
+
+    if (loaded.numPoints != recording.numPoints || loaded.frames != recording.frames) {
+      std::cout << "FAIL " << savePath << " doesn't read back the saved recording" << std::endl;
+      passed = false;
+    }
+  }
+
+  // Pool and hash table only fit the cells of the first frame (as in
+  // PointServerHashGenerator::generate), so the replay also has to grow them
+  const uint32_t numCells =
+      (uint32_t)(NUM_CELLS_PREALLOCATION_FACTOR * getNumOccupiedCells(recording.frames[0]));
+  uint32_t hashTableSize = 1;
+  while (hashTableSize * FIXED_HASH_BUCKET_SIZE < numCells << HASH_LOG2_SIZE_FACTOR)
+    hashTableSize *= 2;
+
+  PointCellPoolReference pool;
+  pool.init(
+      numCells, hashTableSize, hashType, (uint32_t)cellCapacity, !args.get<bool>("--disable_gc"));
+  const auto stats = pool.replay(recording);
+
+  if (!args.get<std::string>("--csv").empty())
+    PointCellPoolReference::writeCSV(stats, args.get<std::string>("--csv"));
+
+  uint32_t maxOccupiedCells = 0;
+  uint32_t numCompactions = 0;
+  uint32_t numDropped = 0;
+  for (const auto& s : stats) {
+    maxOccupiedCells = std::max(maxOccupiedCells, getNumOccupiedCells(recording.frames[s.frame]));
+    numCompactions += s.numRemapRuns > 0 ? 1 : 0;
+    numDropped += s.numDroppedCellFull;
+
+    if (s.numLiveCells + s.numFreeCells != s.numAllocatedCells ||
+        s.numAllocatedCells > s.maxNumCells) {
+      std::cout << "FAIL frame " << s.frame << ": inconsistent cell counts" << std::endl;
+      passed = false;
+    }
+  }
+
+  const auto& last = stats.back();
+  const float maxAllocatedFactor = args.get<float>("--max_allocated_factor");
+
+  std::cout << "replayed " << stats.size() << " frames of " << recording.numPoints
+            << " points: allocated cells " << last.numAllocatedCells << ", live "
+            << last.numLiveCells << ", free " << last.numFreeCells << ", max occupied " << maxOccupiedCells
+            << ", pool " << last.maxNumCells << ", hash buckets " << last.hashTableSize
+            << ", compactions " << numCompactions << ", dropped " << numDropped << std::endl;
+
+  if (last.numAllocatedCells > maxAllocatedFactor * maxOccupiedCells) {
+    std::cout << "FAIL " << last.numAllocatedCells << " allocated cells > " << maxAllocatedFactor
+              << " * " << maxOccupiedCells << " occupied cells" << std::endl;
+    passed = false;
+  }
+
+  std::cout << (passed ? "PASSED" : "FAILED") << std::endl;
+  return passed ? 0 : kExitLeak;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PointDataSoA.h"
+#include <algorithm>
+#include <execution>
+#include <numeric>
+
+namespace split_rendering {
+
+namespace {
+// Each stream starts on its own cache line so parallel chunks never share one across streams
+constexpr size_t kStreamAlignment = 64;
+
+size_t alignStreamSize(size_t size) {
+  return (size + kStreamAlignment - 1) & ~(kStreamAlignment - 1);
+}
+} // namespace
+
+void PointDataSoA::allocate(size_t numPoints, uint32_t streams) {
+  const size_t streamSizes[] = {
+      (streams & kPositions) ? alignStreamSize(numPoints * sizeof(Falcor::float3)) : 0,
+      (streams & kNormals) ? alignStreamSize(numPoints * sizeof(Falcor::float3)) : 0,
+      (streams & kTangents) ? alignStreamSize(numPoints * sizeof(Falcor::float3)) : 0,
+      (streams & kBarycentrics) ? alignStreamSize(numPoints * sizeof(Falcor::float2)) : 0,
+      (streams & kInstanceTriangleIds) ? alignStreamSize(numPoints * sizeof(uint32_t)) : 0,
+      (streams & kInstanceIds) ? alignStreamSize(numPoints * sizeof(uint32_t)) : 0,
+      (streams & kValues) ? alignStreamSize(numPoints * sizeof(float)) : 0};
+
+  const size_t totalSize =
+      std::accumulate(std::begin(streamSizes), std::end(streamSizes), size_t(0));
+
+  // One allocation for all streams, over-allocated so we can align the base pointer
+  storage_.reset(new uint8_t[totalSize + kStreamAlignment]);
+  numPoints_ = numPoints;
+
+  uint8_t* base = (uint8_t*)alignStreamSize((size_t)storage_.get());
+  auto nextStream = [&](size_t size) {
+    uint8_t* stream = size > 0 ? base : nullptr;
+    base += size;
+    return stream;
+  };
+
+  streams_.positions = (Falcor::float3*)nextStream(streamSizes[0]);
+  streams_.normals = (Falcor::float3*)nextStream(streamSizes[1]);
+  streams_.tangents = (Falcor::float3*)nextStream(streamSizes[2]);
+  streams_.barycentrics = (Falcor::float2*)nextStream(streamSizes[3]);
+  streams_.instanceTriangleIds = (uint32_t*)nextStream(streamSizes[4]);
+  streams_.instanceIds = (uint32_t*)nextStream(streamSizes[5]);
+  streams_.values = (float*)nextStream(streamSizes[6]);
+}
+
+void PointDataSoA::setExternal(size_t numPoints, const PointDataStreams& streams) {
+  storage_.reset();
+  numPoints_ = numPoints;
+  streams_ = streams;
+}
+
+void PointDataSoA::release() {
+  storage_.reset();
+  streams_ = {};
+  numPoints_ = 0;
+}
+
+template <typename IndexFunc>
+void PointDataSoA::splitImpl(
+    const Falcor::PointData* points,
+    size_t numPoints,
+    IndexFunc&& sourceIndex) {
+  FALCOR_ASSERT(numPoints <= numPoints_);
+
+  std::vector<size_t> chunkStarts((numPoints + kChunkSize - 1) / kChunkSize);
+  for (size_t chunk = 0; chunk < chunkStarts.size(); chunk++)
+    chunkStarts[chunk] = chunk * kChunkSize;
+
+  const PointDataStreams s = streams_;
+
+  std::for_each(
+      std::execution::par, chunkStarts.begin(), chunkStarts.end(), [&](size_t chunkStart) {
+        const size_t chunkEnd = std::min(chunkStart + kChunkSize, numPoints);
+
+        for (size_t i = chunkStart; i < chunkEnd; i++) {
+          const Falcor::PointData& point = points[sourceIndex(i)];
+
+          if (s.positions)
+            s.positions[i] = point.position;
+          if (s.normals)
+            s.normals[i] = point.normal;
+          if (s.tangents)
+            s.tangents[i] = point.tangent;
+          if (s.barycentrics)
+            s.barycentrics[i] = point.barycentrics;
+          if (s.instanceTriangleIds)
+            s.instanceTriangleIds[i] = point.instanceTriangleId;
+          if (s.instanceIds)
+            s.instanceIds[i] = point.instanceId;
+          if (s.values)
+            s.values[i] = point.value;
+        }
+      });
+}
+
+void PointDataSoA::split(const Falcor::PointData* points, size_t numPoints) {
+  splitImpl(points, numPoints, [](size_t i) { return i; });
+}
+
+void PointDataSoA::fill(const Falcor::PointData& point) {
+  splitImpl(&point, numPoints_, [](size_t) { return (size_t)0; });
+}
+
+} // namespace split_rendering
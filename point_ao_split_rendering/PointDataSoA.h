@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <memory>
+#include "PointData.slang"
+
+namespace split_rendering {
+
+// Destination pointers for the structure-of-arrays representation of Falcor::PointData.
+// A nullptr stream is skipped when splitting.
+struct PointDataStreams {
+  Falcor::float3* positions = nullptr;
+  Falcor::float3* normals = nullptr;
+  Falcor::float3* tangents = nullptr;
+  Falcor::float2* barycentrics = nullptr;
+  uint32_t* instanceTriangleIds = nullptr;
+  uint32_t* instanceIds = nullptr;
+  float* values = nullptr;
+};
+
+// Falcor::PointData as one stream per member, which is what the shaders bind (to circumvent the
+// 4GB buffer limit). Points are either written one at a time with set() or split from AoS
+// PointData in a single parallel pass.
+//
+// The streams are either owned by this class, in which case all requested streams share one
+// contiguous allocation, or provided by the caller (e.g. mapped upload memory).
+class PointDataSoA {
+ public:
+  enum Stream : uint32_t {
+    kPositions = 1 << 0,
+    kNormals = 1 << 1,
+    kTangents = 1 << 2,
+    kBarycentrics = 1 << 3,
+    kInstanceTriangleIds = 1 << 4,
+    kInstanceIds = 1 << 5,
+    kValues = 1 << 6,
+    kAllStreams = 0x7F,
+  };
+
+  // Allocates memory for numPoints points and the selected streams, the contents are undefined
+  void allocate(size_t numPoints, uint32_t streams = kAllStreams);
+
+  // Uses caller-owned memory, each non-null stream must hold at least numPoints elements
+  void setExternal(size_t numPoints, const PointDataStreams& streams);
+
+  // Writes points[i] into element i of every stream
+  void split(const Falcor::PointData* points, size_t numPoints);
+
+  // Writes point into every element of every stream
+  void fill(const Falcor::PointData& point);
+
+  // Writes point into element i of every stream
+  void set(size_t i, const Falcor::PointData& point) {
+    if (streams_.positions)
+      streams_.positions[i] = point.position;
+    if (streams_.normals)
+      streams_.normals[i] = point.normal;
+    if (streams_.tangents)
+      streams_.tangents[i] = point.tangent;
+    if (streams_.barycentrics)
+      streams_.barycentrics[i] = point.barycentrics;
+    if (streams_.instanceTriangleIds)
+      streams_.instanceTriangleIds[i] = point.instanceTriangleId;
+    if (streams_.instanceIds)
+      streams_.instanceIds[i] = point.instanceId;
+    if (streams_.values)
+      streams_.values[i] = point.value;
+  }
+
+  // Element i of every stream, members without a stream keep their default
+  Falcor::PointData get(size_t i) const {
+    Falcor::PointData point;
+    if (streams_.positions)
+      point.position = streams_.positions[i];
+    if (streams_.normals)
+      point.normal = streams_.normals[i];
+    if (streams_.tangents)
+      point.tangent = streams_.tangents[i];
+    if (streams_.barycentrics)
+      point.barycentrics = streams_.barycentrics[i];
+    if (streams_.instanceTriangleIds)
+      point.instanceTriangleId = streams_.instanceTriangleIds[i];
+    if (streams_.instanceIds)
+      point.instanceId = streams_.instanceIds[i];
+    if (streams_.values)
+      point.value = streams_.values[i];
+    return point;
+  }
+
+  // Frees owned memory
+  void release();
+
+  const PointDataStreams& getStreams() const {
+    return streams_;
+  }
+
+  size_t getNumPoints() const {
+    return numPoints_;
+  }
+
+ private:
+  template <typename IndexFunc>
+  void splitImpl(const Falcor::PointData* points, size_t numPoints, IndexFunc&& sourceIndex);
+
+  // Number of points handled by one parallel task
+  static constexpr size_t kChunkSize = 1 << 16;
+
+  PointDataStreams streams_;
+  std::unique_ptr<uint8_t[]> storage_;
+  size_t numPoints_ = 0;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PointEncodingBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include "CPUKNNQueryEngine.h"
+
+namespace split_rendering {
+
+namespace {
+
+// Valid point of a slot and the grid cell its position is encoded in
+struct GridPoint {
+  uint32_t slot;
+  uint32_t instanceId;
+  Falcor::uint3 gridIndex;
+};
+
+// Grid points of each cell of an instance
+using CellMap = std::unordered_map<uint64_t, std::vector<uint32_t>>;
+
+uint64_t getCellKey(const Falcor::uint3& gridIndex) {
+  return (uint64_t)gridIndex.x | ((uint64_t)gridIndex.y << 21) | ((uint64_t)gridIndex.z << 42);
+}
+
+// Per grid point, either decoded or the uncompressed reference
+struct DecodedPoints {
+  std::vector<Falcor::float3> positions;
+  std::vector<Falcor::float3> normals;
+  std::vector<float> values;
+
+  void resize(size_t numPoints) {
+    positions.resize(numPoints);
+    normals.resize(numPoints);
+    values.resize(numPoints);
+  }
+};
+
+double getAngleDegrees(const Falcor::float3& a, const Falcor::float3& b) {
+  const double cosAngle = std::clamp((double)glm::dot(a, b), -1.0, 1.0);
+  return std::acos(cosAngle) * 180.0 / 3.14159265358979323846;
+}
+
+// AO of every grid point from the points of the 2x2x2 cells around it, weighted like
+// CPUAOReconstruction::reconstructQuery. The shading points are the uncompressed points.
+std::vector<float> reconstructAO(
+    const std::vector<GridPoint>& gridPoints,
+    const std::vector<CellMap>& cellsPerInstance,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+    const std::vector<float>& diskRadiusPerInstance,
+    const DecodedPoints& reference,
+    const DecodedPoints& points,
+    const CPUAOReconstruction::Settings& settings) {
+  std::vector<float> ao(gridPoints.size());
+
+  auto reconstructPoint = [&](uint32_t pointId) {
+    const uint32_t instanceId = gridPoints[pointId].instanceId;
+    const auto& ipi = instancePointInfos[instanceId];
+    const auto& cells = cellsPerInstance[instanceId];
+
+    const CPUKNNQueryEngine::ShadingPoint sp = CPUKNNQueryEngine::makeShadingPoint(
+        reference.positions[pointId],
+        reference.normals[pointId],
+        reference.normals[pointId],
+        instanceId,
+        diskRadiusPerInstance[instanceId],
+        settings.interpolationRadiusFactor);
+
+    const Falcor::float3 floatCoords = (sp.posW - ipi.aabbMin) / sp.diskRadius;
+    const Falcor::int3 intBaseCoords = Falcor::int3(floatCoords - 0.5f);
+
+    CPUKNNQueryEngine::SamplingWeight samplingWeight;
+    uint32_t numHitCells = 0;
+
+    for (int x = 0; x <= 1; x++) {
+      for (int y = 0; y <= 1; y++) {
+        for (int z = 0; z <= 1; z++) {
+          const Falcor::int3 coords = intBaseCoords + Falcor::int3(x, y, z);
+
+          if (coords.x < 0 || coords.y < 0 || coords.z < 0)
+            continue;
+
+          const auto cell = cells.find(getCellKey(Falcor::uint3(coords)));
+
+          if (cell == cells.end())
+            continue;
+
+          numHitCells++;
+
+          for (uint32_t neighborId : cell->second) {
+            samplingWeight.add(
+                sp,
+                points.positions[neighborId],
+                points.normals[neighborId],
+                points.values[neighborId],
+                settings.cosDeltaThreshold,
+                settings.cosNormalThreshold);
+          }
+        }
+      }
+    }
+
+    ao[pointId] = numHitCells > 0 ? samplingWeight.getAO() : 1.0f;
+  };
+
+  std::vector<uint32_t> pointIds(gridPoints.size());
+  std::iota(pointIds.begin(), pointIds.end(), 0);
+
+  if (settings.parallel)
+    std::for_each(std::execution::par, pointIds.begin(), pointIds.end(), reconstructPoint);
+  else
+    std::for_each(pointIds.begin(), pointIds.end(), reconstructPoint);
+
+  return ao;
+}
+
+} // namespace
+
+void PointEncodingBenchmark::run(
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+    const std::vector<float>& diskRadiusPerInstance,
+    const std::vector<Falcor::PointData>& pointSlots,
+    int numRepeats) {
+  reports_.clear();
+
+  // Valid points and the cells they fall into, as on the server
+  std::vector<GridPoint> gridPoints;
+  std::vector<CellMap> cellsPerInstance(instancePointInfos.size());
+  DecodedPoints reference;
+
+  for (uint32_t slot = 0; slot < (uint32_t)pointSlots.size(); slot++) {
+    const auto& point = pointSlots[slot];
+
+    if (point.value < 0.0f || point.instanceId >= instancePointInfos.size())
+      continue;
+
+    const auto& ipi = instancePointInfos[point.instanceId];
+    const float gridCellSize = DISK_RADIUS_FACTOR * diskRadiusPerInstance[point.instanceId];
+    const Falcor::int3 coords = Falcor::int3((point.position - ipi.aabbMin) / gridCellSize);
+
+    if (coords.x < 0 || coords.y < 0 || coords.z < 0)
+      continue;
+
+    const Falcor::uint3 gridIndex(coords);
+    cellsPerInstance[point.instanceId][getCellKey(gridIndex)].push_back(
+        (uint32_t)gridPoints.size());
+    gridPoints.push_back({slot, point.instanceId, gridIndex});
+
+    reference.positions.push_back(point.position);
+    reference.normals.push_back(point.normal);
+    reference.values.push_back(point.value);
+  }
+
+  const size_t numPoints = gridPoints.size();
+
+  if (numPoints == 0) {
+    std::cout << "no valid points for the point encoding benchmark" << std::endl;
+    return;
+  }
+
+  const std::vector<float> referenceAO = reconstructAO(
+      gridPoints,
+      cellsPerInstance,
+      instancePointInfos,
+      diskRadiusPerInstance,
+      reference,
+      reference,
+      settings_);
+
+  for (int encoding = 0; encoding < NUM_POINT_ENCODINGS; encoding++) {
+    const Falcor::PointEncodingLayout layout = Falcor::getPointEncodingLayout(encoding);
+
+    EncodingReport report;
+    report.encoding = encoding;
+    report.numWords = layout.numWords;
+    report.payloadBits = 1 + 3 * layout.posBits + layout.normalBits + layout.valBits;
+    report.numPoints = (uint32_t)numPoints;
+
+    for (uint32_t instanceId = 0; instanceId < (uint32_t)cellsPerInstance.size(); instanceId++) {
+      const uint32_t numCells = (uint32_t)cellsPerInstance[instanceId].size();
+      report.numCells += numCells;
+      report.cellUpdateBytes += (uint64_t)numCells * sizeof(uint32_t) *
+          (1 + instancePointInfos[instanceId].cellCapacity * layout.numWords);
+    }
+
+    // Encoding and decoding, timed without the error computation
+    std::vector<Falcor::uint2> encoded(numPoints);
+    DecodedPoints decoded;
+    decoded.resize(numPoints);
+
+    double bestEncodeSeconds = std::numeric_limits<double>::max();
+    double bestDecodeSeconds = std::numeric_limits<double>::max();
+
+    for (int repeat = 0; repeat < std::max(numRepeats, 1); repeat++) {
+      auto start = std::chrono::high_resolution_clock::now();
+
+      for (size_t i = 0; i < numPoints; i++) {
+        const uint32_t instanceId = gridPoints[i].instanceId;
+        encoded[i] = Falcor::encodePoint(
+            layout,
+            reference.positions[i],
+            reference.normals[i],
+            reference.values[i],
+            DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId],
+            instancePointInfos[instanceId].aabbMin);
+      }
+
+      auto middle = std::chrono::high_resolution_clock::now();
+
+      for (size_t i = 0; i < numPoints; i++) {
+        const uint32_t instanceId = gridPoints[i].instanceId;
+        const Falcor::ClientPointData cpd = Falcor::decodePoint(
+            layout,
+            encoded[i],
+            gridPoints[i].gridIndex,
+            DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId],
+            instancePointInfos[instanceId].aabbMin);
+        decoded.positions[i] = cpd.position;
+        decoded.normals[i] = cpd.normal;
+        decoded.values[i] = cpd.value;
+      }
+
+      auto end = std::chrono::high_resolution_clock::now();
+      bestEncodeSeconds =
+          std::min(bestEncodeSeconds, std::chrono::duration<double>(middle - start).count());
+      bestDecodeSeconds =
+          std::min(bestDecodeSeconds, std::chrono::duration<double>(end - middle).count());
+    }
+
+    report.nsPerPointEncode = bestEncodeSeconds * 1e9 / numPoints;
+    report.nsPerPointDecode = bestDecodeSeconds * 1e9 / numPoints;
+
+    // Quantization errors
+    double positionErrorSum = 0.0;
+    double normalErrorSum = 0.0;
+    double valueErrorSum = 0.0;
+
+    for (size_t i = 0; i < numPoints; i++) {
+      const float gridCellSize =
+          DISK_RADIUS_FACTOR * diskRadiusPerInstance[gridPoints[i].instanceId];
+      const double positionError =
+          glm::length(decoded.positions[i] - reference.positions[i]) / gridCellSize;
+      const double normalError = getAngleDegrees(decoded.normals[i], reference.normals[i]);
+      const double valueError = std::abs(decoded.values[i] - reference.values[i]);
+
+      positionErrorSum += positionError * positionError;
+      report.maxPositionError = std::max(report.maxPositionError, positionError);
+      normalErrorSum += normalError;
+      report.maxNormalError = std::max(report.maxNormalError, normalError);
+      valueErrorSum += valueError;
+      report.maxValueError = std::max(report.maxValueError, valueError);
+    }
+
+    report.positionRMSE = std::sqrt(positionErrorSum / numPoints);
+    report.meanNormalError = normalErrorSum / numPoints;
+    report.meanValueError = valueErrorSum / numPoints;
+
+    // Error of the reconstructed AO
+    const std::vector<float> ao = reconstructAO(
+        gridPoints,
+        cellsPerInstance,
+        instancePointInfos,
+        diskRadiusPerInstance,
+        reference,
+        decoded,
+        settings_);
+
+    double aoErrorSum = 0.0;
+    double aoSquaredErrorSum = 0.0;
+
+    for (size_t i = 0; i < numPoints; i++) {
+      const double error = std::abs(ao[i] - referenceAO[i]);
+      aoErrorSum += error;
+      aoSquaredErrorSum += error * error;
+      report.aoMaxAbsError = std::max(report.aoMaxAbsError, error);
+    }
+
+    report.aoMeanAbsError = aoErrorSum / numPoints;
+    report.aoRMSE = std::sqrt(aoSquaredErrorSum / numPoints);
+
+    reports_.push_back(report);
+  }
+}
+
+void PointEncodingBenchmark::printSummary(std::ostream& out) const {
+  out << "Point encoding benchmark (encoding: bytes per point, payload bits, cell update bytes, "
+         "position rmse / max in cells, normal mean / max degrees, value mean / max, AO mean / "
+         "rmse / max, encode / decode ns per point)"
+      << std::endl;
+
+  for (const auto& report : reports_) {
+    out << "  " << getEncodingName(report.encoding)
+        << (report.encoding == POINT_ENCODING ? " (selected)" : "") << ": "
+        << report.numWords * sizeof(uint32_t) << ", " << report.payloadBits << ", "
+        << report.cellUpdateBytes << ", " << report.positionRMSE << " / "
+        << report.maxPositionError << ", " << report.meanNormalError << " / "
+        << report.maxNormalError << ", " << report.meanValueError << " / " << report.maxValueError
+        << ", " << report.aoMeanAbsError << " / " << report.aoRMSE << " / "
+        << report.aoMaxAbsError << ", " << report.nsPerPointEncode << " / "
+        << report.nsPerPointDecode << std::endl;
+  }
+}
+
+void PointEncodingBenchmark::writeCSV(const std::string& filename) const {
+  std::fstream csv;
+  csv.open(filename, std::ios::out);
+
+  if (!csv.is_open()) {
+    std::cout << "could not write point encoding benchmark to " << filename << std::endl;
+    return;
+  }
+
+  csv << "encoding,selected,bytes_per_point,payload_bits,num_points,num_cells,cell_update_bytes,"
+         "position_rmse,max_position_error,mean_normal_error,max_normal_error,mean_value_error,"
+         "max_value_error,ao_mean_abs_error,ao_rmse,ao_max_abs_error,ns_per_point_encode,"
+         "ns_per_point_decode\n";
+
+  for (const auto& report : reports_) {
+    csv << getEncodingName(report.encoding) << "," << (report.encoding == POINT_ENCODING) << ","
+        << report.numWords * sizeof(uint32_t) << "," << report.payloadBits << ","
+        << report.numPoints << "," << report.numCells << "," << report.cellUpdateBytes << ","
+        << report.positionRMSE << "," << report.maxPositionError << ","
+        << report.meanNormalError << "," << report.maxNormalError << ","
+        << report.meanValueError << "," << report.maxValueError << "," << report.aoMeanAbsError
+        << "," << report.aoRMSE << "," << report.aoMaxAbsError << ","
+        << report.nsPerPointEncode << "," << report.nsPerPointDecode << "\n";
+  }
+
+  csv.flush();
+  csv.close();
+}
+
+const char* PointEncodingBenchmark::getEncodingName(int encoding) {
+  switch (encoding) {
+    case POINT_ENCODING_COMPACT_32:
+      return "compact32";
+    case POINT_ENCODING_48:
+      return "48";
+    case POINT_ENCODING_64:
+      return "64";
+    default:
+      return "unknown";
+  }
+}
+
+} // namespace split_rendering
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CPUAOReconstruction.h"
+#include "PointData.slang"
+
+namespace split_rendering {
+
+// Compares the point encodings (POINT_ENCODING_*, see PointAOConstantsShared.slangh) on the points
+// of a scene. Every valid point is encoded and decoded with each layout, and the size and the
+// quantization error of positions, normals and values are reported together with the error of the
+// AO that the client reconstructs from the decoded points, relative to the uncompressed points.
+//
+// The reconstruction looks up the 2x2x2 grid cells around every point like
+// samplePointAOHashUpdate, but from the point slots directly, so the results don't depend on the
+// hash table. Only the selected encoding (POINT_ENCODING) is used by the shaders and the network.
+class PointEncodingBenchmark {
+ public:
+  struct EncodingReport {
+    int encoding = POINT_ENCODING_COMPACT_32;
+    uint32_t numWords = 0;
+    uint32_t payloadBits = 0; // including the valid bit
+    uint32_t numPoints = 0;
+    uint32_t numCells = 0;
+    // Cell updates of all cells holding points, including their headers
+    uint64_t cellUpdateBytes = 0;
+    // In units of the grid cell size
+    double positionRMSE = 0.0;
+    double maxPositionError = 0.0;
+    // In degrees
+    double meanNormalError = 0.0;
+    double maxNormalError = 0.0;
+    double meanValueError = 0.0;
+    double maxValueError = 0.0;
+    // AO of every point reconstructed from its neighbors
+    double aoMeanAbsError = 0.0;
+    double aoRMSE = 0.0;
+    double aoMaxAbsError = 0.0;
+    // Fastest of all repeats, single threaded
+    double nsPerPointEncode = 0.0;
+    double nsPerPointDecode = 0.0;
+  };
+
+  // pointSlots are the server points, e.g. read back after the AO has converged. Slots with a
+  // negative value are empty.
+  void run(
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+      const std::vector<float>& diskRadiusPerInstance,
+      const std::vector<Falcor::PointData>& pointSlots,
+      int numRepeats = 3);
+
+  // One line per encoding
+  void printSummary(std::ostream& out) const;
+  void writeCSV(const std::string& filename) const;
+
+  const std::vector<EncodingReport>& getReports() const {
+    return reports_;
+  }
+
+  static const char* getEncodingName(int encoding);
+
+  // interpolationRadiusFactor, cosNormalThreshold and cosDeltaThreshold of the reconstruction
+  CPUAOReconstruction::Settings settings_;
+
+ private:
+  std::vector<EncodingReport> reports_;
+};
+
+} // namespace split_rendering
@@ -8,6 +8,7 @@
 
 #include "PointHashCreateNetworkBufferStage.h"
 #include "PointData.slang"
+#include "Tracing.h"
 using namespace Falcor;
 
 namespace split_rendering {
@@ -27,15 +28,19 @@ void PointHashCreateNetworkBufferStage::init(PointServerHashGenerator& serverHas
       Falcor::Buffer::CpuAccess::None,
       &args_init);
 
+  resize(serverHashGen);
+}
+
+void PointHashCreateNetworkBufferStage::resize(PointServerHashGenerator& serverHashGen) {
   hashUpdateBuffer_ = Falcor::Buffer::createStructured(
       sizeof(Falcor::HashUpdateInfo),
-      serverHashGen.getCPUHashToPointCell().size() / FIXED_HASH_BUCKET_SIZE,
+      serverHashGen.getNumHashEntries() / FIXED_HASH_BUCKET_SIZE,
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None);
 
   dirtyHashInfoBuffer_ = Falcor::Buffer::createStructured(
       sizeof(uint32_t),
-      serverHashGen.getCPUHashToPointCell().size() / FIXED_POINTS_PER_CELL,
+      serverHashGen.getNumHashEntries() / FIXED_HASH_BUCKET_SIZE,
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None);
 }
@@ -45,6 +50,7 @@ void PointHashCreateNetworkBufferStage::execute(
     PointServerHashGenerator& serverHashGen,
     MeshPointGenerator& pointGen) {
   FALCOR_PROFILE("PointHashCreateNetworkBufferStage");
+  TRACE_SCOPE("PointHashCreateNetworkBufferStage");
 
   auto vars = hashUpdateComputePass_->getVars();
 
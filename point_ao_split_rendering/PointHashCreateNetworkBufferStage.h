@@ -14,6 +14,8 @@ namespace split_rendering {
 class PointHashCreateNetworkBufferStage {
  public:
   void init(PointServerHashGenerator& serverHashGen);
+  // (Re-)creates the buffers that depend on the size of the server hash table and point cells
+  void resize(PointServerHashGenerator& serverHashGen);
   void execute(
       Falcor::RenderContext* renderContext,
       PointServerHashGenerator& serverHashGen,
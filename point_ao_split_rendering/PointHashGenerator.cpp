@@ -15,11 +15,14 @@ namespace split_rendering {
 void PointHashGenerator::generate(
     Falcor::Scene::SharedPtr& scene,
     const MeshPointGenerator& pointGen,
-    std::vector<Falcor::PointData>& pointCells,
+    const PointDataSoA& pointCells,
     std::vector<Falcor::InstancePointInfo>& instancePointInfos) {
   const auto& numFinalSamplesPerInstance = pointGen.getNumSamplesPerInstance();
   const auto& diskRadiusPerInstance = pointGen.getDiskRadiusPerInstance();
-  const auto& cpuPointsData = pointCells;
+
+  // The hash build only reads positions and values
+  const Falcor::float3* positions = pointCells.getStreams().positions;
+  const float* values = pointCells.getStreams().values;
 
   // Hash Table Setup
   for (uint32_t instanceId = 0; instanceId < scene->getGeometryInstanceCount(); instanceId++) {
@@ -59,15 +62,13 @@ void PointHashGenerator::generate(
         -std::numeric_limits<float>::max());
 
     for (uint32_t pointId = ipi.pointCellOffset;
-         pointId < ipi.pointCellOffset + ipi.numAllocatedCells * FIXED_POINTS_PER_CELL;
+         pointId < ipi.pointCellOffset + ipi.numAllocatedCells * ipi.cellCapacity;
          pointId++) {
-      const auto& point = cpuPointsData[pointId];
-
-      if (point.value < 0)
+      if (values[pointId] < 0)
         continue;
 
-      instanceAABB.min = glm::min(instanceAABB.min, point.position);
-      instanceAABB.max = glm::max(instanceAABB.max, point.position);
+      instanceAABB.min = glm::min(instanceAABB.min, positions[pointId]);
+      instanceAABB.max = glm::max(instanceAABB.max, positions[pointId]);
     }
 
     float diskRadius = DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId];
@@ -76,12 +77,12 @@ void PointHashGenerator::generate(
     glm::uvec3 gridDim = ipi.gridDim;
 
     for (uint32_t pointId = ipi.pointCellOffset;
-         pointId < ipi.pointCellOffset + ipi.numAllocatedCells * FIXED_POINTS_PER_CELL;
+         pointId < ipi.pointCellOffset + ipi.numAllocatedCells * ipi.cellCapacity;
          pointId++) {
-      if (cpuPointsData[pointId].value < 0)
+      if (values[pointId] < 0)
         continue;
 
-      const auto& point = cpuPointsData[pointId].position;
+      const auto& point = positions[pointId];
 
       // Get grid index for point given grid size == poisson disk radius
 
@@ -192,6 +193,7 @@ void PointHashGenerator::generate(
     ihf.hashBucketToPointCellOffset = hashBucketToPointCell_.size();
     ihf.pointCellOffset = pointCells_.size();
     ihf.gridDim = gridDim;
+    ihf.hashType = HASH_TYPE_LINEAR;
 
     hashToBucket_.resize(hashToBucket_.size() + instanceHashTable.size());
     std::copy(
@@ -10,6 +10,7 @@
 
 #include <Falcor.h>
 #include "PointData.slang"
+#include "PointDataSoA.h"
 #include "MeshPointGenerator.h"
 #include "HashFunctionShared.slang"
 
@@ -20,7 +21,7 @@ class PointHashGenerator {
   void generate(
       Falcor::Scene::SharedPtr& scene,
       const MeshPointGenerator& pointGen,
-      std::vector<Falcor::PointData>& pointCells,
+      const PointDataSoA& pointCells,
       std::vector<Falcor::InstancePointInfo>& instancePointInfos);
 
   Falcor::Buffer::SharedPtr& getGPUHashToBucket() {
@@ -0,0 +1,502 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "PointKDTree.h"
+#include <algorithm>
+#include <cstring>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include "nanoflann.hpp"
+
+namespace split_rendering {
+
+// This is used when building a kd-tree from point cells of fixed sizes
+// These point cells can have invalid/unused points in them which we need to skip
+// The kdTreeIndexMap needs to be mapped to the GPU later as well to get the correct lookup.
+struct SparsePointCloudRange {
+  SparsePointCloudRange(const PointDataSoA& p, uint32_t start, uint32_t sparseSize)
+      : start(start), sparseSize(sparseSize) {
+    const auto& streams = p.getStreams();
+    const auto first = streams.values + start;
+    const auto last = first + sparseSize;
+
+    kdTreeIndexMap.resize(std::count_if(first, last, [](float value) { return value >= 0; }));
+
+    uint32_t numValid = 0;
+    for (uint32_t i = start; i < start + sparseSize; i++) {
+      if (streams.values[i] >= 0)
+        kdTreeIndexMap[numValid++] = i;
+    }
+
+    // Gather the valid positions into a dense stream so the tree build doesn't skip over the empty
+    // slots
+    positions.resize(kdTreeIndexMap.size());
+    for (size_t i = 0; i < kdTreeIndexMap.size(); i++)
+      positions[i] = streams.positions[kdTreeIndexMap[i]];
+  }
+
+  std::vector<uint32_t> kdTreeIndexMap;
+  std::vector<Falcor::float3> positions;
+  uint32_t start;
+  uint32_t sparseSize;
+
+  // Must return the number of data points
+  inline size_t kdTreeGetPointCount() const {
+    return kdTreeIndexMap.size();
+  }
+
+  // Returns the dim'th component of the idx'th point in the class:
+  // Since this is inlined and the "dim" argument is typically an immediate
+  // value, the
+  //  "if/else's" are actually solved at compile time.
+  inline float kdTreeGetPt(const size_t idx, const size_t dim) const {
+    return positions[idx][dim];
+  }
+
+  // Optional bounding-box computation: return false to default to a standard
+  // bbox computation loop.
+  //   Return true if the BBOX was already computed by the class and returned
+  //   in "bb" so it can be avoided to redo it again. Look at bb.size() to
+  //   find out the expected dimensionality (e.g. 2 or 3 for point clouds)
+  template <class BBOX>
+  bool kdTreeGetBbox(BBOX& /* bb */) const {
+    return false;
+  }
+};
+
+namespace {
+
+float getNodeSize(const Falcor::float3& min, const Falcor::float3& max) {
+  const Falcor::float3 extent = max - min;
+  return extent.x + extent.y + extent.z;
+}
+
+uint32_t getDivfeat(const Falcor::KDTreeCompactNode& node) {
+  return node.parentAndDivfeat & KD_TREE_DIVFEAT_MASK;
+}
+
+uint32_t getParent(const Falcor::KDTreeCompactNode& node) {
+  return node.parentAndDivfeat >> KD_TREE_PARENT_SHIFT;
+}
+
+} // namespace
+
+std::vector<Falcor::KDTreeCompactNode> PointKDTree::compactTree(
+    const std::vector<Falcor::KDTreeGPUNode>& nodes) {
+  std::vector<Falcor::KDTreeCompactNode> compactNodes(nodes.size());
+
+  for (size_t nodeId = 0; nodeId < nodes.size(); nodeId++) {
+    const auto& node = nodes[nodeId];
+    auto& compactNode = compactNodes[nodeId];
+
+    const bool isLeaf = node.child1 == -1 && node.child2 == -1;
+    const uint32_t parent = node.parentId < 0 ? KD_TREE_NO_PARENT : (uint32_t)node.parentId;
+
+    compactNode.leftOrDivLow = node.leftOrDivLow;
+    compactNode.rightOrDivHigh = node.rightOrDivHigh;
+    compactNode.firstChild = isLeaf ? 0 : (uint32_t)node.child1;
+    compactNode.parentAndDivfeat =
+        (parent << KD_TREE_PARENT_SHIFT) | (isLeaf ? KD_TREE_LEAF : node.divfeat);
+
+    // The layout relies on siblings being stored next to each other
+    FALCOR_ASSERT(isLeaf || node.child2 == node.child1 + 1);
+  }
+
+  return compactNodes;
+}
+
+float PointKDTree::getCacheLinesPerPath(size_t nodeSize) const {
+  const size_t kCacheLineSize = 64;
+
+  struct PathNode {
+    uint32_t nodeId;
+    size_t lastLine;
+    uint32_t numLines;
+  };
+
+  uint64_t numLines = 0;
+  uint32_t numLeaves = 0;
+
+  for (uint32_t instanceId = 0; instanceId < (uint32_t)instanceNodeOffsets_.size(); instanceId++) {
+    if (getNumInstanceNodes(instanceId) == 0)
+      continue;
+
+    const Falcor::KDTreeCompactNode* nodes = nodes_.data() + instanceNodeOffsets_[instanceId];
+
+    // Children are stored after their parent, so the lines of a path only grow
+    std::vector<PathNode> stack = {{0, std::numeric_limits<size_t>::max(), 0}};
+
+    while (!stack.empty()) {
+      PathNode pathNode = stack.back();
+      stack.pop_back();
+
+      const size_t firstLine = pathNode.nodeId * nodeSize / kCacheLineSize;
+      const size_t lastLine = (pathNode.nodeId * nodeSize + nodeSize - 1) / kCacheLineSize;
+      pathNode.numLines += (uint32_t)(lastLine - firstLine + 1);
+      if (firstLine == pathNode.lastLine)
+        pathNode.numLines--;
+
+      const auto& node = nodes[pathNode.nodeId];
+      if (getDivfeat(node) == KD_TREE_LEAF) {
+        numLines += pathNode.numLines;
+        numLeaves++;
+        continue;
+      }
+
+      stack.push_back({node.firstChild, lastLine, pathNode.numLines});
+      stack.push_back({node.firstChild + 1, lastLine, pathNode.numLines});
+    }
+  }
+
+  return numLeaves > 0 ? (float)numLines / (float)numLeaves : 0.0f;
+}
+
+void PointKDTree::build(
+    const PointDataSoA& pointCells,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos) {
+  const Falcor::float3* positions = pointCells.getStreams().positions;
+  const uint32_t numInstances = (uint32_t)instancePointInfos.size();
+
+  struct InstanceKDTree {
+    std::vector<Falcor::KDTreeCompactNode> nodes;
+    std::vector<uint32_t> indices;
+  };
+
+  std::vector<InstanceKDTree> instanceKdTrees(numInstances);
+
+  std::vector<uint32_t> instanceIds(numInstances);
+  std::iota(instanceIds.begin(), instanceIds.end(), 0);
+
+  // Trees of different instances are independent, so they are built in parallel
+  std::for_each(
+      std::execution::par, instanceIds.begin(), instanceIds.end(), [&](uint32_t instanceId) {
+        const auto& ipi = instancePointInfos[instanceId];
+
+        SparsePointCloudRange pc = SparsePointCloudRange(
+            pointCells, ipi.pointCellOffset, ipi.numAllocatedCells * ipi.cellCapacity);
+
+        // construct a kd-tree index:
+        using my_kd_tree_t = nanoflann::KDTreeSingleIndexAdaptor<
+            nanoflann::L2_Simple_Adaptor<float, SparsePointCloudRange>,
+            SparsePointCloudRange,
+            3>;
+
+        my_kd_tree_t index(3 /*dim*/, pc, {kMaxPointsLeaf /* max leaf */});
+
+        auto& kdTree = instanceKdTrees[instanceId];
+        kdTree.nodes = compactTree(index.getLinearizedTree());
+        kdTree.indices.resize(index.vAcc.size());
+
+        for (size_t i = 0; i < index.vAcc.size(); i++) {
+          kdTree.indices[i] = pc.kdTreeIndexMap[index.vAcc[i]];
+        }
+      });
+
+  // Offsets of all instances, then every instance copies its tree into place
+  instanceNodeOffsets_.resize(numInstances);
+  instanceIndexOffsets_.resize(numInstances);
+  uint32_t numNodes = 0;
+  uint32_t numIndices = 0;
+
+  for (uint32_t instanceId = 0; instanceId < numInstances; instanceId++) {
+    instanceNodeOffsets_[instanceId] = numNodes;
+    instanceIndexOffsets_[instanceId] = numIndices;
+    numNodes += (uint32_t)instanceKdTrees[instanceId].nodes.size();
+    numIndices += (uint32_t)instanceKdTrees[instanceId].indices.size();
+  }
+
+  nodes_.resize(numNodes);
+  indices_.resize(numIndices);
+  nodeBuildSizes_.resize(numNodes);
+
+  std::for_each(
+      std::execution::par, instanceIds.begin(), instanceIds.end(), [&](uint32_t instanceId) {
+        const auto& kdTree = instanceKdTrees[instanceId];
+
+        std::copy(
+            kdTree.nodes.begin(),
+            kdTree.nodes.end(),
+            nodes_.begin() + instanceNodeOffsets_[instanceId]);
+        std::copy(
+            kdTree.indices.begin(),
+            kdTree.indices.end(),
+            indices_.begin() + instanceIndexOffsets_[instanceId]);
+
+        // Sizes of the freshly built nodes are the reference for refit()
+        std::vector<NodeBounds> bounds;
+        refitInstance(instanceId, positions, bounds);
+
+        for (uint32_t nodeId = 0; nodeId < (uint32_t)bounds.size(); nodeId++) {
+          nodeBuildSizes_[instanceNodeOffsets_[instanceId] + nodeId] =
+              getNodeSize(bounds[nodeId].min, bounds[nodeId].max);
+        }
+      });
+}
+
+bool PointKDTree::assign(
+    std::vector<Falcor::KDTreeCompactNode> nodes,
+    std::vector<uint32_t> indices,
+    std::vector<uint32_t> instanceNodeOffsets,
+    std::vector<uint32_t> instanceIndexOffsets,
+    std::vector<float> nodeBuildSizes,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos) {
+  const uint32_t numInstances = (uint32_t)instancePointInfos.size();
+  bool valid = instanceNodeOffsets.size() == numInstances &&
+      instanceIndexOffsets.size() == numInstances && nodeBuildSizes.size() == nodes.size();
+
+  // Offsets have to increase, and every leaf index has to be a slot of its instance
+  for (uint32_t instanceId = 0; instanceId < numInstances && valid; instanceId++) {
+    const bool last = instanceId + 1 == numInstances;
+    const uint32_t nodeEnd = last ? (uint32_t)nodes.size() : instanceNodeOffsets[instanceId + 1];
+    const uint32_t indexEnd =
+        last ? (uint32_t)indices.size() : instanceIndexOffsets[instanceId + 1];
+    valid = instanceNodeOffsets[instanceId] <= nodeEnd && nodeEnd <= nodes.size() &&
+        instanceIndexOffsets[instanceId] <= indexEnd && indexEnd <= indices.size();
+
+    const auto& ipi = instancePointInfos[instanceId];
+    const uint64_t slotEnd =
+        ipi.pointCellOffset + (uint64_t)ipi.numAllocatedCells * ipi.cellCapacity;
+    for (uint32_t i = instanceIndexOffsets[instanceId]; i < indexEnd && valid; i++)
+      valid = indices[i] >= ipi.pointCellOffset && indices[i] < slotEnd;
+  }
+
+  if (!valid) {
+    std::cout << "PointKDTree: the assigned trees don't fit the point slots" << std::endl;
+    return false;
+  }
+
+  nodes_ = std::move(nodes);
+  indices_ = std::move(indices);
+  instanceNodeOffsets_ = std::move(instanceNodeOffsets);
+  instanceIndexOffsets_ = std::move(instanceIndexOffsets);
+  nodeBuildSizes_ = std::move(nodeBuildSizes);
+  return true;
+}
+
+uint32_t PointKDTree::getNumInstanceNodes(uint32_t instanceId) const {
+  const uint32_t end = instanceId + 1 < (uint32_t)instanceNodeOffsets_.size()
+      ? instanceNodeOffsets_[instanceId + 1]
+      : (uint32_t)nodes_.size();
+  return end - instanceNodeOffsets_[instanceId];
+}
+
+uint32_t PointKDTree::getNumInstanceIndices(uint32_t instanceId) const {
+  const uint32_t end = instanceId + 1 < (uint32_t)instanceIndexOffsets_.size()
+      ? instanceIndexOffsets_[instanceId + 1]
+      : (uint32_t)indices_.size();
+  return end - instanceIndexOffsets_[instanceId];
+}
+
+void PointKDTree::refitInstance(
+    uint32_t instanceId,
+    const Falcor::float3* positions,
+    std::vector<NodeBounds>& bounds) {
+  const uint32_t numNodes = getNumInstanceNodes(instanceId);
+  Falcor::KDTreeCompactNode* nodes = nodes_.data() + instanceNodeOffsets_[instanceId];
+  const uint32_t* indices = indices_.data() + instanceIndexOffsets_[instanceId];
+
+  bounds.resize(numNodes);
+
+  // Children are stored after their parent (breadth-first), so going backwards is bottom-up
+  for (uint32_t nodeId = numNodes; nodeId-- > 0;) {
+    auto& node = nodes[nodeId];
+    auto& nodeBounds = bounds[nodeId];
+
+    if (getDivfeat(node) == KD_TREE_LEAF) {
+      std::memcpy(&nodeBounds.begin, &node.leftOrDivLow, sizeof(nodeBounds.begin));
+      std::memcpy(&nodeBounds.end, &node.rightOrDivHigh, sizeof(nodeBounds.end));
+
+      nodeBounds.min = Falcor::float3(std::numeric_limits<float>::max());
+      nodeBounds.max = Falcor::float3(std::numeric_limits<float>::lowest());
+
+      for (uint32_t i = nodeBounds.begin; i < nodeBounds.end; i++) {
+        const Falcor::float3& position = positions[indices[i]];
+        nodeBounds.min = glm::min(nodeBounds.min, position);
+        nodeBounds.max = glm::max(nodeBounds.max, position);
+      }
+    } else {
+      const auto& left = bounds[node.firstChild];
+      const auto& right = bounds[node.firstChild + 1];
+      const uint32_t divfeat = getDivfeat(node);
+
+      nodeBounds.min = glm::min(left.min, right.min);
+      nodeBounds.max = glm::max(left.max, right.max);
+      nodeBounds.begin = left.begin;
+      nodeBounds.end = right.end;
+
+      // Same split values as nanoflann's divideTree, computed from the current positions
+      node.leftOrDivLow = left.max[divfeat];
+      node.rightOrDivHigh = right.min[divfeat];
+    }
+  }
+}
+
+void PointKDTree::rebuildSubtrees(
+    uint32_t instanceId,
+    const Falcor::float3* positions,
+    const std::vector<NodeBounds>& bounds,
+    const std::vector<uint8_t>& rebuildNodes) {
+  const uint32_t numNodes = getNumInstanceNodes(instanceId);
+  Falcor::KDTreeCompactNode* nodes = nodes_.data() + instanceNodeOffsets_[instanceId];
+  uint32_t* indices = indices_.data() + instanceIndexOffsets_[instanceId];
+
+  // Parents are split before their children. The ranges of the nodes don't change.
+  for (uint32_t nodeId = 0; nodeId < numNodes; nodeId++) {
+    auto& node = nodes[nodeId];
+
+    if (!rebuildNodes[nodeId] || getDivfeat(node) == KD_TREE_LEAF)
+      continue;
+
+    const auto& nodeBounds = bounds[nodeId];
+    const uint32_t numLeft = bounds[node.firstChild].end - nodeBounds.begin;
+
+    // Split along the largest extent of the points that are now in the node
+    Falcor::float3 min = Falcor::float3(std::numeric_limits<float>::max());
+    Falcor::float3 max = Falcor::float3(std::numeric_limits<float>::lowest());
+
+    for (uint32_t i = nodeBounds.begin; i < nodeBounds.end; i++) {
+      min = glm::min(min, positions[indices[i]]);
+      max = glm::max(max, positions[indices[i]]);
+    }
+
+    const Falcor::float3 extent = max - min;
+    const uint32_t divfeat = extent.x >= extent.y && extent.x >= extent.z ? 0
+        : extent.y >= extent.z                                           ? 1
+                                                                         : 2;
+
+    std::nth_element(
+        indices + nodeBounds.begin,
+        indices + nodeBounds.begin + numLeft,
+        indices + nodeBounds.end,
+        [&](uint32_t a, uint32_t b) {
+          return positions[a][divfeat] < positions[b][divfeat];
+        });
+
+    node.parentAndDivfeat = (getParent(node) << KD_TREE_PARENT_SHIFT) | divfeat;
+  }
+}
+
+bool PointKDTree::hasSameSlots(
+    const PointDataSoA& pointCells,
+    const Falcor::InstancePointInfo& ipi,
+    uint32_t instanceId) const {
+  const float* values = pointCells.getStreams().values;
+  const uint32_t* indices = indices_.data() + instanceIndexOffsets_[instanceId];
+  const uint32_t numIndices = getNumInstanceIndices(instanceId);
+
+  // The tree's slots have to be valid, and no other slot of the instance
+  const uint32_t end = ipi.pointCellOffset + ipi.numAllocatedCells * ipi.cellCapacity;
+  if (end > pointCells.getNumPoints())
+    return false;
+
+  const uint32_t numValid =
+      (uint32_t)std::count_if(values + ipi.pointCellOffset, values + end, [](float value) {
+        return value >= 0;
+      });
+
+  return numValid == numIndices &&
+      std::all_of(indices, indices + numIndices, [&](uint32_t slot) {
+           return slot >= ipi.pointCellOffset && slot < end && values[slot] >= 0;
+         });
+}
+
+PointKDTree::RefitStats PointKDTree::refit(
+    const PointDataSoA& pointCells,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+    const std::vector<uint32_t>& instanceIds,
+    std::vector<RefitStats>* instanceStats) {
+  RefitStats stats;
+  const Falcor::float3* positions = pointCells.getStreams().positions;
+
+  if (nodes_.empty()) {
+    std::cout << "PointKDTree: refit requires build()" << std::endl;
+    return stats;
+  }
+
+  std::vector<RefitStats> localInstanceStats(instanceIds.size());
+  std::vector<uint32_t> ids(instanceIds.size());
+  std::iota(ids.begin(), ids.end(), 0);
+
+  std::for_each(std::execution::par, ids.begin(), ids.end(), [&](uint32_t i) {
+    const uint32_t instanceId = instanceIds[i];
+    const uint32_t numNodes = getNumInstanceNodes(instanceId);
+    const Falcor::KDTreeCompactNode* nodes =
+        nodes_.data() + instanceNodeOffsets_[instanceId];
+    float* buildSizes = nodeBuildSizes_.data() + instanceNodeOffsets_[instanceId];
+    auto& localStats = localInstanceStats[i];
+
+    if (!hasSameSlots(pointCells, instancePointInfos[instanceId], instanceId)) {
+      localStats.numChangedInstances = 1;
+      return;
+    }
+
+    std::vector<NodeBounds> bounds;
+    refitInstance(instanceId, positions, bounds);
+
+    // Mark degraded nodes and everything below them, parents come first
+    std::vector<uint8_t> rebuildNodes(numNodes, 0);
+
+    for (uint32_t nodeId = 0; nodeId < numNodes; nodeId++) {
+      const auto& node = nodes[nodeId];
+      const uint32_t parent = getParent(node);
+
+      if (parent != KD_TREE_NO_PARENT && rebuildNodes[parent]) {
+        rebuildNodes[nodeId] = 1;
+        localStats.numRebuiltNodes++;
+        continue;
+      }
+
+      const uint32_t divfeat = getDivfeat(node);
+
+      if (divfeat == KD_TREE_LEAF)
+        continue;
+
+      const auto& nodeBounds = bounds[nodeId];
+      const float extent = std::max(nodeBounds.max[divfeat] - nodeBounds.min[divfeat], 1e-6f);
+      const float overlap = std::max(node.leftOrDivLow - node.rightOrDivHigh, 0.0f) / extent;
+      const float sizeGrowth =
+          getNodeSize(nodeBounds.min, nodeBounds.max) / std::max(buildSizes[nodeId], 1e-6f);
+
+      if (overlap > refitSettings_.maxOverlap || sizeGrowth > refitSettings_.maxSizeGrowth) {
+        rebuildNodes[nodeId] = 1;
+        localStats.numRebuiltSubtrees++;
+        localStats.numRebuiltNodes++;
+      }
+    }
+
+    if (localStats.numRebuiltSubtrees > 0) {
+      rebuildSubtrees(instanceId, positions, bounds, rebuildNodes);
+      refitInstance(instanceId, positions, bounds);
+
+      for (uint32_t nodeId = 0; nodeId < numNodes; nodeId++) {
+        if (rebuildNodes[nodeId])
+          buildSizes[nodeId] = getNodeSize(bounds[nodeId].min, bounds[nodeId].max);
+      }
+    }
+
+    localStats.numInstances = 1;
+    localStats.numNodes = numNodes;
+  });
+
+  for (const auto& localStats : localInstanceStats) {
+    stats.numInstances += localStats.numInstances;
+    stats.numNodes += localStats.numNodes;
+    stats.numRebuiltSubtrees += localStats.numRebuiltSubtrees;
+    stats.numRebuiltNodes += localStats.numRebuiltNodes;
+    stats.numChangedInstances += localStats.numChangedInstances;
+  }
+
+  if (instanceStats != nullptr)
+    *instanceStats = localInstanceStats;
+
+  return stats;
+}
+
+} // namespace split_rendering
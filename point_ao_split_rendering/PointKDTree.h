@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <vector>
+#include "PointData.slang"
+#include "PointDataSoA.h"
+
+namespace split_rendering {
+
+// CPU kd-trees of the points of all instances, in the breadth-first KDTreeCompactNode layout of
+// KDTree.slang. PointKDTreeGenerator uploads them to the GPU, CPUKNNQueryEngine traverses them. The
+// trees don't depend on the scene or the device, so they can be built and refit headless.
+class PointKDTree {
+ public:
+  // Thresholds for rebuilding a subtree during refit(), checked for every inner node
+  struct RefitSettings {
+    // Overlap of the two children along the split axis, relative to the extent of the node
+    float maxOverlap = 0.25f;
+    // Growth of the size of a node (sum of its extents, flat instances have no volume) since it
+    // was last built
+    float maxSizeGrowth = 1.5f;
+  };
+
+  struct RefitStats {
+    uint32_t numInstances = 0;
+    uint32_t numNodes = 0;
+    uint32_t numRebuiltSubtrees = 0;
+    uint32_t numRebuiltNodes = 0;
+    // Instances whose valid point slots changed since build(), e.g. because points moved into
+    // other cells. They are skipped and need a new build().
+    uint32_t numChangedInstances = 0;
+  };
+
+  // Builds one tree per instance from its valid point slots (see InstancePointInfo), the trees of
+  // different instances are built in parallel
+  void build(
+      const PointDataSoA& pointCells,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos);
+
+  // Takes over trees of a previous build() (see the getters below), e.g. from a bake package.
+  // Returns false and keeps the current trees if they don't fit together or don't belong to the
+  // point slots of instancePointInfos.
+  bool assign(
+      std::vector<Falcor::KDTreeCompactNode> nodes,
+      std::vector<uint32_t> indices,
+      std::vector<uint32_t> instanceNodeOffsets,
+      std::vector<uint32_t> instanceIndexOffsets,
+      std::vector<float> nodeBuildSizes,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos);
+
+  // Updates the trees of the given instances after their points moved, e.g. for skinned meshes.
+  // pointCells holds the current positions of the point slots the trees were built from. The
+  // topology of the trees is kept: the split values of all inner nodes are refit to the bounds of
+  // their children, which can then overlap. Subtrees that degraded past refitSettings_ are split
+  // again at the median of their points, with the same number of points on each side, so the nodes
+  // and leaf ranges stay where they are. instanceStats receives the stats of every instance, in the
+  // order of instanceIds.
+  RefitStats refit(
+      const PointDataSoA& pointCells,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+      const std::vector<uint32_t>& instanceIds,
+      std::vector<RefitStats>* instanceStats = nullptr);
+
+  // Converts a tree from nanoflann's getLinearizedTree (breadth-first, siblings next to each other)
+  // into 16 byte nodes
+  static std::vector<Falcor::KDTreeCompactNode> compactTree(
+      const std::vector<Falcor::KDTreeGPUNode>& nodes);
+
+  // Average number of 64 byte cache lines that the nodes of a root to leaf path touch, with the
+  // trees stored from cache line aligned addresses with nodeSize bytes per node. Compares the node
+  // layouts, the order of the nodes is the same for all of them.
+  float getCacheLinesPerPath(size_t nodeSize) const;
+
+  const std::vector<Falcor::KDTreeCompactNode>& getNodes() const {
+    return nodes_;
+  }
+
+  // Point slots of the leaves, leaves store ranges of this relative to their instance
+  const std::vector<uint32_t>& getIndices() const {
+    return indices_;
+  }
+
+  const std::vector<uint32_t>& getInstanceNodeOffsets() const {
+    return instanceNodeOffsets_;
+  }
+
+  const std::vector<uint32_t>& getInstanceIndexOffsets() const {
+    return instanceIndexOffsets_;
+  }
+
+  // Size of every node when it was last built
+  const std::vector<float>& getNodeBuildSizes() const {
+    return nodeBuildSizes_;
+  }
+
+  uint32_t getNumInstanceNodes(uint32_t instanceId) const;
+  uint32_t getNumInstanceIndices(uint32_t instanceId) const;
+
+  RefitSettings refitSettings_;
+
+ private:
+  struct NodeBounds {
+    Falcor::float3 min;
+    Falcor::float3 max;
+    // Range of the indices covered by the node, relative to the instance
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  // Whether the valid slots of the instance are still the ones the tree was built from
+  bool hasSameSlots(
+      const PointDataSoA& pointCells,
+      const Falcor::InstancePointInfo& ipi,
+      uint32_t instanceId) const;
+
+  // Computes the bounds of all nodes of an instance's tree bottom-up and sets the split values of
+  // the inner nodes to them
+  void refitInstance(
+      uint32_t instanceId,
+      const Falcor::float3* positions,
+      std::vector<NodeBounds>& bounds);
+
+  // Splits the subtree of every marked inner node again, top-down
+  void rebuildSubtrees(
+      uint32_t instanceId,
+      const Falcor::float3* positions,
+      const std::vector<NodeBounds>& bounds,
+      const std::vector<uint8_t>& rebuildNodes);
+
+  static constexpr uint32_t kMaxPointsLeaf = 16;
+
+  std::vector<Falcor::KDTreeCompactNode> nodes_;
+  std::vector<uint32_t> indices_;
+  std::vector<uint32_t> instanceNodeOffsets_;
+  std::vector<uint32_t> instanceIndexOffsets_;
+  // Size of every node when it was last built, for refit()
+  std::vector<float> nodeBuildSizes_;
+};
+
+} // namespace split_rendering
@@ -11,6 +11,7 @@
 #include <algorithm>
 #include <execution>
 #include "../poisson_sampling/cySampleElim.h"
+#include "Tracing.h"
 #include "nanoflann.hpp"
 
 namespace split_rendering {
@@ -87,133 +88,174 @@ struct PointCloudRange {
   }
 };
 
-// This is used when building a kd-tree from point cells of fixed sizes
-// These point cells can have invalid/unused points in them which we need to skip
-// The kdTreeIndexMap needs to be mapped to the GPU later as well to get the correct lookup.
-struct SparsePointCloudRange {
-  SparsePointCloudRange(
-      const std::vector<Falcor::PointData>& p,
-      uint32_t start,
-      uint32_t sparseSize)
-      : pts(p), start(start), sparseSize(sparseSize) {
-    for (uint32_t i = start; i < start + sparseSize; i++) {
-      if (pts[i].value >= 0) {
-        kdTreeIndexMap.push_back(i);
-      }
-    }
-  }
-
-  const std::vector<Falcor::PointData>& pts;
-  std::vector<uint32_t> kdTreeIndexMap;
-  uint32_t start;
-  uint32_t sparseSize;
-
-  // Must return the number of data points
-  inline size_t kdTreeGetPointCount() const {
-    return kdTreeIndexMap.size();
-  }
-
-  // Returns the dim'th component of the idx'th point in the class:
-  // Since this is inlined and the "dim" argument is typically an immediate
-  // value, the
-  //  "if/else's" are actually solved at compile time.
-  inline float kdTreeGetPt(const size_t idx, const size_t dim) const {
-    if (dim == 0)
-      return pts[kdTreeIndexMap[idx]].position.x;
-    else if (dim == 1)
-      return pts[kdTreeIndexMap[idx]].position.y;
-    else
-      return pts[kdTreeIndexMap[idx]].position.z;
-  }
-
-  // Optional bounding-box computation: return false to default to a standard
-  // bbox computation loop.
-  //   Return true if the BBOX was already computed by the class and returned
-  //   in "bb" so it can be avoided to redo it again. Look at bb.size() to
-  //   find out the expected dimensionality (e.g. 2 or 3 for point clouds)
-  template <class BBOX>
-  bool kdTreeGetBbox(BBOX& /* bb */) const {
-    return false;
-  }
-};
-
 void PointKDTreeGenerator::generate(
     Falcor::Scene::SharedPtr& scene,
     const MeshPointGenerator& pointGen,
-    std::vector<Falcor::PointData>& pointCells,
+    const PointDataSoA& pointCells,
     std::vector<Falcor::InstancePointInfo>& instancePointInfos) {
-  const auto& numFinalSamplesPerInstance = pointGen.getNumSamplesPerInstance();
-  const auto& sampleOffsetPerInstance = pointGen.getSampleOffsetPerInstance();
-  const auto& cpuPointsData = pointCells;
+  FALCOR_ASSERT(instancePointInfos.size() == scene->getGeometryInstanceCount());
 
-  std::vector<Falcor::KDTreeGPUNode> linearizedKdTrees;
-  std::vector<uint32_t> linearizedKdTreeIndices;
-  std::vector<uint32_t> instanceIdToKdTree;
-  std::vector<uint32_t> instanceIdToKdTreeIndexOffset;
-
-  instanceIdToKdTree.push_back(0);
-
-  for (uint32_t instanceId = 0; instanceId < scene->getGeometryInstanceCount(); instanceId++) {
-    const auto& ipi = instancePointInfos[instanceId];
-
-    SparsePointCloudRange pc = SparsePointCloudRange(
-        cpuPointsData, ipi.pointCellOffset, ipi.numAllocatedCells * FIXED_POINTS_PER_CELL);
-
-    // construct a kd-tree index:
-    using my_kd_tree_t = nanoflann::KDTreeSingleIndexAdaptor<
-        nanoflann::L2_Simple_Adaptor<float, SparsePointCloudRange>,
-        SparsePointCloudRange,
-        3>;
-
-    my_kd_tree_t index(3 /*dim*/, pc, {kKdTreeMaxPointsLeaf /* max leaf */});
-
-    auto kdTree = index.getLinearizedTree();
-    auto kdTreeIndex = index.vAcc;
+  cpuKdTree_.build(pointCells, instancePointInfos);
+  createGPUBuffers();
+}
 
-    for (auto& idx : kdTreeIndex) {
-      idx = pc.kdTreeIndexMap[idx];
-    }
+void PointKDTreeGenerator::writeBake(BakePackageWriter& writer) const {
+  TRACE_SCOPE("PointKDTreeGenerator::writeBake");
+  writer.addSection(kBakeKDTreeNodes, cpuKdTree_.getNodes());
+  writer.addSection(kBakeKDTreeIndices, cpuKdTree_.getIndices());
+  writer.addSection(kBakeKDTreeInstanceNodeOffsets, cpuKdTree_.getInstanceNodeOffsets());
+  writer.addSection(kBakeKDTreeInstanceIndexOffsets, cpuKdTree_.getInstanceIndexOffsets());
+  writer.addSection(kBakeKDTreeNodeBuildSizes, cpuKdTree_.getNodeBuildSizes());
+}
 
-    linearizedKdTrees.insert(
-        std::end(linearizedKdTrees), std::begin(kdTree), std::end(kdTree));
+bool PointKDTreeGenerator::loadBake(
+    const BakePackage& package,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos) {
+  TRACE_SCOPE("PointKDTreeGenerator::loadBake");
+  std::vector<Falcor::KDTreeCompactNode> nodes;
+  std::vector<uint32_t> indices;
+  std::vector<uint32_t> instanceNodeOffsets;
+  std::vector<uint32_t> instanceIndexOffsets;
+  std::vector<float> nodeBuildSizes;
+
+  bool valid = package.readSection(kBakeKDTreeNodes, nodes) &&
+      package.readSection(kBakeKDTreeIndices, indices) &&
+      package.readSection(kBakeKDTreeInstanceNodeOffsets, instanceNodeOffsets) &&
+      package.readSection(kBakeKDTreeInstanceIndexOffsets, instanceIndexOffsets) &&
+      package.readSection(kBakeKDTreeNodeBuildSizes, nodeBuildSizes);
+
+  if (!valid) {
+    std::cout << "bake package is missing the kd-trees" << std::endl;
+    return false;
+  }
 
-    instanceIdToKdTreeIndexOffset.push_back(linearizedKdTreeIndices.size());
+  if (!cpuKdTree_.assign(
+          std::move(nodes),
+          std::move(indices),
+          std::move(instanceNodeOffsets),
+          std::move(instanceIndexOffsets),
+          std::move(nodeBuildSizes),
+          instancePointInfos)) {
+    return false;
+  }
 
-    linearizedKdTreeIndices.insert(
-        std::end(linearizedKdTreeIndices), std::begin(kdTreeIndex), std::end(kdTreeIndex));
+  createGPUBuffers();
+  return true;
+}
 
-    if (instanceId < scene->getGeometryInstanceCount() - 1) {
-      instanceIdToKdTree.push_back(instanceIdToKdTree.back() + kdTree.size());
-    }
+void PointKDTreeGenerator::createGPUBuffers() {
+  const auto& nodes = cpuKdTree_.getNodes();
+  const auto& indices = cpuKdTree_.getIndices();
+  const auto& instanceNodeOffsets = cpuKdTree_.getInstanceNodeOffsets();
+  const auto& instanceIndexOffsets = cpuKdTree_.getInstanceIndexOffsets();
+
+  const size_t nodeSize =
+      compactNodes_ ? sizeof(Falcor::KDTreeCompactNode) : sizeof(Falcor::KDTreeGPUNode);
+  std::cout << "PointKDTreeGenerator: " << nodes.size() << " nodes, " << nodes.size() * nodeSize
+            << " bytes, cache lines per root to leaf path "
+            << cpuKdTree_.getCacheLinesPerPath(sizeof(Falcor::KDTreeCompactNode))
+            << " (compact) / " << cpuKdTree_.getCacheLinesPerPath(sizeof(Falcor::KDTreeGPUNode))
+            << " (KDTreeGPUNode)" << std::endl;
+
+  if (compactNodes_) {
+    gpuKdTree_ = Falcor::Buffer::createStructured(
+        sizeof(Falcor::KDTreeCompactNode),
+        nodes.size(),
+        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+        Falcor::Buffer::CpuAccess::None,
+        nodes.data());
+  } else {
+    const auto gpuNodes = getGPUNodes(0, (uint32_t)nodes.size());
+
+    gpuKdTree_ = Falcor::Buffer::createStructured(
+        sizeof(Falcor::KDTreeGPUNode),
+        gpuNodes.size(),
+        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+        Falcor::Buffer::CpuAccess::None,
+        gpuNodes.data());
   }
 
-  gpuKdTree_ = Falcor::Buffer::createStructured(
-      sizeof(Falcor::KDTreeGPUNode),
-      linearizedKdTrees.size(),
-      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-      Falcor::Buffer::CpuAccess::None,
-      linearizedKdTrees.data());
-
   gpuKdTreeIndex_ = Falcor::Buffer::createStructured(
       sizeof(uint32_t),
-      linearizedKdTreeIndices.size(),
+      indices.size(),
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None,
-      linearizedKdTreeIndices.data());
+      indices.data());
 
   gpuInstanceKdTreeOffset_ = Falcor::Buffer::createStructured(
       sizeof(uint32_t),
-      instanceIdToKdTree.size(),
+      instanceNodeOffsets.size(),
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None,
-      instanceIdToKdTree.data());
+      instanceNodeOffsets.data());
 
   gpuInstanceKdTreeIndexOffset_ = Falcor::Buffer::createStructured(
       sizeof(uint32_t),
-      instanceIdToKdTreeIndexOffset.size(),
+      instanceIndexOffsets.size(),
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None,
-      instanceIdToKdTreeIndexOffset.data());
+      instanceIndexOffsets.data());
+}
+
+std::vector<Falcor::KDTreeGPUNode> PointKDTreeGenerator::getGPUNodes(
+    uint32_t firstNode,
+    uint32_t numNodes) const {
+  const auto& nodes = cpuKdTree_.getNodes();
+  std::vector<Falcor::KDTreeGPUNode> gpuNodes(numNodes);
+
+  for (uint32_t i = 0; i < numNodes; i++)
+    gpuNodes[i] = Falcor::unpackKDTreeNode(nodes[firstNode + i]);
+
+  return gpuNodes;
+}
+
+PointKDTree::RefitStats PointKDTreeGenerator::refit(
+    const PointDataSoA& pointCells,
+    const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+    const std::vector<uint32_t>& instanceIds) {
+  std::vector<PointKDTree::RefitStats> instanceStats;
+  const auto stats = cpuKdTree_.refit(pointCells, instancePointInfos, instanceIds, &instanceStats);
+
+  if (!gpuKdTree_)
+    return stats;
+
+  const auto& nodes = cpuKdTree_.getNodes();
+  const auto& indices = cpuKdTree_.getIndices();
+
+  for (uint32_t i = 0; i < (uint32_t)instanceStats.size(); i++) {
+    const uint32_t instanceId = instanceIds[i];
+
+    if (instanceStats[i].numChangedInstances > 0)
+      continue;
+
+    // The nodes of an instance always change, the indices only if subtrees were rebuilt
+    const uint32_t nodeOffset = cpuKdTree_.getInstanceNodeOffsets()[instanceId];
+    const uint32_t numNodes = cpuKdTree_.getNumInstanceNodes(instanceId);
+
+    if (compactNodes_) {
+      gpuKdTree_->setBlob(
+          nodes.data() + nodeOffset,
+          nodeOffset * sizeof(Falcor::KDTreeCompactNode),
+          numNodes * sizeof(Falcor::KDTreeCompactNode));
+    } else {
+      const auto gpuNodes = getGPUNodes(nodeOffset, numNodes);
+      gpuKdTree_->setBlob(
+          gpuNodes.data(),
+          nodeOffset * sizeof(Falcor::KDTreeGPUNode),
+          numNodes * sizeof(Falcor::KDTreeGPUNode));
+    }
+
+    if (instanceStats[i].numRebuiltSubtrees > 0) {
+      const uint32_t indexOffset = cpuKdTree_.getInstanceIndexOffsets()[instanceId];
+
+      gpuKdTreeIndex_->setBlob(
+          indices.data() + indexOffset,
+          indexOffset * sizeof(uint32_t),
+          cpuKdTree_.getNumInstanceIndices(instanceId) * sizeof(uint32_t));
+    }
+  }
+
+  return stats;
 }
 
 } // namespace split_rendering
@@ -9,7 +9,11 @@
 #pragma once
 
 #include <Falcor.h>
+#include <vector>
+#include "BakePackage.h"
 #include "PointData.slang"
+#include "PointDataSoA.h"
+#include "PointKDTree.h"
 #include "MeshPointGenerator.h"
 
 namespace split_rendering {
@@ -20,9 +24,19 @@ class PointKDTreeGenerator {
   void generate(
       Falcor::Scene::SharedPtr& scene,
       const MeshPointGenerator& pointGen,
-      std::vector<Falcor::PointData>& pointCells,
+      const PointDataSoA& pointCells,
       std::vector<Falcor::InstancePointInfo>& instancePointInfos);
 
+  // Stores the CPU trees in a bake package, call after generate()
+  void writeBake(BakePackageWriter& writer) const;
+
+  // Restores the trees of generate() from a bake package and uploads them, returns false if
+  // sections are missing or don't fit the point slots. The trees are copied out of the package
+  // because refit() changes them.
+  bool loadBake(
+      const BakePackage& package,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos);
+
   Falcor::Buffer::SharedPtr& getGPUKDTree() {
     return gpuKdTree_;
   }
@@ -39,8 +53,34 @@ class PointKDTreeGenerator {
     return gpuInstanceKdTreeIndexOffset_;
   }
 
+  // Refits the CPU trees of the given instances after their points moved (see PointKDTree::refit)
+  // and uploads the changed trees to the GPU buffers in place
+  PointKDTree::RefitStats refit(
+      const PointDataSoA& pointCells,
+      const std::vector<Falcor::InstancePointInfo>& instancePointInfos,
+      const std::vector<uint32_t>& instanceIds);
+
+  // CPU copies of the trees of all instances
+  const PointKDTree& getCPUKDTree() const {
+    return cpuKdTree_;
+  }
+
+  PointKDTree& getCPUKDTree() {
+    return cpuKdTree_;
+  }
+
+  // Stores the GPU tree as KDTreeCompactNode instead of KDTreeGPUNode (KD_TREE_COMPACT_NODES in
+  // KDTree.slang)
+  bool compactNodes_ = true;
+
  private:
-  static constexpr Falcor::uint kKdTreeMaxPointsLeaf = 16;
+  // Creates all GPU buffers from the CPU trees after generate() or loadBake()
+  void createGPUBuffers();
+
+  // Nodes of the CPU trees in the KDTreeGPUNode layout
+  std::vector<Falcor::KDTreeGPUNode> getGPUNodes(uint32_t firstNode, uint32_t numNodes) const;
+
+  PointKDTree cpuKdTree_;
   Falcor::Buffer::SharedPtr gpuKdTree_;
   Falcor::Buffer::SharedPtr gpuKdTreeIndex_;
   Falcor::Buffer::SharedPtr gpuInstanceKdTreeIndexOffset_;
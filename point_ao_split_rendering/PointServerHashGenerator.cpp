@@ -8,16 +8,91 @@
 
 #include "PointServerHashGenerator.h"
 #include <algorithm>
+#include <array>
+#include <cstring>
 #include <execution>
+#include <iostream>
+#include <numeric>
+#include "ClientPointCodec.h"
 #include "Pointdata.slang"
+#include "PointCellGarbageCollector.h"
+#include "PointDataSoA.h"
+#include "Tracing.h"
 
 namespace split_rendering {
 
+namespace {
+// Rehashing into a larger table is retried this many times with twice the size before giving up
+constexpr uint32_t kMaxRehashDoublings = 4;
+
+// Offset of a region of size elements, a released one if possible, otherwise appended to the end
+// of the buffer
+uint32_t allocateRegion(BufferRegionFreeList& freeRegions, uint32_t& bufferSize, uint32_t size) {
+  uint32_t offset = freeRegions.allocate(size);
+
+  if (offset == INVALID_CELL) {
+    offset = bufferSize;
+    bufferSize += size;
+  }
+
+  return offset;
+}
+
+// Points the stream at a section of the package, false if it is missing or has another size. The
+// section is only read, the stream is non-const because PointDataSoA also owns writable streams.
+template <typename T>
+bool getPointCellStream(const BakePackage& package, uint32_t id, size_t numPoints, T*& stream) {
+  const ConstArrayView<T> section = package.getSectionView<T>(id);
+  stream = const_cast<T*>(section.data());
+  return section.data() && section.size() == numPoints;
+}
+} // namespace
+
 int compressHashToCellInfoIndex(int pointCellIndex, uint32_t numPoints, uint32_t numCells) {
   return pointCellIndex;
 }
 
 
+uint32_t PointServerHashGenerator::getHashTableSize(uint32_t numSamples, int log2SizeFactor) {
+  // NOTE: sometimes the hash table size can be a bit too small, and ideally we want to configure
+  // it and/or figure out dynamically how much we need
+  uint32_t hashTableSize = (uint32_t)std::exp2(
+      std::ceil(std::log2((numSamples / FIXED_HASH_BUCKET_SIZE))) + log2SizeFactor);
+
+  return std::max(hashTableSize, (uint32_t)FIXED_HASH_BUCKET_SIZE);
+}
+
+uint32_t PointServerHashGenerator::selectCellCapacity(
+    const std::vector<uint32_t>& numPointsPerCell) {
+  uint64_t numPoints = 0;
+  for (uint32_t numCellPoints : numPointsPerCell)
+    numPoints += numCellPoints;
+
+  for (uint32_t capacityClass = 0; capacityClass < NUM_CELL_CAPACITY_CLASSES - 1; capacityClass++) {
+    const uint32_t cellCapacity = Falcor::getCellCapacity(capacityClass);
+
+    uint64_t numKeptPoints = 0;
+    for (uint32_t numCellPoints : numPointsPerCell)
+      numKeptPoints += std::min(numCellPoints, cellCapacity);
+
+    if (numKeptPoints >= CELL_CAPACITY_POINT_COVERAGE * numPoints)
+      return cellCapacity;
+  }
+
+  return MAX_POINTS_PER_CELL;
+}
+
+int PointServerHashGenerator::getInstanceHashType(
+    int requestedHashType,
+    const Falcor::uint3& gridDim) {
+  if (requestedHashType == HASH_TYPE_MORTON &&
+      std::max(std::max(gridDim.x, gridDim.y), gridDim.z) > MORTON_MAX_GRID_DIM) {
+    return HASH_TYPE_XORSHIFT;
+  }
+
+  return requestedHashType;
+}
+
 void PointServerHashGenerator::generate(
     Falcor::Scene::SharedPtr& scene,
     const MeshPointGenerator& pointGen) {
@@ -26,328 +101,378 @@ void PointServerHashGenerator::generate(
   const auto& diskRadiusPerInstance = pointGen.getDiskRadiusPerInstance();
   const auto& cpuPointsData = pointGen.getCPUPointData();
 
-  std::vector<Falcor::HashNumBuckets> hashNumBuckets;
+  const uint32_t numInstances = scene->getGeometryInstanceCount();
+  bakeCompressedClientPointCells_ = {};
+  bakeCompactHashToPointCell_ = {};
+
+  instanceHashInfo_.resize(numInstances);
+  instancePointInfo_.resize(numInstances);
+  instanceDropStats_.assign(numInstances, {});
+
+  std::vector<uint32_t> instanceIds(numInstances);
+  std::iota(instanceIds.begin(), instanceIds.end(), 0);
+
+  // Phase 1: compute the grid of every instance and count the cells its points occupy, so the pools
+  // only need a small safety margin on top (they are grown at runtime if necessary).
+  std::vector<uint32_t> numOccupiedCells(numInstances, 0);
+
+  std::for_each(
+      std::execution::par, instanceIds.begin(), instanceIds.end(), [&](uint32_t& instanceId) {
+        auto& ihi = instanceHashInfo_[instanceId];
+        auto& ipi = instancePointInfo_[instanceId];
+
+        Falcor::float3& aabbMin = ipi.aabbMin;
+        Falcor::float3& aabbMax = ipi.aabbMax;
+        aabbMin = glm::float3(
+            std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::max());
+        aabbMax = glm::float3(
+            -std::numeric_limits<float>::max(),
+            -std::numeric_limits<float>::max(),
+            -std::numeric_limits<float>::max());
+
+        for (uint32_t pointId = sampleOffsetPerInstance[instanceId];
+             pointId < sampleOffsetPerInstance[instanceId] + numFinalSamplesPerInstance[instanceId];
+             pointId++) {
+          const auto& point = cpuPointsData[pointId];
+
+          aabbMin = glm::min(aabbMin, point.position);
+          aabbMax = glm::max(aabbMax, point.position);
+        }
 
-  // Hash Table Setup
-  for (uint32_t instanceId = 0; instanceId < scene->getGeometryInstanceCount(); instanceId++) {
-    // NOTE: sometimes the hash table size can be a bit too small, and ideally we want to configure
-    // it and/or figure out dynamically how much we need
-    uint32_t hashTableSize = (uint32_t)std::exp2(
-        std::ceil(std::log2((numFinalSamplesPerInstance[instanceId] / FIXED_HASH_BUCKET_SIZE))) +
-        HASH_LOG2_SIZE_FACTOR);
+        glm::float3 aabbSizeInitial = aabbMax - aabbMin;
 
-    hashTableSize = std::max(hashTableSize, (uint32_t)FIXED_HASH_BUCKET_SIZE);
+        aabbMax += 0.5f * aabbSizeInitial;
 
-    // Conservatively use 4x the average number of cells to preallocate memory for cells
-    uint32_t numCells = (uint32_t) ((numFinalSamplesPerInstance[instanceId] / DISK_RADIUS_FACTOR) *
-        NUM_CELLS_PREALLOCATION_FACTOR);
+        aabbMin -= 0.5f * aabbSizeInitial;
 
-    numCells = std::max(numCells, 1U);
+        ihi.aabbMin = aabbMin;
+        ihi.aabbMax = aabbMax;
 
-    if (scene->getGeometryInstance(instanceId).isDynamic()) {
-      // More memory for dynamic instances - this will make things easier when updating (= adding
-      // more cells) later
-      numCells *= 8;
-    }
+        float diskRadius = DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId];
+        glm::float3 aabbSize = aabbMax - aabbMin;
 
-    instanceHashInfo_.push_back({});
-    instancePointInfo_.push_back({});
-    auto& ihi = instanceHashInfo_.back();
-    auto& ipi = instancePointInfo_.back();
+        glm::uvec3 gridDim = {
+            ((aabbSize.x / diskRadius)),
+            ((aabbSize.y / diskRadius)),
+            ((aabbSize.z / diskRadius))};
 
-    ihi.hashToBucketOffset = hashToPointCellSize_;
-    ipi.pointCellOffset = pointCellsSize_;
-    ihi.hashToBucketSize = hashTableSize;
-    ipi.maxNumPoints = numCells * FIXED_POINTS_PER_CELL;
-
-    hashNumBuckets.resize(hashToPointCellSize_ + hashTableSize);
-
-    hashToPointCell_.resize(hashToPointCellSize_ + hashTableSize * FIXED_HASH_BUCKET_SIZE);
-    hashToPointCellSize_ = hashToPointCell_.size();
-    pointCells_.resize(pointCellsSize_ + numCells * FIXED_POINTS_PER_CELL);
-
-    compressedClientPointCells_.resize(pointCellsSize_ + numCells * FIXED_POINTS_PER_CELL);
-    pointCellsSize_ = pointCells_.size();
-
-    uint32_t& numAllocatedCells = ipi.numAllocatedCells;
-    numAllocatedCells = 0;
-
-    Falcor::float3& aabbMin = ipi.aabbMin;
-    Falcor::float3& aabbMax = ipi.aabbMax;
-    aabbMin = glm::float3(
-        std::numeric_limits<float>::max(),
-        std::numeric_limits<float>::max(),
-        std::numeric_limits<float>::max());
-    aabbMax = glm::float3(
-        -std::numeric_limits<float>::max(),
-        -std::numeric_limits<float>::max(),
-        -std::numeric_limits<float>::max());
-
-    for (uint32_t pointId = sampleOffsetPerInstance[instanceId];
-         pointId < sampleOffsetPerInstance[instanceId] + numFinalSamplesPerInstance[instanceId];
-         pointId++) {
-      const auto& point = cpuPointsData[pointId];
-
-      aabbMin = glm::min(aabbMin, point.position);
-      aabbMax = glm::max(aabbMax, point.position);
-    }
+        gridDim.x = glm::max(glm::max(gridDim.x, gridDim.y), gridDim.z);
+        gridDim.y = gridDim.x;
+        gridDim.z = gridDim.x;
 
-    glm::float3 aabbSizeInitial = aabbMax - aabbMin;
+        ipi.gridDim = gridDim;
 
-    aabbMax += 0.5f * aabbSizeInitial;
+        ihi.gridDim = gridDim;
+        ihi.hashType = getInstanceHashType(hashType_, gridDim);
 
-    aabbMin -= 0.5f * aabbSizeInitial;
+        std::vector<uint32_t> rawCellIds;
+        rawCellIds.reserve(numFinalSamplesPerInstance[instanceId]);
 
-    ihi.aabbMin = aabbMin;
-    ihi.aabbMax = aabbMax;
-
-    float diskRadius = DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId];
-    glm::float3 aabbSize = aabbMax - aabbMin;
+        for (uint32_t pointId = sampleOffsetPerInstance[instanceId];
+             pointId < sampleOffsetPerInstance[instanceId] + numFinalSamplesPerInstance[instanceId];
+             pointId++) {
+          glm::ivec3 coords = ((cpuPointsData[pointId].position - aabbMin)) / diskRadius;
+          rawCellIds.push_back(Falcor::getRawCellId(coords, gridDim, ihi.hashType));
+        }
 
-    glm::uvec3 gridDim = {
-        ((aabbSize.x / diskRadius)),
-        ((aabbSize.y / diskRadius)),
-        ((aabbSize.z / diskRadius))};
+        std::sort(rawCellIds.begin(), rawCellIds.end());
 
-    gridDim.x = glm::max(glm::max(gridDim.x, gridDim.y), gridDim.z);
-    gridDim.y = gridDim.x;
-    gridDim.z = gridDim.x;
-    
-    ipi.gridDim = gridDim;
+        std::vector<uint32_t> numPointsPerCell;
+        for (uint32_t pointId = 0; pointId < rawCellIds.size(); pointId++) {
+          if (pointId == 0 || rawCellIds[pointId] != rawCellIds[pointId - 1])
+            numPointsPerCell.push_back(0);
+          numPointsPerCell.back()++;
+        }
 
-    ihi.gridDim = gridDim;
+        numOccupiedCells[instanceId] = (uint32_t)numPointsPerCell.size();
+        ipi.cellCapacity = cellCapacityClass_ >= 0
+            ? Falcor::getCellCapacity(cellCapacityClass_)
+            : selectCellCapacity(numPointsPerCell);
+      });
 
-    for (uint32_t pointId = sampleOffsetPerInstance[instanceId];
-         pointId < sampleOffsetPerInstance[instanceId] + numFinalSamplesPerInstance[instanceId];
-         pointId++) {
-      const auto& cpuPoint = cpuPointsData[pointId];
-      const auto& pointPos = cpuPoint.position;
+  // The table and pool sizes are known now, so we compute all offsets with a prefix sum and
+  // allocate each array exactly once.
+  hashToPointCellSize_ = 0;
+  pointCellsSize_ = 0;
+  numCells_ = 0;
+  freeHashRegions_.clear();
+  freePointSlotRegions_.clear();
+  freeCellRegions_.clear();
 
-      // Get grid index for point given grid size == poisson disk radius
-      glm::ivec3 coords = ((pointPos - aabbMin)) / diskRadius;
+  for (uint32_t instanceId = 0; instanceId < numInstances; instanceId++) {
+    const uint32_t hashTableSize = getHashTableSize(numFinalSamplesPerInstance[instanceId]);
 
-      Falcor::HashData hd = Falcor::getHash(coords, gridDim, hashTableSize, 0);
+    // More memory for dynamic instances - this will make things easier when updating (= adding
+    // more cells) later
+    const float preallocationFactor = scene->getGeometryInstance(instanceId).isDynamic()
+        ? NUM_CELLS_DYNAMIC_PREALLOCATION_FACTOR
+        : NUM_CELLS_PREALLOCATION_FACTOR;
 
-      // We store the buckets linearly in memory so we need the extra multiplication here
-      hd.hashBase *= FIXED_HASH_BUCKET_SIZE;
+    uint32_t numCells = (uint32_t)std::ceil(numOccupiedCells[instanceId] * preallocationFactor);
 
-      bool found = false;
+    numCells = std::max(numCells, 1U);
 
-      // Check if we already have an existing entry that matches the rawCellId, otherwise
-      // keep track of first non-negative index
+    auto& ihi = instanceHashInfo_[instanceId];
+    auto& ipi = instancePointInfo_[instanceId];
 
-      int firstFreeIndex = -1;
-      bool foundCell = false;
+    ihi.hashToBucketOffset = hashToPointCellSize_;
+    ipi.pointCellOffset = pointCellsSize_;
+    ipi.cellOffset = numCells_;
+    ihi.hashToBucketSize = hashTableSize;
+    ipi.maxNumPoints = numCells * ipi.cellCapacity;
+    ipi.numAllocatedCells = 0;
+    ipi.numBucketOverflows = 0;
+    ipi.numPoolOverflows = 0;
+    ipi.numFreeCells = 0;
+
+    hashToPointCellSize_ += hashTableSize * FIXED_HASH_BUCKET_SIZE;
+    pointCellsSize_ += numCells * ipi.cellCapacity;
+    numCells_ += numCells;
+  }
 
-      for (int hashInfoIndex = 0; hashInfoIndex < FIXED_HASH_BUCKET_SIZE; hashInfoIndex++) {
-        auto& hashInfo = hashToPointCell_[hd.hashBase + ihi.hashToBucketOffset + hashInfoIndex];
+  if (pointCellsSize_ > MAX_POINT_SLOTS) {
+    std::cout << "Error: " << pointCellsSize_ << " point slots exceed the " << MAX_POINT_SLOTS
+              << " that cell updates can address" << std::endl;
+    FALCOR_ASSERT(false);
+  }
 
-        // if a matching cell already exists
-        if (hashInfo.pointCellIndex >= 0 && hashInfo.rawCellId == hd.rawCellId) {
-          // Find first free entry in the point cell
-          foundCell = true;
-          for (uint32_t localPointCellOffset = 0; localPointCellOffset < FIXED_POINTS_PER_CELL;
-               localPointCellOffset++) {
-            auto& pointCellPoint =
-                pointCells_[hashInfo.pointCellIndex + ipi.pointCellOffset + localPointCellOffset];
+  hashToPointCell_.assign(hashToPointCellSize_, {});
+  // Points are written straight into the streams that are uploaded, empty slots have value -1
+  pointCells_.allocate(pointCellsSize_);
+  pointCells_.fill(Falcor::PointData());
+  compressedClientPointCells_.assign(pointCellsSize_, {});
 
-            if (pointCellPoint.value < 0) {
-              pointCellPoint = cpuPoint;
-              pointCellPoint.value = UNINITIALIZED_VALUE;
-              hashInfo.numPoints++;
-              compressedClientPointCells_
-                  [hashInfo.pointCellIndex + ipi.pointCellOffset + localPointCellOffset] =
-                      Falcor::compressClientData(pointCellPoint.position, pointCellPoint.normal, pointCellPoint.value, diskRadius, ipi.aabbMin);
+  std::vector<Falcor::HashNumBuckets> hashNumBuckets(
+      hashToPointCellSize_ / FIXED_HASH_BUCKET_SIZE, Falcor::HashNumBuckets{0});
 
-              break;
-            }
+  // Every allocated cell references its hash entry, so empty cells can be freed on the GPU
+  std::vector<Falcor::CellInfo> cellInfos(numCells_, Falcor::CellInfo{INVALID_CELL, INVALID_CELL});
 
-            // if we don't find anything, we just skip/ignore.
-          }
+  // Phase 2: every instance only touches its own (disjoint) range of the hash table and point
+  // cells, so instances can be built in parallel without any synchronization.
+  std::for_each(
+      std::execution::par, instanceIds.begin(), instanceIds.end(), [&](uint32_t& instanceId) {
+        auto& ihi = instanceHashInfo_[instanceId];
+        auto& ipi = instancePointInfo_[instanceId];
 
-          // break out as we already found a cell
-          break;
+        const uint32_t hashTableSize = ihi.hashToBucketSize;
+        const uint32_t cellCapacity = ipi.cellCapacity;
+        const uint32_t numCells = ipi.maxNumPoints / cellCapacity;
 
-        } else if (hashInfo.pointCellIndex < 0 && firstFreeIndex < 0) {
-          firstFreeIndex = hashInfoIndex;
+        for (uint32_t cell = 0; cell < numCells; cell++) {
+          cellInfos[ipi.cellOffset + cell].instanceId = instanceId;
         }
-      }
-
-      // If we successfully found a cell for the given point, go to next.
-      // Note that this even happens if the cell is full, which we ignore.
-      if (foundCell)
-        continue;
 
-      // If the hash bucket for this given hash is full, we also skip/ignore
-      if (firstFreeIndex < 0)
-        continue;
+        uint32_t& numAllocatedCells = ipi.numAllocatedCells;
 
-      // We reach this part of the code if we need to allocate a new point cell within this hash
-      // info and found an empty hash info in the array
-      auto& hashInfo = hashToPointCell_[hd.hashBase + ihi.hashToBucketOffset + firstFreeIndex];
-      hashInfo.rawCellId = hd.rawCellId;
-      hashInfo.numPoints = 1;
-      hashInfo.pointCellIndex = (numAllocatedCells * FIXED_POINTS_PER_CELL);
-      numAllocatedCells++;
+        const glm::float3 aabbMin = ipi.aabbMin;
+        const glm::uvec3 gridDim = ipi.gridDim;
+        float diskRadius = DISK_RADIUS_FACTOR * diskRadiusPerInstance[instanceId];
 
-      if (hashInfo.pointCellIndex >= (numCells * FIXED_POINTS_PER_CELL)) {
-        // If this happens, we run out of preallocated memory. This ideally should not happen.
-        continue;
-      }
-      hashNumBuckets
-          [hd.hashBase / FIXED_HASH_BUCKET_SIZE + ihi.hashToBucketOffset / FIXED_HASH_BUCKET_SIZE]
-              .numBuckets++;
-      auto& pointCell = pointCells_[hashInfo.pointCellIndex + ipi.pointCellOffset];
-      // As this is a new cell, we simply add the point as the first entry and set it to valid
-
-      pointCell = cpuPoint;
-      pointCell.value = UNINITIALIZED_VALUE;
-      compressedClientPointCells_
-          [hashInfo.pointCellIndex + ipi.pointCellOffset] =
-          Falcor::compressClientData(
-              pointCell.position, pointCell.normal, pointCell.value, diskRadius, ipi.aabbMin);
-    }
-  }
+        auto& dropStats = instanceDropStats_[instanceId];
+        float* pointValues = pointCells_.getStreams().values + ipi.pointCellOffset;
 
-  // Compress hash table entries
+        for (uint32_t pointId = sampleOffsetPerInstance[instanceId];
+             pointId < sampleOffsetPerInstance[instanceId] + numFinalSamplesPerInstance[instanceId];
+             pointId++) {
+          const auto& cpuPoint = cpuPointsData[pointId];
+          const auto& pointPos = cpuPoint.position;
 
-  for (const auto& hashEntry : hashToPointCell_) {
-    Falcor::CompactHashToCellInfo chtci;
+          // Get grid index for point given grid size == poisson disk radius
+          glm::ivec3 coords = ((pointPos - aabbMin)) / diskRadius;
 
-    chtci.rawCellId = hashEntry.rawCellId;
+          Falcor::HashData hd = Falcor::getHash(coords, gridDim, hashTableSize, ihi.hashType);
 
-    chtci.encodedIndex = compressHashToCellInfoIndex(
-        hashEntry.pointCellIndex, hashEntry.numPoints, hashEntry.numCells);
+          // We store the buckets linearly in memory so we need the extra multiplication here
+          hd.hashBase *= FIXED_HASH_BUCKET_SIZE;
 
-    if (hashEntry.pointCellIndex < 0) {
-      chtci.encodedIndex = INVALID_CELL;
-      chtci.rawCellId = INVALID_CELL;
-    }
+          // Check if we already have an existing entry that matches the rawCellId, otherwise
+          // keep track of first non-negative index
 
-    compactHashToPointCell_.push_back(chtci);
-  }
+          int firstFreeIndex = -1;
+          bool foundCell = false;
 
-  // After all instances have been processed, we can generate the GPU buffers
-  gpuHashToPointCell_ = Falcor::Buffer::createStructured(
-      sizeof(Falcor::CompactHashToCellInfo),
-      compactHashToPointCell_.size(),
-      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-      Falcor::Buffer::CpuAccess::None,
-      compactHashToPointCell_.data());
+          for (int hashInfoIndex = 0; hashInfoIndex < FIXED_HASH_BUCKET_SIZE; hashInfoIndex++) {
+            auto& hashInfo = hashToPointCell_[hd.hashBase + ihi.hashToBucketOffset + hashInfoIndex];
 
-  gpuHashNumBuckets_ = Falcor::Buffer::createStructured(
-      sizeof(Falcor::HashNumBuckets),
-      hashNumBuckets.size(),
-      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-      Falcor::Buffer::CpuAccess::None,
-      hashNumBuckets.data());
-
-  
-    // Create all sub-data for GPU buffers to circumvent 4GB buffer limit
-  // float3 position;
-  // float3 normal;
-  // float3 tangent;
-  // float2 barycentrics;
-  // uint instanceTriangleId;
-  // uint instanceId;
-  // float value;
-  {
-    std::vector<Falcor::float3> vals;
+            // if a matching cell already exists
+            if (hashInfo.pointCellIndex >= 0 && hashInfo.rawCellId == hd.rawCellId) {
+              // Find first free entry in the point cell
+              foundCell = true;
+              for (uint32_t localPointCellOffset = 0; localPointCellOffset < cellCapacity;
+                   localPointCellOffset++) {
+                const uint32_t pointSlot = hashInfo.pointCellIndex + localPointCellOffset;
 
-    for (const auto& point : pointCells_)
-      vals.push_back(point.position);
+                if (pointValues[pointSlot] < 0) {
+                  pointCells_.set(ipi.pointCellOffset + pointSlot, cpuPoint);
+                  pointValues[pointSlot] = UNINITIALIZED_VALUE;
+                  hashInfo.numPoints++;
+                  break;
+                }
 
-    gpuPositions_ = Falcor::Buffer::createStructured(
-        sizeof(vals[0]),
-        vals.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        vals.data());
+                // if we don't find anything, we just skip/ignore.
+                if (localPointCellOffset == cellCapacity - 1)
+                  dropStats.cellFull++;
+              }
 
-  }
+              // break out as we already found a cell
+              break;
 
-  {
-    std::vector<Falcor::float3> vals;
+            } else if (hashInfo.pointCellIndex < 0 && firstFreeIndex < 0) {
+              firstFreeIndex = hashInfoIndex;
+            }
+          }
 
-    for (const auto& point : pointCells_)
-      vals.push_back(point.normal);
+          // If we successfully found a cell for the given point, go to next.
+          // Note that this even happens if the cell is full, which we ignore.
+          if (foundCell)
+            continue;
 
-    gpuNormals_ = Falcor::Buffer::createStructured(
-        sizeof(vals[0]),
-        vals.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        vals.data());
-  }
+          // If the hash bucket for this given hash is full, we also skip/ignore
+          if (firstFreeIndex < 0) {
+            dropStats.bucketFull++;
+            continue;
+          }
 
-  {
-    std::vector<Falcor::float3> vals;
+          if (numAllocatedCells >= numCells) {
+            // If this happens, we run out of preallocated memory. This ideally should not happen.
+            // We check before claiming the hash entry so the table never references a cell
+            // outside of this instance's range.
+            dropStats.poolFull++;
+            continue;
+          }
 
-    for (const auto& point : pointCells_)
-      vals.push_back(point.tangent);
+          // We reach this part of the code if we need to allocate a new point cell within this
+          // hash info and found an empty hash info in the array
+          const uint32_t hashEntry = hd.hashBase + ihi.hashToBucketOffset + firstFreeIndex;
+          auto& hashInfo = hashToPointCell_[hashEntry];
+          hashInfo.rawCellId = hd.rawCellId;
+          hashInfo.numPoints = 1;
+          hashInfo.pointCellIndex = (numAllocatedCells * cellCapacity);
+          numAllocatedCells++;
+
+          cellInfos[ipi.cellOffset + numAllocatedCells - 1].hashEntry = hashEntry;
+
+          hashNumBuckets
+              [hd.hashBase / FIXED_HASH_BUCKET_SIZE +
+               ihi.hashToBucketOffset / FIXED_HASH_BUCKET_SIZE]
+                  .numBuckets++;
+          // As this is a new cell, we simply add the point as the first entry and set it to valid
+          pointCells_.set(ipi.pointCellOffset + hashInfo.pointCellIndex, cpuPoint);
+          pointValues[hashInfo.pointCellIndex] = UNINITIALIZED_VALUE;
+        }
 
-    gpuTangents_ = Falcor::Buffer::createStructured(
-        sizeof(vals[0]),
-        vals.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        vals.data());
+        // Compress the allocated cells of this instance in one batch, empty slots stay invalid
+        const auto& streams = pointCells_.getStreams();
+        ClientPointCodec::compressSlots(
+            streams.positions + ipi.pointCellOffset,
+            streams.normals + ipi.pointCellOffset,
+            pointValues,
+            numAllocatedCells * cellCapacity,
+            diskRadius,
+            aabbMin,
+            compressedClientPointCells_.data() + ipi.pointCellOffset);
+      });
+
+  InstanceDropStats totalDrops;
+  for (const auto& dropStats : instanceDropStats_) {
+    totalDrops.bucketFull += dropStats.bucketFull;
+    totalDrops.cellFull += dropStats.cellFull;
+    totalDrops.poolFull += dropStats.poolFull;
   }
 
-  {
-    std::vector<Falcor::float2> vals;
+  std::cout << "Server hash generation dropped points - bucket full: " << totalDrops.bucketFull
+            << ", cell full: " << totalDrops.cellFull << ", pool full: " << totalDrops.poolFull
+            << std::endl;
 
-    for (const auto& point : pointCells_)
-      vals.push_back(point.barycentrics);
+  std::array<uint32_t, NUM_CELL_CAPACITY_CLASSES> numInstancesPerCapacityClass = {};
+  for (const auto& ipi : instancePointInfo_) {
+    for (uint32_t capacityClass = 0; capacityClass < NUM_CELL_CAPACITY_CLASSES; capacityClass++) {
+      if (ipi.cellCapacity == Falcor::getCellCapacity(capacityClass))
+        numInstancesPerCapacityClass[capacityClass]++;
+    }
+  }
 
-    gpuBarycentrics_ = Falcor::Buffer::createStructured(
-        sizeof(vals[0]),
-        vals.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        vals.data());
+  std::cout << "Instances per cell capacity -";
+  for (uint32_t capacityClass = 0; capacityClass < NUM_CELL_CAPACITY_CLASSES; capacityClass++) {
+    std::cout << (capacityClass > 0 ? ", " : " ") << Falcor::getCellCapacity(capacityClass)
+              << " points: " << numInstancesPerCapacityClass[capacityClass];
   }
+  std::cout << std::endl;
 
-  {
-    std::vector<uint32_t> vals;
+  // Compress hash table entries
+  compactHashToPointCell_.resize(hashToPointCell_.size());
 
-    for (const auto& point : pointCells_)
-      vals.push_back(point.instanceTriangleId);
+  std::transform(
+      std::execution::par,
+      hashToPointCell_.begin(),
+      hashToPointCell_.end(),
+      compactHashToPointCell_.begin(),
+      [](const Falcor::HashToCellInfo& hashEntry) {
+        Falcor::CompactHashToCellInfo chtci;
 
-    gpuInstanceTriangleIDs_ = Falcor::Buffer::createStructured(
-        sizeof(vals[0]),
-        vals.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        vals.data());
-  }
+        chtci.rawCellId = hashEntry.rawCellId;
 
-  {
-    std::vector<uint32_t> vals;
+        chtci.encodedIndex = compressHashToCellInfoIndex(
+            hashEntry.pointCellIndex, hashEntry.numPoints, hashEntry.numCells);
 
-    for (const auto& point : pointCells_)
-      vals.push_back(point.instanceId);
+        if (hashEntry.pointCellIndex < 0) {
+          chtci.encodedIndex = INVALID_CELL;
+          chtci.rawCellId = INVALID_CELL;
+        }
 
-    gpuInstanceIDs_ = Falcor::Buffer::createStructured(
-        sizeof(vals[0]),
-        vals.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        vals.data());
-  }
+        return chtci;
+      });
 
-  {
-    std::vector<float> vals;
+  // After all instances have been processed, we can generate the GPU buffers
+  createGPUBuffers(
+      compactHashToPointCell_.data(),
+      compressedClientPointCells_.data(),
+      hashNumBuckets.data(),
+      cellInfos.data());
+}
 
-    for (const auto& point : pointCells_)
-      vals.push_back(point.value);
+void PointServerHashGenerator::createGPUBuffers(
+    const Falcor::CompactHashToCellInfo* compactHashToPointCell,
+    const Falcor::CompressedClientPointData* compressedClientPointCells,
+    const Falcor::HashNumBuckets* hashNumBuckets,
+    const Falcor::CellInfo* cellInfos) {
+  gpuHashToPointCell_ = Falcor::Buffer::createStructured(
+      sizeof(Falcor::CompactHashToCellInfo),
+      hashToPointCellSize_,
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      Falcor::Buffer::CpuAccess::None,
+      compactHashToPointCell);
+
+  gpuHashNumBuckets_ = Falcor::Buffer::createStructured(
+      sizeof(Falcor::HashNumBuckets),
+      hashToPointCellSize_ / FIXED_HASH_BUCKET_SIZE,
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      Falcor::Buffer::CpuAccess::None,
+      hashNumBuckets);
 
-    gpuValues_ = Falcor::Buffer::createStructured(
-        sizeof(vals[0]),
-        vals.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        vals.data());
+  // Create all sub-data for GPU buffers to circumvent 4GB buffer limit. The point cells are already
+  // stored as these streams, so they are uploaded as is.
+  {
+    const auto& streams = pointCells_.getStreams();
+    const auto createStream = [&](uint32_t elementSize, const void* data) {
+      return Falcor::Buffer::createStructured(
+          elementSize,
+          (uint32_t)pointCells_.getNumPoints(),
+          Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+          Falcor::Buffer::CpuAccess::None,
+          data);
+    };
+
+    gpuPositions_ = createStream(sizeof(Falcor::float3), streams.positions);
+    gpuNormals_ = createStream(sizeof(Falcor::float3), streams.normals);
+    gpuTangents_ = createStream(sizeof(Falcor::float3), streams.tangents);
+    gpuBarycentrics_ = createStream(sizeof(Falcor::float2), streams.barycentrics);
+    gpuInstanceTriangleIDs_ = createStream(sizeof(uint32_t), streams.instanceTriangleIds);
+    gpuInstanceIDs_ = createStream(sizeof(uint32_t), streams.instanceIds);
+    gpuValues_ = createStream(sizeof(float), streams.values);
   }
 
   /*
@@ -361,23 +486,37 @@ void PointServerHashGenerator::generate(
 
   mGPUCellDirtyFlags = Falcor::Buffer::createStructured(
       sizeof(uint32_t),
-      pointCells_.size() / FIXED_POINTS_PER_CELL,
+      numCells_,
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      Falcor::Buffer::CpuAccess::None);
+
+  gpuCellInfos_ = Falcor::Buffer::createStructured(
+      sizeof(Falcor::CellInfo),
+      numCells_,
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      Falcor::Buffer::CpuAccess::None,
+      cellInfos);
+
+  // Each instance has a free list region with one entry per cell of its pool
+  gpuCellFreeList_ = Falcor::Buffer::createStructured(
+      sizeof(uint32_t),
+      numCells_,
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None);
 
   gpuCompressedClientPointCells_ = Falcor::Buffer::createStructured(
       sizeof(Falcor::CompressedClientPointData),
-      compressedClientPointCells_.size(),
+      pointCellsSize_,
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None,
-      compressedClientPointCells_.data());
+      compressedClientPointCells);
 
   gpuPreviousCompressedClientPointCells_ = Falcor::Buffer::createStructured(
       sizeof(Falcor::CompressedClientPointData),
-      compressedClientPointCells_.size(),
+      pointCellsSize_,
       Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
       Falcor::Buffer::CpuAccess::None,
-      compressedClientPointCells_.data());
+      compressedClientPointCells);
 
   gpuInstanceHashInfo_ = Falcor::Buffer::createStructured(
       sizeof(Falcor::InstanceHashInfo),
@@ -394,12 +533,666 @@ void PointServerHashGenerator::generate(
       instancePointInfo_.data());
 
   // Generate point update data and staging buffer
-  const uint32_t kNumMaxUpdates = std::min(4000000000 / sizeof(Falcor::PointUpdateData), pointCells_.size());
+  createPointUpdateBuffers(pointCells_.getNumPoints());
+}
+
+void PointServerHashGenerator::writeBake(
+    BakePackageWriter& writer,
+    NetworkCompressionBase& clientCompression) {
+  TRACE_SCOPE("PointServerHashGenerator::writeBake");
+  const uint32_t hashSizes[] = {hashToPointCellSize_, pointCellsSize_, numCells_};
+  writer.addSection(kBakeHashSizes, hashSizes, sizeof(uint32_t), 3);
+
+  writer.addSection(kBakeInstanceHashInfo, instanceHashInfo_);
+  writer.addSection(kBakeInstancePointInfo, instancePointInfo_);
+  writer.addSection(kBakeInstanceDropStats, instanceDropStats_);
+
+  const auto& streams = pointCells_.getStreams();
+  writer.addSection(kBakePositions, streams.positions, sizeof(Falcor::float3), pointCellsSize_);
+  writer.addSection(kBakeNormals, streams.normals, sizeof(Falcor::float3), pointCellsSize_);
+  writer.addSection(kBakeTangents, streams.tangents, sizeof(Falcor::float3), pointCellsSize_);
+  writer.addSection(
+      kBakeBarycentrics, streams.barycentrics, sizeof(Falcor::float2), pointCellsSize_);
+  writer.addSection(
+      kBakeInstanceTriangleIds, streams.instanceTriangleIds, sizeof(uint32_t), pointCellsSize_);
+  writer.addSection(kBakeInstanceIds, streams.instanceIds, sizeof(uint32_t), pointCellsSize_);
+  writer.addSection(kBakeValues, streams.values, sizeof(float), pointCellsSize_);
+
+  writer.addSection(kBakeCompressedClientPointCells, compressedClientPointCells_);
+  writer.addCompressedSection(
+      kBakeClientSnapshot,
+      compressedClientPointCells_.data(),
+      sizeof(Falcor::CompressedClientPointData),
+      compressedClientPointCells_.size(),
+      clientCompression);
+  writer.addSection(kBakeCompactHashToPointCell, compactHashToPointCell_);
+
+  const void* hashNumBuckets = gpuHashNumBuckets_->map(Falcor::Buffer::MapType::Read);
+  writer.addSection(
+      kBakeHashNumBuckets,
+      hashNumBuckets,
+      sizeof(Falcor::HashNumBuckets),
+      hashToPointCellSize_ / FIXED_HASH_BUCKET_SIZE);
+  gpuHashNumBuckets_->unmap();
+
+  const void* cellInfos = gpuCellInfos_->map(Falcor::Buffer::MapType::Read);
+  writer.addSection(kBakeCellInfos, cellInfos, sizeof(Falcor::CellInfo), numCells_);
+  gpuCellInfos_->unmap();
+}
+
+bool PointServerHashGenerator::loadBake(const BakePackage& package) {
+  TRACE_SCOPE("PointServerHashGenerator::loadBake");
+  size_t numHashSizes = 0;
+  size_t numHashNumBuckets = 0;
+  size_t numCellInfos = 0;
+  const uint32_t* hashSizes = package.getSection<uint32_t>(kBakeHashSizes, numHashSizes);
+  const auto* hashNumBuckets =
+      package.getSection<Falcor::HashNumBuckets>(kBakeHashNumBuckets, numHashNumBuckets);
+  const auto* cellInfos = package.getSection<Falcor::CellInfo>(kBakeCellInfos, numCellInfos);
+  const auto compressedClientPointCells =
+      package.getSectionView<Falcor::CompressedClientPointData>(kBakeCompressedClientPointCells);
+  const auto compactHashToPointCell =
+      package.getSectionView<Falcor::CompactHashToCellInfo>(kBakeCompactHashToPointCell);
+
+  // Only the per instance infos are copied, everything per point or hash entry stays in the
+  // package
+  bool valid = hashSizes && numHashSizes == 3 && hashNumBuckets && cellInfos &&
+      compressedClientPointCells.data() && compactHashToPointCell.data() &&
+      package.readSection(kBakeInstanceHashInfo, instanceHashInfo_) &&
+      package.readSection(kBakeInstancePointInfo, instancePointInfo_) &&
+      package.readSection(kBakeInstanceDropStats, instanceDropStats_);
+
+  if (valid) {
+    hashToPointCellSize_ = hashSizes[0];
+    pointCellsSize_ = hashSizes[1];
+    numCells_ = hashSizes[2];
+    freeHashRegions_.clear();
+    freePointSlotRegions_.clear();
+    freeCellRegions_.clear();
+
+    valid = compactHashToPointCell.size() == hashToPointCellSize_ &&
+        numHashNumBuckets == hashToPointCellSize_ / FIXED_HASH_BUCKET_SIZE &&
+        compressedClientPointCells.size() == pointCellsSize_ && numCellInfos == numCells_ &&
+        instancePointInfo_.size() == instanceHashInfo_.size() && pointCellsSize_ <= MAX_POINT_SLOTS;
+  }
+
+  PointDataStreams streams;
+
+  if (valid) {
+    valid = getPointCellStream(package, kBakePositions, pointCellsSize_, streams.positions) &&
+        getPointCellStream(package, kBakeNormals, pointCellsSize_, streams.normals) &&
+        getPointCellStream(package, kBakeTangents, pointCellsSize_, streams.tangents) &&
+        getPointCellStream(package, kBakeBarycentrics, pointCellsSize_, streams.barycentrics) &&
+        getPointCellStream(
+            package, kBakeInstanceTriangleIds, pointCellsSize_, streams.instanceTriangleIds) &&
+        getPointCellStream(package, kBakeInstanceIds, pointCellsSize_, streams.instanceIds) &&
+        getPointCellStream(package, kBakeValues, pointCellsSize_, streams.values);
+  }
+
+  if (!valid) {
+    std::cout << "bake package is missing the server hash tables" << std::endl;
+    return false;
+  }
+
+  pointCells_.setExternal(pointCellsSize_, streams);
+  compressedClientPointCells_.clear();
+  hashToPointCell_.clear();
+  compactHashToPointCell_.clear();
+  bakeCompressedClientPointCells_ = compressedClientPointCells;
+  bakeCompactHashToPointCell_ = compactHashToPointCell;
+
+  createGPUBuffers(
+      compactHashToPointCell.data(), compressedClientPointCells.data(), hashNumBuckets, cellInfos);
+  return true;
+}
+
+void PointServerHashGenerator::releaseBake() {
+  if (!bakeCompactHashToPointCell_.data())
+    return;
+
+  pointCells_.release();
+  bakeCompressedClientPointCells_ = {};
+  bakeCompactHashToPointCell_ = {};
+}
+
+void PointServerHashGenerator::createPointUpdateBuffers(size_t numPointSlots) {
+  // At most every point moves in a frame. The hot and cold parts are capped separately so that
+  // both have the same number of entries.
+  const size_t kMaxBufferBytes = 4000000000;
+  const uint32_t kNumMaxUpdates = (uint32_t)std::min(
+      {kMaxBufferBytes / sizeof(Falcor::PointUpdateData),
+       kMaxBufferBytes / sizeof(Falcor::PointUpdateColdData),
+       numPointSlots});
+  const auto kBindFlags =
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess;
+
   gpuPointUpdateData_ = Falcor::Buffer::createStructured(
       sizeof(Falcor::PointUpdateData),
       kNumMaxUpdates,
-      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      kBindFlags,
+      Falcor::Buffer::CpuAccess::None);
+  gpuPointUpdateColdData_ = Falcor::Buffer::createStructured(
+      sizeof(Falcor::PointUpdateColdData),
+      kNumMaxUpdates,
+      kBindFlags,
+      Falcor::Buffer::CpuAccess::None);
+}
+
+void PointServerHashGenerator::readBackInstancePointInfo() {
+  TRACE_SCOPE("PointServerHashGenerator::readBackInstancePointInfo");
+  const Falcor::InstancePointInfo* gpuInstancePointInfo =
+      (const Falcor::InstancePointInfo*)gpuInstancePointInfo_->map(Falcor::Buffer::MapType::Read);
+  std::memcpy(
+      instancePointInfo_.data(),
+      gpuInstancePointInfo,
+      instancePointInfo_.size() * sizeof(Falcor::InstancePointInfo));
+  gpuInstancePointInfo_->unmap();
+}
+
+void PointServerHashGenerator::readBackPointSlots(PointDataSoA& pointSlots) {
+  TRACE_SCOPE("PointServerHashGenerator::readBackPointSlots");
+
+  if (pointSlots.getNumPoints() != pointCellsSize_)
+    pointSlots.allocate(pointCellsSize_, PointDataSoA::kPositions | PointDataSoA::kValues);
+
+  const auto& streams = pointSlots.getStreams();
+
+  const Falcor::float3* gpuPositions =
+      (const Falcor::float3*)gpuPositions_->map(Falcor::Buffer::MapType::Read);
+  std::memcpy(streams.positions, gpuPositions, pointCellsSize_ * sizeof(Falcor::float3));
+  gpuPositions_->unmap();
+
+  const float* gpuValues = (const float*)gpuValues_->map(Falcor::Buffer::MapType::Read);
+  std::memcpy(streams.values, gpuValues, pointCellsSize_ * sizeof(float));
+  gpuValues_->unmap();
+}
+
+std::vector<Falcor::CompactHashToCellInfo> PointServerHashGenerator::readBackHashTable() {
+  std::vector<Falcor::CompactHashToCellInfo> hashTable(hashToPointCellSize_);
+
+  const Falcor::CompactHashToCellInfo* gpuHashTable =
+      (const Falcor::CompactHashToCellInfo*)gpuHashToPointCell_->map(
+          Falcor::Buffer::MapType::Read);
+  std::memcpy(
+      hashTable.data(), gpuHashTable, hashTable.size() * sizeof(Falcor::CompactHashToCellInfo));
+  gpuHashToPointCell_->unmap();
+
+  return hashTable;
+}
+
+void PointServerHashGenerator::uploadHashTable(
+    const Falcor::InstanceHashInfo& ihi,
+    const std::vector<Falcor::CompactHashToCellInfo>& hashEntries) {
+  std::vector<Falcor::HashNumBuckets> hashNumBuckets(
+      ihi.hashToBucketSize, Falcor::HashNumBuckets{0});
+  for (uint32_t entryId = 0; entryId < hashEntries.size(); entryId++) {
+    if (hashEntries[entryId].rawCellId != INVALID_CELL)
+      hashNumBuckets[entryId / FIXED_HASH_BUCKET_SIZE].numBuckets++;
+  }
+
+  gpuHashToPointCell_->setBlob(
+      hashEntries.data(),
+      ihi.hashToBucketOffset * sizeof(Falcor::CompactHashToCellInfo),
+      hashEntries.size() * sizeof(Falcor::CompactHashToCellInfo));
+  gpuHashNumBuckets_->setBlob(
+      hashNumBuckets.data(),
+      (ihi.hashToBucketOffset / FIXED_HASH_BUCKET_SIZE) * sizeof(Falcor::HashNumBuckets),
+      hashNumBuckets.size() * sizeof(Falcor::HashNumBuckets));
+}
+
+void PointServerHashGenerator::uploadCellInfos(
+    uint32_t instanceId,
+    const std::vector<Falcor::CompactHashToCellInfo>& hashEntries) {
+  const auto& ihi = instanceHashInfo_[instanceId];
+  const auto& ipi = instancePointInfo_[instanceId];
+
+  std::vector<Falcor::CellInfo> cellInfos(
+      ipi.maxNumPoints / ipi.cellCapacity, Falcor::CellInfo{INVALID_CELL, instanceId});
+
+  for (uint32_t entryId = 0; entryId < hashEntries.size(); entryId++) {
+    const auto& entry = hashEntries[entryId];
+    if (entry.rawCellId == INVALID_CELL || entry.rawCellId == DELETED_CELL ||
+        entry.encodedIndex == INVALID_CELL)
+      continue;
+
+    cellInfos[(entry.encodedIndex & COMPACT_HASH_INDEX_MASK) / ipi.cellCapacity].hashEntry =
+        ihi.hashToBucketOffset + entryId;
+  }
+
+  gpuCellInfos_->setBlob(
+      cellInfos.data(),
+      ipi.cellOffset * sizeof(Falcor::CellInfo),
+      cellInfos.size() * sizeof(Falcor::CellInfo));
+}
+
+void PointServerHashGenerator::invalidatePointSlots(uint32_t offset, uint32_t numPoints) {
+  if (numPoints == 0)
+    return;
+
+  std::vector<float> invalidValues(numPoints, -1.0f);
+  std::vector<Falcor::CompressedClientPointData> invalidPoints(numPoints);
+
+  gpuValues_->setBlob(invalidValues.data(), offset * sizeof(float), numPoints * sizeof(float));
+  gpuCompressedClientPointCells_->setBlob(
+      invalidPoints.data(),
+      offset * sizeof(Falcor::CompressedClientPointData),
+      numPoints * sizeof(Falcor::CompressedClientPointData));
+  gpuPreviousCompressedClientPointCells_->setBlob(
+      invalidPoints.data(),
+      offset * sizeof(Falcor::CompressedClientPointData),
+      numPoints * sizeof(Falcor::CompressedClientPointData));
+}
+
+std::vector<Falcor::Buffer::SharedPtr*> PointServerHashGenerator::getPointSlotBuffers() {
+  return {
+      &gpuPositions_,
+      &gpuNormals_,
+      &gpuTangents_,
+      &gpuBarycentrics_,
+      &gpuInstanceTriangleIDs_,
+      &gpuInstanceIDs_,
+      &gpuValues_,
+      &gpuCompressedClientPointCells_,
+      &gpuPreviousCompressedClientPointCells_};
+}
+
+std::vector<PointServerHashGenerator::InstanceRelocation> PointServerHashGenerator::grow(
+    Falcor::RenderContext* renderContext) {
+  FALCOR_PROFILE("PointServerHashGenerator::grow");
+  TRACE_SCOPE("PointServerHashGenerator::grow");
+
+  struct GrowInfo {
+    uint32_t instanceId;
+    bool growHash;
+    bool rebuildHash;
+    bool growPool;
+  };
+
+  std::vector<GrowInfo> growInfos;
+
+  for (uint32_t instanceId = 0; instanceId < instancePointInfo_.size(); instanceId++) {
+    auto& ipi = instancePointInfo_[instanceId];
+    const auto& ihi = instanceHashInfo_[instanceId];
+
+    const uint32_t numCells = ipi.maxNumPoints / ipi.cellCapacity;
+
+    // Free cells are reused before the pool grows
+    const uint32_t numUsedCells = ipi.numAllocatedCells - std::max(ipi.numFreeCells, 0);
+
+    GrowInfo growInfo = {instanceId, false, false, false};
+    growInfo.growPool =
+        ipi.numPoolOverflows > 0 || numUsedCells >= POOL_GROW_OCCUPANCY * numCells;
+    growInfo.growHash =
+        numUsedCells >= HASH_GROW_LOAD_FACTOR * ihi.hashToBucketSize * FIXED_HASH_BUCKET_SIZE;
+    // Full buckets at a low load are mostly caused by tombstones, rebuilding the table is enough
+    growInfo.rebuildHash = ipi.numBucketOverflows > 0;
+
+    // Point cell indices in the hash table are limited to COMPACT_HASH_INDEX_BITS
+    if (growInfo.growPool && 2 * ipi.maxNumPoints > COMPACT_HASH_INDEX_MASK) {
+      std::cout << "Point cell pool of instance " << instanceId
+                << " can not grow any further, points will be dropped" << std::endl;
+      growInfo.growPool = false;
+    }
+
+    ipi.numBucketOverflows = 0;
+    ipi.numPoolOverflows = 0;
+
+    if (growInfo.growHash || growInfo.rebuildHash || growInfo.growPool)
+      growInfos.push_back(growInfo);
+  }
+
+  if (growInfos.empty()) {
+    return {};
+  }
+
+  const std::vector<Falcor::CompactHashToCellInfo> hashTable = readBackHashTable();
+
+  const uint32_t oldHashToPointCellSize = hashToPointCellSize_;
+  const uint32_t oldPointCellsSize = pointCellsSize_;
+
+  // Cell indices of relocated pools before growing, to move their free lists
+  std::vector<uint32_t> oldCellOffsets(growInfos.size());
+
+  // Regions left behind by the relocations are only released after all of them are copied
+  struct Region {
+    BufferRegionFreeList* freeRegions;
+    uint32_t offset;
+    uint32_t size;
+  };
+  std::vector<Region> releasedRegions;
+
+  // Compute the new layout. Regions are reused or appended in the order of the relocations, and
+  // every relocation carries the buffer sizes after it, which allows the client to grow its
+  // buffers one relocation at a time.
+  std::vector<InstanceRelocation> relocations(growInfos.size());
+  bool movedPools = false;
+
+  for (uint32_t relocationId = 0; relocationId < growInfos.size(); relocationId++) {
+    const auto& growInfo = growInfos[relocationId];
+    auto& relocation = relocations[relocationId];
+    auto& ihi = instanceHashInfo_[growInfo.instanceId];
+    auto& ipi = instancePointInfo_[growInfo.instanceId];
+
+    relocation.info.instanceId = growInfo.instanceId;
+    relocation.info.oldPointCellOffset = ipi.pointCellOffset;
+    relocation.info.oldMaxNumPoints = ipi.maxNumPoints;
+    oldCellOffsets[relocationId] = ipi.cellOffset;
+
+    const Falcor::CompactHashToCellInfo* oldEntries = &hashTable[ihi.hashToBucketOffset];
+    const uint32_t numOldEntries = ihi.hashToBucketSize * FIXED_HASH_BUCKET_SIZE;
+
+    // The table is always rebuilt, which removes tombstones and entries without point cells. If it
+    // keeps its size it stays in place, otherwise it moves to a new region.
+    uint32_t newHashTableSize = growInfo.growHash ? 2 * ihi.hashToBucketSize : ihi.hashToBucketSize;
+
+    // Doubling the size again is very unlikely to be necessary, but the rehash must not lose cells
+    bool rehashed = PointCellGarbageCollector::rehash(
+        oldEntries, numOldEntries, newHashTableSize, ihi.hashType, relocation.hashEntries);
+
+    for (uint32_t doubling = 0; !rehashed && doubling < kMaxRehashDoublings; doubling++) {
+      newHashTableSize *= 2;
+      rehashed = PointCellGarbageCollector::rehash(
+          oldEntries, numOldEntries, newHashTableSize, ihi.hashType, relocation.hashEntries);
+    }
+
+    if (!rehashed) {
+      std::cout << "Hash table of instance " << growInfo.instanceId
+                << " could not be rehashed into " << newHashTableSize
+                << " buckets, keeping the old table" << std::endl;
+      newHashTableSize = ihi.hashToBucketSize;
+      relocation.hashEntries.assign(oldEntries, oldEntries + numOldEntries);
+    }
+
+    if (newHashTableSize != ihi.hashToBucketSize) {
+      releasedRegions.push_back({&freeHashRegions_, ihi.hashToBucketOffset, numOldEntries});
+      ihi.hashToBucketOffset = allocateRegion(
+          freeHashRegions_, hashToPointCellSize_, newHashTableSize * FIXED_HASH_BUCKET_SIZE);
+      ihi.hashToBucketSize = newHashTableSize;
+    }
+
+    if (growInfo.growPool) {
+      // Cell indices are relative to the instance, so the pool is copied as is
+      const uint32_t numCells = ipi.maxNumPoints / ipi.cellCapacity;
+      const uint32_t newPointCellOffset =
+          allocateRegion(freePointSlotRegions_, pointCellsSize_, 2 * ipi.maxNumPoints);
+
+      if (pointCellsSize_ > MAX_POINT_SLOTS) {
+        // Only a region appended to the end can exceed the limit, so this undoes the allocation
+        pointCellsSize_ = newPointCellOffset;
+        std::cout << "Point cell pool of instance " << growInfo.instanceId
+                  << " can not grow any further, cell updates only address " << MAX_POINT_SLOTS
+                  << " point slots" << std::endl;
+      } else {
+        releasedRegions.push_back({&freePointSlotRegions_, ipi.pointCellOffset, ipi.maxNumPoints});
+        releasedRegions.push_back({&freeCellRegions_, ipi.cellOffset, numCells});
+
+        ipi.maxNumPoints *= 2;
+        ipi.pointCellOffset = newPointCellOffset;
+        ipi.cellOffset = allocateRegion(freeCellRegions_, numCells_, 2 * numCells);
+        movedPools = true;
+      }
+    }
+
+    relocation.info.totalHashEntries = hashToPointCellSize_;
+    relocation.info.totalPointSlots = pointCellsSize_;
+    relocation.info.numHashEntries = (uint32_t)relocation.hashEntries.size();
+    relocation.info.ihi = ihi;
+    relocation.info.ipi = ipi;
+  }
+
+  const auto kBindFlags =
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess;
+
+  // Creates a larger buffer with the old contents at the start. The old buffer is returned so
+  // regions can be copied from it.
+  const auto growBuffer = [&](Falcor::Buffer::SharedPtr& buffer, uint32_t newElementCount) {
+    Falcor::Buffer::SharedPtr oldBuffer = buffer;
+
+    if (newElementCount > oldBuffer->getElementCount()) {
+      buffer = Falcor::Buffer::createStructured(
+          oldBuffer->getStructSize(),
+          newElementCount,
+          kBindFlags,
+          Falcor::Buffer::CpuAccess::None);
+      renderContext->copyBufferRegion(buffer.get(), 0, oldBuffer.get(), 0, oldBuffer->getSize());
+    }
+
+    return oldBuffer;
+  };
+
+  // A region that moves within a buffer that did not grow can't be copied directly, a buffer
+  // can't be the source and destination of a copy at the same time
+  Falcor::Buffer::SharedPtr scratch;
+  const auto copyRegion = [&](Falcor::Buffer* dst,
+                              uint64_t dstOffset,
+                              Falcor::Buffer* src,
+                              uint64_t srcOffset,
+                              uint64_t size) {
+    if (dst != src) {
+      renderContext->copyBufferRegion(dst, dstOffset, src, srcOffset, size);
+      return;
+    }
+
+    if (!scratch || scratch->getSize() < size) {
+      scratch = Falcor::Buffer::create(
+          size, Falcor::ResourceBindFlags::None, Falcor::Buffer::CpuAccess::None);
+    }
+
+    renderContext->copyBufferRegion(scratch.get(), 0, src, srcOffset, size);
+    renderContext->copyBufferRegion(dst, dstOffset, scratch.get(), 0, size);
+  };
+
+  // Hash table: write the (rehashed) regions and recompute the number of used bucket entries
+  growBuffer(gpuHashToPointCell_, hashToPointCellSize_);
+  growBuffer(gpuHashNumBuckets_, hashToPointCellSize_ / FIXED_HASH_BUCKET_SIZE);
+
+  for (const auto& relocation : relocations) {
+    uploadHashTable(relocation.info.ihi, relocation.hashEntries);
+  }
+
+  // Point cells: copy the pools of relocated instances into their new region and invalidate the
+  // rest of the new region as well as the old region (which is never referenced again)
+  if (movedPools) {
+    for (Falcor::Buffer::SharedPtr* stream : getPointSlotBuffers()) {
+      auto oldStream = growBuffer(*stream, pointCellsSize_);
+      const uint32_t elementSize = oldStream->getStructSize();
+
+      for (const auto& relocation : relocations) {
+        if (relocation.info.ipi.pointCellOffset == relocation.info.oldPointCellOffset)
+          continue;
+
+        copyRegion(
+            stream->get(),
+            (uint64_t)relocation.info.ipi.pointCellOffset * elementSize,
+            oldStream.get(),
+            (uint64_t)relocation.info.oldPointCellOffset * elementSize,
+            (uint64_t)relocation.info.oldMaxNumPoints * elementSize);
+      }
+    }
+
+    // Free lists are relative to the instance as well
+    growBuffer(gpuCellInfos_, numCells_);
+    auto oldCellFreeList = growBuffer(gpuCellFreeList_, numCells_);
+
+    for (uint32_t relocationId = 0; relocationId < relocations.size(); relocationId++) {
+      const auto& info = relocations[relocationId].info;
+      if (info.ipi.pointCellOffset == info.oldPointCellOffset)
+        continue;
+
+      if (info.ipi.numFreeCells > 0) {
+        copyRegion(
+            gpuCellFreeList_.get(),
+            info.ipi.cellOffset * sizeof(uint32_t),
+            oldCellFreeList.get(),
+            oldCellOffsets[relocationId] * sizeof(uint32_t),
+            info.ipi.numFreeCells * sizeof(uint32_t));
+      }
+
+      invalidatePointSlots(info.oldPointCellOffset, info.oldMaxNumPoints);
+      invalidatePointSlots(
+          info.ipi.pointCellOffset + info.oldMaxNumPoints,
+          info.ipi.maxNumPoints - info.oldMaxNumPoints);
+    }
+
+    // All cells are clean between frames
+    if (numCells_ > mGPUCellDirtyFlags->getElementCount()) {
+      mGPUCellDirtyFlags = Falcor::Buffer::createStructured(
+          sizeof(uint32_t), numCells_, kBindFlags, Falcor::Buffer::CpuAccess::None);
+      std::vector<uint32_t> cleanFlags(numCells_, CELL_NOT_DIRTY);
+      mGPUCellDirtyFlags->setBlob(cleanFlags.data(), 0, cleanFlags.size() * sizeof(uint32_t));
+    }
+
+    if (pointCellsSize_ > oldPointCellsSize)
+      createPointUpdateBuffers(pointCellsSize_);
+  }
+
+  for (const auto& region : releasedRegions) {
+    region.freeRegions->release(region.offset, region.size);
+  }
+
+  // Hash entries (and possibly cells) moved, so the cells need to know their new entries
+  for (const auto& relocation : relocations) {
+    uploadCellInfos(relocation.info.instanceId, relocation.hashEntries);
+  }
+
+  gpuInstanceHashInfo_->setBlob(
+      instanceHashInfo_.data(), 0, instanceHashInfo_.size() * sizeof(Falcor::InstanceHashInfo));
+  gpuInstancePointInfo_->setBlob(
+      instancePointInfo_.data(), 0, instancePointInfo_.size() * sizeof(Falcor::InstancePointInfo));
+
+  std::cout << "Grew " << relocations.size() << " instance(s), hash table entries: "
+            << oldHashToPointCellSize << " -> " << hashToPointCellSize_
+            << ", point slots: " << oldPointCellsSize << " -> " << pointCellsSize_
+            << ", released point slots: " << freePointSlotRegions_.getNumFreeElements()
+            << std::endl;
+
+  return relocations;
+}
+
+std::vector<PointServerHashGenerator::InstanceCellRemap> PointServerHashGenerator::compact(
+    Falcor::RenderContext* renderContext) {
+  FALCOR_PROFILE("PointServerHashGenerator::compact");
+  TRACE_SCOPE("PointServerHashGenerator::compact");
+
+  std::vector<uint32_t> instanceIds;
+  for (uint32_t instanceId = 0; instanceId < instancePointInfo_.size(); instanceId++) {
+    if (PointCellGarbageCollector::needsCompaction(instancePointInfo_[instanceId]))
+      instanceIds.push_back(instanceId);
+  }
+
+  if (instanceIds.empty()) {
+    return {};
+  }
+
+  const std::vector<Falcor::CompactHashToCellInfo> hashTable = readBackHashTable();
+
+  std::vector<PointCellGarbageCollector::Compaction> compactions(instanceIds.size());
+  std::vector<uint32_t> compactionIds(instanceIds.size());
+  std::iota(compactionIds.begin(), compactionIds.end(), 0);
+
+  std::for_each(
+      std::execution::par,
+      compactionIds.begin(),
+      compactionIds.end(),
+      [&](uint32_t& compactionId) {
+        const uint32_t instanceId = instanceIds[compactionId];
+        const auto& ihi = instanceHashInfo_[instanceId];
+
+        compactions[compactionId] = PointCellGarbageCollector::compact(
+            &hashTable[ihi.hashToBucketOffset],
+            ihi.hashToBucketSize,
+            ihi.hashType,
+            instancePointInfo_[instanceId].cellCapacity,
+            instancePointInfo_[instanceId].numAllocatedCells);
+      });
+
+  // Runs are moved towards the front, but may overlap their old location, so the allocated part
+  // of the pool is staged in a scratch buffer first
+  uint32_t maxNumPoints = 0;
+  for (uint32_t instanceId : instanceIds) {
+    const auto& ipi = instancePointInfo_[instanceId];
+    maxNumPoints = std::max(maxNumPoints, ipi.numAllocatedCells * ipi.cellCapacity);
+  }
+
+  const auto pointSlotBuffers = getPointSlotBuffers();
+
+  uint32_t maxElementSize = 0;
+  for (Falcor::Buffer::SharedPtr* stream : pointSlotBuffers) {
+    maxElementSize = std::max(maxElementSize, (*stream)->getStructSize());
+  }
+
+  Falcor::Buffer::SharedPtr scratch = Falcor::Buffer::create(
+      (size_t)maxNumPoints * maxElementSize,
+      Falcor::ResourceBindFlags::None,
       Falcor::Buffer::CpuAccess::None);
+
+  std::vector<InstanceCellRemap> remaps(instanceIds.size());
+  uint32_t numMovedCells = 0;
+
+  for (uint32_t compactionId = 0; compactionId < instanceIds.size(); compactionId++) {
+    const uint32_t instanceId = instanceIds[compactionId];
+    const auto& compaction = compactions[compactionId];
+    const auto& ihi = instanceHashInfo_[instanceId];
+    auto& ipi = instancePointInfo_[instanceId];
+
+    for (Falcor::Buffer::SharedPtr* stream : pointSlotBuffers) {
+      const uint32_t elementSize = (*stream)->getStructSize();
+      const uint32_t cellSize = elementSize * ipi.cellCapacity;
+
+      renderContext->copyBufferRegion(
+          scratch.get(),
+          0,
+          stream->get(),
+          (uint64_t)ipi.pointCellOffset * elementSize,
+          (uint64_t)ipi.numAllocatedCells * cellSize);
+
+      for (const auto& run : compaction.runs) {
+        if (run.oldCell == run.newCell)
+          continue;
+
+        renderContext->copyBufferRegion(
+            stream->get(),
+            (uint64_t)ipi.pointCellOffset * elementSize + (uint64_t)run.newCell * cellSize,
+            scratch.get(),
+            (uint64_t)run.oldCell * cellSize,
+            (uint64_t)run.numCells * cellSize);
+      }
+    }
+
+    for (const auto& run : compaction.runs) {
+      if (run.oldCell != run.newCell)
+        numMovedCells += run.numCells;
+    }
+
+    invalidatePointSlots(
+        ipi.pointCellOffset + compaction.numAllocatedCells * ipi.cellCapacity,
+        (ipi.numAllocatedCells - compaction.numAllocatedCells) * ipi.cellCapacity);
+
+    auto& remap = remaps[compactionId];
+    remap.info.instanceId = instanceId;
+    remap.info.pointCellOffset = ipi.pointCellOffset;
+    remap.info.hashToBucketOffset = ihi.hashToBucketOffset;
+    remap.info.numHashEntries = ihi.hashToBucketSize * FIXED_HASH_BUCKET_SIZE;
+    remap.info.oldNumAllocatedCells = ipi.numAllocatedCells;
+    remap.info.newNumAllocatedCells = compaction.numAllocatedCells;
+    remap.info.numRuns = (uint32_t)compaction.runs.size();
+    remap.info.cellCapacity = ipi.cellCapacity;
+    remap.runs = compaction.runs;
+
+    ipi.numAllocatedCells = compaction.numAllocatedCells;
+    ipi.numFreeCells = 0;
+
+    uploadHashTable(ihi, compaction.hashEntries);
+    uploadCellInfos(instanceId, compaction.hashEntries);
+  }
+
+  gpuInstancePointInfo_->setBlob(
+      instancePointInfo_.data(), 0, instancePointInfo_.size() * sizeof(Falcor::InstancePointInfo));
+
+  std::cout << "Compacted " << remaps.size() << " instance(s), moved " << numMovedCells
+            << " point cells" << std::endl;
+
+  return remaps;
 }
 
 } // namespace split_rendering
@@ -9,9 +9,12 @@
 #pragma once
 
 #include <Falcor.h>
+#include "BakePackage.h"
 #include "HashFunctionShared.slang"
 #include "MeshPointGenerator.h"
+#include "PointCellGarbageCollector.h"
 #include "PointData.slang"
+#include "PointDataSoA.h"
 
 namespace split_rendering {
 
@@ -25,9 +28,82 @@ namespace split_rendering {
 // relevant in the future.
 class PointServerHashGenerator {
  public:
+  // Points that could not be inserted during generation, per instance
+  struct InstanceDropStats {
+    uint32_t bucketFull = 0; // all entries of the hash bucket were taken by other cells
+    uint32_t cellFull = 0; // the point cell already held cellCapacity points
+    uint32_t poolFull = 0; // the instance ran out of preallocated point cells
+  };
+
+  // An instance whose hash table and/or point cells were moved into a new region by grow()
+  struct InstanceRelocation {
+    Falcor::InstanceRelocationInfo info;
+    // The instance's full hash table after the relocation
+    std::vector<Falcor::CompactHashToCellInfo> hashEntries;
+  };
+
+  // An instance whose point cells were compacted by compact()
+  struct InstanceCellRemap {
+    Falcor::InstanceCellRemapInfo info;
+    std::vector<Falcor::CellRemapRun> runs;
+  };
+
   // Generates linearized kd-tree buffers for use in shaders
   void generate(Falcor::Scene::SharedPtr& scene, const MeshPointGenerator& pointGen);
 
+  // Stores the generated hash tables and point cells in a bake package, the client snapshot
+  // (compressed client point cells) is also stored compressed with clientCompression so it can be
+  // sent as is. Must be called right after generate(), before any frame changed the GPU state.
+  void writeBake(BakePackageWriter& writer, NetworkCompressionBase& clientCompression);
+
+  // Restores the state after generate() from a bake package and uploads it, returns false if
+  // sections are missing or don't fit together. The large sections are uploaded from the mapped
+  // package and only viewed on the CPU, so the package has to stay open until releaseBake().
+  bool loadBake(const BakePackage& package);
+
+  // Drops the views of the bake package, call before closing it
+  void releaseBake();
+
+  // Copies the cell counters of all instances (allocations, free lists, overflows), which are
+  // only tracked on the GPU, into the host copy. This waits for the GPU, so callers only check the
+  // occupancy every few frames. grow() and compact() work on this copy, so it has to be read back
+  // right before them.
+  void readBackInstancePointInfo();
+
+  // Copies the positions and values of all point slots, which the rayGen pass moves on the GPU,
+  // into pointSlots (the other streams are not allocated). Waits for the GPU like
+  // readBackInstancePointInfo().
+  void readBackPointSlots(PointDataSoA& pointSlots);
+
+  // Checks the occupancy of every instance and doubles the hash table (rehashing all
+  // cells) and/or the point cell pool of instances above POOL_GROW_OCCUPANCY or
+  // HASH_GROW_LOAD_FACTOR, or with deferred points. Grown instances are moved into a region that
+  // an earlier grow() released or into a new region at the end of the buffers, so other instances
+  // and their offsets are unaffected. Must be called between frames, i.e. not while cell updates
+  // are pending.
+  //
+  // Returns one relocation per grown instance (in order), which the client applies to mirror the
+  // new layout.
+  std::vector<InstanceRelocation> grow(Falcor::RenderContext* renderContext);
+
+  // Moves the live point cells of instances with many free cells (see
+  // PointCellGarbageCollector::needsCompaction) to the front of their pool, rebuilds their hash
+  // tables without tombstones and clears their free lists. Same restrictions as grow().
+  //
+  // Returns the cell moves of every compacted instance for the client.
+  std::vector<InstanceCellRemap> compact(Falcor::RenderContext* renderContext);
+
+  // Number of hash buckets (power of two) for an instance with numSamples points
+  static uint32_t getHashTableSize(uint32_t numSamples, int log2SizeFactor = HASH_LOG2_SIZE_FACTOR);
+
+  // Smallest cell capacity class (in points) that keeps CELL_CAPACITY_POINT_COVERAGE of the points,
+  // given the number of points of every occupied cell
+  static uint32_t selectCellCapacity(const std::vector<uint32_t>& numPointsPerCell);
+
+  // Hash function actually used for an instance, falls back to HASH_TYPE_XORSHIFT if the grid is
+  // too large for unique Morton codes
+  static int getInstanceHashType(int requestedHashType, const Falcor::uint3& gridDim);
+
   Falcor::Buffer::SharedPtr& getGPUHashToPointCell() {
     return gpuHashToPointCell_;
   }
@@ -60,10 +136,22 @@ class PointServerHashGenerator {
     return gpuPointUpdateData_;
   }
 
+  Falcor::Buffer::SharedPtr& getGPUPointUpdateColdData() {
+    return gpuPointUpdateColdData_;
+  }
+
   Falcor::Buffer::SharedPtr& getGPUCellDirtyFlags() {
     return mGPUCellDirtyFlags;
   }
 
+  Falcor::Buffer::SharedPtr& getGPUCellInfos() {
+    return gpuCellInfos_;
+  }
+
+  Falcor::Buffer::SharedPtr& getGPUCellFreeList() {
+    return gpuCellFreeList_;
+  }
+
   std::vector<Falcor::InstancePointInfo>& getCPUInstancePointInfo() {
     return instancePointInfo_;
   }
@@ -72,22 +160,57 @@ class PointServerHashGenerator {
     return instanceHashInfo_;
   }
 
-  std::vector<Falcor::PointData>& getCPUPointCells() {
+  // Current size of the GPU point cell buffers, the CPU copies below keep the size after
+  // generation
+  uint32_t getNumPointSlots() const {
+    return pointCellsSize_;
+  }
+
+  // Current size of the GPU hash table
+  uint32_t getNumHashEntries() const {
+    return hashToPointCellSize_;
+  }
+
+  // Current number of point cells of all instances, i.e. the size of the per cell GPU buffers
+  uint32_t getNumCells() const {
+    return numCells_;
+  }
+
+  // Point slots as the same streams as on the GPU. After loadBake(), the streams are the sections
+  // of the bake package until releaseBake().
+  const PointDataSoA& getCPUPointCells() const {
     return pointCells_;
   }
 
-  std::vector<Falcor::CompressedClientPointData>& getCPUCompressedClientPointCells() {
-    return compressedClientPointCells_;
+  // The compressed client point cells and the compact hash table as sent to the client during
+  // init, also views of the bake package after loadBake()
+  ConstArrayView<Falcor::CompressedClientPointData> getCPUCompressedClientPointCells() const {
+    return bakeCompressedClientPointCells_.data()
+        ? bakeCompressedClientPointCells_
+        : ConstArrayView<Falcor::CompressedClientPointData>(compressedClientPointCells_);
   }
 
+  // Only after generate(), loadBake() doesn't need the full hash table
   std::vector<Falcor::HashToCellInfo>& getCPUHashToPointCell() {
     return hashToPointCell_;
   }
 
-  std::vector<Falcor::CompactHashToCellInfo>& getCPUCompactHashToPointCell() {
-    return compactHashToPointCell_;
+  ConstArrayView<Falcor::CompactHashToCellInfo> getCPUCompactHashToPointCell() const {
+    return bakeCompactHashToPointCell_.data()
+        ? bakeCompactHashToPointCell_
+        : ConstArrayView<Falcor::CompactHashToCellInfo>(compactHashToPointCell_);
+  }
+
+  const std::vector<InstanceDropStats>& getInstanceDropStats() const {
+    return instanceDropStats_;
   }
 
+  // HASH_TYPE_* used for all instances, can be analyzed with HashTableAnalysis
+  int hashType_ = HASH_TYPE_LINEAR;
+
+  // Cell capacity class used for all instances, -1 picks one per instance (selectCellCapacity)
+  int cellCapacityClass_ = -1;
+
   Falcor::Buffer::SharedPtr gpuPositions_;
   Falcor::Buffer::SharedPtr gpuNormals_;
   Falcor::Buffer::SharedPtr gpuTangents_;
@@ -97,6 +220,37 @@ class PointServerHashGenerator {
   Falcor::Buffer::SharedPtr gpuValues_;
 
  private:
+  // Returns a copy of the compact hash table of all instances on the GPU (between frames only)
+  std::vector<Falcor::CompactHashToCellInfo> readBackHashTable();
+
+  // Creates all GPU buffers from the CPU copies after generation or the sections of a bake
+  // package, with pointCells_ as the point slots. The number of used entries per hash bucket and
+  // the cell infos have no CPU copy, they are only tracked on the GPU afterwards.
+  void createGPUBuffers(
+      const Falcor::CompactHashToCellInfo* compactHashToPointCell,
+      const Falcor::CompressedClientPointData* compressedClientPointCells,
+      const Falcor::HashNumBuckets* hashNumBuckets,
+      const Falcor::CellInfo* cellInfos);
+
+  // Update buffers of the points moving in a frame (PointRTAO -> PointCellAllocationStage)
+  void createPointUpdateBuffers(size_t numPointSlots);
+
+  // Writes an instance's hash table and the matching number of used entries per bucket
+  void uploadHashTable(
+      const Falcor::InstanceHashInfo& ihi,
+      const std::vector<Falcor::CompactHashToCellInfo>& hashEntries);
+
+  // Rebuilds the cell infos of an instance's pool from its hash table
+  void uploadCellInfos(
+      uint32_t instanceId,
+      const std::vector<Falcor::CompactHashToCellInfo>& hashEntries);
+
+  // Marks point slots as empty on the server and for the compressed client data
+  void invalidatePointSlots(uint32_t offset, uint32_t numPoints);
+
+  // All buffers with one element per point slot
+  std::vector<Falcor::Buffer::SharedPtr*> getPointSlotBuffers();
+
   Falcor::Buffer::SharedPtr gpuHashToPointCell_;
   Falcor::Buffer::SharedPtr gpuHashNumBuckets_;
   Falcor::Buffer::SharedPtr gpuInstanceHashInfo_;
@@ -119,16 +273,29 @@ class PointServerHashGenerator {
   Falcor::Buffer::SharedPtr gpuCompressedClientPointCells_;
   Falcor::Buffer::SharedPtr gpuPreviousCompressedClientPointCells_;
   Falcor::Buffer::SharedPtr gpuPointUpdateData_;
+  Falcor::Buffer::SharedPtr gpuPointUpdateColdData_;
   Falcor::Buffer::SharedPtr mGPUCellDirtyFlags;
+  Falcor::Buffer::SharedPtr gpuCellInfos_;
+  Falcor::Buffer::SharedPtr gpuCellFreeList_;
   std::vector<Falcor::InstanceHashInfo> instanceHashInfo_;
   std::vector<Falcor::InstancePointInfo> instancePointInfo_;
-  std::vector<Falcor::PointData> pointCells_;
+  PointDataSoA pointCells_;
   std::vector<Falcor::CompressedClientPointData> compressedClientPointCells_;
   std::vector<Falcor::HashToCellInfo> hashToPointCell_;
   std::vector<Falcor::CompactHashToCellInfo> compactHashToPointCell_;
+  // Used instead of the two vectors above after loadBake()
+  ConstArrayView<Falcor::CompressedClientPointData> bakeCompressedClientPointCells_;
+  ConstArrayView<Falcor::CompactHashToCellInfo> bakeCompactHashToPointCell_;
+  std::vector<InstanceDropStats> instanceDropStats_;
 
   uint32_t hashToPointCellSize_ = 0;
   uint32_t pointCellsSize_ = 0;
+  uint32_t numCells_ = 0;
+
+  // Regions of moved hash tables, point slots and cells, reused by later calls of grow()
+  BufferRegionFreeList freeHashRegions_;
+  BufferRegionFreeList freePointSlotRegions_;
+  BufferRegionFreeList freeCellRegions_;
 };
 
 } // namespace split_rendering
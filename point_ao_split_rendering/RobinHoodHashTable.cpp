@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "RobinHoodHashTable.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace split_rendering {
+
+void RobinHoodHashTable::init(uint32_t hashTableSize, int hashType) {
+  hashType_ = hashType;
+  numCells_ = 0;
+  maxProbeDistance_ = 0;
+  entries_.assign(hashTableSize, {});
+}
+
+uint32_t RobinHoodHashTable::getHashTableSize(uint32_t numCells) {
+  const uint32_t minNumSlots =
+      (uint32_t)std::ceil(std::max(numCells, 1u) / ROBIN_HOOD_MAX_LOAD_FACTOR);
+  return std::max((uint32_t)1 << (uint32_t)std::ceil(std::log2(minNumSlots)), 2u);
+}
+
+bool RobinHoodHashTable::insert(uint32_t rawCellId, uint32_t encodedIndex) {
+  const uint32_t hashTableSize = getHashTableSize();
+
+  Falcor::CompactHashToCellInfo entry;
+  entry.rawCellId = rawCellId;
+  entry.encodedIndex = encodedIndex;
+
+  uint32_t slot = getHomeSlot(rawCellId);
+  uint32_t distance = 0;
+
+  for (uint32_t numProbes = 0; numProbes < hashTableSize; numProbes++) {
+    auto& resident = entries_[slot];
+
+    if (resident.rawCellId == INVALID_CELL) {
+      resident = entry;
+      numCells_++;
+      maxProbeDistance_ = std::max(maxProbeDistance_, distance);
+      return true;
+    }
+
+    // Only possible before the first swap, the entry we started with is the one being updated
+    if (resident.rawCellId == entry.rawCellId) {
+      resident.encodedIndex = entry.encodedIndex;
+      return true;
+    }
+
+    const uint32_t residentDistance =
+        Falcor::getProbeDistance(slot, getHomeSlot(resident.rawCellId), hashTableSize);
+
+    // Take the slot from entries that are closer to their home slot and continue with them
+    if (residentDistance < distance) {
+      maxProbeDistance_ = std::max(maxProbeDistance_, distance);
+      std::swap(resident, entry);
+      distance = residentDistance;
+    }
+
+    slot = (slot + 1) & (hashTableSize - 1);
+    distance++;
+  }
+
+  return false;
+}
+
+int RobinHoodHashTable::find(uint32_t rawCellId, uint32_t& numProbes) const {
+  const uint32_t hashTableSize = getHashTableSize();
+
+  uint32_t slot = getHomeSlot(rawCellId);
+  numProbes = 0;
+
+  for (uint32_t distance = 0; distance <= maxProbeDistance_; distance++) {
+    const auto& entry = entries_[slot];
+    numProbes++;
+
+    if (entry.rawCellId == rawCellId)
+      return (int)slot;
+
+    // rawCellId would have displaced this entry if it was in the table
+    if (entry.rawCellId == INVALID_CELL ||
+        Falcor::getProbeDistance(slot, getHomeSlot(entry.rawCellId), hashTableSize) < distance)
+      return -1;
+
+    slot = (slot + 1) & (hashTableSize - 1);
+  }
+
+  return -1;
+}
+
+bool RobinHoodHashTable::erase(uint32_t rawCellId) {
+  const int foundSlot = find(rawCellId);
+
+  if (foundSlot < 0)
+    return false;
+
+  const uint32_t hashTableSize = getHashTableSize();
+
+  // Shift the following entries back by one slot until an empty slot or an entry in its home slot
+  uint32_t slot = (uint32_t)foundSlot;
+  uint32_t nextSlot = (slot + 1) & (hashTableSize - 1);
+
+  while (entries_[nextSlot].rawCellId != INVALID_CELL &&
+         Falcor::getProbeDistance(
+             nextSlot, getHomeSlot(entries_[nextSlot].rawCellId), hashTableSize) > 0) {
+    entries_[slot] = entries_[nextSlot];
+    slot = nextSlot;
+    nextSlot = (nextSlot + 1) & (hashTableSize - 1);
+  }
+
+  entries_[slot] = {};
+  numCells_--;
+
+  return true;
+}
+
+} // namespace split_rendering
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <Falcor.h>
+#include <vector>
+#include "HashFunctionShared.slang"
+#include "PointData.slang"
+
+namespace split_rendering {
+
+// Open addressing hash table from raw cell ids to point cells with Robin-Hood insertion, as an
+// alternative to the bucket layout of PointServerHashGenerator. Each cell has a home slot
+// (getHashBase) and is stored at the first free slot after it. When an inserted entry is further
+// from its home slot than the entry it probes, the two are swapped and the displaced entry keeps
+// probing. This keeps the probe lengths short and even at high load factors, and lookups can stop
+// at the first entry that is closer to its home slot than the current probe distance.
+//
+// Entries are removed by shifting the following entries back, so there are no tombstones.
+//
+// This is a host-only model for HashTableAnalysis::benchmarkLayouts. The server, the shaders and
+// the client always use the bucket layout, so switching would also need a GPU insertion (the
+// displacement isn't a single atomic) and a new client lookup.
+class RobinHoodHashTable {
+ public:
+  void init(uint32_t hashTableSize, int hashType);
+
+  // Smallest power of two table size that holds numCells at ROBIN_HOOD_MAX_LOAD_FACTOR
+  static uint32_t getHashTableSize(uint32_t numCells);
+
+  // Inserts or updates the entry of rawCellId. Returns false if the table is full.
+  bool insert(uint32_t rawCellId, uint32_t encodedIndex);
+
+  // Slot of rawCellId or -1, numProbes is the number of slots visited
+  int find(uint32_t rawCellId, uint32_t& numProbes) const;
+
+  int find(uint32_t rawCellId) const {
+    uint32_t numProbes = 0;
+    return find(rawCellId, numProbes);
+  }
+
+  // Returns false if rawCellId is not in the table
+  bool erase(uint32_t rawCellId);
+
+  const std::vector<Falcor::CompactHashToCellInfo>& getEntries() const {
+    return entries_;
+  }
+
+  uint32_t getHashTableSize() const {
+    return (uint32_t)entries_.size();
+  }
+
+  uint32_t getNumCells() const {
+    return numCells_;
+  }
+
+  // Upper bound of the slots visited by any lookup since init()
+  uint32_t getMaxProbeLength() const {
+    return maxProbeDistance_ + 1;
+  }
+
+ private:
+  uint32_t getHomeSlot(uint32_t rawCellId) const {
+    return Falcor::getHashBase(rawCellId, getHashTableSize(), hashType_);
+  }
+
+  int hashType_ = HASH_TYPE_LINEAR;
+  uint32_t numCells_ = 0;
+  uint32_t maxProbeDistance_ = 0;
+  std::vector<Falcor::CompactHashToCellInfo> entries_;
+};
+
+} // namespace split_rendering
@@ -52,9 +52,17 @@ int main(int argc, char** argv) {
       .default_value("test_scenes/arcade_with_animated_things.pyscene");
 
   args.add_argument("--camera_path")
-      .help("path to a camera trajectory (.bin) file")
+      .help("path to a camera path (CameraPath.h, or a legacy .bin with one matrix per frame)")
       .default_value("");
 
+  args.add_argument("--convert_camera_path")
+      .help("writes a legacy --camera_path in the current camera path format to this file")
+      .default_value(std::string(""));
+
+  args.add_argument("--record_camera_path")
+      .help("records the camera of every frame and writes it as a camera path to this file on exit")
+      .default_value(std::string(""));
+
   args.add_argument("--selected_renderer")
       .help("which renderer to select (PBAO, RTAO, SSAO)")
       .default_value("PBAO");
@@ -102,6 +110,70 @@ int main(int argc, char** argv) {
       .help("minSamplesPerInstance")
       .default_value(1024)
       .scan<'d', int>();
+  args.add_argument("--hash_type")
+      .help("hash function for the server hash tables (linear, morton, xorshift)")
+      .default_value("linear");
+  args.add_argument("--cell_capacity")
+      .help("points per point cell for all instances (3, 7, 15), auto picks one per instance")
+      .default_value("auto");
+  args.add_argument("--occupancy_check_interval")
+      .help("frames between checks whether hash tables / point cell pools need to grow or compact")
+      .default_value(30)
+      .scan<'d', int>();
+  args.add_argument("--kd_tree_refit_interval")
+      .help("frames between refits of the point kd-trees, 0 only builds them for a --bake_package")
+      .default_value(0)
+      .scan<'d', int>();
+  args.add_argument("--analyze_hash")
+      .help("whether or not to write a hash table analysis of all hash functions to the output dir")
+      .default_value(false)
+      .implicit_value(true);
+  args.add_argument("--benchmark_point_encodings")
+      .help("whether or not to write a comparison of all point encodings to the output dir")
+      .default_value(false)
+      .implicit_value(true);
+  args.add_argument("--metrics_format")
+      .help("file format of the per-frame metrics in the output dir (csv, binary)")
+      .default_value("csv");
+  args.add_argument("--trace")
+      .help("whether or not to write a chrome://tracing/Perfetto trace to the output dir")
+      .default_value(false)
+      .implicit_value(true);
+  args.add_argument("--flip_workers")
+      .help("threads that evaluate FLIP of automated screenshots, 0 evaluates on the render thread")
+      .default_value(2)
+      .scan<'d', int>();
+  args.add_argument("--sweep_config")
+      .help("JSON file with the automated screenshot sweep, started after loading or with '='")
+      .default_value(std::string(""));
+  args.add_argument("--exit_after_sweep")
+      .help("whether or not to exit after the automated screenshot sweep is done")
+      .default_value(false)
+      .implicit_value(true);
+  args.add_argument("--export_image_buffers")
+      .help("frames that --export_images buffers for encoding before the frame loop waits")
+      .default_value(8)
+      .scan<'d', int>();
+  args.add_argument("--export_image_workers")
+      .help("threads that encode the --export_images frames, 0 encodes on the render thread")
+      .default_value(2)
+      .scan<'d', int>();
+  args.add_argument("--bake_package")
+      .help("package with the point structures, loaded if it matches the scene and settings or "
+            "written after generating them")
+      .default_value(std::string(""));
+  args.add_argument("--record_update_stream")
+      .help("writes the cell and hash updates of the first --record_frames frames to this file for "
+            "AOQualityHarness, disables growing/compacting the point structures")
+      .default_value(std::string(""));
+  args.add_argument("--record_frames")
+      .help("frames that --record_update_stream records")
+      .default_value(300)
+      .scan<'d', int>();
+  args.add_argument("--bake")
+      .help("whether or not to only write the --bake_package and exit")
+      .default_value(false)
+      .implicit_value(true);
   args.add_argument("--width")
       .help("window/framebuffer width")
       .default_value(1920)
@@ -141,6 +213,10 @@ int main(int argc, char** argv) {
   falcorSampleConfig.windowDesc.width = args.get<int>("--width");
   falcorSampleConfig.windowDesc.height = args.get<int>("--height");
 
+  // Baking only needs the device, it exits before the first frame is presented
+  if (args.get<bool>("--bake"))
+    falcorSampleConfig.windowDesc.mode = Window::WindowMode::Minimized;
+
   // falcorSampleConfig.stereo = true;
   // server.startThreads();
 
@@ -16,11 +16,13 @@
 #include <glm/gtx/string_cast.hpp>
 #include <algorithm>
 #include <execution>
-#include "FLIPScreenshotComparison.h"
+#include <numeric>
+#include <string_view>
 #include "LZ4Compression.h"
 #include "Utils/Math/FalcorMath.h"
 #include "Utils/Math/Matrix.h"
 #include "Utils/Threading.h"
+#include "Tracing.h"
 #include "Utils/UI/TextRenderer.h"
 #include "ZSTDCompression.h"
 
@@ -28,6 +30,8 @@
 namespace split_rendering {
 
 static const float4 kClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+// Frame after which --benchmark_point_encodings reads back the points, the AO has converged
+static const uint32_t kPointEncodingBenchmarkFrame = 200;
 // static const std::string kDefaultScene = "test_scenes/skinned.pyscene";
 // static const std::string kDefaultScene = "test_scenes/bunny.pyscene";
 // static const std::string kDefaultScene = "test_scenes/plant.pyscene";
@@ -48,6 +52,7 @@ void ServerPointRenderer::onGuiRender(Gui* gui) {
   w.dropdown("AO Type", kAOTypeDropdown, aoType_);
   w.text(std::string("Num points changed: ") + std::to_string(frameUpdateInfo_.numChangedPoints));
   w.text(std::string("Num cells alloc'd: ") + std::to_string(frameUpdateInfo_.numAllocatedCells));
+  w.text(std::string("Num points dropped: ") + std::to_string(frameUpdateInfo_.numDroppedPoints));
   w.text(std::string("Max points changed: ") + std::to_string(maxNumPointsChanged_));
   w.text(std::string("Total points changed: ") + std::to_string(totalNumPointsChanged_));
 
@@ -178,6 +183,10 @@ void ServerPointRenderer::loadScene(const std::filesystem::path& path, const Fbo
   rasterPass_ = RasterScenePass::create(scene_, rasterProgDesc, defines);
   rasterPass_->getProgram()->setGenerateDebugInfoEnabled(true);
 
+  // The kd-tree buffer holds the node layout that kdTreeGen_ generates (see KDTree.slang)
+  if (kdTreeGen_.compactNodes_)
+    rasterPass_->getProgram()->addDefine("KD_TREE_COMPACT_NODES");
+
   Program::Desc depthNormalsProgDesc;
   depthNormalsProgDesc.addShaderModules(shaderModules);
   depthNormalsProgDesc.addShaderLibrary("Samples/FalcorServer/DepthNormals.ps.slang")
@@ -268,11 +277,35 @@ void ServerPointRenderer::firstFrameInit(RenderContext* renderContext) {
   pointCellCreateNetworkBufferStage_.init(serverHashGen_);
   pointHashCreateNetworkBufferStage_.init(serverHashGen_);
 
-  if (!sendMessages_)
+  if (!args_.get<std::string>("--record_update_stream").empty()) {
+    // Cell remaps and instance relocations are not part of the recording
+    if (occupancyCheckInterval_ != 0) {
+      std::cout << "--record_update_stream disables growing/compacting the point structures"
+                << std::endl;
+      occupancyCheckInterval_ = 0;
+    }
+
+    const auto hashEntries = serverHashGen_.getCPUCompactHashToPointCell();
+    const auto compressedPoints = serverHashGen_.getCPUCompressedClientPointCells();
+    updateStreamRecording_ = std::make_unique<UpdateStreamRecording>();
+    updateStreamRecording_->initialState.init(
+        serverHashGen_.getCPUInstanceHashInfo(),
+        serverHashGen_.getCPUInstancePointInfo(),
+        {hashEntries.begin(), hashEntries.end()},
+        {compressedPoints.begin(), compressedPoints.end()},
+        pointGen_.getDiskRadiusPerInstance());
+  }
+
+  // The server hash generator views the sections of a loaded bake package until here
+  if (!sendMessages_) {
+    serverHashGen_.releaseBake();
+    bakePackage_.close();
     return;
+  }
 
   // TODO: refactor to use the same function for this and the other message send function
-  const auto send_vector_message = [&](TCPMessageType type, auto& vectorData, int headerId = 0) {
+  const auto send_vector_message = [&](TCPMessageType type, const auto& vectorData,
+                                       int headerId = 0) {
     TCPMessage msg;
     msg.header.type = type;
     msg.header.id = headerId;
@@ -284,6 +317,7 @@ void ServerPointRenderer::firstFrameInit(RenderContext* renderContext) {
     std::memcpy(msg.data.data(), vectorData.data(), msg.data.size());
 
     msg.header.size = msg.data.size();
+    msg.header.decompressedSize = msg.data.size();
     msg.header.width = 0;
     msg.header.height = 0;
     msg.header.timestamp = gpFramework->getGlobalClock().getTime() + simulatedLatencySec_;
@@ -299,9 +333,32 @@ void ServerPointRenderer::firstFrameInit(RenderContext* renderContext) {
   send_vector_message(
       TCPMessageType::PAOInstanceToPoissonRadius, pointGen_.getDiskRadiusPerInstance());
 
-  send_vector_message(
-      TCPMessageType::PAOCompressedClientAOPoints,
-      serverHashGen_.getCPUCompressedClientPointCells());
+  // A bake package has the client snapshot compressed already, it is sent as is
+  NetworkCompressionID snapshotCompression = NetworkCompressionID::NUM_IDS;
+  uint64_t snapshotSize = 0;
+  uint64_t snapshotDecompressedSize = 0;
+  const uint8_t* snapshot = bakePackage_.getCompressedSection(
+      kBakeClientSnapshot, snapshotCompression, snapshotSize, snapshotDecompressedSize);
+
+  if (snapshot) {
+    TCPMessage msg;
+    msg.header.type = TCPMessageType::PAOCompressedClientAOPoints;
+    msg.header.id = 0;
+
+    msg.data.assign(snapshot, snapshot + snapshotSize);
+
+    // Encode the ID of the network compression type in the message width
+    msg.header.size = msg.data.size();
+    msg.header.decompressedSize = (uint32_t)snapshotDecompressedSize;
+    msg.header.width = (uint32_t)snapshotCompression;
+    msg.header.height = 0;
+    msg.header.timestamp = gpFramework->getGlobalClock().getTime() + simulatedLatencySec_;
+    // server_.send(msg);
+  } else {
+    send_vector_message(
+        TCPMessageType::PAOCompressedClientAOPoints,
+        serverHashGen_.getCPUCompressedClientPointCells());
+  }
 
   send_vector_message(
       TCPMessageType::PAOServerHashToPointCell, serverHashGen_.getCPUCompactHashToPointCell());
@@ -317,22 +374,82 @@ void ServerPointRenderer::firstFrameInit(RenderContext* renderContext) {
     msg.header.height = 0;
     // server_.send(msg);
   }
+
+  serverHashGen_.releaseBake();
+  bakePackage_.close();
 }
 
 void ServerPointRenderer::setupPointStructures(RenderContext* renderContext) {
-  pointGen_.generatePointsInScene(scene_, renderContext);
+  const std::string bakeFilename = args_.get<std::string>("--bake_package");
+  const bool bake = args_.get<bool>("--bake");
+
+  if (bake && bakeFilename.empty()) {
+    std::cout << "--bake needs a --bake_package to write" << std::endl;
+    exit(1);
+  }
+
+  // --bake always regenerates the package
+  bool loadedBake = false;
+  if (!bake && std::filesystem::exists(bakeFilename) &&
+      bakePackage_.open(bakeFilename, getBakeKey())) {
+    // The kd-trees are only needed for refitting
+    loadedBake = pointGen_.loadBake(bakePackage_) && serverHashGen_.loadBake(bakePackage_) &&
+        (kdTreeRefitInterval_ == 0 ||
+         kdTreeGen_.loadBake(bakePackage_, serverHashGen_.getCPUInstancePointInfo()));
+    if (!loadedBake) {
+      serverHashGen_.releaseBake();
+      bakePackage_.close();
+    }
+  }
+
+  if (loadedBake) {
+    std::cout << "loaded bake package " << bakeFilename << std::endl;
+  } else {
+    pointGen_.generatePointsInScene(scene_, renderContext);
+    serverHashGen_.generate(scene_, pointGen_);
+
+    // Packages always contain the kd-trees, so they load with any --kd_tree_refit_interval
+    if (kdTreeRefitInterval_ > 0 || !bakeFilename.empty()) {
+      kdTreeGen_.generate(
+          scene_,
+          pointGen_,
+          serverHashGen_.getCPUPointCells(),
+          serverHashGen_.getCPUInstancePointInfo());
+    }
+
+    if (!bakeFilename.empty() && writeBakePackage(bakeFilename))
+      bakePackage_.open(bakeFilename, getBakeKey());
+  }
+
+  if (bake) {
+    // Not shutdown(), nothing was rendered that could be saved
+    std::cout << (bakePackage_.isOpen() ? "baked " : "could not bake ") << bakeFilename
+              << std::endl;
+    exit(bakePackage_.isOpen() ? 0 : 1);
+  }
+
   const auto& numFinalSamplesPerInstance = pointGen_.getNumSamplesPerInstance();
   const auto& sampleOffsetPerInstance = pointGen_.getSampleOffsetPerInstance();
   const auto& diskRadiusPerInstance = pointGen_.getDiskRadiusPerInstance();
 
-  serverHashGen_.generate(scene_, pointGen_);
+  if (args_.get<bool>("--analyze_hash")) {
+    HashTableAnalysis hashAnalysis;
+    hashAnalysis.analyze(
+        pointGen_,
+        serverHashGen_.getCPUInstanceHashInfo(),
+        serverHashGen_.getCPUInstancePointInfo(),
+        HASH_LOG2_SIZE_FACTOR - 2,
+        HASH_LOG2_SIZE_FACTOR + 1);
+    hashAnalysis.printSummary(std::cout);
+    hashAnalysis.writeCSV(outputDirectory_ + "/hash_analysis.csv");
+
+    hashAnalysis.benchmarkLayouts(
+        pointGen_, serverHashGen_.getCPUInstanceHashInfo(), serverHashGen_.hashType_);
+    hashAnalysis.printLayoutSummary(std::cout);
+    hashAnalysis.writeLayoutCSV(outputDirectory_ + "/hash_layout_benchmark.csv");
+  }
 
   /*
-  kdTreeGen_.generate(
-      scene_,
-      pointGen_,
-      serverHashGen_.getCPUPointCells(),
-      serverHashGen_.getCPUInstancePointInfo());
   hashGen_.generate(
       scene_,
       pointGen_,
@@ -348,195 +465,197 @@ void ServerPointRenderer::setupPointStructures(RenderContext* renderContext) {
       Buffer::CpuAccess::None);
 }
 
+std::string ServerPointRenderer::getBakeKey() const {
+  // The scene file is identified by its size and modification time, not by its contents
+  const std::filesystem::path scenePath = scene_->getPath();
+  std::error_code error;
+  const auto sceneSize = std::filesystem::file_size(scenePath, error);
+  const auto sceneTime = std::filesystem::last_write_time(scenePath, error);
+
+  // Invisible triangles get no points, empty without visibility data
+  const std::vector<uint32_t> visibilityBitmask = triangleVisibility_.toBitmask();
+  const size_t visibilityHash = std::hash<std::string_view>{}(std::string_view(
+      reinterpret_cast<const char*>(visibilityBitmask.data()),
+      visibilityBitmask.size() * sizeof(uint32_t)));
+
+  return "scene=" + scenePath.string() + ";scene_size=" + std::to_string(sceneSize) +
+      ";scene_time=" + std::to_string(sceneTime.time_since_epoch().count()) +
+      ";samples_per_unit_squared=" + std::to_string(pointGen_.kNumSamplesPerUnitSquaredEliminated) +
+      ";min_samples=" + std::to_string(pointGen_.kMinSamplesPerInstance) +
+      ";samples_eliminated_factor=" + std::to_string(pointGen_.kSamplesEliminatedFactor) +
+      ";hash_type=" + std::to_string(serverHashGen_.hashType_) +
+      ";cell_capacity_class=" + std::to_string(serverHashGen_.cellCapacityClass_) +
+      ";hash_log2_size_factor=" + std::to_string(HASH_LOG2_SIZE_FACTOR) +
+      ";hash_bucket_size=" + std::to_string(FIXED_HASH_BUCKET_SIZE) +
+      ";kd_tree_compact_nodes=" + std::to_string(kdTreeGen_.compactNodes_) +
+      ";visibility=" + std::to_string(visibilityHash);
+}
+
+bool ServerPointRenderer::writeBakePackage(const std::string& filename) {
+  TRACE_SCOPE("writeBakePackage");
+  BakePackageWriter writer;
+  if (!writer.open(filename))
+    return false;
+
+  pointGen_.writeBake(writer);
+  serverHashGen_.writeBake(writer, *networkCompression_);
+  kdTreeGen_.writeBake(writer);
+  return writer.finish(getBakeKey());
+}
+
 void ServerPointRenderer::setupAutomatedScreenshots() {
   screenshotHelper_ = {};
 
-  // Camera positions, new camera setups can be exported with the "Minus" key
-  automatedCameraSetups_ = {
-      [&]() {
-        // camera_->setHeadPosition(glm::vec3(-1.682712, 1.612922, 3.208458));
-        // camera_->setHeadTarget(glm::vec3(-1.097630, 1.206952, 2.506413));
-        camera_->setUpVector(glm::vec3(0.001629, 0.999997, -0.001951));
-      },
-      [&]() {
-        // camera_->setHeadPosition(glm::vec3(-1.372512, 0.599973, 0.306184));
-        // camera_->setHeadTarget(glm::vec3(-1.355760, 0.419115, -0.677182));
-        camera_->setUpVector(glm::vec3(0.000000, 1.000000, 0.000000));
-      },
-      [&]() {
-        // camera_->setHeadPosition(glm::vec3(0.370434, 0.570594, 1.203125));
-        // camera_->setHeadTarget(glm::vec3(0.289852, 0.664340, 0.210795));
-        camera_->setUpVector(glm::vec3(0.000224, 0.999996, 0.002757));
-      },
-      [&]() {
-        // camera_->setHeadPosition(glm::vec3(-1.259848, 0.272437, -0.148128));
-        // camera_->setHeadTarget(glm::vec3(-0.893683, -0.123221, -0.990374));
-        camera_->setUpVector(glm::vec3(-0.000676, 0.999999, 0.001559));
-      },
-      [&]() {
-        // camera_->setHeadPosition(glm::vec3(-1.742759, 0.183640, -0.475140));
-        // camera_->setHeadTarget(glm::vec3(-0.846588, 0.121357, -0.914456));
-        camera_->setUpVector(glm::vec3(-0.001659, 0.999998, 0.000813));
-      },
-  };
+  // The FLIP callbacks of a previous sweep write to its manifest
+  flipComparisonPool_->waitForAll();
 
-  automatedAOConfigSetups_ = {
-      [&]() {
-        aoOnly_ = false;
-        pointViz_ = false;
-      },
-      [&]() {
-        aoOnly_ = false;
-        pointViz_ = true;
-      },
-      [&]() {
-        aoOnly_ = true;
-        pointViz_ = false;
-      },
-  };
+  // Without --sweep_config, the defaults of SweepConfig are used. New cameras can be exported with
+  // the "Minus" key.
+  SweepConfig config;
+  std::string configFilename = args_.get<std::string>("--sweep_config");
+  if (!configFilename.empty() && !SweepConfig::load(configFilename, config))
+    return;
 
-  const static std::vector<float> timeStamps = {1.0f, 5.0f};
-  const static std::vector<float> latencySetups = {0.0f, 40.0f, 80.0f, 120.0f};
-
-  // Write out color only
-  for (uint32_t cameraSetupIndex = 0; cameraSetupIndex < automatedCameraSetups_.size();
-       cameraSetupIndex++) {
-    for (const auto timeStamp : timeStamps) {
-      screenshotHelper_.addFrame(
-          [&, cameraSetupIndex, timeStamp]() {
-            gpFramework->getGlobalClock().setFrame(0);
-            gpFramework->getGlobalClock().setTime(timeStamp);
-            automatedCameraSetups_[cameraSetupIndex]();
-            aoOnly_ = false;
-            colorOnly_ = true;
-          },
-          [&, cameraSetupIndex, timeStamp]() {
-            std::string directoryBase = "automated_screenshots_" +
-                std::to_string(pointGen_.getCPUPointData().size()) + "_" +
-                std::to_string(timeStamp);
-            std::string destinationDirectoryOutput = directoryBase + "/color_only_out";
-
-            std::filesystem::create_directories(destinationDirectoryOutput);
-
-            // Screenshot
-            std::string currentFilename = destinationDirectoryOutput + "/" +
-                std::to_string(cameraSetupIndex) + "_color_only.png";
-
-            screenshotFBO_->getColorTexture(0)->captureToFile(0, 0, currentFilename);
-            colorOnly_ = false;
-          });
-    }
+  if (config.outputDirectory.empty()) {
+    config.outputDirectory = outputDirectory_ + "/automated_screenshots_" +
+        std::to_string(pointGen_.getCPUPointData().size());
   }
 
-  // Loop over all camera setups for automated screenshotting
-  for (uint32_t cameraSetupIndex = 0; cameraSetupIndex < automatedCameraSetups_.size();
-       cameraSetupIndex++) {
-    // Loop over all ao configs
-    for (uint32_t aoConfigSetupIndex = 0; aoConfigSetupIndex < automatedAOConfigSetups_.size();
-         aoConfigSetupIndex++) {
-      // Loop over all latencies
-      for (const auto latencyMs : latencySetups) {
-        // Loop over all timestamps
-        for (const auto timeStamp : timeStamps) {
-          // Loop over AO types
-          for (const auto& aoSetting : kAOTypeDropdown) {
-            // We only want to compare point AO (update), SSAO and RTAO
-            if (aoSetting.value > AO_TYPE_PER_PIXEL_RTAO &&
-                aoSetting.value < AO_TYPE_POINT_AO_HASH_UPDATE)
-              continue;
-
-            screenshotHelper_.addFrame(
-                [&, cameraSetupIndex, aoConfigSetupIndex, latencyMs, timeStamp]() {
-                  logWarning(
-                      std::string("Begin camera ") + std::to_string(cameraSetupIndex) + ": " +
-                      aoSetting.label);
-                  gpFramework->getGlobalClock().setFrame(0);
-                  gpFramework->getGlobalClock().setTime(timeStamp);
-                  simulatedLatencyMSec_ = latencyMs;
-                  simulatedLatencySec_ = -simulatedLatencyMSec_ * kMSecToSec;
-                  automatedCameraSetups_[cameraSetupIndex]();
-                  automatedAOConfigSetups_[aoConfigSetupIndex]();
-                  aoType_ = aoSetting.value;
-
-                  if (aoSetting.value == AO_TYPE_PER_PIXEL_RTAO) {
-                    aoSamples_ = 512;
-                  } else {
-                    aoSamples_ = 4096;
-                  }
-                },
-                [&, cameraSetupIndex, aoConfigSetupIndex, latencyMs, timeStamp]() {
-                  logWarning(
-                      std::string("End camera ") + std::to_string(cameraSetupIndex) + ": " +
-                      aoSetting.label);
-
-                  std::string directoryBase = "automated_screenshots_" +
-                      std::to_string(pointGen_.getCPUPointData().size()) + "_" +
-                      std::to_string(timeStamp);
-                  std::string destinationDirectory = directoryBase + "/flip_color";
-                  std::string destinationDirectoryOutput = directoryBase + "/color_out";
-
-                  if (aoOnly_) {
-                    destinationDirectoryOutput = directoryBase + "/ao_out";
-                    destinationDirectory = directoryBase + "/flip_ao";
-                  }
-
-                  if (pointViz_) {
-                    destinationDirectoryOutput = directoryBase + "/point_viz_out";
-                  }
-
-                  std::filesystem::create_directories(destinationDirectory);
-
-                  std::filesystem::create_directories(destinationDirectoryOutput);
-
-                  // Screenshot
-                  std::string currentFilename = destinationDirectoryOutput + "/" +
-                      std::to_string(cameraSetupIndex) + "_" + std::string(aoSetting.label) + "_" +
-                      std::to_string(aoConfigSetupIndex) + "_" + std::to_string(latencyMs) + ".png";
-
-                  std::string referenceFilename = destinationDirectoryOutput + "/" +
-                      std::to_string(cameraSetupIndex) + "_" +
-                      std::string(kAOTypeDropdown[AO_TYPE_PER_PIXEL_RTAO].label) + "_" +
-                      std::to_string(aoConfigSetupIndex) + "_" + std::to_string(latencySetups[0]) +
-                      ".png";
-
-                  screenshotFBO_->getColorTexture(0)->captureToFile(0, 0, currentFilename);
-
-                  // Wait for screenshot to finish, so we can process the images with FLIP
-                  // afterwards
-                  Threading::finish();
-
-                  if (pointViz_)
-                    return;
-
-                  FlipScreenshotComparison::compare(
-                      referenceFilename, currentFilename, destinationDirectory);
-
-                  simulatedLatencyMSec_ = 0.0f;
-                  simulatedLatencySec_ = -simulatedLatencyMSec_ * kMSecToSec;
-                });
-          }
-        }
+  sweep_ = std::make_unique<ExperimentSweep>(config);
+
+  logWarning(
+      "Sweep " + config.outputDirectory + ": " + std::to_string(sweep_->getNumRuns()) + " runs, " +
+      std::to_string(sweep_->getNumResumed()) + " already finished");
+
+  for (const SweepRun& run : sweep_->getPendingRuns()) {
+    uint32_t aoType = aoType_;
+    if (!run.colorOnly) {
+      auto aoSetting = std::find_if(
+          kAOTypeDropdown.begin(), kAOTypeDropdown.end(), [&](const auto& setting) {
+            return setting.label == run.aoType;
+          });
+
+      if (aoSetting == kAOTypeDropdown.end()) {
+        logWarning("Skipping " + run.id + ", unknown AO type " + run.aoType);
+        continue;
       }
+      aoType = aoSetting->value;
     }
+
+    const auto beginRun = [&, run, aoType]() {
+      gpFramework->getGlobalClock().setFrame(0);
+      gpFramework->getGlobalClock().setTime(run.timeStamp);
+
+      const auto& camera = sweep_->getConfig().cameras[run.cameraIndex];
+      if (camera.hasPosition) {
+        camera_->setPosition(float3(camera.position[0], camera.position[1], camera.position[2]));
+        camera_->setTarget(float3(camera.target[0], camera.target[1], camera.target[2]));
+      }
+      camera_->setUpVector(float3(camera.up[0], camera.up[1], camera.up[2]));
+
+      if (run.colorOnly) {
+        aoOnly_ = false;
+        pointViz_ = false;
+        colorOnly_ = true;
+        return;
+      }
+
+      simulatedLatencyMSec_ = run.latencyMs;
+      simulatedLatencySec_ = -simulatedLatencyMSec_ * kMSecToSec;
+      aoOnly_ = run.aoConfig.aoOnly;
+      pointViz_ = run.aoConfig.pointViz;
+      aoType_ = aoType;
+      aoSamples_ = run.aoSamples;
+    };
+
+    // Warm-up frames only render, the screenshot is taken at the end of the last frame
+    for (uint32_t i = 0; i < run.warmupFrames; i++)
+      screenshotHelper_.addFrame(beginRun, []() {});
+
+    screenshotHelper_.addFrame(
+        [&, run, beginRun]() {
+          logWarning("Begin " + run.id);
+          beginRun();
+        },
+        [&, run]() { finishSweepRun(run); });
   }
 }
 
+void ServerPointRenderer::finishSweepRun(const SweepRun& run) {
+  logWarning("End " + run.id);
+
+  std::filesystem::create_directories(std::filesystem::path(run.imageFilename).parent_path());
+  screenshotFBO_->getColorTexture(0)->captureToFile(0, 0, run.imageFilename);
+
+  // Wait for screenshot to finish, so we can process the images with FLIP afterwards. FLIP itself
+  // runs on the comparison pool.
+  Threading::finish();
+
+  colorOnly_ = false;
+  simulatedLatencyMSec_ = 0.0f;
+  simulatedLatencySec_ = -simulatedLatencyMSec_ * kMSecToSec;
+
+  if (run.referenceFilename.empty()) {
+    sweep_->markFinished(run);
+    return;
+  }
+
+  if (!std::filesystem::exists(run.referenceFilename)) {
+    logWarning("No reference " + run.referenceFilename + " for " + run.id);
+    sweep_->markFinished(run);
+    return;
+  }
+
+  std::filesystem::create_directories(run.flipDirectory);
+
+  // The run only counts as finished once its FLIP result is in the manifest
+  ExperimentSweep* sweep = sweep_.get();
+  flipComparisonPool_->enqueue(
+      run.referenceFilename,
+      run.imageFilename,
+      run.flipDirectory,
+      [sweep, run](const FlipComparisonResult& result) { sweep->markFinished(run, &result); });
+}
+
 void ServerPointRenderer::loadCameraPath() {
   std::string filename = args_.get<std::string>("--camera_path");
+  std::string convertedFilename = args_.get<std::string>("--convert_camera_path");
+
+  if (!args_.get<std::string>("--record_camera_path").empty())
+    cameraPathRecording_ = std::make_unique<CameraPathWriter>();
 
-  std::ifstream file(filename, std::ios::binary);
+  if (filename.empty())
+    return;
 
-  if (!file.is_open())
+  // Legacy paths have one key per frame
+  if (!cameraPath_.open(filename, fixedFrameTime) || !cameraPath_.isLegacy())
     return;
 
-  int count = 0;
-  file.read(reinterpret_cast<char*>(&count), sizeof(int));
+  if (convertedFilename.empty()) {
+    logWarning(
+        "Camera path " + filename +
+        " uses the legacy format, convert it with --convert_camera_path");
+    return;
+  }
 
-  cameraPathMatrices_.resize(count);
+  CameraPathWriter converted;
+  converted.addKeys(cameraPath_);
+  if (converted.write(convertedFilename))
+    std::cout << "converted camera path " << filename << " to " << convertedFilename << std::endl;
+}
 
-  file.read(reinterpret_cast<char*>(cameraPathMatrices_.data()), sizeof(glm::mat4) * count);
+void ServerPointRenderer::recordCameraPath(double time) {
+  // Keys have to be in increasing time order, e.g. resetting the clock ends the recording
+  if (cameraPathRecording_->getNumKeys() > 0 && time <= cameraPathRecording_->getDuration())
+    return;
 
-  file.close();
+  const auto toArray = [](const float3& v) { return std::array<float, 3>{v.x, v.y, v.z}; };
+  cameraPathRecording_->addKey(
+      time,
+      CameraPathPose::fromLookAt(
+          toArray(camera_->getPosition()),
+          toArray(camera_->getTarget()),
+          toArray(camera_->getUpVector())));
 }
 
 void ServerPointRenderer::initTriangleVisibilityBuffer() {
@@ -573,113 +692,134 @@ void ServerPointRenderer::initTriangleVisibilityBuffer() {
       Falcor::Buffer::CpuAccess::None,
       instanceTriangleVisibilityOffsets_.data());
 
-  auto path = scene_->getPath().filename().string() +
-      std::filesystem::path{args_.get<std::string>("--camera_path")}.filename().string() +
-      "_visibility.bin";
-
-  std::ifstream file(path, std::ios::binary);
-
-  if (file.is_open()) {
-    file.unsetf(std::ios::skipws);
-
-    // get length of file
-    file.seekg(0, std::ios::end);
-    size_t length = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    cpuTriangleVisibilityData_.resize(length / sizeof(uint32_t));
-
-    file.read((char*)cpuTriangleVisibilityData_.data(), length);
-
-    pointGen_.cpuTriangleVisibility_ = cpuTriangleVisibilityData_;
-    pointGen_.cpuTriangleVisibilityOffsets_ = instanceTriangleVisibilityOffsets_;
-
-    triangleVisibilityDataTest_ = Falcor::Buffer::createStructured(
-        sizeof(uint32_t),
-        cpuTriangleVisibilityData_.size(),
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None,
-        cpuTriangleVisibilityData_.data());
-
-    int a = 3;
-  } else {
-    triangleVisibilityDataTest_ = Falcor::Buffer::createStructured(
-        sizeof(uint32_t),
-        triangleCount,
-        Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
-        Falcor::Buffer::CpuAccess::None);
+  // Zero-copy, older files with one uint32 per triangle are converted while loading
+  auto path = getTriangleVisibilityPath();
+  if (std::filesystem::exists(path) &&
+      triangleVisibility_.open(path, instanceTriangleVisibilityOffsets_)) {
+    if (triangleVisibility_.getNumTriangles() == triangleCount) {
+      pointGen_.setTriangleVisibility(&triangleVisibility_);
+    } else {
+      logWarning("Ignoring " + path + ", it doesn't match the triangles of the scene");
+      triangleVisibility_.close();
+    }
   }
+
+  // One bit per triangle, empty without visibility data
+  std::vector<uint32_t> visibilityBitmask = triangleVisibility_.toBitmask();
+  triangleVisibilityDataTest_ = Falcor::Buffer::createStructured(
+      sizeof(uint32_t),
+      (triangleCount + 31) / 32,
+      Falcor::ResourceBindFlags::ShaderResource | Falcor::ResourceBindFlags::UnorderedAccess,
+      Falcor::Buffer::CpuAccess::None,
+      visibilityBitmask.empty() ? nullptr : visibilityBitmask.data());
 }
 
-void ServerPointRenderer::saveTriangleVisibilityBuffer() {
-  auto path = scene_->getPath().filename().string() +
+std::string ServerPointRenderer::getTriangleVisibilityPath() const {
+  return scene_->getPath().filename().string() +
       std::filesystem::path{args_.get<std::string>("--camera_path")}.filename().string() +
       "_visibility.bin";
+}
 
-  std::ofstream file(path, std::ios::binary);
+void ServerPointRenderer::saveTriangleVisibilityBuffer() {
+  // Encode first, this also releases the mapping of the file we are about to overwrite
+  const uint32_t* bufferData =
+      (const uint32_t*)triangleVisibilityData_->map(Buffer::MapType::Read);
+  triangleVisibility_.assign(
+      bufferData,
+      (uint32_t)(triangleVisibilityData_->getSize() / sizeof(uint32_t)),
+      instanceTriangleVisibilityOffsets_);
+  triangleVisibilityData_->unmap();
+
+  if (!triangleVisibility_.write(getTriangleVisibilityPath()))
+    std::cout << "didn't write visibility data" << std::endl;
+}
 
-  // Get buffer data to cpu
+void ServerPointRenderer::registerMetrics() {
+  using MetricType = MetricsRegistry::MetricType;
+
+  metricIds_.frameTime = metrics_.registerMetric("frame_time", MetricType::kFloat);
+  metricIds_.serverRenderAOPoints =
+      metrics_.registerMetric("server_render_ao_points", MetricType::kFloat);
+  metricIds_.serverPointCellAlloc =
+      metrics_.registerMetric("server_point_cell_alloc", MetricType::kFloat);
+  metricIds_.serverPointCellNetworkBuffer =
+      metrics_.registerMetric("server_point_cell_network_buffer", MetricType::kFloat);
+  metricIds_.serverPointHashNetworkBuffer =
+      metrics_.registerMetric("server_point_hash_network_buffer", MetricType::kFloat);
+  metricIds_.ssaoRender = metrics_.registerMetric("ssao_render", MetricType::kFloat);
+  metricIds_.serverRender = metrics_.registerMetric("server_render", MetricType::kFloat);
+  metricIds_.clientRender = metrics_.registerMetric("client_render", MetricType::kFloat);
+  metricIds_.serverCompression = metrics_.registerMetric("server_compression", MetricType::kFloat);
+
+  metricIds_.frameNumber = metrics_.registerMetric("frame_number", MetricType::kInt);
+  metricIds_.numberOfPoints = metrics_.registerMetric("number_of_points", MetricType::kInt);
+  metricIds_.numChangedPoints = metrics_.registerMetric("numChangedPoints", MetricType::kInt);
+  metricIds_.numDroppedPoints = metrics_.registerMetric("numDroppedPoints", MetricType::kInt);
+  metricIds_.pointCellUpdateBytes =
+      metrics_.registerMetric("point_cell_update_bytes", MetricType::kInt);
+  metricIds_.pointHashUpdateBytes =
+      metrics_.registerMetric("point_hash_update_bytes", MetricType::kInt);
+  metricIds_.cellRemapBytes = metrics_.registerMetric("cell_remap_bytes", MetricType::kInt);
+  metricIds_.instanceRelocationBytes =
+      metrics_.registerMetric("instance_relocation_bytes", MetricType::kInt);
+  metricIds_.kdTreeRefitNodes = metrics_.registerMetric("kd_tree_refit_nodes", MetricType::kInt);
+  metricIds_.kdTreeRebuiltNodes =
+      metrics_.registerMetric("kd_tree_rebuilt_nodes", MetricType::kInt);
+
+  // Rows are streamed while running, so long runs don't keep all frames in memory
+  if (args_.get<std::string>("--metrics_format") == "binary")
+    metrics_.start(outputDirectory_ + "/frame_metrics.bin", MetricsRegistry::OutputFormat::kBinary);
+  else
+    metrics_.start(outputDirectory_ + "/frame_metrics.csv");
+}
 
-  if (file.is_open()) {
-    const char* buffer_data = (const char*)triangleVisibilityData_->map(Buffer::MapType::Read);
+void ServerPointRenderer::finishVertexAnimationExport() {
+  for (auto& animExport : vertexAnimExports_) {
+    if (!animExport.writer)
+      continue;
 
-    file.write(buffer_data, triangleVisibilityData_->getSize());
-    file.flush();
-    file.close();
-  } else {
-    std::cout << "didn't write visibility data" << std::endl;
+    animExport.writer->close();
+    if (animExport.writer->getNumFrames() < 10)
+      std::filesystem::remove(animExport.writer->getFilename());
   }
+
+  vertexAnimExports_.clear();
 }
 
 void ServerPointRenderer::shutdown() {
   saveTriangleVisibilityBuffer();
-  Threading::shutdown();
-
-  // Write .csv of profiling stuff
-
-  if (profilingStats_.size() > 0) {
-    {
-      std::fstream csv;
-      csv.open(outputDirectory_ + "/float_stats.csv ", std::ios::out);
-      if (csv.is_open()) {
-        for (const auto& header : profilingStats_[0].profilingStages_)
-          csv << header.name_ << ",";
-
-        csv << "\n";
+  finishVertexAnimationExport();
 
-        for (const auto& stats : profilingStats_) {
-          for (const auto& float_tuple : stats.profilingStages_)
-            csv << float_tuple.val_ << ",";
-
-          csv << "\n";
-        }
-      }
-
-      csv.flush();
-      csv.close();
+  if (cameraPathRecording_ && cameraPathRecording_->getNumKeys() > 0) {
+    std::string filename = args_.get<std::string>("--record_camera_path");
+    if (cameraPathRecording_->write(filename)) {
+      std::cout << "recorded " << cameraPathRecording_->getNumKeys() << " camera keys to "
+                << filename << std::endl;
     }
+  }
+  Threading::shutdown();
 
-    {
-      std::fstream csv;
-      csv.open(outputDirectory_ + "/int_stats.csv ", std::ios::out);
-      if (csv.is_open()) {
-        for (const auto& header : profilingStats_[0].networkDataStages_)
-          csv << header.name_ << ",";
+  while (!pendingImageReadbacks_.empty())
+    submitImageReadback();
+  imageCapturePipeline_->flush();
 
-        csv << "\n";
+  if (uint64_t numExported = imageCapturePipeline_->getNumWritten()) {
+    std::cout << "exported " << numExported << " images, " << imageCapturePipeline_->getNumFailed()
+              << " failed, the frame loop waited " << imageCapturePipeline_->getStallSeconds()
+              << " s for " << imageCapturePipeline_->getNumStalls() << " frames" << std::endl;
+  }
 
-        for (const auto& stats : profilingStats_) {
-          for (const auto& float_tuple : stats.networkDataStages_)
-            csv << float_tuple.val_ << ",";
+  if (size_t numPending = flipComparisonPool_->getNumPending()) {
+    std::cout << "waiting for " << numPending << " FLIP comparisons" << std::endl;
+    flipComparisonPool_->waitForAll();
+  }
 
-          csv << "\n";
-        }
-      }
+  metrics_.stop();
+  metrics_.printSummary(std::cout);
 
-      csv.flush();
-      csv.close();
-    }
-  }
+  if (Tracing::isEnabled())
+    Tracing::writeChromeTrace(outputDirectory_ + "/server_trace.json");
+  metrics_.writeSummaryCSV(outputDirectory_ + "/frame_metrics_summary.csv");
 
   exit(0);
 }
@@ -701,6 +841,7 @@ void ServerPointRenderer::onLoad(RenderContext* renderContext) {
 
 void ServerPointRenderer::sendMessages(RenderContext* renderContext) {
   FALCOR_PROFILE("sendMessages");
+  TRACE_SCOPE("sendMessages");
   static int id = 0;
 
   auto point_cell_update_vec =
@@ -748,6 +889,8 @@ void ServerPointRenderer::sendMessages(RenderContext* renderContext) {
         // server_.send(msg);
       };
 
+  recordUpdateStream(point_cell_update_vec, point_hash_update_vec);
+
   send_vector_message(
       TCPMessageType::PAOPointCellUpdate, point_cell_update_vec, id++, useCompression_);
   send_vector_message(TCPMessageType::PAOHashUpdate, point_hash_update_vec, id++);
@@ -760,8 +903,138 @@ void ServerPointRenderer::sendMessages(RenderContext* renderContext) {
   }
 }
 
+void ServerPointRenderer::recordUpdateStream(
+    const std::vector<uint32_t>& packedCellUpdates,
+    const std::vector<Falcor::HashUpdateInfo>& hashUpdates) {
+  if (!updateStreamRecording_)
+    return;
+
+  updateStreamRecording_->addFrame(packedCellUpdates, hashUpdates);
+
+  if (updateStreamRecording_->frames.size() < (size_t)args_.get<int>("--record_frames"))
+    return;
+
+  const std::string filename = args_.get<std::string>("--record_update_stream");
+  if (updateStreamRecording_->save(filename)) {
+    std::cout << "recorded " << updateStreamRecording_->frames.size() << " frames of updates to "
+              << filename << std::endl;
+  }
+
+  updateStreamRecording_.reset();
+}
+
+void ServerPointRenderer::growPointStructures(RenderContext* renderContext) {
+  FALCOR_PROFILE("growPointStructures");
+  TRACE_SCOPE("growPointStructures");
+
+  // Reading the cell counters back waits for the GPU, so the occupancy is only checked every few
+  // frames. Compaction and growth share the same readback.
+  if (occupancyCheckInterval_ == 0 || frameCount_ % occupancyCheckInterval_ != 0)
+    return;
+
+  serverHashGen_.readBackInstancePointInfo();
+
+  // Compacting first returns free cells, which might make growing unnecessary
+  auto cellRemaps = serverHashGen_.compact(renderContext);
+
+  uint32_t numCellRemapBytes = 0;
+
+  for (const auto& cellRemap : cellRemaps) {
+    TCPMessage msg;
+    msg.header.type = TCPMessageType::PAOInstanceCellRemap;
+    msg.header.id = cellRemap.info.instanceId;
+
+    const uint32_t runsSize = cellRemap.runs.size() * sizeof(Falcor::CellRemapRun);
+
+    msg.data.resize(sizeof(Falcor::InstanceCellRemapInfo) + runsSize);
+    std::memcpy(msg.data.data(), &cellRemap.info, sizeof(Falcor::InstanceCellRemapInfo));
+    std::memcpy(
+        msg.data.data() + sizeof(Falcor::InstanceCellRemapInfo), cellRemap.runs.data(), runsSize);
+
+    msg.header.size = msg.data.size();
+    msg.header.decompressedSize = msg.data.size();
+    msg.header.width = 0;
+    msg.header.height = 0;
+    msg.header.timestamp = gpFramework->getGlobalClock().getTime() + simulatedLatencySec_;
+
+    numCellRemapBytes += msg.header.size;
+
+    // if (sendMessages_)
+    //   server_.send(msg);
+  }
+
+  metrics_.recordInt(metricIds_.cellRemapBytes, numCellRemapBytes);
+
+  auto relocations = serverHashGen_.grow(renderContext);
+
+  if (!relocations.empty()) {
+    pointCellCreateNetworkBufferStage_.resize(serverHashGen_);
+    pointHashCreateNetworkBufferStage_.resize(serverHashGen_);
+  }
+
+  uint32_t numRelocationBytes = 0;
+
+  for (const auto& relocation : relocations) {
+    TCPMessage msg;
+    msg.header.type = TCPMessageType::PAOInstanceRelocation;
+    msg.header.id = relocation.info.instanceId;
+
+    const uint32_t hashEntriesSize =
+        relocation.hashEntries.size() * sizeof(Falcor::CompactHashToCellInfo);
+
+    msg.data.resize(sizeof(Falcor::InstanceRelocationInfo) + hashEntriesSize);
+    std::memcpy(msg.data.data(), &relocation.info, sizeof(Falcor::InstanceRelocationInfo));
+    std::memcpy(
+        msg.data.data() + sizeof(Falcor::InstanceRelocationInfo),
+        relocation.hashEntries.data(),
+        hashEntriesSize);
+
+    msg.header.size = msg.data.size();
+    msg.header.decompressedSize = msg.data.size();
+    msg.header.width = 0;
+    msg.header.height = 0;
+    msg.header.timestamp = gpFramework->getGlobalClock().getTime() + simulatedLatencySec_;
+
+    numRelocationBytes += msg.header.size;
+
+    // if (sendMessages_)
+    //   server_.send(msg);
+  }
+
+  metrics_.recordInt(metricIds_.instanceRelocationBytes, numRelocationBytes);
+}
+
+void ServerPointRenderer::refitKDTrees() {
+  FALCOR_PROFILE("refitKDTrees");
+  TRACE_SCOPE("refitKDTrees");
+
+  // Like growPointStructures(), the readback waits for the GPU
+  if (kdTreeRefitInterval_ == 0 || frameCount_ % kdTreeRefitInterval_ != 0)
+    return;
+
+  serverHashGen_.readBackInstancePointInfo();
+  serverHashGen_.readBackPointSlots(kdTreePointSlots_);
+  auto& instancePointInfos = serverHashGen_.getCPUInstancePointInfo();
+
+  std::vector<uint32_t> instanceIds(instancePointInfos.size());
+  std::iota(instanceIds.begin(), instanceIds.end(), 0);
+
+  const auto stats = kdTreeGen_.refit(kdTreePointSlots_, instancePointInfos, instanceIds);
+  uint32_t numRebuiltNodes = stats.numRebuiltNodes;
+
+  // Points that moved into other cells or relocated instances change the slots of the trees
+  if (stats.numChangedInstances > 0) {
+    kdTreeGen_.generate(scene_, pointGen_, kdTreePointSlots_, instancePointInfos);
+    numRebuiltNodes = (uint32_t)kdTreeGen_.getCPUKDTree().getNodes().size();
+  }
+
+  metrics_.recordInt(metricIds_.kdTreeRefitNodes, stats.numNodes);
+  metrics_.recordInt(metricIds_.kdTreeRebuiltNodes, numRebuiltNodes);
+}
+
 void ServerPointRenderer::receiveMessages() {
   FALCOR_PROFILE("receiveMessages");
+  TRACE_SCOPE("receiveMessages");
   TCPMessage msg;
 
   // while (server_.tryPopFront(msg)) {
@@ -773,6 +1046,7 @@ void ServerPointRenderer::receiveMessages() {
 
 void ServerPointRenderer::setPerFrameVars(const Fbo* targetFbo, EyeType eye) {
   FALCOR_PROFILE("setPerFrameVars");
+  TRACE_SCOPE("setPerFrameVars");
   auto constantBuffer = rtaoVars_["perFrameConstantBuffer"];
   constantBuffer["invView"] = inverse(camera_->getViewMatrix());
   constantBuffer["viewportDims"] = float2(targetFbo->getWidth(), targetFbo->getHeight());
@@ -786,6 +1060,7 @@ void ServerPointRenderer::setPerFrameVars(const Fbo* targetFbo, EyeType eye) {
 
 void ServerPointRenderer::renderRT(RenderContext* renderContext, const Fbo* targetFbo) {
   FALCOR_PROFILE("renderRT");
+  TRACE_SCOPE("renderRT");
 
   renderContext->clearFbo(targetFbo, kClearColor, 1.0f, 0, FboAttachmentType::All);
 
@@ -805,6 +1080,7 @@ void ServerPointRenderer::renderRT(RenderContext* renderContext, const Fbo* targ
 
 void ServerPointRenderer::renderAOPoints(RenderContext* renderContext, uint32_t raytracingEnabled) {
   FALCOR_PROFILE("renderAOPoints");
+  TRACE_SCOPE("renderAOPoints");
 
   auto constantBuffer = pointAOVars_["perFrameConstantBuffer"];
   constantBuffer["sampleIndex"] = sampleIndex_++;
@@ -832,6 +1108,7 @@ void ServerPointRenderer::renderAOPoints(RenderContext* renderContext, uint32_t
   pointAOVars_["instanceToDiskRadius"] = pointGen_.getGPUDiskRadiusPerInstance();
   pointAOVars_["serverInstanceHashInfo"] = serverHashGen_.getGPUInstanceHashInfo();
   pointAOVars_["pointUpdateData"] = serverHashGen_.getGPUPointUpdateData();
+  pointAOVars_["pointUpdateColdData"] = serverHashGen_.getGPUPointUpdateColdData();
   pointAOVars_["cellAllocIndirectDispatchArgs"] = pointCellAllocStage_.getIndirectBuffer();
   pointAOVars_["cellNetworkBufferIndirectDispatchArgs"] =
       pointCellCreateNetworkBufferStage_.getCellIndirectBuffer();
@@ -840,6 +1117,8 @@ void ServerPointRenderer::renderAOPoints(RenderContext* renderContext, uint32_t
   pointAOVars_["serverHashToPointCell"] = serverHashGen_.getGPUHashToPointCell();
   pointAOVars_["hashNumBuckets"] = serverHashGen_.getGPUHashNumBuckets();
   pointAOVars_["cellDirtyFlags"] = serverHashGen_.getGPUCellDirtyFlags();
+  pointAOVars_["cellInfos"] = serverHashGen_.getGPUCellInfos();
+  pointAOVars_["cellFreeList"] = serverHashGen_.getGPUCellFreeList();
   pointAOVars_["cellDirtyInfos"] = pointCellCreateNetworkBufferStage_.getDirtyCellInfoBuffer();
   pointAOVars_["hashDirtyInfos"] = pointHashCreateNetworkBufferStage_.getDirtyHashInfoBuffer();
 
@@ -865,8 +1144,8 @@ void ServerPointRenderer::renderAOPoints(RenderContext* renderContext, uint32_t
 
   frameUpdateInfo_ = *(PerFrameUpdateInfo*)gpuFrameUpdateInfo_->map(Buffer::MapType::Read);
 
-  profilingStats_.back().networkDataStages_.push_back(
-      {"numChangedPoints", frameUpdateInfo_.numChangedPoints});
+  metrics_.recordInt(metricIds_.numChangedPoints, frameUpdateInfo_.numChangedPoints);
+  metrics_.recordInt(metricIds_.numDroppedPoints, frameUpdateInfo_.numDroppedPoints);
 
   if (frameCount_ > 100) {
     minNumPointsChanged_ = std::min(frameUpdateInfo_.numChangedPoints, minNumPointsChanged_);
@@ -876,11 +1155,45 @@ void ServerPointRenderer::renderAOPoints(RenderContext* renderContext, uint32_t
   gpuFrameUpdateInfo_->unmap();
 }
 
+void ServerPointRenderer::benchmarkPointEncodings() {
+  // The point streams are only up to date on the GPU
+  const uint32_t numPointSlots = serverHashGen_.getNumPointSlots();
+  std::vector<PointData> pointSlots(numPointSlots);
+
+  const float3* positions = (const float3*)serverHashGen_.gpuPositions_->map(Buffer::MapType::Read);
+  const float3* normals = (const float3*)serverHashGen_.gpuNormals_->map(Buffer::MapType::Read);
+  const uint32_t* instanceIds =
+      (const uint32_t*)serverHashGen_.gpuInstanceIDs_->map(Buffer::MapType::Read);
+  const float* values = (const float*)serverHashGen_.gpuValues_->map(Buffer::MapType::Read);
+
+  for (uint32_t pointSlot = 0; pointSlot < numPointSlots; pointSlot++) {
+    pointSlots[pointSlot].position = positions[pointSlot];
+    pointSlots[pointSlot].normal = normals[pointSlot];
+    pointSlots[pointSlot].instanceId = instanceIds[pointSlot];
+    pointSlots[pointSlot].value = values[pointSlot];
+  }
+
+  serverHashGen_.gpuPositions_->unmap();
+  serverHashGen_.gpuNormals_->unmap();
+  serverHashGen_.gpuInstanceIDs_->unmap();
+  serverHashGen_.gpuValues_->unmap();
+
+  PointEncodingBenchmark benchmark;
+  benchmark.settings_.interpolationRadiusFactor = interpolationRadiusFactor_;
+  benchmark.settings_.cosNormalThreshold = cosNormalThreshold_;
+  benchmark.settings_.cosDeltaThreshold = cosDeltaThreshold_;
+  benchmark.run(
+      serverHashGen_.getCPUInstancePointInfo(), pointGen_.getDiskRadiusPerInstance(), pointSlots);
+  benchmark.printSummary(std::cout);
+  benchmark.writeCSV(outputDirectory_ + "/point_encoding_benchmark.csv");
+}
+
 void ServerPointRenderer::renderAOBlur(
     RenderContext* renderContext,
     const Fbo* inputFbo,
     const Fbo* targetFbo) {
   FALCOR_PROFILE("renderAOBlur");
+  TRACE_SCOPE("renderAOBlur");
 
   renderContext->clearFbo(targetFbo, kClearColor, 1.0f, 0, FboAttachmentType::All);
 
@@ -903,6 +1216,7 @@ void ServerPointRenderer::visualizePoints(
     RenderContext* renderContext,
     const Fbo::SharedPtr& targetFbo) {
   FALCOR_PROFILE("visualizePoints");
+  TRACE_SCOPE("visualizePoints");
   const auto& animationController = scene_->getAnimationController();
   const auto& globalTransforms = animationController->getGlobalMatrices();
   const auto& invTransposeGlobalTransforms = animationController->getInvTransposeGlobalMatrices();
@@ -932,9 +1246,14 @@ void ServerPointRenderer::visualizePoints(
 void ServerPointRenderer::onFrameRender(
     RenderContext* renderContext,
     const Fbo::SharedPtr& targetFbo) {
+  TRACE_SCOPE("onFrameRender");
+
   if (!firstFrameInitDone_) {
     firstFrameInit(renderContext);
     firstFrameInitDone_ = true;
+
+    if (!args_.get<std::string>("--sweep_config").empty())
+      setupAutomatedScreenshots();
   }
 
   if (sendMessages_ && !clientInitDone_)
@@ -957,31 +1276,24 @@ void ServerPointRenderer::onFrameRender(
 
   // Update camera if we have a prerecorded path
 
-  if (!cameraPathMatrices_.empty()) {
-    rmcv::mat4 view = cameraPathMatrices_[frameCount_ % cameraPathMatrices_.size()].getTranspose();
-    rmcv::mat4 inv_view = rmcv::inverse(view);
-    // Falcor doesn't set position when setting a view matrix for some reason
-    // camera_->setPosition(view.getCol(3).xyz);
-    camera_->setViewMatrix(view);
+  if (cameraPath_.isOpen()) {
+    // Sampled at the scene time, so the playback doesn't depend on the frame rate
+    double pathTime = gpFramework->getGlobalClock().getTime();
+    CameraPathSample pose = cameraPath_.sample(pathTime, !exitAfterCameraPath_);
 
-    float3 pos = inv_view.getCol(3);
-    float3 fwd = -inv_view.getCol(2);
-    float3 up = inv_view.getCol(1);
+    const auto toFloat3 = [](const std::array<float, 3>& v) { return float3(v[0], v[1], v[2]); };
+    camera_->setPosition(toFloat3(pose.head.position));
+    camera_->setUpVector(toFloat3(pose.head.getUp()));
+    camera_->setTarget(toFloat3(pose.head.getTarget()));
 
-    camera_->setPosition(pos);
-    camera_->setUpVector(up);
-    camera_->setTarget(pos + fwd);
-
-    // camera_->updateFromAnimation(view);
-    // updateFromAnimation
-    // camera_->setTarget(camera_->getPosition() + camera_->getViewMatrix()[2].xyz);
-    // camera_->setUpVector(camera_->getViewMatrix()[1].xyz);
-
-    if (frameCount_ == cameraPathMatrices_.size() && exitAfterCameraPath_) {
+    if (exitAfterCameraPath_ && pathTime > cameraPath_.getDuration() + fixedFrameTime * 0.5f) {
       shutdown();
     }
   }
 
+  if (cameraPathRecording_)
+    recordCameraPath(gpFramework->getGlobalClock().getTime());
+
   if (fixedFrameTime > 0) {
     gpFramework->getGlobalClock().setFrame(frameCount_++);
     gpFramework->getGlobalClock().setTime(fixedFrameTime * frameCount_);
@@ -1016,11 +1328,10 @@ void ServerPointRenderer::onFrameRender(
     raytracingEnabled = 1;
   }
 
-  profilingStats_.push_back(ProfilingStats());
-  profilingStats_.back().profilingStages_.push_back({"frame_time", lastServerTimeStamp_});
-  profilingStats_.back().networkDataStages_.push_back({"frame_number", frameCount_});
-  profilingStats_.back().networkDataStages_.push_back(
-      {"number_of_points", (int64_t)pointGen_.getCPUPointData().size()});
+  metrics_.beginFrame();
+  metrics_.recordFloat(metricIds_.frameTime, lastServerTimeStamp_);
+  metrics_.recordInt(metricIds_.frameNumber, frameCount_);
+  metrics_.recordInt(metricIds_.numberOfPoints, pointGen_.getCPUPointData().size());
 
   auto start = std::chrono::high_resolution_clock::now();
   renderContext->clearFbo(screenshotFBO_.get(), kClearColor, 1.0f, 0, FboAttachmentType::All);
@@ -1031,9 +1342,15 @@ void ServerPointRenderer::onFrameRender(
     scene_->update(renderContext, sceneTime + simulatedLatencySec_);
     auto start_server_total = std::chrono::high_resolution_clock::now();
     if (raytraceAOPoints_) {
-      // only update the first portion that tracks the number of changed points per frame
-      PerFrameUpdateInfo zero = {0, 0};
-      renderContext->updateBuffer(gpuFrameUpdateInfo_.get(), &zero, 0, 4);
+      // only reset the per frame counters, numAllocatedCells tracks the total
+      PerFrameUpdateInfo zero = {0, 0, 0};
+      renderContext->updateBuffer(
+          gpuFrameUpdateInfo_.get(), &zero.numChangedPoints, 0, sizeof(uint32_t));
+      renderContext->updateBuffer(
+          gpuFrameUpdateInfo_.get(),
+          &zero.numDroppedPoints,
+          offsetof(PerFrameUpdateInfo, numDroppedPoints),
+          sizeof(uint32_t));
 
       {
         auto start_server = std::chrono::high_resolution_clock::now();
@@ -1046,10 +1363,13 @@ void ServerPointRenderer::onFrameRender(
             std::chrono::duration_cast<std::chrono::duration<float>>(end_server - start_server)
                 .count();
 
-        profilingStats_.back().profilingStages_.push_back(
-            {"server_render_ao_points", duration_server_sec});
+        metrics_.recordFloat(metricIds_.serverRenderAOPoints, duration_server_sec);
       }
 
+      if (args_.get<bool>("--benchmark_point_encodings") &&
+          frameCount_ == kPointEncodingBenchmarkFrame)
+        benchmarkPointEncodings();
+
       {
         auto start_server = std::chrono::high_resolution_clock::now();
 
@@ -1061,14 +1381,14 @@ void ServerPointRenderer::onFrameRender(
             std::chrono::duration_cast<std::chrono::duration<float>>(end_server - start_server)
                 .count();
 
-        profilingStats_.back().profilingStages_.push_back(
-            {"server_point_cell_alloc", duration_server_sec});
+        metrics_.recordFloat(metricIds_.serverPointCellAlloc, duration_server_sec);
       }
 
       {
         auto start_server = std::chrono::high_resolution_clock::now();
 
-        pointCellCreateNetworkBufferStage_.execute(renderContext, serverHashGen_, pointGen_);
+        pointCellCreateNetworkBufferStage_.execute(
+            renderContext, serverHashGen_, pointGen_, pointHashCreateNetworkBufferStage_);
 
         renderContext->flush();
         auto end_server = std::chrono::high_resolution_clock::now();
@@ -1076,8 +1396,7 @@ void ServerPointRenderer::onFrameRender(
             std::chrono::duration_cast<std::chrono::duration<float>>(end_server - start_server)
                 .count();
 
-        profilingStats_.back().profilingStages_.push_back(
-            {"server_point_cell_network_buffer", duration_server_sec});
+        metrics_.recordFloat(metricIds_.serverPointCellNetworkBuffer, duration_server_sec);
       }
 
       {
@@ -1091,8 +1410,7 @@ void ServerPointRenderer::onFrameRender(
             std::chrono::duration_cast<std::chrono::duration<float>>(end_server - start_server)
                 .count();
 
-        profilingStats_.back().profilingStages_.push_back(
-            {"server_point_hash_network_buffer", duration_server_sec});
+        metrics_.recordFloat(metricIds_.serverPointHashNetworkBuffer, duration_server_sec);
       }
     }
     auto rasterVars = rasterPass_->getVars();
@@ -1124,6 +1442,7 @@ void ServerPointRenderer::onFrameRender(
 
         {
           FALCOR_PROFILE("SSAO");
+          TRACE_SCOPE("SSAO");
           ssao_->generateAOMap(renderContext, camera_.get(), eye);
 
         }
@@ -1137,7 +1456,7 @@ void ServerPointRenderer::onFrameRender(
         .count();
 
 
-      profilingStats_.back().profilingStages_.push_back({ "ssao_render", duration_ssao });
+      metrics_.recordFloat(metricIds_.ssaoRender, duration_ssao);
     }
 
     auto end_server_total = std::chrono::high_resolution_clock::now();
@@ -1146,7 +1465,7 @@ void ServerPointRenderer::onFrameRender(
                                          end_server_total - start_server_total)
                                          .count();
 
-    profilingStats_.back().profilingStages_.push_back({"server_render", duration_server_total_sec});
+    metrics_.recordFloat(metricIds_.serverRender, duration_server_total_sec);
 
     // TODO/Hack: this is essentially the same hack as on the client side - we use the previous
     // frame's transformations to store the transformations with the simulated latency. This is a
@@ -1192,8 +1511,8 @@ void ServerPointRenderer::onFrameRender(
 
       std::vector<bool> is_really_dynamic(instanceCount);
 
-      if (vSavers_.empty()) {
-        vSavers_.resize(instanceCount);
+      if (vertexAnimExports_.empty()) {
+        vertexAnimExports_.resize(instanceCount);
         instanceMatrices_.resize(matrices.size());
 
         for (auto& instance_matrix : instanceMatrices_) {
@@ -1202,18 +1521,14 @@ void ServerPointRenderer::onFrameRender(
       }
 
       for (uint32_t instanceId = 0; instanceId < instanceCount; instanceId++) {
-        auto& vSaver = vSavers_[instanceId];
         const auto& instance = scene_->getGeometryInstance(instanceId);
         const auto& mesh = scene_->getMesh(MeshID{instance.geometryID});
 
         const auto matrix_id = instance.globalMatrixID;
         const auto& instance_matrix = matrices[matrix_id];
 
-        if (instanceMatrices_[matrix_id] == instance_matrix && !mesh.isDynamic()) {
+        if (instanceMatrices_[matrix_id] == instance_matrix && !mesh.isDynamic())
           continue;
-        } else {
-          vSaver.number_of_changed_frames++;
-        }
 
         // if (!mesh.isDynamic())
         //{
@@ -1232,7 +1547,7 @@ void ServerPointRenderer::onFrameRender(
         vertexAnimPassCB["vertexCount"] = vertexCount;
 
         Falcor::Buffer::SharedPtr resultVertices = Buffer::createStructured(
-            sizeof(PackedStaticVertexData),
+            sizeof(VertexAnimationVertex),
             vertexCount,
             ResourceBindFlags::ShaderResource | ResourceBindFlags::UnorderedAccess,
             Buffer::CpuAccess::None);
@@ -1242,43 +1557,38 @@ void ServerPointRenderer::onFrameRender(
 
         renderContext->flush(true);
 
-        PackedStaticVertexData* result_cpu =
-            (PackedStaticVertexData*)resultVertices->map(Buffer::MapType::Read);
+        const VertexAnimationVertex* result_cpu =
+            (const VertexAnimationVertex*)resultVertices->map(Buffer::MapType::Read);
 
-        // TODO: multiple instances?
-        uint32_t cpu_buffer_offset = vSaver.vertex_data.size();
-        vSaver.vertex_data.resize(vSaver.vertex_data.size() + vertexCount);
-        std::memcpy(
-            vSaver.vertex_data.data() + cpu_buffer_offset,
-            result_cpu,
-            sizeof(PackedStaticVertexData) * vertexCount);
+        // Frames are appended to the file right away, so long captures don't fill up memory
+        auto& animExport = vertexAnimExports_[instanceId];
+        if (!animExport.writer && animExport.firstFrame.empty()) {
+          animExport.firstFrame.assign(result_cpu, result_cpu + vertexCount);
+          animExport.firstFrameNumber = frameCount_;
+        } else {
+          if (!animExport.writer) {
+            std::string filename = "vertex_anim_" +
+                scene_->getMaterial(Falcor::MaterialID{instance.materialID})->getName();
+            std::string sceneName = scene_->getPath().filename().replace_extension("").string();
+            filename += std::to_string(instanceId);
+            filename += sceneName;
+            filename += ".bin";
+
+            animExport.writer = std::make_unique<VertexAnimationWriter>();
+            animExport.writer->open(filename, vertexCount);
+            animExport.writer->addFrame(
+                animExport.firstFrameNumber, animExport.firstFrame.data());
+            animExport.firstFrame = {};
+          }
 
-        vSaver.number_of_frames++;
+          animExport.writer->addFrame(frameCount_, result_cpu);
+        }
 
         resultVertices->unmap();
       }
 
-      if (exportVertexAnimFrameLimit > 0 && frameCount_ == exportVertexAnimFrameLimit) {
-        for (uint32_t instanceId = 0; instanceId < instanceCount; instanceId++) {
-          auto& vSaver = vSavers_[instanceId];
-          const auto& instance = scene_->getGeometryInstance(instanceId);
-          const auto& mesh = scene_->getMesh(MeshID{instance.geometryID});
-
-          if (vSaver.number_of_changed_frames < 10)
-            continue;
-
-          std::string filename = "vertex_anim_" +
-              scene_->getMaterial(Falcor::MaterialID{instance.materialID})->getName();
-          std::string sceneName = scene_->getPath().filename().replace_extension("").string();
-          filename += std::to_string(instanceId);
-          filename += sceneName;
-          filename += ".bin";
-
-          vSaver.save(filename.c_str());
-        }
-
+      if (exportVertexAnimFrameLimit > 0 && frameCount_ == exportVertexAnimFrameLimit)
         shutdown();
-      }
     }
 
     auto constantBuffer = rasterVars["perFrameConstantBuffer"];
@@ -1323,6 +1633,7 @@ void ServerPointRenderer::onFrameRender(
 
     {
       FALCOR_PROFILE("client_render");
+      TRACE_SCOPE("client_render");
       rasterPass_->renderScene(renderContext, screenshotFBO_);
       renderContext->flush();
     }
@@ -1331,7 +1642,7 @@ void ServerPointRenderer::onFrameRender(
     auto duration_client_sec =
         std::chrono::duration_cast<std::chrono::duration<float>>(end_client - start_client).count();
 
-    profilingStats_.back().profilingStages_.push_back({"client_render", duration_client_sec});
+    metrics_.recordFloat(metricIds_.clientRender, duration_client_sec);
 
     if (pointViz_) {
       visualizePoints(renderContext, screenshotFBO_);
@@ -1348,6 +1659,7 @@ void ServerPointRenderer::onFrameRender(
     sendMessages(renderContext);
   else {
     // Simply compress & measure
+    TRACE_SCOPE("server_compression");
 
     auto start_compress = std::chrono::high_resolution_clock::now();
 
@@ -1357,6 +1669,8 @@ void ServerPointRenderer::onFrameRender(
     auto point_hash_update_vec =
         pointHashCreateNetworkBufferStage_.getNetworkHashUpdateInfo(renderContext);
 
+    recordUpdateStream(point_cell_update_vec, point_hash_update_vec);
+
     uint32_t numCompressedBytes = 0;
 
     uint32_t inputNumBytes = point_cell_update_vec.size() *
@@ -1367,8 +1681,7 @@ void ServerPointRenderer::onFrameRender(
     numCompressedBytes =
         networkCompression_->compressData(point_cell_update_vec.data(), dummy, inputNumBytes);
 
-    profilingStats_.back().networkDataStages_.push_back(
-        {"point_cell_update_bytes", numCompressedBytes});
+    metrics_.recordInt(metricIds_.pointCellUpdateBytes, numCompressedBytes);
 
     inputNumBytes = point_hash_update_vec.size() *
         sizeof(std::remove_reference_t<decltype(point_hash_update_vec)>::value_type);
@@ -1376,8 +1689,7 @@ void ServerPointRenderer::onFrameRender(
     numCompressedBytes =
         networkCompression_->compressData(point_hash_update_vec.data(), dummy, inputNumBytes);
 
-    profilingStats_.back().networkDataStages_.push_back(
-        {"point_hash_update_bytes", numCompressedBytes});
+    metrics_.recordInt(metricIds_.pointHashUpdateBytes, numCompressedBytes);
 
     auto end_compress = std::chrono::high_resolution_clock::now();
 
@@ -1385,11 +1697,16 @@ void ServerPointRenderer::onFrameRender(
         std::chrono::duration_cast<std::chrono::duration<float>>(end_compress - start_compress)
             .count();
 
-    profilingStats_.back().profilingStages_.push_back({"server_compression", compress_duration});
+    metrics_.recordFloat(metricIds_.serverCompression, compress_duration);
 
     // std::cout << "num compressed MB: " << numCompressedBytes / 1000000.0f << std::endl;
   }
 
+  if (scene_ && raytraceAOPoints_) {
+    growPointStructures(renderContext);
+    refitKDTrees();
+  }
+
   if (!noGUI_)
     TextRenderer::render(renderContext, gpFramework->getFrameRate().getMsg(), targetFbo, {20, 20});
 
@@ -1402,16 +1719,62 @@ void ServerPointRenderer::onFrameRender(
       duration_sec * movingAverageFactor_ + smoothedRenderTime_ * (1.0f - movingAverageFactor_);
 
   screenshotHelper_.endFrame();
+  metrics_.endFrame();
+
+  if (sweep_ && !screenshotHelper_.isRunning() && args_.get<bool>("--exit_after_sweep"))
+    shutdown();
 
   if (args_.get<bool>("--export_images")) {
     std::stringstream ss;
     ss << std::setw(10) << std::setfill('0') << frameCount_ - 1;
     std::string s = ss.str();
-    screenshotFBO_->getColorTexture(0)->captureToFile(
-        0, 0, screenshotOutputDirectory_ + s + ".png");
+    exportImage(renderContext, screenshotOutputDirectory_ + s + ".png");
+  }
+}
+
+void ServerPointRenderer::exportImage(RenderContext* renderContext, const std::string& filename) {
+  TRACE_SCOPE("exportImage");
+
+  const Texture* texture = screenshotFBO_->getColorTexture(0).get();
+
+  PendingImageReadback readback;
+  readback.filename = filename;
+  readback.width = texture->getWidth();
+  readback.height = texture->getHeight();
 
-    Threading::finish();
+  switch (texture->getFormat()) {
+    case ResourceFormat::BGRA8Unorm:
+    case ResourceFormat::BGRA8UnormSrgb:
+      readback.format = CapturePixelFormat::kBGRA8;
+      break;
+    case ResourceFormat::RGBA8Unorm:
+    case ResourceFormat::RGBA8UnormSrgb:
+      readback.format = CapturePixelFormat::kRGBA8;
+      break;
+    default:
+      // Formats the pipeline can't encode use Falcor's (blocking) capture
+      texture->captureToFile(0, 0, filename);
+      Threading::finish();
+      return;
   }
+
+  // The copy into the readback buffer is submitted now, but only waited for a few frames later
+  readback.task = renderContext->asyncReadTextureSubresource(texture, 0);
+  pendingImageReadbacks_.push_back(std::move(readback));
+
+  if (pendingImageReadbacks_.size() > kImageReadbackLatency)
+    submitImageReadback();
+}
+
+void ServerPointRenderer::submitImageReadback() {
+  PendingImageReadback& readback = pendingImageReadbacks_.front();
+
+  // Waits for the copy, the rows are tightly packed
+  std::vector<uint8_t> pixels = readback.task->getData();
+  imageCapturePipeline_->submit(
+      readback.filename, readback.width, readback.height, readback.format, pixels.data());
+
+  pendingImageReadbacks_.pop_front();
 }
 
 bool ServerPointRenderer::onKeyEvent(const KeyboardEvent& keyEvent) {
@@ -1424,27 +1787,19 @@ bool ServerPointRenderer::onKeyEvent(const KeyboardEvent& keyEvent) {
       saveTriangleVisibilityBuffer();
     }
 
-    /*
-  if (keyEvent.key == KeyboardEvent::Key::Minus) {
-    // Export current cam position / orientation
-
-    std::string cameraDumpStr = "";
-
-    const auto& headPos = camera_->getHeadPosition();
-    const auto& headTarget = camera_->getHeadTarget();
-    const auto& upVec = camera_->getUpVector();
-
-    cameraDumpStr += "camera_->setHeadPosition(glm::" + glm::to_string(headPos) + ");\n";
-    cameraDumpStr += "camera_->setHeadTarget(glm::" + glm::to_string(headTarget) + ");\n";
-    cameraDumpStr += "camera_->setUpVector(glm::" + glm::to_string(upVec) + ");\n";
-
-    logWarning("Camera dump: ");
-    logWarning(cameraDumpStr);
-
-    screenshotFBO_->getColorTexture(0)->captureToFile(0, 0, "texture.png");
-  } else */
+    if (keyEvent.key == Input::Key::Minus) {
+      // Export the current camera as a "cameras" entry of a sweep config
+      const auto toJson = [](const float3& v) {
+        std::stringstream ss;
+        ss << "[" << v.x << ", " << v.y << ", " << v.z << "]";
+        return ss.str();
+      };
 
-    if (keyEvent.key == Input::Key::Equal) {
+      logWarning(
+          "Camera dump: {\"position\": " + toJson(camera_->getPosition()) +
+          ", \"target\": " + toJson(camera_->getTarget()) +
+          ", \"up\": " + toJson(camera_->getUpVector()) + "}");
+    } else if (keyEvent.key == Input::Key::Equal) {
       // Setup screenshot helper
       setupAutomatedScreenshots();
     } else if (keyEvent.key == Input::Key::RightBracket) {
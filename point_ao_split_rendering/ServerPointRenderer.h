@@ -19,15 +19,28 @@
 #include "PointData.slang"
 #include "Rendering/Lights/EnvMapLighting.h"
 #include "ScreenshotCaptureHelper.h"
+#include "Tracing.h"
 
 #include <atomic>
+#include <deque>
+#include "BakePackage.h"
+#include "CPUAOReconstruction.h"
+#include "CameraPath.h"
+#include "ExperimentSweep.h"
+#include "FLIPComparisonPool.h"
+#include "HashTableAnalysis.h"
+#include "ImageCapturePipeline.h"
 #include "MeshPointGenerator.h"
+#include "MetricsRegistry.h"
 #include "NetworkCompressionBase.h"
 #include "PointAOConstantsShared.slangh"
 #include "PointHashGenerator.h"
+#include "PointEncodingBenchmark.h"
 #include "PointKDTreeGenerator.h"
 #include "PointServerHashGenerator.h"
 #include "RenderGraph/BasePasses/RasterScenePass.h"
+#include "TriangleVisibilitySet.h"
+#include "VertexAnimation.h"
 #include "argparse.hpp"
 
 #include <fstream>
@@ -41,39 +54,6 @@ const static EyeType kAllEyes[2] = {kEyeLeft, kEyeRight};
 
 namespace split_rendering {
 
-class VertexAnimationSaver {
- public:
-  std::vector<PackedStaticVertexData> vertex_data;
-  uint32_t number_of_frames = 0;
-  uint32_t number_of_changed_frames = 0;
-
-  void save(const char* path) {
-    std::ofstream file(path, std::ios::binary);
-    file.write((const char*)&number_of_frames, sizeof(uint32_t));
-    file.write((const char*)&vertex_data[0], sizeof(PackedStaticVertexData) * vertex_data.size());
-  }
-};
-
-struct NamedFloatTuple
-{
-  NamedFloatTuple(std::string name, float val) : name_(name), val_(val) {}
-  std::string name_;
-  float val_;
-};
-
-struct NamedIntTuple
-{
-  NamedIntTuple(std::string name, int64_t val) : name_(name), val_(val) {}
-  std::string name_;
-  int64_t val_;
-};
-
-struct ProfilingStats
-{
-  std::vector<NamedFloatTuple> profilingStages_;
-  std::vector<NamedIntTuple> networkDataStages_;
-};
-
 class ServerPointRenderer : public IRenderer {
  public:
   const Gui::DropdownList kAOTypeDropdown = {
@@ -91,13 +71,31 @@ class ServerPointRenderer : public IRenderer {
         exitAfterCameraPath_(args.get<bool>("--exit_after_camera_path")),
         raytracingFramerate_(args.get<int>("--raytracingFramerate")),
         serverFramerate_(args.get<int>("--serverFramerate")),
-        aoOnly_(args.get<bool>("--aoOnly")) {
+        aoOnly_(args.get<bool>("--aoOnly")),
+        occupancyCheckInterval_((uint32_t)args.get<int>("--occupancy_check_interval")),
+        kdTreeRefitInterval_((uint32_t)args.get<int>("--kd_tree_refit_interval")) {
 
     pointGen_.kNumSamplesPerUnitSquaredEliminated =
         args.get<int>("--numSamplesPerUnitSquaredEliminated");
     pointGen_.kMinSamplesPerInstance =
         args.get<int>("--minSamplesPerInstance");
 
+    std::string hash_type = args.get<std::string>("--hash_type");
+
+    if (hash_type == "morton")
+      serverHashGen_.hashType_ = HASH_TYPE_MORTON;
+    else if (hash_type == "xorshift")
+      serverHashGen_.hashType_ = HASH_TYPE_XORSHIFT;
+    else
+      serverHashGen_.hashType_ = HASH_TYPE_LINEAR;
+
+    std::string cell_capacity = args.get<std::string>("--cell_capacity");
+
+    for (int capacityClass = 0; capacityClass < NUM_CELL_CAPACITY_CLASSES; capacityClass++) {
+      if (cell_capacity == std::to_string(Falcor::getCellCapacity(capacityClass)))
+        serverHashGen_.cellCapacityClass_ = capacityClass;
+    }
+
     std::string selected_renderer = args.get<std::string>("--selected_renderer");
 
     if (selected_renderer == "RTAO")
@@ -114,6 +112,20 @@ class ServerPointRenderer : public IRenderer {
 
     std::filesystem::create_directories(std::filesystem::path{screenshotOutputDirectory_});
 
+    registerMetrics();
+
+    flipComparisonPool_ =
+        std::make_unique<FlipComparisonPool>((uint32_t)args.get<int>("--flip_workers"));
+
+    imageCapturePipeline_ = std::make_unique<ImageCapturePipeline>(
+        (uint32_t)args.get<int>("--export_image_buffers"),
+        (uint32_t)args.get<int>("--export_image_workers"));
+
+    if (args.get<bool>("--trace")) {
+      Tracing::enable("FalcorServer", 1);
+      Tracing::setThreadName("render");
+    }
+
     setupNetworkCallbacks();
   }
 
@@ -145,6 +157,12 @@ class ServerPointRenderer : public IRenderer {
   bool colorOnly_ = false;
   bool pointViz_ = false;
   bool raytraceAOPoints_ = true;
+  // Frames between two checks of the hash table and point cell pool occupancy, 0 never grows or
+  // compacts them
+  uint32_t occupancyCheckInterval_ = 30;
+  // Frames between two refits of the kd-trees to the moved points, 0 doesn't build the kd-trees
+  // except to write them into a new bake package
+  uint32_t kdTreeRefitInterval_ = 0;
   bool sendMessages_ = false;
   bool noGUI_ = false;
   bool useCompression_ = false;
@@ -200,6 +218,8 @@ class ServerPointRenderer : public IRenderer {
 
   MeshPointGenerator pointGen_;
   PointKDTreeGenerator kdTreeGen_;
+  // Point slots read back for refitKDTrees()
+  PointDataSoA kdTreePointSlots_;
   PointHashGenerator hashGen_;
   PointServerHashGenerator serverHashGen_;
   TCPMessage latencyMessage_;
@@ -212,8 +232,7 @@ class ServerPointRenderer : public IRenderer {
   PointCellCreateNetworkBufferStage pointCellCreateNetworkBufferStage_;
   PointHashCreateNetworkBufferStage pointHashCreateNetworkBufferStage_;
   ScreenshotCaptureHelper screenshotHelper_;
-  std::vector<std::function<void()>> automatedCameraSetups_;
-  std::vector<std::function<void()>> automatedAOConfigSetups_;
+  std::unique_ptr<ExperimentSweep> sweep_;
 
   static constexpr float movingAverageFactor_ = 0.3f;
   float smoothedRenderTime_ = 0.0f;
@@ -224,14 +243,38 @@ class ServerPointRenderer : public IRenderer {
   const float fixedFrameTime = 0.016666666666666f;
   uint32_t exportVertexAnimFrameLimit = 1800;
   std::chrono::steady_clock::time_point lastShadedTime_;
-  std::vector<VertexAnimationSaver> vSavers_;
+  struct VertexAnimationExport {
+    // The first frame stays in memory until the instance changes again, so static instances
+    // don't keep a file open
+    std::vector<VertexAnimationVertex> firstFrame;
+    uint32_t firstFrameNumber = 0;
+    std::unique_ptr<VertexAnimationWriter> writer;
+  };
+  std::vector<VertexAnimationExport> vertexAnimExports_;
   Falcor::SceneBuilder::InstanceMatrices instanceMatrices_;
   std::vector<bool> meshStaticFlags_;
   bool exportVertexAnims_ = false;
-  std::vector<rmcv::mat4x4> cameraPathMatrices_;
+  CameraPath cameraPath_;
+  // Set by --record_camera_path, the camera of every frame is written on shutdown()
+  std::unique_ptr<CameraPathWriter> cameraPathRecording_;
+  // Mapped from setupPointStructures() until the init messages are sent
+  BakePackage bakePackage_;
+  // Set by --record_update_stream until its frames are recorded and written
+  std::unique_ptr<UpdateStreamRecording> updateStreamRecording_;
 
   void sendMessages(RenderContext* renderContext);
+  // Compacts fragmented point cell pools, grows hash tables / point cell pools that are running
+  // full and sends the cell remaps and relocations
+  void growPointStructures(RenderContext* renderContext);
+  // Refits the kd-trees to the point slots read back from the GPU and rebuilds them if points
+  // moved into other slots
+  void refitKDTrees();
   void receiveMessages();
+  // Adds the network buffers of a frame to updateStreamRecording_ and writes it once it has
+  // --record_frames frames
+  void recordUpdateStream(
+      const std::vector<uint32_t>& packedCellUpdates,
+      const std::vector<Falcor::HashUpdateInfo>& hashUpdates);
 
   void setPerFrameVars(const Fbo* targetFbo, EyeType eye);
   void renderRT(RenderContext* renderContext, const Fbo* targetFbo);
@@ -242,18 +285,40 @@ class ServerPointRenderer : public IRenderer {
 
   void firstFrameInit(RenderContext* renderContext);
   void setupPointStructures(RenderContext* renderContext);
+  // Describes the scene and every setting the point structures depend on, bake packages (see
+  // --bake_package) with another key are regenerated
+  std::string getBakeKey() const;
+  bool writeBakePackage(const std::string& filename);
+  // Schedules the runs of the sweep (--sweep_config) that aren't finished yet
   void setupAutomatedScreenshots();
+  // Writes the screenshot of the run and queues its FLIP comparison
+  void finishSweepRun(const SweepRun& run);
+
+  // Runs PointEncodingBenchmark on the current server points (--benchmark_point_encodings)
+  void benchmarkPointEncodings();
 
+  // Opens --camera_path and writes it in the current format if it's legacy and
+  // --convert_camera_path is set
   void loadCameraPath();
+  void recordCameraPath(double time);
 
   void initTriangleVisibilityBuffer();
   void saveTriangleVisibilityBuffer();
+  std::string getTriangleVisibilityPath() const;
 
+  // Queues the readback of the screenshot texture for --export_images, the pixels are handed to
+  // imageCapturePipeline_ kImageReadbackLatency frames later, when the copy is done
+  void exportImage(RenderContext* renderContext, const std::string& filename);
+  void submitImageReadback();
+
+  void registerMetrics();
+  // Closes the vertex animation files, only instances that changed often enough are kept
+  void finishVertexAnimationExport();
   void shutdown();
 
 
   std::vector<uint32_t> instanceTriangleVisibilityOffsets_;
-  std::vector<uint32_t> cpuTriangleVisibilityData_;
+  TriangleVisibilitySet triangleVisibility_;
   Buffer::SharedPtr triangleVisibilityData_;
   Buffer::SharedPtr triangleVisibilityDataPerFrame_;
   Buffer::SharedPtr triangleVisibilityDataTest_;
@@ -263,7 +328,46 @@ class ServerPointRenderer : public IRenderer {
   bool exitAfterCameraPath_ = false;
   std::string outputDirectory_ = "";
   std::string screenshotOutputDirectory_ = "";
-  std::vector<ProfilingStats> profilingStats_;
+
+  // Per-frame timings in seconds and sizes in bytes, registered in registerMetrics()
+  MetricsRegistry metrics_;
+  struct MetricIds {
+    MetricsRegistry::MetricId frameTime;
+    MetricsRegistry::MetricId frameNumber;
+    MetricsRegistry::MetricId numberOfPoints;
+    MetricsRegistry::MetricId serverRenderAOPoints;
+    MetricsRegistry::MetricId serverPointCellAlloc;
+    MetricsRegistry::MetricId serverPointCellNetworkBuffer;
+    MetricsRegistry::MetricId serverPointHashNetworkBuffer;
+    MetricsRegistry::MetricId ssaoRender;
+    MetricsRegistry::MetricId serverRender;
+    MetricsRegistry::MetricId clientRender;
+    MetricsRegistry::MetricId serverCompression;
+    MetricsRegistry::MetricId numChangedPoints;
+    MetricsRegistry::MetricId numDroppedPoints;
+    MetricsRegistry::MetricId pointCellUpdateBytes;
+    MetricsRegistry::MetricId pointHashUpdateBytes;
+    MetricsRegistry::MetricId cellRemapBytes;
+    MetricsRegistry::MetricId instanceRelocationBytes;
+    MetricsRegistry::MetricId kdTreeRefitNodes;
+    MetricsRegistry::MetricId kdTreeRebuiltNodes;
+  } metricIds_;
+
+  // FLIP of the automated screenshots
+  std::unique_ptr<FlipComparisonPool> flipComparisonPool_;
+
+  // --export_images
+  struct PendingImageReadback {
+    std::string filename;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    CapturePixelFormat format = CapturePixelFormat::kBGRA8;
+    CopyContext::ReadTextureTask::SharedPtr task;
+  };
+
+  static constexpr size_t kImageReadbackLatency = 2;
+  std::deque<PendingImageReadback> pendingImageReadbacks_;
+  std::unique_ptr<ImageCapturePipeline> imageCapturePipeline_;
 };
 
 } // namespace split_rendering
@@ -12,6 +12,7 @@
 
 #include "ServerScreenSpaceRenderer.h"
 #include "BinaryMessageType.h"
+#include "Tracing.h"
 
 //#include <glog/logging.h>
 
@@ -172,6 +173,7 @@ void ServerScreenSpaceRenderer::receiveMessages() {}
 
 void ServerScreenSpaceRenderer::setPerFrameVars(const Fbo* targetFbo, EyeType eye) {
   FALCOR_PROFILE("setPerFrameVars");
+  TRACE_SCOPE("setPerFrameVars");
   auto constantBuffer = rtaoVars_["perFrameConstantBuffer"];
   constantBuffer["invView"] = glm::inverse(camera_->getViewMatrix(eye));
   constantBuffer["viewportDims"] = float2(targetFbo->getWidth(), targetFbo->getHeight());
@@ -185,6 +187,7 @@ void ServerScreenSpaceRenderer::setPerFrameVars(const Fbo* targetFbo, EyeType ey
 
 void ServerScreenSpaceRenderer::renderRT(RenderContext* renderContext, const Fbo* targetFbo) {
   FALCOR_PROFILE("renderRT");
+  TRACE_SCOPE("renderRT");
 
   renderContext->clearFbo(targetFbo, kClearColor, 1.0f, 0, FboAttachmentType::All);
 
@@ -209,6 +212,7 @@ void ServerScreenSpaceRenderer::renderAOBlur(
     const Fbo* inputFbo,
     const Fbo* targetFbo) {
   FALCOR_PROFILE("renderAOBlur");
+  TRACE_SCOPE("renderAOBlur");
 
   renderContext->clearFbo(targetFbo, kClearColor, 1.0f, 0, FboAttachmentType::All);
 
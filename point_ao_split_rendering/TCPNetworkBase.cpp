@@ -8,6 +8,7 @@
 
 
 #include "TCPNetworkBase.h"
+#include "Tracing.h"
 
 namespace split_rendering {
 
@@ -21,6 +22,8 @@ void TCPNetworkBase::startThreads() {
   threadRunning_ = true;
 
   receiverThread_ = std::thread([&]() {
+    Tracing::setThreadName("receiver");
+
     establishConnection();
 
     while (tcpConnection_.getStatus() != rlr_streaming::TcpStatus::Connected) {
@@ -48,6 +51,9 @@ void TCPNetworkBase::startThreads() {
         return -1;
       }
 
+      // Excludes waiting for the header, i.e. for the next message
+      TRACE_SCOPE("receiveMessage");
+
       message.data.resize(message.header.size);
       if (!tcpConnection_.receive(message.data.data(), message.header.size)) {
         LOG(ERROR) << "Failed to read message";
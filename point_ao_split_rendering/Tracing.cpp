@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Tracing.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace split_rendering {
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  int64_t startNs;
+  int64_t durationNs;
+};
+
+struct ThreadBuffer {
+  uint32_t threadId = 0;
+  // Guarded by TraceRegistry::mutex
+  std::string threadName;
+  std::unique_ptr<TraceEvent[]> events;
+  uint32_t capacity = 0;
+  // Written by the owning thread only, events [0, numEvents) are complete
+  std::atomic<uint32_t> numEvents{0};
+  std::atomic<uint64_t> numDropped{0};
+  // Start of the first dropped scope, marks where the thread's trace ends
+  std::atomic<int64_t> firstDroppedNs{0};
+};
+
+struct TraceRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  std::string processName = "split_rendering";
+  uint32_t processId = 0;
+  uint32_t maxEventsPerThread = Tracing::kDefaultMaxEventsPerThread;
+  uint32_t nextThreadId = 0;
+};
+
+TraceRegistry& getRegistry() {
+  static TraceRegistry registry;
+  return registry;
+}
+
+thread_local ThreadBuffer* tlsBuffer = nullptr;
+thread_local const char* tlsThreadName = nullptr;
+
+ThreadBuffer* getThreadBuffer() {
+  if (tlsBuffer != nullptr)
+    return tlsBuffer;
+
+  TraceRegistry& registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  auto buffer = std::make_unique<ThreadBuffer>();
+  buffer->threadId = registry.nextThreadId++;
+  buffer->threadName = tlsThreadName != nullptr
+      ? tlsThreadName
+      : "thread " + std::to_string(buffer->threadId);
+  buffer->capacity = registry.maxEventsPerThread;
+  buffer->events.reset(new TraceEvent[buffer->capacity]);
+
+  tlsBuffer = buffer.get();
+  registry.buffers.push_back(std::move(buffer));
+  return tlsBuffer;
+}
+
+void writeJSONString(std::ostream& out, const std::string& str) {
+  out << "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      out << '\\' << c;
+    else if ((unsigned char)c < 0x20)
+      out << ' ';
+    else
+      out << c;
+  }
+  out << "\"";
+}
+
+} // namespace
+
+std::atomic<bool> Tracing::enabled_{false};
+
+void Tracing::enable(
+    const std::string& processName,
+    uint32_t processId,
+    uint32_t maxEventsPerThread) {
+  TraceRegistry& registry = getRegistry();
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.processName = processName;
+    registry.processId = processId;
+    // Only applies to threads that didn't record yet
+    registry.maxEventsPerThread = std::max<uint32_t>(maxEventsPerThread, 1);
+  }
+
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracing::disable() {
+  enabled_.store(false, std::memory_order_relaxed);
+}
+
+void Tracing::setThreadName(const char* name) {
+  tlsThreadName = name;
+
+  if (tlsBuffer != nullptr) {
+    std::lock_guard<std::mutex> lock(getRegistry().mutex);
+    tlsBuffer->threadName = name;
+  }
+}
+
+void Tracing::record(const char* name, int64_t startNs, int64_t endNs) {
+  ThreadBuffer* buffer = getThreadBuffer();
+
+  uint32_t numEvents = buffer->numEvents.load(std::memory_order_relaxed);
+  if (numEvents >= buffer->capacity) {
+    if (buffer->numDropped.fetch_add(1, std::memory_order_relaxed) == 0) {
+      buffer->firstDroppedNs.store(startNs, std::memory_order_relaxed);
+      std::cout << "trace buffer of thread " << buffer->threadId << " is full after "
+                << buffer->capacity << " scopes, further scopes are dropped" << std::endl;
+    }
+    return;
+  }
+
+  buffer->events[numEvents] = {name, startNs, endNs - startNs};
+  buffer->numEvents.store(numEvents + 1, std::memory_order_release);
+}
+
+uint64_t Tracing::getNumDroppedEvents() {
+  TraceRegistry& registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  uint64_t numDropped = 0;
+  for (const auto& buffer : registry.buffers)
+    numDropped += buffer->numDropped.load(std::memory_order_relaxed);
+  return numDropped;
+}
+
+bool Tracing::writeChromeTrace(const std::string& filename) {
+  std::ofstream file(filename, std::ios::out);
+
+  if (!file.is_open()) {
+    std::cout << "could not write trace to " << filename << std::endl;
+    return false;
+  }
+
+  TraceRegistry& registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+
+  // Timestamps are steady_clock time in us, which is shared by all processes of a machine on
+  // Windows, so the traces of server and client can be loaded together
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << registry.processId
+       << ",\"tid\":0,\"args\":{\"name\":";
+  writeJSONString(file, registry.processName);
+  file << "}}";
+
+  uint64_t numEventsTotal = 0;
+  uint64_t numDroppedTotal = 0;
+
+  for (const auto& buffer : registry.buffers) {
+    file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << registry.processId
+         << ",\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+    writeJSONString(file, buffer->threadName);
+    file << "}}";
+
+    uint32_t numEvents = buffer->numEvents.load(std::memory_order_acquire);
+
+    for (uint32_t i = 0; i < numEvents; i++) {
+      const TraceEvent& event = buffer->events[i];
+
+      file << ",\n{\"name\":";
+      writeJSONString(file, event.name);
+      file << ",\"ph\":\"X\",\"pid\":" << registry.processId << ",\"tid\":" << buffer->threadId
+           << ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0
+           << "}";
+    }
+
+    // Dropped scopes show up as an instant event on the thread where its trace ends
+    const uint64_t numDropped = buffer->numDropped.load(std::memory_order_relaxed);
+
+    if (numDropped > 0) {
+      file << ",\n{\"name\":\"trace buffer full, " << numDropped
+           << " scopes dropped\",\"ph\":\"i\",\"s\":\"t\",\"pid\":" << registry.processId
+           << ",\"tid\":" << buffer->threadId << ",\"ts\":"
+           << buffer->firstDroppedNs.load(std::memory_order_relaxed) / 1000.0
+           << ",\"args\":{\"dropped_events\":" << numDropped << "}}";
+    }
+
+    numEventsTotal += numEvents;
+    numDroppedTotal += numDropped;
+  }
+
+  file << "\n],\"otherData\":{\"dropped_events\":\"" << numDroppedTotal << "\"}}\n";
+
+  std::cout << "wrote " << numEventsTotal << " trace events of " << registry.buffers.size()
+            << " threads to " << filename;
+  if (numDroppedTotal > 0)
+    std::cout << " (" << numDroppedTotal << " dropped, buffers full)";
+  std::cout << std::endl;
+
+  return true;
+}
+
+} // namespace split_rendering
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace split_rendering {
+
+// CPU trace of scopes on all threads of a process that can be viewed in chrome://tracing or
+// Perfetto (ui.perfetto.dev), e.g. to see how the receiver thread, compression and the render
+// thread overlap.
+//
+// Every thread records into its own preallocated buffer, so recording a scope doesn't take a lock
+// or allocate (except for the first scope of a thread). Buffers are kept after their thread exits.
+// Once a buffer is full, further scopes of that thread are dropped and counted, the trace marks
+// where they start and has their count. While tracing is disabled, a scope only costs one relaxed
+// atomic load.
+//
+// Scope names must outlive the trace, i.e. should be string literals.
+class Tracing {
+ public:
+  // Events per thread, 24 bytes each
+  static constexpr uint32_t kDefaultMaxEventsPerThread = 1 << 16;
+
+  // processId and processName identify the process when traces of server and client are merged
+  static void enable(
+      const std::string& processName,
+      uint32_t processId,
+      uint32_t maxEventsPerThread = kDefaultMaxEventsPerThread);
+  static void disable();
+  static bool isEnabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Shown instead of the thread id, can be called before tracing is enabled
+  static void setThreadName(const char* name);
+
+  // Chrome trace event format (JSON). Threads that record while writing can be missing their
+  // newest scopes.
+  static bool writeChromeTrace(const std::string& filename);
+
+  static uint64_t getNumDroppedEvents();
+
+  static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static void record(const char* name, int64_t startNs, int64_t endNs);
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+// Records the time from its construction to the end of the enclosing scope
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name) {
+    if (Tracing::isEnabled()) {
+      name_ = name;
+      start_ = Tracing::now();
+    }
+  }
+
+  ~TraceScope() {
+    if (name_ != nullptr)
+      Tracing::record(name_, start_, Tracing::now());
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* name_ = nullptr;
+  int64_t start_ = 0;
+};
+
+} // namespace split_rendering
+
+#define TRACE_SCOPE_CONCAT_IMPL(a, b) a##b
+#define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) \
+  ::split_rendering::TraceScope TRACE_SCOPE_CONCAT(traceScope_, __LINE__)(name)
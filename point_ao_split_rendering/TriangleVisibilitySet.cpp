@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TriangleVisibilitySet.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace split_rendering {
+
+namespace {
+
+uint32_t popcount64(uint64_t x) {
+  x = x - ((x >> 1) & 0x5555555555555555ull);
+  x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return (uint32_t)((x * 0x0101010101010101ull) >> 56);
+}
+
+size_t alignTo8(size_t size) {
+  return (size + 7) & ~(size_t)7;
+}
+
+uint32_t getNumWords(uint32_t chunkSize) {
+  return (chunkSize + 63) / 64;
+}
+
+uint32_t getNumBlocks(uint32_t chunkSize) {
+  return (getNumWords(chunkSize) + TriangleVisibilitySet::kBlockWords - 1) /
+      TriangleVisibilitySet::kBlockWords;
+}
+
+size_t getPayloadSize(const TriangleVisibilityContainer& container, uint32_t chunkSize) {
+  switch (container.type) {
+    case TriangleVisibilityContainer::kArray:
+      return sizeof(uint16_t) * container.cardinality;
+    case TriangleVisibilityContainer::kBitmap:
+      return sizeof(uint64_t) * getNumWords(chunkSize) +
+          sizeof(uint16_t) * getNumBlocks(chunkSize);
+    default:
+      return 0;
+  }
+}
+
+} // namespace
+
+bool TriangleVisibilitySet::open(
+    const std::string& filename,
+    const std::vector<uint32_t>& legacyInstanceOffsets) {
+  close();
+
+  if (!file_.open(filename)) {
+    std::cout << "could not open triangle visibility " << filename << std::endl;
+    return false;
+  }
+
+  TriangleVisibilityFileHeader header;
+  if (file_.getSize() >= sizeof(header))
+    std::memcpy(&header, file_.getData(), sizeof(header));
+
+  if (file_.getSize() < sizeof(header) || header.magic != TriangleVisibilityFileHeader::kMagic) {
+    // Legacy: one uint32 per triangle
+    if (legacyInstanceOffsets.empty() || file_.getSize() % sizeof(uint32_t) != 0) {
+      std::cout << "invalid triangle visibility " << filename << std::endl;
+      close();
+      return false;
+    }
+
+    assign(
+        reinterpret_cast<const uint32_t*>(file_.getData()),
+        (uint32_t)(file_.getSize() / sizeof(uint32_t)),
+        legacyInstanceOffsets);
+    return true;
+  }
+
+  if (!setData(file_.getData(), file_.getSize())) {
+    std::cout << "invalid triangle visibility " << filename << " (version " << header.version
+              << ")" << std::endl;
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void TriangleVisibilitySet::close() {
+  file_.close();
+  encoded_.clear();
+  header_ = {};
+  data_ = nullptr;
+  size_ = 0;
+  instances_ = nullptr;
+  containers_ = nullptr;
+}
+
+void TriangleVisibilitySet::assign(
+    const uint32_t* triangleVisibility,
+    uint32_t numTriangles,
+    const std::vector<uint32_t>& instanceOffsets) {
+  TriangleVisibilityFileHeader header;
+  header.numInstances = (uint32_t)instanceOffsets.size();
+  header.numTriangles = numTriangles;
+
+  std::vector<TriangleVisibilityInstance> instances(header.numInstances + 1);
+  std::vector<TriangleVisibilityContainer> containers;
+  std::vector<uint8_t> payload;
+
+  for (uint32_t instanceId = 0; instanceId <= header.numInstances; instanceId++) {
+    uint32_t begin = instanceId < header.numInstances
+        ? std::min(instanceOffsets[instanceId], numTriangles)
+        : numTriangles;
+    uint32_t end = instanceId + 1 < header.numInstances
+        ? std::clamp(instanceOffsets[instanceId + 1], begin, numTriangles)
+        : numTriangles;
+
+    instances[instanceId] = {begin, (uint32_t)containers.size()};
+    if (instanceId == header.numInstances)
+      break;
+
+    for (uint32_t chunkBegin = begin; chunkBegin < end; chunkBegin += kChunkSize) {
+      uint32_t chunkSize = std::min(end - chunkBegin, kChunkSize);
+      const uint32_t* chunk = triangleVisibility + chunkBegin;
+
+      TriangleVisibilityContainer container = {};
+      container.rank = header.numVisible;
+      container.cardinality =
+          (uint32_t)std::count_if(chunk, chunk + chunkSize, [](uint32_t v) { return v != 0; });
+      header.numVisible += container.cardinality;
+
+      if (container.cardinality == 0) {
+        container.type = TriangleVisibilityContainer::kEmpty;
+      } else if (container.cardinality == chunkSize) {
+        container.type = TriangleVisibilityContainer::kFull;
+      } else {
+        container.type = TriangleVisibilityContainer::kArray;
+        size_t arraySize = getPayloadSize(container, chunkSize);
+        container.type = TriangleVisibilityContainer::kBitmap;
+        if (arraySize < getPayloadSize(container, chunkSize))
+          container.type = TriangleVisibilityContainer::kArray;
+      }
+
+      container.dataOffset = (uint32_t)payload.size();
+      payload.resize(alignTo8(payload.size() + getPayloadSize(container, chunkSize)));
+      uint8_t* data = payload.data() + container.dataOffset;
+
+      if (container.type == TriangleVisibilityContainer::kArray) {
+        uint16_t* indices = reinterpret_cast<uint16_t*>(data);
+        for (uint32_t i = 0; i < chunkSize; i++) {
+          if (chunk[i] != 0)
+            *indices++ = (uint16_t)i;
+        }
+      } else if (container.type == TriangleVisibilityContainer::kBitmap) {
+        uint32_t numWords = getNumWords(chunkSize);
+        uint64_t* words = reinterpret_cast<uint64_t*>(data);
+        uint16_t* blockRanks = reinterpret_cast<uint16_t*>(words + numWords);
+
+        for (uint32_t i = 0; i < chunkSize; i++) {
+          if (chunk[i] != 0)
+            words[i / 64] |= 1ull << (i % 64);
+        }
+
+        uint32_t blockRank = 0;
+        for (uint32_t w = 0; w < numWords; w++) {
+          if (w % kBlockWords == 0)
+            blockRanks[w / kBlockWords] = (uint16_t)blockRank;
+          blockRank += popcount64(words[w]);
+        }
+      }
+
+      containers.push_back(container);
+    }
+  }
+
+  header.numContainers = (uint32_t)containers.size();
+  header.instanceOffset = sizeof(header);
+  header.containerOffset =
+      header.instanceOffset + (uint32_t)(sizeof(TriangleVisibilityInstance) * instances.size());
+  size_t payloadOffset =
+      alignTo8(header.containerOffset + sizeof(TriangleVisibilityContainer) * containers.size());
+
+  for (auto& container : containers)
+    container.dataOffset += (uint32_t)payloadOffset;
+
+  size_t size = payloadOffset + payload.size();
+  std::vector<uint64_t> encoded(alignTo8(size) / sizeof(uint64_t));
+  uint8_t* data = reinterpret_cast<uint8_t*>(encoded.data());
+
+  std::memcpy(data, &header, sizeof(header));
+  std::memcpy(
+      data + header.instanceOffset,
+      instances.data(),
+      sizeof(TriangleVisibilityInstance) * instances.size());
+  std::memcpy(
+      data + header.containerOffset,
+      containers.data(),
+      sizeof(TriangleVisibilityContainer) * containers.size());
+  if (!payload.empty())
+    std::memcpy(data + payloadOffset, payload.data(), payload.size());
+
+  // The input may be the mapped file
+  close();
+  encoded_ = std::move(encoded);
+  setData(reinterpret_cast<const uint8_t*>(encoded_.data()), size);
+}
+
+bool TriangleVisibilitySet::write(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::binary);
+  if (!file.is_open()) {
+    std::cout << "could not write triangle visibility " << filename << std::endl;
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(data_), size_);
+  return file.good();
+}
+
+bool TriangleVisibilitySet::setData(const uint8_t* data, size_t size) {
+  TriangleVisibilityFileHeader header;
+  if (size < sizeof(header))
+    return false;
+  std::memcpy(&header, data, sizeof(header));
+
+  uint64_t instanceEnd =
+      header.instanceOffset + sizeof(TriangleVisibilityInstance) * (header.numInstances + 1ull);
+  uint64_t containerEnd =
+      header.containerOffset + sizeof(TriangleVisibilityContainer) * (uint64_t)header.numContainers;
+  bool valid = header.magic == TriangleVisibilityFileHeader::kMagic &&
+      header.version <= TriangleVisibilityFileHeader::kVersion && header.instanceOffset % 8 == 0 &&
+      header.containerOffset % 8 == 0 && instanceEnd <= size && containerEnd <= size;
+  if (!valid)
+    return false;
+
+  auto instances =
+      reinterpret_cast<const TriangleVisibilityInstance*>(data + header.instanceOffset);
+  auto containers =
+      reinterpret_cast<const TriangleVisibilityContainer*>(data + header.containerOffset);
+
+  // Check every container once, so queries don't need bounds checks
+  for (uint32_t instanceId = 0; instanceId < header.numInstances; instanceId++) {
+    const auto& instance = instances[instanceId];
+    const auto& next = instances[instanceId + 1];
+    if (next.triangleOffset < instance.triangleOffset ||
+        next.triangleOffset > header.numTriangles)
+      return false;
+
+    uint32_t numTriangles = next.triangleOffset - instance.triangleOffset;
+    uint32_t numContainers = (numTriangles + kChunkSize - 1) / kChunkSize;
+    if (instance.firstContainer + (uint64_t)numContainers > header.numContainers)
+      return false;
+
+    for (uint32_t i = 0; i < numContainers; i++) {
+      const auto& container = containers[instance.firstContainer + i];
+      uint32_t chunkSize = std::min(numTriangles - i * kChunkSize, kChunkSize);
+      if (container.type > TriangleVisibilityContainer::kBitmap ||
+          container.cardinality > chunkSize || container.dataOffset % 8 != 0 ||
+          container.dataOffset + getPayloadSize(container, chunkSize) > size)
+        return false;
+    }
+  }
+
+  header_ = header;
+  data_ = data;
+  size_ = size;
+  instances_ = instances;
+  containers_ = containers;
+  return true;
+}
+
+const TriangleVisibilityContainer* TriangleVisibilitySet::findContainer(
+    uint32_t instanceId,
+    uint32_t triangleIndex) const {
+  if (instanceId >= header_.numInstances)
+    return nullptr;
+
+  const auto& instance = instances_[instanceId];
+  if (triangleIndex >= instances_[instanceId + 1].triangleOffset - instance.triangleOffset)
+    return nullptr;
+
+  return &containers_[instance.firstContainer + triangleIndex / kChunkSize];
+}
+
+bool TriangleVisibilitySet::isVisible(uint32_t instanceId, uint32_t triangleIndex) const {
+  const auto* container = findContainer(instanceId, triangleIndex);
+  if (!container)
+    return true;
+
+  uint32_t index = triangleIndex % kChunkSize;
+  const uint8_t* data = data_ + container->dataOffset;
+
+  switch (container->type) {
+    case TriangleVisibilityContainer::kEmpty:
+      return false;
+    case TriangleVisibilityContainer::kFull:
+      return true;
+    case TriangleVisibilityContainer::kArray: {
+      auto indices = reinterpret_cast<const uint16_t*>(data);
+      return std::binary_search(indices, indices + container->cardinality, (uint16_t)index);
+    }
+    default: {
+      auto words = reinterpret_cast<const uint64_t*>(data);
+      return (words[index / 64] >> (index % 64)) & 1;
+    }
+  }
+}
+
+uint32_t TriangleVisibilitySet::rank(uint32_t instanceId, uint32_t triangleIndex) const {
+  const auto* container = findContainer(instanceId, triangleIndex);
+  if (!container)
+    return header_.numVisible;
+
+  uint32_t index = triangleIndex % kChunkSize;
+  const uint8_t* data = data_ + container->dataOffset;
+
+  switch (container->type) {
+    case TriangleVisibilityContainer::kEmpty:
+      return container->rank;
+    case TriangleVisibilityContainer::kFull:
+      return container->rank + index;
+    case TriangleVisibilityContainer::kArray: {
+      auto indices = reinterpret_cast<const uint16_t*>(data);
+      return container->rank +
+          (uint32_t)(std::lower_bound(indices, indices + container->cardinality, (uint16_t)index) -
+                     indices);
+    }
+    default: {
+      const auto& instance = instances_[instanceId];
+      uint32_t chunkBegin = triangleIndex - index;
+      uint32_t chunkSize = std::min(
+          instances_[instanceId + 1].triangleOffset - instance.triangleOffset - chunkBegin,
+          kChunkSize);
+
+      auto words = reinterpret_cast<const uint64_t*>(data);
+      auto blockRanks = reinterpret_cast<const uint16_t*>(words + getNumWords(chunkSize));
+
+      uint32_t word = index / 64;
+      uint32_t result = container->rank + blockRanks[word / kBlockWords];
+      for (uint32_t w = word - word % kBlockWords; w < word; w++)
+        result += popcount64(words[w]);
+      return result + popcount64(words[word] & ((1ull << (index % 64)) - 1));
+    }
+  }
+}
+
+std::vector<uint32_t> TriangleVisibilitySet::toBitmask() const {
+  std::vector<uint32_t> bitmask((header_.numTriangles + 31) / 32);
+  auto setBit = [&](uint32_t i) { bitmask[i / 32] |= 1u << (i % 32); };
+
+  for (uint32_t instanceId = 0; instanceId < header_.numInstances; instanceId++) {
+    const auto& instance = instances_[instanceId];
+    uint32_t numTriangles = instances_[instanceId + 1].triangleOffset - instance.triangleOffset;
+
+    for (uint32_t chunkBegin = 0; chunkBegin < numTriangles; chunkBegin += kChunkSize) {
+      const auto& container = containers_[instance.firstContainer + chunkBegin / kChunkSize];
+      uint32_t chunkSize = std::min(numTriangles - chunkBegin, kChunkSize);
+      uint32_t base = instance.triangleOffset + chunkBegin;
+      const uint8_t* data = data_ + container.dataOffset;
+
+      if (container.type == TriangleVisibilityContainer::kFull) {
+        for (uint32_t i = 0; i < chunkSize; i++)
+          setBit(base + i);
+      } else if (container.type == TriangleVisibilityContainer::kArray) {
+        auto indices = reinterpret_cast<const uint16_t*>(data);
+        for (uint32_t i = 0; i < container.cardinality; i++)
+          setBit(base + indices[i]);
+      } else if (container.type == TriangleVisibilityContainer::kBitmap) {
+        auto words = reinterpret_cast<const uint64_t*>(data);
+        for (uint32_t w = 0; w < getNumWords(chunkSize); w++) {
+          for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+            uint32_t bit = 0;
+            while (!((bits >> bit) & 1))
+              bit++;
+            setBit(base + w * 64 + bit);
+          }
+        }
+      }
+    }
+  }
+
+  return bitmask;
+}
+
+} // namespace split_rendering
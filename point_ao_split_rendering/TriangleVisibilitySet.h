@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+namespace split_rendering {
+
+// File format of triangle visibility sets (little endian):
+//
+//   TriangleVisibilityFileHeader
+//   (numInstances + 1) x TriangleVisibilityInstance at instanceOffset, the last one is a sentinel
+//   numContainers x TriangleVisibilityContainer at containerOffset
+//   container payloads, 8 byte aligned
+//
+// The triangles of every instance are split into chunks of kChunkSize triangles, each stored in
+// its own container like in roaring bitmaps: empty and full chunks have no payload, sparse
+// chunks store the sorted 16 bit indices of their visible triangles and dense chunks a bitmap
+// followed by the number of visible triangles before every kBlockWords bitmap words for rank().
+struct TriangleVisibilityFileHeader {
+  static constexpr uint32_t kMagic = 0x56544153; // "SATV"
+  static constexpr uint16_t kVersion = 1;
+
+  uint32_t magic = kMagic;
+  uint16_t version = kVersion;
+  uint16_t flags = 0;
+  uint32_t numInstances = 0;
+  uint32_t numTriangles = 0;
+  uint32_t numVisible = 0;
+  uint32_t numContainers = 0;
+  uint32_t instanceOffset = 0;
+  uint32_t containerOffset = 0;
+};
+
+struct TriangleVisibilityInstance {
+  // Index of the first triangle of the instance in the scene-wide triangle list
+  uint32_t triangleOffset;
+  uint32_t firstContainer;
+};
+
+struct TriangleVisibilityContainer {
+  enum Type : uint16_t { kEmpty = 0, kFull = 1, kArray = 2, kBitmap = 3 };
+
+  uint16_t type;
+  uint16_t reserved;
+  uint32_t cardinality;
+  // Visible triangles of the whole set before this container
+  uint32_t rank;
+  uint32_t dataOffset;
+};
+
+static_assert(sizeof(TriangleVisibilityFileHeader) == 32, "header is part of the format");
+static_assert(sizeof(TriangleVisibilityInstance) == 8, "instance is part of the format");
+static_assert(sizeof(TriangleVisibilityContainer) == 16, "container is part of the format");
+
+// Compressed set of the triangles seen along a camera path, indexed by geometry instance and
+// triangle. Files are memory mapped and queried in place.
+//
+// Triangles outside of the set (or all triangles if the set is empty) count as visible, so
+// missing or stale visibility data never removes geometry.
+class TriangleVisibilitySet {
+ public:
+  static constexpr uint32_t kChunkSize = 1 << 16;
+  static constexpr uint32_t kBlockWords = 8;
+
+  TriangleVisibilitySet() = default;
+
+  TriangleVisibilitySet(const TriangleVisibilitySet&) = delete;
+  TriangleVisibilitySet& operator=(const TriangleVisibilitySet&) = delete;
+
+  // Files without the header are read as legacy visibility buffers (one uint32 per triangle),
+  // which are encoded in memory using the first triangle of every instance.
+  // Returns false and prints the error if the file can't be read.
+  bool open(const std::string& filename, const std::vector<uint32_t>& legacyInstanceOffsets = {});
+  void close();
+
+  // Encodes a visibility buffer with one uint32 per triangle, non-zero for visible triangles.
+  // instanceOffsets holds the index of the first triangle of every instance.
+  void assign(
+      const uint32_t* triangleVisibility,
+      uint32_t numTriangles,
+      const std::vector<uint32_t>& instanceOffsets);
+
+  bool write(const std::string& filename) const;
+
+  bool isEmpty() const {
+    return data_ == nullptr;
+  }
+
+  uint32_t getNumInstances() const {
+    return header_.numInstances;
+  }
+
+  uint32_t getNumTriangles() const {
+    return header_.numTriangles;
+  }
+
+  uint32_t getNumVisible() const {
+    return header_.numVisible;
+  }
+
+  // Size of the encoded set in bytes
+  size_t getSize() const {
+    return size_;
+  }
+
+  bool isVisible(uint32_t instanceId, uint32_t triangleIndex) const;
+
+  // Number of visible triangles of the whole set before the given triangle, e.g. to compact
+  // per-triangle data to the visible triangles
+  uint32_t rank(uint32_t instanceId, uint32_t triangleIndex) const;
+
+  // One bit per scene-wide triangle index, for upload to the GPU
+  std::vector<uint32_t> toBitmask() const;
+
+ private:
+  bool setData(const uint8_t* data, size_t size);
+  const TriangleVisibilityContainer* findContainer(
+      uint32_t instanceId,
+      uint32_t triangleIndex) const;
+
+  TriangleVisibilityFileHeader header_;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  const TriangleVisibilityInstance* instances_ = nullptr;
+  const TriangleVisibilityContainer* containers_ = nullptr;
+
+  // Either the file is mapped or the set was encoded into memory
+  MappedFile file_;
+  std::vector<uint64_t> encoded_;
+};
+
+} // namespace split_rendering
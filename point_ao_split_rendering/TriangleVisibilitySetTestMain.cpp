@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless check of TriangleVisibilitySet. A visibility buffer (one uint32 per triangle) with
+// instances whose chunks end up in every container type (empty, full, array and bitmap, including
+// partial chunks and an instance without triangles) is encoded with assign(), and isVisible(),
+// rank() and toBitmask() are compared with the buffer for every triangle. The same has to hold
+// after write() and open() of the file, and for the buffer opened as a legacy file. Truncated
+// files have to be rejected.
+//
+// Example usage:
+// $ ./TriangleVisibilitySetTest --output_dir visibility_test --seed 3
+//
+// Exit codes: 0 if all checks pass, 1 if a check fails, 2 for invalid arguments.
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "TriangleVisibilitySet.h"
+#include "argparse.hpp"
+
+using split_rendering::TriangleVisibilityContainer;
+using split_rendering::TriangleVisibilityFileHeader;
+using split_rendering::TriangleVisibilitySet;
+
+namespace {
+
+const int kExitFailed = 1;
+const int kExitInvalid = 2;
+
+const uint32_t kChunkSize = TriangleVisibilitySet::kChunkSize;
+
+uint32_t numFailures = 0;
+
+void fail(const std::string& message) {
+  if (numFailures++ < 20)
+    std::cout << "FAIL " << message << std::endl;
+}
+
+// Visibility buffer of all instances and the first triangle of every instance
+struct TestScene {
+  std::vector<uint32_t> visibility;
+  std::vector<uint32_t> instanceOffsets;
+};
+
+// Appends an instance whose chunks have the given fractions of visible triangles, 0 and 1 give
+// empty and full containers, small fractions arrays and large ones bitmaps
+void addInstance(
+    TestScene& scene,
+    uint32_t numTriangles,
+    const std::vector<float>& chunkFractions,
+    std::mt19937& random) {
+  scene.instanceOffsets.push_back((uint32_t)scene.visibility.size());
+
+  for (uint32_t i = 0; i < numTriangles; i++) {
+    const float fraction =
+        chunkFractions[std::min<size_t>(i / kChunkSize, chunkFractions.size() - 1)];
+    const bool visible = std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < fraction;
+    // Any non-zero value counts as visible
+    scene.visibility.push_back(visible ? 1 + random() % 7 : 0);
+  }
+}
+
+TestScene createTestScene(uint32_t seed) {
+  std::mt19937 random(seed);
+  TestScene scene;
+
+  // Empty, full, array and a partial bitmap chunk
+  addInstance(scene, 3 * kChunkSize + 100, {0.0f, 1.0f, 0.01f, 0.5f}, random);
+  // A full bitmap chunk and a partial full chunk
+  addInstance(scene, kChunkSize + 7, {0.5f, 1.0f}, random);
+  addInstance(scene, 0, {0.0f}, random);
+  // A single partial array chunk
+  addInstance(scene, 1000, {0.003f}, random);
+  // A single triangle, the last instance ends at the end of the buffer
+  addInstance(scene, 1, {1.0f}, random);
+
+  return scene;
+}
+
+// Number of containers of every type in an encoded file
+std::vector<uint32_t> countContainerTypes(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  std::vector<uint32_t> numContainers(4, 0);
+  TriangleVisibilityFileHeader header;
+  if (data.size() < sizeof(header))
+    return numContainers;
+  std::memcpy(&header, data.data(), sizeof(header));
+
+  for (uint32_t i = 0; i < header.numContainers; i++) {
+    TriangleVisibilityContainer container;
+    const size_t offset = header.containerOffset + sizeof(container) * i;
+    if (offset + sizeof(container) > data.size())
+      break;
+    std::memcpy(&container, data.data() + offset, sizeof(container));
+    if (container.type < numContainers.size())
+      numContainers[container.type]++;
+  }
+
+  return numContainers;
+}
+
+// Compares every query of the set with the visibility buffer
+void checkSet(const TriangleVisibilitySet& set, const TestScene& scene, const std::string& name) {
+  const uint32_t numInstances = (uint32_t)scene.instanceOffsets.size();
+  const uint32_t numTriangles = (uint32_t)scene.visibility.size();
+
+  uint32_t numVisible = 0;
+  for (uint32_t v : scene.visibility)
+    numVisible += v != 0;
+
+  if (set.isEmpty() || set.getNumInstances() != numInstances ||
+      set.getNumTriangles() != numTriangles || set.getNumVisible() != numVisible) {
+    fail(name + ": wrong number of instances, triangles or visible triangles");
+    return;
+  }
+
+  uint32_t numWrongVisible = 0;
+  uint32_t numWrongRanks = 0;
+  uint32_t rank = 0;
+
+  for (uint32_t instanceId = 0; instanceId < numInstances; instanceId++) {
+    const uint32_t begin = scene.instanceOffsets[instanceId];
+    const uint32_t end =
+        instanceId + 1 < numInstances ? scene.instanceOffsets[instanceId + 1] : numTriangles;
+
+    for (uint32_t triangle = begin; triangle < end; triangle++) {
+      const bool visible = scene.visibility[triangle] != 0;
+      numWrongVisible += set.isVisible(instanceId, triangle - begin) != visible;
+      numWrongRanks += set.rank(instanceId, triangle - begin) != rank;
+      rank += visible;
+    }
+
+    // Triangles outside of the set count as visible
+    if (!set.isVisible(instanceId, end - begin) || set.rank(instanceId, end - begin) != numVisible)
+      fail(name + ": triangle after instance " + std::to_string(instanceId) + " is not visible");
+  }
+
+  if (!set.isVisible(numInstances, 0) || set.rank(numInstances, 0) != numVisible)
+    fail(name + ": unknown instance is not visible");
+
+  if (numWrongVisible > 0)
+    fail(name + ": isVisible() is wrong for " + std::to_string(numWrongVisible) + " triangles");
+  if (numWrongRanks > 0)
+    fail(name + ": rank() is wrong for " + std::to_string(numWrongRanks) + " triangles");
+
+  const std::vector<uint32_t> bitmask = set.toBitmask();
+  uint32_t numWrongBits = 0;
+  if (bitmask.size() != (numTriangles + 31) / 32) {
+    fail(name + ": bitmask has the wrong size");
+  } else {
+    for (uint32_t triangle = 0; triangle < numTriangles; triangle++) {
+      const bool bit = (bitmask[triangle / 32] >> (triangle % 32)) & 1;
+      numWrongBits += bit != (scene.visibility[triangle] != 0);
+    }
+    for (uint32_t triangle = numTriangles; triangle < bitmask.size() * 32; triangle++)
+      numWrongBits += (bitmask[triangle / 32] >> (triangle % 32)) & 1;
+  }
+
+  if (numWrongBits > 0)
+    fail(name + ": toBitmask() is wrong for " + std::to_string(numWrongBits) + " triangles");
+}
+
+bool writeFile(const std::string& filename, const void* data, size_t size) {
+  std::ofstream file(filename, std::ios::binary);
+  file.write(static_cast<const char*>(data), size);
+  return file.good();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("TriangleVisibilitySetTest");
+
+  args.add_argument("--output_dir")
+      .help("directory for the test files")
+      .default_value(
+          (std::filesystem::temp_directory_path() / "TriangleVisibilitySetTest").string());
+  args.add_argument("--seed")
+      .help("seed of the random visibility")
+      .default_value(1)
+      .scan<'d', int>();
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const std::filesystem::path outputDir = args.get<std::string>("--output_dir");
+  std::filesystem::create_directories(outputDir);
+  const std::string filename = (outputDir / "visibility.bin").string();
+  const std::string legacyFilename = (outputDir / "legacy_visibility.bin").string();
+  const std::string truncatedFilename = (outputDir / "truncated_visibility.bin").string();
+
+  const TestScene scene = createTestScene((uint32_t)args.get<int>("--seed"));
+
+  // An empty set keeps all triangles
+  TriangleVisibilitySet emptySet;
+  if (!emptySet.isEmpty() || !emptySet.isVisible(0, 0))
+    fail("an empty set hides triangles");
+
+  TriangleVisibilitySet assigned;
+  assigned.assign(
+      scene.visibility.data(), (uint32_t)scene.visibility.size(), scene.instanceOffsets);
+  checkSet(assigned, scene, "assign()");
+
+  if (!assigned.write(filename)) {
+    fail("can't write " + filename);
+  } else {
+    const std::vector<uint32_t> numContainers = countContainerTypes(filename);
+    const char* typeNames[] = {"empty", "full", "array", "bitmap"};
+    for (uint32_t type = 0; type < numContainers.size(); type++) {
+      if (numContainers[type] == 0)
+        fail(std::string("the test set has no ") + typeNames[type] + " containers");
+    }
+
+    TriangleVisibilitySet opened;
+    if (!opened.open(filename)) {
+      fail("can't open " + filename);
+    } else {
+      if (opened.getSize() != std::filesystem::file_size(filename))
+        fail("the opened set has another size than its file");
+      checkSet(opened, scene, "open()");
+    }
+
+    std::cout << "encoded " << scene.visibility.size() << " triangles into "
+              << assigned.getSize() << " bytes, containers: " << numContainers[0] << " empty, "
+              << numContainers[1] << " full, " << numContainers[2] << " array, "
+              << numContainers[3] << " bitmap" << std::endl;
+  }
+
+  // Legacy files are the visibility buffer, they need the instance offsets
+  writeFile(legacyFilename, scene.visibility.data(), scene.visibility.size() * sizeof(uint32_t));
+  TriangleVisibilitySet legacy;
+  if (!legacy.open(legacyFilename, scene.instanceOffsets))
+    fail("can't open " + legacyFilename + " as a legacy file");
+  else
+    checkSet(legacy, scene, "legacy open()");
+
+  TriangleVisibilitySet legacyWithoutOffsets;
+  if (legacyWithoutOffsets.open(legacyFilename))
+    fail("a legacy file was opened without instance offsets");
+
+  // A header whose containers are cut off
+  std::vector<char> truncated(assigned.getSize() / 2);
+  std::ifstream(filename, std::ios::binary).read(truncated.data(), truncated.size());
+  writeFile(truncatedFilename, truncated.data(), truncated.size());
+  TriangleVisibilitySet truncatedSet;
+  if (truncatedSet.open(truncatedFilename))
+    fail("a truncated file was opened");
+
+  std::cout << (numFailures == 0 ? "PASSED" : "FAILED") << std::endl;
+  return numFailures == 0 ? 0 : kExitFailed;
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "VertexAnimation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include "Tracing.h"
+
+namespace split_rendering {
+
+namespace {
+
+// Planes per frame: position x, y, z and octahedral normal u, v
+constexpr uint32_t kNumPlanes = 5;
+constexpr float kPositionSteps = 65535.0f;
+constexpr float kNormalScale = 32767.0f;
+
+float signNotZero(float v) {
+  return v < 0.0f ? -1.0f : 1.0f;
+}
+
+void encodeNormal(const float normal[3], int32_t& u, int32_t& v) {
+  float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+  float x = length > 0.0f ? normal[0] / length : 0.0f;
+  float y = length > 0.0f ? normal[1] / length : 0.0f;
+
+  if (normal[2] < 0.0f) {
+    float foldedX = (1.0f - std::abs(y)) * signNotZero(x);
+    y = (1.0f - std::abs(x)) * signNotZero(y);
+    x = foldedX;
+  }
+
+  u = (int32_t)std::lround(std::clamp(x, -1.0f, 1.0f) * kNormalScale);
+  v = (int32_t)std::lround(std::clamp(y, -1.0f, 1.0f) * kNormalScale);
+}
+
+void decodeNormal(int32_t u, int32_t v, float normal[3]) {
+  float x = u / kNormalScale;
+  float y = v / kNormalScale;
+  float z = 1.0f - std::abs(x) - std::abs(y);
+
+  if (z < 0.0f) {
+    float foldedX = (1.0f - std::abs(y)) * signNotZero(x);
+    y = (1.0f - std::abs(x)) * signNotZero(y);
+    x = foldedX;
+  }
+
+  float length = std::sqrt(x * x + y * y + z * z);
+  normal[0] = x / length;
+  normal[1] = y / length;
+  normal[2] = z / length;
+}
+
+int32_t quantize(float value, float origin, float step) {
+  double q = std::round((value - origin) / (double)step);
+  return (int32_t)std::clamp(
+      q,
+      (double)std::numeric_limits<int32_t>::min(),
+      (double)std::numeric_limits<int32_t>::max());
+}
+
+} // namespace
+
+VertexAnimationWriter::VertexAnimationWriter(const Options& options)
+    : options_(options), compression_(options.compressionLevel, 0) {}
+
+VertexAnimationWriter::~VertexAnimationWriter() {
+  close();
+}
+
+bool VertexAnimationWriter::open(const std::string& filename, uint32_t numVertices) {
+  close();
+
+  file_.open(filename, std::ios::binary);
+  if (!file_.is_open()) {
+    std::cout << "could not write vertex animation " << filename << std::endl;
+    return false;
+  }
+
+  filename_ = filename;
+  header_ = {};
+  header_.numVertices = numVertices;
+  header_.keyFrameInterval = std::max(options_.keyFrameInterval, 1u);
+  header_.texCrdOffset = sizeof(header_);
+  index_.clear();
+
+  previousFrame_.assign(kNumPlanes * numVertices, 0);
+  frame_.resize(kNumPlanes * numVertices);
+  delta_.resize(kNumPlanes * numVertices);
+
+  // Placeholder until close()
+  file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  numBytesWritten_ = sizeof(header_);
+  return true;
+}
+
+bool VertexAnimationWriter::close() {
+  if (!file_.is_open())
+    return false;
+
+  // Align the index for reading it in place
+  const char padding[8] = {};
+  file_.write(padding, (8 - numBytesWritten_ % 8) % 8);
+  numBytesWritten_ += (8 - numBytesWritten_ % 8) % 8;
+
+  header_.indexOffset = numBytesWritten_;
+  file_.write(
+      reinterpret_cast<const char*>(index_.data()),
+      sizeof(VertexAnimationFrameEntry) * index_.size());
+  numBytesWritten_ += sizeof(VertexAnimationFrameEntry) * index_.size();
+
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+
+  bool success = file_.good();
+  file_.close();
+
+  if (!success)
+    std::cout << "could not write vertex animation " << filename_ << std::endl;
+  return success;
+}
+
+bool VertexAnimationWriter::addFrame(uint32_t frameNumber, const VertexAnimationVertex* vertices) {
+  TRACE_SCOPE("VertexAnimationWriter::addFrame");
+  if (!file_.is_open())
+    return false;
+
+  const uint32_t numVertices = header_.numVertices;
+
+  if (header_.numFrames == 0) {
+    // The bounds of the first frame define the quantization grid
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      float minValue = std::numeric_limits<float>::max();
+      float maxValue = std::numeric_limits<float>::lowest();
+      for (uint32_t i = 0; i < numVertices; i++) {
+        minValue = std::min(minValue, vertices[i].position[axis]);
+        maxValue = std::max(maxValue, vertices[i].position[axis]);
+      }
+
+      header_.origin[axis] = numVertices > 0 ? minValue : 0.0f;
+      header_.step[axis] =
+          numVertices > 0 ? std::max((maxValue - minValue) / kPositionSteps, 1e-6f) : 1.0f;
+    }
+
+    for (uint32_t i = 0; i < numVertices; i++)
+      file_.write(reinterpret_cast<const char*>(vertices[i].texCrd), sizeof(float) * 2);
+    numBytesWritten_ += sizeof(float) * 2 * numVertices;
+  }
+
+  for (uint32_t i = 0; i < numVertices; i++) {
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      frame_[axis * numVertices + i] =
+          quantize(vertices[i].position[axis], header_.origin[axis], header_.step[axis]);
+    }
+    encodeNormal(vertices[i].normal, frame_[3 * numVertices + i], frame_[4 * numVertices + i]);
+  }
+
+  bool isKeyFrame = header_.numFrames % header_.keyFrameInterval == 0;
+  for (size_t i = 0; i < frame_.size(); i++)
+    delta_[i] = isKeyFrame ? frame_[i] : frame_[i] - previousFrame_[i];
+  std::swap(previousFrame_, frame_);
+
+  int compressedSize =
+      compression_.compressData(delta_.data(), compressed_, sizeof(int32_t) * delta_.size());
+  if (compressedSize < 0) {
+    std::cout << "could not compress vertex animation frame " << frameNumber << std::endl;
+    return false;
+  }
+
+  file_.write(reinterpret_cast<const char*>(compressed_.data()), compressedSize);
+  index_.push_back({numBytesWritten_, (uint32_t)compressedSize, frameNumber});
+  numBytesWritten_ += compressedSize;
+  header_.numFrames++;
+
+  return file_.good();
+}
+
+bool VertexAnimationReader::open(const std::string& filename) {
+  close();
+
+  if (!file_.open(filename)) {
+    std::cout << "could not open vertex animation " << filename << std::endl;
+    return false;
+  }
+
+  VertexAnimationFileHeader header;
+  if (file_.getSize() >= sizeof(header))
+    std::memcpy(&header, file_.getData(), sizeof(header));
+
+  // An index offset of 0 means the writer wasn't closed
+  bool valid = file_.getSize() >= sizeof(header) &&
+      header.magic == VertexAnimationFileHeader::kMagic &&
+      header.version <= VertexAnimationFileHeader::kVersion && header.keyFrameInterval > 0 &&
+      header.indexOffset > 0 && header.indexOffset % 8 == 0 &&
+      header.texCrdOffset + sizeof(float) * 2ull * header.numVertices <= file_.getSize() &&
+      header.indexOffset + sizeof(VertexAnimationFrameEntry) * (uint64_t)header.numFrames <=
+          file_.getSize();
+
+  if (valid) {
+    index_ = reinterpret_cast<const VertexAnimationFrameEntry*>(
+        file_.getData() + header.indexOffset);
+    for (uint32_t i = 0; i < header.numFrames && valid; i++)
+      valid = index_[i].offset + index_[i].compressedSize <= header.indexOffset;
+  }
+
+  if (!valid) {
+    std::cout << "invalid vertex animation " << filename << " (version " << header.version << ")"
+              << std::endl;
+    close();
+    return false;
+  }
+
+  header_ = header;
+  texCrds_ = reinterpret_cast<const float*>(file_.getData() + header.texCrdOffset);
+  frame_.assign(kNumPlanes * header.numVertices, 0);
+  delta_.resize(kNumPlanes * header.numVertices);
+  decompressed_.resize(sizeof(int32_t) * delta_.size());
+  return true;
+}
+
+void VertexAnimationReader::close() {
+  file_.close();
+  header_ = {};
+  index_ = nullptr;
+  texCrds_ = nullptr;
+  decodedFrame_ = -1;
+}
+
+bool VertexAnimationReader::decodeFrame(uint32_t index) {
+  const auto& entry = index_[index];
+  const uint8_t* data = file_.getData() + entry.offset;
+  compressed_.assign(data, data + entry.compressedSize);
+
+  int size = compression_.decompressData(compressed_, decompressed_);
+  if (size != (int)decompressed_.size()) {
+    std::cout << "could not decompress vertex animation frame " << index << std::endl;
+    decodedFrame_ = -1;
+    return false;
+  }
+
+  std::memcpy(delta_.data(), decompressed_.data(), decompressed_.size());
+
+  if (index % header_.keyFrameInterval == 0) {
+    std::swap(frame_, delta_);
+  } else {
+    for (size_t i = 0; i < frame_.size(); i++)
+      frame_[i] += delta_[i];
+  }
+
+  decodedFrame_ = index;
+  return true;
+}
+
+bool VertexAnimationReader::readFrame(
+    uint32_t index,
+    std::vector<VertexAnimationVertex>& vertices) {
+  TRACE_SCOPE("VertexAnimationReader::readFrame");
+  if (index >= header_.numFrames)
+    return false;
+
+  // Continue from the last decoded frame if it is in the same key frame interval
+  uint32_t keyFrame = index - index % header_.keyFrameInterval;
+  uint32_t first = decodedFrame_ >= keyFrame && decodedFrame_ <= index
+      ? (uint32_t)decodedFrame_ + 1
+      : keyFrame;
+
+  for (uint32_t i = first; i <= index; i++) {
+    if (!decodeFrame(i))
+      return false;
+  }
+
+  const uint32_t numVertices = header_.numVertices;
+  vertices.resize(numVertices);
+
+  for (uint32_t i = 0; i < numVertices; i++) {
+    auto& vertex = vertices[i];
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      vertex.position[axis] =
+          header_.origin[axis] + header_.step[axis] * (float)frame_[axis * numVertices + i];
+    }
+    decodeNormal(frame_[3 * numVertices + i], frame_[4 * numVertices + i], vertex.normal);
+    vertex.texCrd[0] = texCrds_[2 * i];
+    vertex.texCrd[1] = texCrds_[2 * i + 1];
+  }
+
+  return true;
+}
+
+} // namespace split_rendering
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "ZSTDCompression.h"
+
+namespace split_rendering {
+
+// World space vertex as written by VertexAnimationExport.cs.slang
+struct VertexAnimationVertex {
+  float position[3];
+  float normal[3];
+  float texCrd[2];
+};
+
+static_assert(sizeof(VertexAnimationVertex) == 32, "has to match VertexAnimationExport");
+
+// File format of exported vertex animations of one instance (little endian):
+//
+//   VertexAnimationFileHeader
+//   numVertices x float2 texture coordinates at texCrdOffset, they don't change over time
+//   numFrames ZSTD compressed frames
+//   numFrames x VertexAnimationFrameEntry at indexOffset
+//
+// Positions are quantized to a grid with 16 bit precision over the bounds of the first frame,
+// but stored as int32 so later frames can leave the bounds. Normals are octahedral encoded with
+// 16 bit per component. Each frame stores the planes x, y, z, u, v; every keyFrameInterval-th
+// frame stores the values, the others the difference to the previous frame.
+//
+// The index is written when the writer is closed, the header is rewritten at the same time.
+struct VertexAnimationFileHeader {
+  static constexpr uint32_t kMagic = 0x41564153; // "SAVA"
+  static constexpr uint16_t kVersion = 1;
+
+  uint32_t magic = kMagic;
+  uint16_t version = kVersion;
+  uint16_t flags = 0;
+  uint32_t numVertices = 0;
+  uint32_t numFrames = 0;
+  uint32_t keyFrameInterval = 0;
+  uint32_t texCrdOffset = 0;
+  uint64_t indexOffset = 0;
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  float step[3] = {0.0f, 0.0f, 0.0f};
+};
+
+struct VertexAnimationFrameEntry {
+  uint64_t offset;
+  uint32_t compressedSize;
+  // Renderer frame the vertices were captured in
+  uint32_t frameNumber;
+};
+
+static_assert(sizeof(VertexAnimationFileHeader) == 56, "header is part of the format");
+static_assert(sizeof(VertexAnimationFrameEntry) == 16, "frame entry is part of the format");
+
+// Appends frames to the file as they are captured, so memory use doesn't grow with the length
+// of the animation
+class VertexAnimationWriter {
+ public:
+  struct Options {
+    uint32_t keyFrameInterval = 30;
+    uint32_t compressionLevel = 3;
+  };
+
+  VertexAnimationWriter() : VertexAnimationWriter(Options{}) {}
+  explicit VertexAnimationWriter(const Options& options);
+  // Closes the file
+  ~VertexAnimationWriter();
+
+  // Returns false and prints the error if the file can't be created
+  bool open(const std::string& filename, uint32_t numVertices);
+  // Writes the index, the file is incomplete until then
+  bool close();
+
+  bool isOpen() const {
+    return file_.is_open();
+  }
+
+  bool addFrame(uint32_t frameNumber, const VertexAnimationVertex* vertices);
+
+  uint32_t getNumFrames() const {
+    return header_.numFrames;
+  }
+
+  uint64_t getNumBytesWritten() const {
+    return numBytesWritten_;
+  }
+
+  const std::string& getFilename() const {
+    return filename_;
+  }
+
+ private:
+  Options options_;
+  std::string filename_;
+  std::ofstream file_;
+  VertexAnimationFileHeader header_;
+  std::vector<VertexAnimationFrameEntry> index_;
+  uint64_t numBytesWritten_ = 0;
+
+  // Quantized planes of the previous and the current frame
+  std::vector<int32_t> previousFrame_;
+  std::vector<int32_t> frame_;
+  std::vector<int32_t> delta_;
+  std::vector<uint8_t> compressed_;
+  ZSTDCompression compression_;
+};
+
+// Memory-mapped vertex animation, frames are decoded from the closest preceding key frame
+class VertexAnimationReader {
+ public:
+  // Returns false and prints the error if the file can't be read
+  bool open(const std::string& filename);
+  void close();
+
+  uint32_t getNumVertices() const {
+    return header_.numVertices;
+  }
+
+  uint32_t getNumFrames() const {
+    return header_.numFrames;
+  }
+
+  uint32_t getFrameNumber(uint32_t index) const {
+    return index_[index].frameNumber;
+  }
+
+  // Sequential reads only decode one frame each
+  bool readFrame(uint32_t index, std::vector<VertexAnimationVertex>& vertices);
+
+ private:
+  bool decodeFrame(uint32_t index);
+
+  MappedFile file_;
+  VertexAnimationFileHeader header_;
+  const VertexAnimationFrameEntry* index_ = nullptr;
+  const float* texCrds_ = nullptr;
+
+  // Quantized planes of the last decoded frame
+  std::vector<int32_t> frame_;
+  std::vector<int32_t> delta_;
+  std::vector<uint8_t> compressed_;
+  std::vector<uint8_t> decompressed_;
+  int64_t decodedFrame_ = -1;
+  ZSTDCompression compression_;
+};
+
+} // namespace split_rendering
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Headless round trip of vertex animations. Frames of a deforming mesh, which later leaves the
+// bounds of the first frame, are written with VertexAnimationWriter using a short key frame
+// interval and read back with VertexAnimationReader out of order, in order and repeatedly.
+// Positions have to be within half a quantization step and normals within the octahedral
+// quantization error, texture coordinates and frame numbers have to be exact. A file with a
+// corrupted frame has to keep the frames of the other key frame intervals readable, so reads only
+// decode from the closest preceding key frame. Files that weren't closed have to be rejected.
+//
+// Example usage:
+// $ ./VertexAnimationTest --output_dir vertex_animation_test --key_frame_interval 5
+//
+// Exit codes: 0 if all checks pass, 1 if a check fails, 2 for invalid arguments.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "VertexAnimation.h"
+#include "argparse.hpp"
+
+using split_rendering::VertexAnimationFileHeader;
+using split_rendering::VertexAnimationFrameEntry;
+using split_rendering::VertexAnimationReader;
+using split_rendering::VertexAnimationVertex;
+using split_rendering::VertexAnimationWriter;
+
+namespace {
+
+const int kExitFailed = 1;
+const int kExitInvalid = 2;
+
+// 16 bit octahedral normals are accurate to about 0.004 degrees
+const float kMaxNormalErrorDegrees = 0.01f;
+// Renderer frame numbers don't start at 0 and can skip frames
+const uint32_t kFirstFrameNumber = 1000;
+const uint32_t kFrameNumberStep = 3;
+
+uint32_t numFailures = 0;
+
+void fail(const std::string& message) {
+  if (numFailures++ < 20)
+    std::cout << "FAIL " << message << std::endl;
+}
+
+void normalize(float v[3]) {
+  const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  for (uint32_t axis = 0; axis < 3; axis++)
+    v[axis] /= length;
+}
+
+// Frames of a sphere with waves running over it, that grows and drifts out of the bounds of the
+// first frame
+std::vector<std::vector<VertexAnimationVertex>>
+createFrames(uint32_t numVertices, uint32_t numFrames, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::normal_distribution<float> normal(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+  std::vector<VertexAnimationVertex> rest(numVertices);
+  for (auto& vertex : rest) {
+    float direction[3] = {normal(random), normal(random), normal(random)};
+    normalize(direction);
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      vertex.position[axis] = direction[axis];
+      vertex.normal[axis] = direction[axis];
+    }
+    vertex.texCrd[0] = uniform(random);
+    vertex.texCrd[1] = uniform(random);
+  }
+
+  std::vector<std::vector<VertexAnimationVertex>> frames(numFrames, rest);
+  for (uint32_t frame = 0; frame < numFrames; frame++) {
+    const float time = (float)frame / std::max(numFrames - 1, 1u);
+    const float scale = 1.0f + 0.5f * time;
+
+    for (auto& vertex : frames[frame]) {
+      const float wave = 0.1f * std::sin(8.0f * vertex.position[1] + 6.0f * time);
+      for (uint32_t axis = 0; axis < 3; axis++)
+        vertex.position[axis] *= scale * (1.0f + wave);
+      vertex.position[0] += 2.0f * time;
+
+      // Tilt the normals with the waves, some of them flip to the other octahedral hemisphere
+      vertex.normal[0] += 0.5f * std::sin(6.0f * time + vertex.texCrd[0] * 10.0f);
+      vertex.normal[2] -= 0.3f * time;
+      normalize(vertex.normal);
+    }
+  }
+
+  // A degenerate normal, which decodes to +z
+  if (numVertices > 0) {
+    for (auto& frame : frames)
+      std::fill(frame[0].normal, frame[0].normal + 3, 0.0f);
+  }
+
+  return frames;
+}
+
+bool writeAnimation(
+    const std::string& filename,
+    const std::vector<std::vector<VertexAnimationVertex>>& frames,
+    uint32_t numVertices,
+    uint32_t keyFrameInterval) {
+  VertexAnimationWriter::Options options;
+  options.keyFrameInterval = keyFrameInterval;
+  VertexAnimationWriter writer(options);
+
+  if (!writer.open(filename, numVertices))
+    return false;
+
+  for (uint32_t frame = 0; frame < frames.size(); frame++) {
+    if (!writer.addFrame(kFirstFrameNumber + kFrameNumberStep * frame, frames[frame].data()))
+      return false;
+  }
+
+  return writer.close();
+}
+
+VertexAnimationFileHeader readHeader(const std::string& filename) {
+  VertexAnimationFileHeader header;
+  std::ifstream(filename, std::ios::binary)
+      .read(reinterpret_cast<char*>(&header), sizeof(header));
+  return header;
+}
+
+// Compares a decoded frame with the written one within the quantization error
+void checkFrame(
+    VertexAnimationReader& reader,
+    uint32_t index,
+    const std::vector<VertexAnimationVertex>& expected,
+    const VertexAnimationFileHeader& header,
+    const std::string& name) {
+  std::vector<VertexAnimationVertex> vertices;
+  if (!reader.readFrame(index, vertices)) {
+    fail(name + ": can't read frame " + std::to_string(index));
+    return;
+  }
+
+  if (reader.getFrameNumber(index) != kFirstFrameNumber + kFrameNumberStep * index)
+    fail(name + ": wrong frame number of frame " + std::to_string(index));
+
+  if (vertices.size() != expected.size()) {
+    fail(name + ": wrong number of vertices in frame " + std::to_string(index));
+    return;
+  }
+
+  // The angle between the normals is measured with the cross product, acos of a float dot product
+  // can't resolve angles this small
+  const double maxNormalError = std::sin(kMaxNormalErrorDegrees * 3.14159265 / 180.0);
+  uint32_t numWrongPositions = 0;
+  uint32_t numWrongNormals = 0;
+  uint32_t numWrongTexCrds = 0;
+
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const auto& vertex = vertices[i];
+    const auto& original = expected[i];
+
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      // Half a step, plus the float rounding of value - origin and of origin + step * q
+      const float tolerance = 0.5f * header.step[axis] +
+          1e-6f * (std::abs(header.origin[axis]) + std::abs(original.position[axis]));
+      numWrongPositions += std::abs(vertex.position[axis] - original.position[axis]) > tolerance;
+    }
+
+    float originalNormal[3] = {original.normal[0], original.normal[1], original.normal[2]};
+    if (originalNormal[0] == 0.0f && originalNormal[1] == 0.0f && originalNormal[2] == 0.0f)
+      originalNormal[2] = 1.0f;
+    double dot = 0.0;
+    double cross = 0.0;
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      const uint32_t next = (axis + 1) % 3;
+      const uint32_t last = (axis + 2) % 3;
+      dot += (double)vertex.normal[axis] * originalNormal[axis];
+      const double c = (double)vertex.normal[next] * originalNormal[last] -
+          (double)vertex.normal[last] * originalNormal[next];
+      cross += c * c;
+    }
+    numWrongNormals += !(dot > 0.0 && std::sqrt(cross) <= maxNormalError);
+
+    numWrongTexCrds +=
+        vertex.texCrd[0] != original.texCrd[0] || vertex.texCrd[1] != original.texCrd[1];
+  }
+
+  const std::string frame = " in frame " + std::to_string(index);
+  if (numWrongPositions > 0)
+    fail(name + ": " + std::to_string(numWrongPositions) + " wrong position components" + frame);
+  if (numWrongNormals > 0)
+    fail(name + ": " + std::to_string(numWrongNormals) + " wrong normals" + frame);
+  if (numWrongTexCrds > 0)
+    fail(name + ": " + std::to_string(numWrongTexCrds) + " wrong texture coordinates" + frame);
+}
+
+// Overwrites the compressed data of a frame, so it can't be decompressed anymore
+bool corruptFrame(const std::string& filename, uint32_t index) {
+  const VertexAnimationFileHeader header = readHeader(filename);
+  if (index >= header.numFrames)
+    return false;
+
+  std::fstream file(filename, std::ios::binary | std::ios::in | std::ios::out);
+  VertexAnimationFrameEntry entry;
+  file.seekg(header.indexOffset + sizeof(entry) * index);
+  file.read(reinterpret_cast<char*>(&entry), sizeof(entry));
+
+  const std::vector<char> garbage(entry.compressedSize, (char)0xa5);
+  file.seekp(entry.offset);
+  file.write(garbage.data(), garbage.size());
+  return file.good();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  argparse::ArgumentParser args("VertexAnimationTest");
+
+  args.add_argument("--output_dir")
+      .help("directory for the test files")
+      .default_value((std::filesystem::temp_directory_path() / "VertexAnimationTest").string());
+  args.add_argument("--num_vertices")
+      .help("number of vertices of the animated mesh")
+      .default_value(5000)
+      .scan<'d', int>();
+  args.add_argument("--num_frames")
+      .help("number of frames, the last key frame interval should be partial")
+      .default_value(23)
+      .scan<'d', int>();
+  args.add_argument("--key_frame_interval")
+      .help("number of frames from one key frame to the next")
+      .default_value(4)
+      .scan<'d', int>();
+  args.add_argument("--seed")
+      .help("seed of the random mesh and of the read order")
+      .default_value(1)
+      .scan<'d', int>();
+
+  try {
+    args.parse_args(argc, argv);
+  } catch (const std::runtime_error& err) {
+    std::cerr << err.what() << std::endl;
+    std::cerr << args;
+    return kExitInvalid;
+  }
+
+  const int numVertices = args.get<int>("--num_vertices");
+  const int numFrames = args.get<int>("--num_frames");
+  const int keyFrameInterval = args.get<int>("--key_frame_interval");
+  const uint32_t seed = (uint32_t)args.get<int>("--seed");
+
+  if (numVertices < 1 || numFrames < 2 || keyFrameInterval < 1) {
+    std::cerr << "--num_vertices has to be positive, --num_frames at least 2 and "
+              << "--key_frame_interval positive" << std::endl;
+    return kExitInvalid;
+  }
+
+  const std::filesystem::path outputDir = args.get<std::string>("--output_dir");
+  std::filesystem::create_directories(outputDir);
+  const std::string filename = (outputDir / "animation.bin").string();
+  const std::string corruptedFilename = (outputDir / "corrupted_animation.bin").string();
+  const std::string unclosedFilename = (outputDir / "unclosed_animation.bin").string();
+
+  const auto frames = createFrames(numVertices, numFrames, seed);
+  if (!writeAnimation(filename, frames, numVertices, keyFrameInterval)) {
+    fail("can't write " + filename);
+    std::cout << "FAILED" << std::endl;
+    return kExitFailed;
+  }
+
+  const VertexAnimationFileHeader header = readHeader(filename);
+  std::cout << "wrote " << numFrames << " frames of " << numVertices << " vertices into "
+            << std::filesystem::file_size(filename) << " bytes" << std::endl;
+
+  VertexAnimationReader reader;
+  if (!reader.open(filename)) {
+    fail("can't open " + filename);
+  } else if (reader.getNumFrames() != (uint32_t)numFrames ||
+             reader.getNumVertices() != (uint32_t)numVertices) {
+    fail("wrong number of frames or vertices");
+  } else {
+    // Random order, which jumps backwards within and across key frame intervals
+    std::vector<uint32_t> order(numFrames);
+    for (uint32_t i = 0; i < order.size(); i++)
+      order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+    for (uint32_t index : order)
+      checkFrame(reader, index, frames[index], header, "random order");
+
+    // In order, which continues from the previously decoded frame, and the same frame twice
+    for (uint32_t index = 0; index < (uint32_t)numFrames; index++)
+      checkFrame(reader, index, frames[index], header, "in order");
+    checkFrame(reader, numFrames - 1, frames.back(), header, "repeated");
+    checkFrame(reader, 0, frames[0], header, "back to the start");
+
+    std::vector<VertexAnimationVertex> vertices;
+    if (reader.readFrame(numFrames, vertices))
+      fail("a frame after the last one was read");
+  }
+  reader.close();
+
+  // A corrupted frame only breaks the rest of its key frame interval
+  std::filesystem::copy_file(
+      filename, corruptedFilename, std::filesystem::copy_options::overwrite_existing);
+  const uint32_t corruptedIndex = std::min(1, numFrames - 1);
+  const uint32_t firstKeyFrame = corruptedIndex - corruptedIndex % keyFrameInterval;
+  const uint32_t nextKeyFrame = firstKeyFrame + keyFrameInterval;
+
+  VertexAnimationReader corrupted;
+  if (!corruptFrame(corruptedFilename, corruptedIndex) || !corrupted.open(corruptedFilename)) {
+    fail("can't corrupt " + corruptedFilename);
+  } else {
+    std::vector<VertexAnimationVertex> vertices;
+    for (uint32_t index = numFrames; index-- > 0;) {
+      const bool broken = index >= corruptedIndex && index < nextKeyFrame;
+      if (broken && corrupted.readFrame(index, vertices))
+        fail("frame " + std::to_string(index) + " after a corrupted frame was read");
+      if (!broken)
+        checkFrame(corrupted, index, frames[index], header, "corrupted file");
+    }
+  }
+  corrupted.close();
+
+  // The index and the header are only written by close()
+  {
+    VertexAnimationWriter writer;
+    writer.open(unclosedFilename, numVertices);
+    for (const auto& frame : frames)
+      writer.addFrame(0, frame.data());
+
+    VertexAnimationReader unclosed;
+    if (unclosed.open(unclosedFilename))
+      fail("an animation that wasn't closed was opened");
+  }
+
+  std::cout << (numFailures == 0 ? "PASSED" : "FAILED") << std::endl;
+  return numFailures == 0 ? 0 : kExitFailed;
+}
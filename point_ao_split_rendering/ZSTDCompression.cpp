@@ -7,11 +7,13 @@
  */
 
 #include "ZSTDCompression.h"
+#include "Tracing.h"
 
 int ZSTDCompression::compressData(
     const void* uncompressedData,
     std::vector<uint8_t>& compressedData,
     uint32_t numUncompressedBytes) {
+  TRACE_SCOPE("ZSTDCompression::compressData");
   uint32_t maxCompressedBytes = ZSTD_compressBound(numUncompressedBytes);
 
   compressedData.resize(maxCompressedBytes);
@@ -27,6 +29,7 @@ int ZSTDCompression::compressData(
 int ZSTDCompression::decompressData(
     const std::vector<uint8_t>& compressedData,
     std::vector<uint8_t>& decompressedData) {
+  TRACE_SCOPE("ZSTDCompression::decompressData");
   // ZSTD decompress
   return ZSTD_decompressDCtx(zstdDecompressionContext_,
       decompressedData.data(),
@@ -25,6 +25,7 @@ class ZSTDCompression : public NetworkCompressionBase {
 
   ~ZSTDCompression() {
     ZSTD_freeCCtx(zstdCompressionContext_);
+    ZSTD_freeDCtx(zstdDecompressionContext_);
   }
 
   virtual int compressData(